@@ -0,0 +1,149 @@
+/**
+ * \file animation.h
+ * \brief Animated CSG tree conversion module
+ */
+
+#ifndef __ANIMATION_H__
+#define __ANIMATION_H__
+
+#include "types.h"
+#include "point_cloud.h"
+#include "tree.h"
+
+/**
+ * \brief Structure defining a node of an animated CSG tree
+ *
+ * \details The nodes are stored in the order of a depth-first search, so the subtree of a node
+ * is the range of the nodes following it.
+ */
+typedef struct {
+	Tree tree; /**< Node of the CSG tree */
+	int parent; /**< Index of the parent node, \e -1 for the root */
+	int end; /**< Index of the first node following the subtree of the node */
+	affine transformations; /**< Points transformation from the frame of the node to the world frame */
+	affine inv_transformations; /**< Points transformation from the world frame to the frame of the node */
+	affine norm_transformations; /**< Normals transformation from the frame of the node to the world frame */
+	point3 min; /**< Lowest corner of the bounding box of the subtree in the world frame */
+	point3 max; /**< Highest corner of the bounding box of the subtree in the world frame */
+} AnimationNode;
+
+/**
+ * \brief Structure defining a constraint on the points of a leaf of an animated CSG tree
+ *
+ * \details A point of the leaf is kept if it belongs, or does not belong, to the sibling subtree of one of the ancestors of the leaf.
+ */
+typedef struct {
+	int ancestor; /**< Index of the ancestor node */
+	int sibling; /**< Index of the sibling subtree */
+	int keep_inside; /**< \e 1 if the points inside the sibling subtree are kept, \e 0 if they are removed */
+} AnimationConstraint;
+
+/**
+ * \brief Structure defining a leaf of an animated CSG tree and its samples
+ *
+ * \details The constraints are ordered from the parent of the leaf to the root.
+ * For each sample, the number of constraints it satisfies before the first failing one is kept,
+ * so a move only tests again the constraints it can change.
+ */
+typedef struct {
+	int node; /**< Index of the leaf node */
+	int flip; /**< \e 1 if the normals of the leaf are flipped, \e 0 otherwise */
+	PointCloud *samples; /**< Samples of the leaf in its canonical frame */
+	int first; /**< Index of the first sample of the leaf in the world arrays */
+	AnimationConstraint *constraints; /**< Constraints array */
+	int constraints_size; /**< Number of constraints */
+} AnimationLeaf;
+
+/**
+ * \brief Structure defining an animated CSG tree
+ *
+ * \details The surfaces of the leaves are sampled once.
+ * When the transformation of a node changes, the samples of its subtree are transformed again
+ * and only tested against the constraints of the ancestors above the node.
+ * The samples of the other leaves are only tested again if they lie in the bounding box of the old or the new position of the subtree,
+ * and only against the constraints whose sibling subtree contains the node.
+ */
+typedef struct {
+	AnimationNode *nodes; /**< Nodes array */
+	int nodes_size; /**< Number of nodes */
+	AnimationLeaf *leaves; /**< Leaves array */
+	int leaves_size; /**< Number of leaves */
+	point3 *vrtx; /**< Samples in the world frame */
+	vec3 *norm; /**< Normals of the samples in the world frame */
+	int *passed; /**< Number of constraints satisfied by each sample before the first failing one */
+	int size; /**< Number of samples */
+	PointCloud *point_cloud; /**< Kept samples, updated after each move */
+	unsigned long transformed; /**< Number of samples transformed by the last move */
+	unsigned long classified; /**< Number of samples tested again by the last move */
+} Animation;
+
+/**
+ * \brief Sample a CSG tree for animation
+ *
+ * \details The leaves are sampled in the order of \e tree_to_point_cloud, so with the same seed
+ * the kept samples are the points of the converted point cloud.
+ * The animation keeps a pointer on the tree, which must not be freed while the animation is used
+ * and must only be modified through \e animation_rotate and \e animation_translate.
+ * The program stops if the allocation has failed.
+ * This function allocate some memory that need to be freed with \e animation_free.
+ *
+ * \param tree CSG tree to animate \n
+ * Can not take the value \e NULL \n
+ * Must be a valid CSG tree
+ *
+ * \param density Point density per unit area \n
+ * Must be strictly positive
+ *
+ * \return a pointer to the allocated animation
+ */
+Animation * animation_allocate(Tree tree, int density);
+
+/**
+ * \brief Free the memory allocated by an animation
+ *
+ * \details The tree is not freed and the pointed animation will be set to \e NULL.
+ *
+ * \param animation Pointer to the animation to free \n
+ * Can not take the value \e NULL
+ */
+void animation_free(Animation **animation);
+
+/**
+ * \brief Rotate a node of an animated CSG tree
+ *
+ * \details The rotation is composed with the transformation of the node like \e tree_rotation,
+ * then the point cloud of the animation is updated.
+ *
+ * \param animation Animation \n
+ * Can not take the value \e NULL
+ *
+ * \param node Index of the node in the order of a depth-first search, \e 0 for the root
+ *
+ * \param x Rotation angle around \e x axis
+ *
+ * \param y Rotation angle around \e y axis
+ *
+ * \param z Rotation angle around \e z axis
+ */
+void animation_rotate(Animation *animation, int node, double x, double y, double z);
+
+/**
+ * \brief Translate a node of an animated CSG tree
+ *
+ * \details The translation is composed with the transformation of the node like \e tree_translation,
+ * then the point cloud of the animation is updated.
+ *
+ * \param animation Animation \n
+ * Can not take the value \e NULL
+ *
+ * \param node Index of the node in the order of a depth-first search, \e 0 for the root
+ *
+ * \param x Translation factor on \e x axis
+ *
+ * \param y Translation factor on \e y axis
+ *
+ * \param z Translation factor on \e z axis
+ */
+void animation_translate(Animation *animation, int node, double x, double y, double z);
+
+#endif
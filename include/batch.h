@@ -0,0 +1,41 @@
+/**
+ * \file batch.h
+ * \brief Batch conversion module
+ */
+
+#ifndef __BATCH_H__
+#define __BATCH_H__
+
+/**
+ * \brief Number of tasks per thread the work of a batch is cut into
+ */
+#define BATCH_TASKS_PER_THREAD (8)
+
+/**
+ * \brief Convert all the jobs of a manifest file and write their point clouds
+ *
+ * \details Each line of the manifest describes a job with four fields separated by spaces :
+ * the path of the scene file, text or compiled, the point density per unit area,
+ * the seed of the sampling and the path of the point cloud file to write with \e point_cloud_write,
+ * or compressed with \e pack_encode and written with \e pack_write if it ends with \e PACK_EXTENSION.
+ * Empty lines and lines starting with \e # are ignored.
+ * \n
+ * All the scenes are loaded first, then the leaves of all the jobs are converted through their active zones
+ * by a single pool of threads. The leaves are cut into tasks of about the same estimated number of samples,
+ * so consecutive small jobs share a task and a large job is spread over several threads.
+ * Each leaf is sampled with a seed derived from the seed of its job and its index,
+ * so the written point clouds do not depend on the number of threads.
+ * A point cloud is written as soon as the last leaf of its job is converted.
+ * \n
+ * A summary of the run is written on the standard output.
+ * The program stops if the manifest is invalid, if a scene can not be loaded or if an output file can not be written.
+ *
+ * \param manifest Path of the manifest file \n
+ * Can not take the value \e NULL
+ *
+ * \param threads Number of threads, \e 0 for one thread per online processor \n
+ * Can not be negative
+ */
+void batch_run(const char *manifest, int threads);
+
+#endif
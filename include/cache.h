@@ -0,0 +1,129 @@
+/**
+ * \file cache.h
+ * \brief Least recently used cache module
+ */
+
+#ifndef __CACHE_H__
+#define __CACHE_H__
+
+#include <stddef.h>
+
+/**
+ * \brief Structure defining an entry of a cache
+ */
+typedef struct CacheEntry {
+	void *key; /**< Copy of the key */
+	size_t key_size; /**< Size of the key in bytes */
+	unsigned long hash; /**< Hash of the key */
+	void *value; /**< Cached value, owned by the cache */
+	size_t size; /**< Size of the value in bytes, as given by the user */
+	struct CacheEntry *next; /**< Next entry in the same bucket */
+	struct CacheEntry *newer; /**< Entry used just after this one */
+	struct CacheEntry *older; /**< Entry used just before this one */
+} CacheEntry;
+
+/**
+ * \brief Structure defining a least recently used cache
+ *
+ * \details The entries are found through a hash table on their keys,
+ * and are chained from the most recently used to the least recently used.
+ * When the total size of the entries exceeds the capacity, the least recently used entries are released.
+ * A cache is not thread-safe.
+ */
+typedef struct {
+	CacheEntry **buckets; /**< Hash table */
+	int buckets_size; /**< Number of buckets, a power of two */
+	int size; /**< Number of entries */
+	CacheEntry *newest; /**< Most recently used entry */
+	CacheEntry *oldest; /**< Least recently used entry */
+	size_t capacity; /**< Maximal total size of the entries in bytes */
+	size_t used; /**< Total size of the entries in bytes, keys included */
+	void (*release)(void *); /**< Function releasing a value */
+	unsigned long hits; /**< Number of successful lookups */
+	unsigned long misses; /**< Number of failed lookups */
+} Cache;
+
+/**
+ * \brief Hash a key
+ *
+ * \details The hash is the 64 bits FNV-1a hash of the bytes of the key.
+ *
+ * \param key Key to hash \n
+ * Can not take the value \e NULL
+ *
+ * \param key_size Size of the key in bytes
+ *
+ * \return the hash of the key
+ */
+unsigned long cache_hash(const void *key, size_t key_size);
+
+/**
+ * \brief Allocate an empty cache
+ *
+ * \details The program stops if the allocation has failed.
+ * This function allocate some memory that need to be freed with \e cache_free.
+ *
+ * \param capacity Maximal total size of the entries in bytes
+ *
+ * \param release Function releasing a value evicted from the cache \n
+ * Can not take the value \e NULL
+ *
+ * \return a pointer to the allocated cache
+ */
+Cache * cache_allocate(size_t capacity, void (*release)(void *));
+
+/**
+ * \brief Free the memory allocated by a cache
+ *
+ * \details All the values are released and the pointed cache will be set to \e NULL.
+ *
+ * \param cache Pointer to the cache to free \n
+ * Can not take the value \e NULL
+ */
+void cache_free(Cache **cache);
+
+/**
+ * \brief Find a value in a cache
+ *
+ * \details A found entry becomes the most recently used one.
+ * The value stays owned by the cache and is valid until the next call to \e cache_put.
+ *
+ * \param cache Cache where to search \n
+ * Can not take the value \e NULL
+ *
+ * \param key Key of the value \n
+ * Can not take the value \e NULL
+ *
+ * \param key_size Size of the key in bytes
+ *
+ * \return the cached value, or \e NULL if the key is not in the cache
+ */
+void * cache_get(Cache *cache, const void *key, size_t key_size);
+
+/**
+ * \brief Insert a value in a cache
+ *
+ * \details The key is copied and the cache takes the ownership of the value.
+ * The value replaces the one with the same key if any,
+ * then the least recently used entries are released until the cache fits in its capacity.
+ * A value larger than the capacity is released immediately.
+ * The program stops if the allocation has failed.
+ *
+ * \param cache Cache where to insert \n
+ * Can not take the value \e NULL
+ *
+ * \param key Key of the value \n
+ * Can not take the value \e NULL
+ *
+ * \param key_size Size of the key in bytes
+ *
+ * \param value Value to insert \n
+ * Can not take the value \e NULL
+ *
+ * \param size Size of the value in bytes
+ *
+ * \return \e 1 if the value is still in the cache, \e 0 if it has been released
+ */
+int cache_put(Cache *cache, const void *key, size_t key_size, void *value, size_t size);
+
+#endif
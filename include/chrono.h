@@ -0,0 +1,18 @@
+/**
+ * \file chrono.h
+ * \brief Wall clock module
+ */
+
+#ifndef __CHRONO_H__
+#define __CHRONO_H__
+
+/**
+ * \brief Read the monotonic clock
+ *
+ * \details The origin is unspecified, only the difference between two readings is meaningful.
+ *
+ * \return the current time in seconds
+ */
+double chrono_now(void);
+
+#endif
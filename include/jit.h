@@ -0,0 +1,73 @@
+/**
+ * \file jit.h
+ * \brief Compiled point belonging tests module
+ */
+
+#ifndef __JIT_H__
+#define __JIT_H__
+
+#include "tree.h"
+
+/**
+ * \brief Name of the private directory of the generated sources and of the compiled shared objects,
+ * created in \e $XDG_CACHE_HOME, or else in \e $HOME/.cache
+ */
+#define JIT_DIRECTORY ("csg_jit")
+
+/**
+ * \brief Command of the C compiler, followed by its options
+ */
+#define JIT_COMPILER ("cc -O2 -shared -fPIC")
+
+/**
+ * \brief Structure defining the compiled point belonging tests of a CSG tree
+ */
+typedef struct {
+	Tree tree; /**< Compiled CSG tree */
+	void *handle; /**< Handle of the loaded shared object */
+	unsigned long hash; /**< Hash of the generated source */
+	int cached; /**< \e 1 if the shared object was found in the cache directory, \e 0 if it has been compiled */
+	double compile_time; /**< Time in seconds spent compiling the shared object */
+} Jit;
+
+/**
+ * \brief Compile the point belonging tests of all the subtrees of a CSG tree
+ *
+ * \details A C function is generated for each node, testing a point given in the frame of the parent of the node like \e tree_contains_point,
+ * with the inverse points transformation written as constants, the terms of its zero coefficients and the products by its unit coefficients left out,
+ * the canonical shape test written out and the operators written as logical expressions evaluating the subtrees in the recorded order.
+ * The source and the shared object compiled from it with \e JIT_COMPILER are kept in an entry named after the hash of the source
+ * in the cache directory \e JIT_DIRECTORY, which must belong to the user and be closed to the others,
+ * or in a new private directory of \e /tmp when neither \e $XDG_CACHE_HOME nor \e $HOME is set.
+ * An entry is built in a directory created by \e mkdtemp and renamed at once, so it is never modified once published,
+ * and it is only reused if its files belong to the user, can not be written by the others, and its source equals the generated one byte for byte,
+ * otherwise the shared object is compiled again and loaded from its build directory.
+ * The loaded shared object gives each node of the tree its compiled function,
+ * which \e tree_contains_point calls instead of testing the node itself, and so do the active zones of the tree.
+ * The compiled tests give the same results as the interpreted ones, but do not count the canonical shape tests
+ * and do not use the membership grids.
+ * Transforming any CSG tree afterwards disables the compiled tests, the tree falling back to the interpreted ones,
+ * and the tree must not be reordered while it is compiled.
+ * The program stops if the allocation has failed.
+ * This function allocate some memory that need to be freed with \e jit_free.
+ *
+ * \param tree CSG tree to compile \n
+ * Can not take the value \e NULL \n
+ * Must be a valid CSG tree
+ *
+ * \return a pointer to the allocated compiled tests, or \e NULL if the compilation or the loading has failed, the tree being left interpreted
+ */
+Jit * jit_compile(Tree tree);
+
+/**
+ * \brief Free the compiled point belonging tests of a CSG tree
+ *
+ * \details The nodes of the tree are interpreted again, the shared object is unloaded but kept in the cache directory,
+ * and the pointed compiled tests will be set to \e NULL.
+ *
+ * \param jit Pointer to the compiled tests to free \n
+ * Can not take the value \e NULL
+ */
+void jit_free(Jit **jit);
+
+#endif
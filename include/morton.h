@@ -0,0 +1,61 @@
+/**
+ * \file morton.h
+ * \brief Spatial ordering module
+ */
+
+#ifndef __MORTON_H__
+#define __MORTON_H__
+
+#include "types.h"
+#include "point_cloud.h"
+
+/**
+ * \brief Number of bits of each quantized coordinate in a Morton code
+ */
+#define MORTON_BITS (10)
+
+/**
+ * \brief Number of bits of the digits of the radix sort
+ */
+#define MORTON_RADIX_BITS (8)
+
+/**
+ * \brief Minimal number of points sorted by a thread, smaller point clouds are sorted by fewer threads
+ */
+#define MORTON_MIN_POINTS (16384)
+
+/**
+ * \brief Compute the Morton code of a point
+ *
+ * \details The coordinates are quantized on \e MORTON_BITS bits in the bounding box,
+ * then their bits are interleaved, the bits of \e x being the lowest ones.
+ *
+ * \param point Point to encode
+ *
+ * \param min Lowest corner of the bounding box
+ *
+ * \param max Highest corner of the bounding box
+ *
+ * \return the Morton code of the point
+ */
+unsigned int morton_code(const point3 point, const point3 min, const point3 max);
+
+/**
+ * \brief Sort a point cloud by the Morton code of its points
+ *
+ * \details The codes are computed in the bounding box of the point cloud and sorted by a stable least significant digit radix sort,
+ * each pass counting the digits of a range of codes per thread before scattering the ranges in parallel.
+ * Only the codes and the indices of the points are moved by the passes, the points, normals and colors are gathered once at the end.
+ * Contiguous ranges of the sorted point cloud cover compact regions of space.
+ * The program stops if the allocation has failed.
+ *
+ * \param point_cloud Point cloud to sort \n
+ * Can not take the value \e NULL \n
+ * Must be a valid point cloud
+ *
+ * \param threads Number of threads, \e 0 for one thread per online processor \n
+ * Can not be negative
+ */
+void morton_sort(PointCloud *point_cloud, int threads);
+
+#endif
@@ -0,0 +1,147 @@
+/**
+ * \file pack.h
+ * \brief Compressed point cloud module
+ */
+
+#ifndef __PACK_H__
+#define __PACK_H__
+
+#include "types.h"
+#include "point_cloud.h"
+#include <stdio.h>
+#include <stddef.h>
+
+/**
+ * \brief Magic number at the beginning of a compressed point cloud file
+ */
+#define PACK_MAGIC ("CSGQ")
+
+/**
+ * \brief Extension of the output files written compressed
+ */
+#define PACK_EXTENSION (".csgq")
+
+/**
+ * \brief Number of consecutive points of a block
+ */
+#define PACK_BLOCK (256)
+
+/**
+ * \brief Number of bits of the quantized coordinates of the points
+ */
+#define PACK_POSITION_BITS (16)
+
+/**
+ * \brief Number of bits of each of the two octahedral coordinates of the normals
+ */
+#define PACK_NORMAL_BITS (8)
+
+/**
+ * \brief Structure defining a compressed point cloud
+ *
+ * \details The points are sorted in Morton order and cut into blocks of \e PACK_BLOCK points.
+ * The coordinates are quantized on \e PACK_POSITION_BITS bits in the bounding box of the point cloud,
+ * and each block stores the lowest quantized coordinates of its points followed by the offsets of the points from them,
+ * on \e 0, \e 1 or \e 2 bytes per axis depending on the extent of the block.
+ * The normals are stored with the octahedral mapping on two bytes,
+ * and the colors as indices in the palette of the distinct colors of the point cloud,
+ * a single index being stored for the blocks of only one color.
+ */
+typedef struct {
+	point3 min; /**< Lowest corner of the bounding box */
+	point3 max; /**< Highest corner of the bounding box */
+	color4 *palette; /**< Distinct colors of the point cloud */
+	int palette_size; /**< Number of colors of the palette */
+	int size; /**< Number of points */
+	unsigned char *data; /**< Blocks of the point cloud */
+	size_t bytes; /**< Size of the blocks in bytes */
+} PackedCloud;
+
+/**
+ * \brief Compress a point cloud
+ *
+ * \details The point cloud is sorted in place with \e morton_sort before being encoded.
+ * A decoded coordinate differs from the original one by at most \e pack_position_error along its axis.
+ * The program stops if the allocation has failed or if the point cloud has more than \e 65536 colors.
+ * This function allocate some memory that need to be freed with \e pack_free.
+ *
+ * \param point_cloud Point cloud to compress \n
+ * Can not take the value \e NULL \n
+ * Must be a valid point cloud
+ *
+ * \param threads Number of threads of the sort, \e 0 for one thread per online processor \n
+ * Can not be negative
+ *
+ * \return a pointer to the allocated compressed point cloud
+ */
+PackedCloud * pack_encode(PointCloud *point_cloud, int threads);
+
+/**
+ * \brief Decompress a point cloud
+ *
+ * \details Each block is decoded axis by axis into the arrays of the point cloud,
+ * with loops without branches over the offsets so the compiler can vectorize them.
+ * The points are in Morton order and the normals have a unit length.
+ * The program stops if the allocation has failed.
+ * This function allocate some memory that need to be freed with \e point_cloud_free.
+ *
+ * \param packed Compressed point cloud \n
+ * Can not take the value \e NULL
+ *
+ * \return a pointer to the allocated point cloud
+ */
+PointCloud * pack_decode(const PackedCloud *packed);
+
+/**
+ * \brief Compute the largest error of the decoded coordinates of a compressed point cloud
+ *
+ * \param packed Compressed point cloud \n
+ * Can not take the value \e NULL
+ *
+ * \param axis Index of the axis, from \e 0 to \e 2
+ *
+ * \return half the quantization step of the axis
+ */
+double pack_position_error(const PackedCloud *packed, int axis);
+
+/**
+ * \brief Write a compressed point cloud in a binary file
+ *
+ * \details The file contains the magic number, the number of points and of colors as \e int,
+ * the bounding box, the palette, the size of the blocks as a \e size_t, then the blocks, in the native byte order.
+ *
+ * \param packed Compressed point cloud to write \n
+ * Can not take the value \e NULL
+ *
+ * \param file File where to write the compressed point cloud, opened in binary mode \n
+ * Can not take the value \e NULL
+ *
+ * \return \e 1 if the compressed point cloud has been written, \e 0 otherwise
+ */
+int pack_write(const PackedCloud *packed, FILE *file);
+
+/**
+ * \brief Read a compressed point cloud from a binary file
+ *
+ * \details The file must have been written by \e pack_write.
+ * The program stops if the allocation has failed.
+ * This function allocate some memory that need to be freed with \e pack_free.
+ *
+ * \param file File where to read the compressed point cloud, opened in binary mode \n
+ * Can not take the value \e NULL
+ *
+ * \return a pointer to the allocated compressed point cloud, or \e NULL if the file is not a valid compressed point cloud file
+ */
+PackedCloud * pack_read(FILE *file);
+
+/**
+ * \brief Free the memory allocated by a compressed point cloud
+ *
+ * \details The pointed compressed point cloud will be set to \e NULL.
+ *
+ * \param packed Pointer to the compressed point cloud to free \n
+ * Can not take the value \e NULL
+ */
+void pack_free(PackedCloud **packed);
+
+#endif
@@ -61,6 +61,7 @@
  * One line in the file should correspond either to a canonical shape or to a combination operator.
  * Check the readme file for more information on the format to follow.
  * The format must be respected otherwise the program stops.
+ * A regular file is memory-mapped from its current position, any other stream is read until its end.
  * 
  * \param file CSG tree file to parse \n
  * Can not take the value \e NULL
@@ -69,4 +70,41 @@
  */  
 Tree parse_tree(FILE *file);
 
+/**
+ * \brief Parse a memory buffer to convert it to a CSG tree
+ * 
+ * \details The buffer follows the same format as a scene file and is read in a single pass.
+ * The lines have no length limit and the tree is built with an explicit stack,
+ * so the depth of the tree is only limited by the memory.
+ * The function does not use any global state.
+ * The format must be respected otherwise the program stops.
+ * 
+ * \param buffer Scene text, does not need to be null terminated \n
+ * Can not take the value \e NULL unless \e length is \e 0
+ * 
+ * \param length Number of characters of the scene text
+ * 
+ * \return the CSG tree represented by the buffer
+ */  
+Tree parse_tree_buffer(const char *buffer, size_t length);
+
+/**
+ * \brief Parse a memory buffer to convert it to a CSG tree without stopping on errors
+ * 
+ * \details This function behaves like \e parse_tree_buffer, but an invalid scene
+ * is reported to the caller instead of stopping the program, so a long-running process can reject it.
+ * 
+ * \param buffer Scene text, does not need to be null terminated \n
+ * Can not take the value \e NULL unless \e length is \e 0
+ * 
+ * \param length Number of characters of the scene text
+ * 
+ * \param error Buffer where to write the message describing why the scene is invalid, can take the value \e NULL
+ * 
+ * \param error_size Size of the error buffer in characters
+ * 
+ * \return the CSG tree represented by the buffer, or \e NULL if the scene is invalid
+ */  
+Tree parse_scene_buffer(const char *buffer, size_t length, char *error, size_t error_size);
+
 #endif
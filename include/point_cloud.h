@@ -7,12 +7,18 @@
 #define __POINT_CLOUD__H__
 
 #include "types.h"
+#include <stdio.h>
 
 /**
  * \brief Size of a point in the point cloud rendering
  */ 
 #define POINT_SIZE (2)
 
+/**
+ * \brief Magic number at the beginning of a point cloud file
+ */ 
+#define POINT_CLOUD_MAGIC ("CSGP")
+
 /**
  * \brief Structure defining a point cloud
  * 
@@ -50,6 +56,71 @@ typedef struct {
  */ 
 PointCloud * point_cloud_allocate(point3 *vrtx, vec3 *norm, color4 *colors, int size);
 
+/**
+ * \brief Allocate a point cloud and its arrays
+ * 
+ * \details The arrays are left uninitialized and hold at least one element, so an empty point cloud is still valid.
+ * The program stops if the allocation has failed.
+ * This function allocate some memory that need to be freed with \e point_cloud_free.
+ * 
+ * \param size Number of points \n
+ * Must be positive or null
+ * 
+ * \return a pointer to the allocated point cloud
+ */ 
+PointCloud * point_cloud_allocate_size(int size);
+
+/**
+ * \brief Copy a range of a point cloud in a new point cloud
+ * 
+ * \details The program stops if the allocation has failed.
+ * This function allocate some memory that need to be freed with \e point_cloud_free.
+ * 
+ * \param point_cloud Point cloud to copy \n
+ * Can not take the value \e NULL
+ * 
+ * \param first Index of the first point to copy
+ * 
+ * \param size Number of points to copy \n
+ * The range must lie in the point cloud
+ * 
+ * \return a pointer to the allocated point cloud
+ */ 
+PointCloud * point_cloud_slice(const PointCloud *point_cloud, int first, int size);
+
+/**
+ * \brief Move point clouds at the end of a point cloud
+ * 
+ * \details The arrays of \e point_cloud are grown once to the total size.
+ * The appended point clouds are released and set to \e NULL.
+ * The program stops if the allocation has failed.
+ * 
+ * \param point_cloud Point cloud to grow \n
+ * Can not take the value \e NULL
+ * 
+ * \param clouds Point clouds to append, in order \n
+ * Can not take the value \e NULL
+ * 
+ * \param size Number of point clouds to append
+ */ 
+void point_cloud_append(PointCloud *point_cloud, PointCloud **clouds, int size);
+
+/**
+ * \brief Concatenate point clouds in a new point cloud
+ * 
+ * \details The concatenated point clouds are released and set to \e NULL.
+ * The program stops if the allocation has failed.
+ * This function allocate some memory that need to be freed with \e point_cloud_free.
+ * 
+ * \param clouds Point clouds to concatenate, in order \n
+ * Can not take the value \e NULL
+ * 
+ * \param size Number of point clouds to concatenate
+ * 
+ * \return a pointer to the allocated point cloud
+ */ 
+PointCloud * point_cloud_concatenate(PointCloud **clouds, int size);
+
 /**
  * \brief Draw a point cloud
  * 
@@ -70,6 +141,36 @@ void point_cloud_draw(const PointCloud *point_cloud);
  */ 
 void point_cloud_free (PointCloud **point_cloud);
 
+/**
+ * \brief Write a point cloud in a binary file
+ * 
+ * \details The file contains the magic number, the number of points as an \e int,
+ * then the points, normals and colors arrays, in the native byte order.
+ *
+ * \param point_cloud Point cloud to write, can be empty \n
+ * Can not take the value \e NULL
+ *
+ * \param file File where to write the point cloud, opened in binary mode \n
+ * Can not take the value \e NULL
+ * 
+ * \return \e 1 if the point cloud has been written, \e 0 otherwise
+ */ 
+int point_cloud_write(const PointCloud *point_cloud, FILE *file);
+
+/**
+ * \brief Read a point cloud from a binary file
+ * 
+ * \details The file must have been written by \e point_cloud_write.
+ * The program stops if the allocation has failed.
+ * This function allocate some memory that need to be freed with \e point_cloud_free.
+ *
+ * \param file File where to read the point cloud, opened in binary mode \n
+ * Can not take the value \e NULL
+ * 
+ * \return a pointer to the allocated point cloud, or \e NULL if the file is not a valid point cloud file
+ */ 
+PointCloud * point_cloud_read(FILE *file);
+
 /**
  * \brief Test if a point cloud datastructure is valid
  * 
@@ -0,0 +1,86 @@
+/**
+ * \file pool.h
+ * \brief Thread pool module
+ */
+
+#ifndef __POOL_H__
+#define __POOL_H__
+
+#include <pthread.h>
+
+/**
+ * \brief Structure defining a task of a thread pool
+ */
+typedef struct {
+	void (*function)(void *); /**< Function to run */
+	void *arg; /**< Argument of the function */
+} PoolTask;
+
+/**
+ * \brief Structure defining a thread pool
+ *
+ * \details The tasks are queued in a circular array and run in submission order by the first idle thread.
+ */
+typedef struct {
+	pthread_t *threads; /**< Worker threads */
+	int size; /**< Number of worker threads */
+	PoolTask *tasks; /**< Circular array of queued tasks */
+	int capacity; /**< Size of the tasks array */
+	int head; /**< Index of the next task to run */
+	int count; /**< Number of queued tasks */
+	int pending; /**< Number of submitted tasks not finished yet */
+	int stop; /**< \e 1 when the worker threads must exit */
+	pthread_mutex_t mutex; /**< Lock of the pool */
+	pthread_cond_t available; /**< Signaled when a task is queued or the pool stops */
+	pthread_cond_t done; /**< Signaled when all the submitted tasks are finished */
+} ThreadPool;
+
+/**
+ * \brief Allocate a thread pool and start its worker threads
+ *
+ * \details The program stops if the allocation or the creation of a thread has failed.
+ * This function allocate some memory that need to be freed with \e pool_free.
+ *
+ * \param threads Number of worker threads \n
+ * Must be strictly positive
+ *
+ * \return a pointer to the allocated thread pool
+ */
+ThreadPool * pool_allocate(int threads);
+
+/**
+ * \brief Submit a task to a thread pool
+ *
+ * \details The task can itself submit other tasks.
+ * The program stops if the allocation has failed.
+ *
+ * \param pool Thread pool \n
+ * Can not take the value \e NULL
+ *
+ * \param function Function to run \n
+ * Can not take the value \e NULL
+ *
+ * \param arg Argument of the function
+ */
+void pool_submit(ThreadPool *pool, void (*function)(void *), void *arg);
+
+/**
+ * \brief Wait until all the tasks submitted to a thread pool are finished
+ *
+ * \param pool Thread pool \n
+ * Can not take the value \e NULL
+ */
+void pool_wait(ThreadPool *pool);
+
+/**
+ * \brief Stop the worker threads and free the memory allocated by a thread pool
+ *
+ * \details The queued tasks are run before the threads stop.
+ * The pointed thread pool will be set to \e NULL.
+ *
+ * \param pool Pointer to the thread pool to free \n
+ * Can not take the value \e NULL
+ */
+void pool_free(ThreadPool **pool);
+
+#endif
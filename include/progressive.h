@@ -0,0 +1,94 @@
+/**
+ * \file progressive.h
+ * \brief Progressive conversion module
+ */
+
+#ifndef __PROGRESSIVE_H__
+#define __PROGRESSIVE_H__
+
+#include "point_cloud.h"
+#include "tree.h"
+#include <pthread.h>
+
+/**
+ * \brief Structure defining a progressive conversion of a CSG tree
+ *
+ * \details A generation thread converts the tree at increasing densities while another thread displays the last completed point cloud.
+ * The front point cloud belongs to the displaying thread, the back point cloud is the last completed one not displayed yet.
+ */
+typedef struct {
+	Tree tree; /**< Converted CSG tree, not transformed while it is converted */
+	int first; /**< Density of the first point cloud */
+	int density; /**< Requested density */
+	unsigned int seed; /**< Seed of the sampling */
+	int morton; /**< \e 1 if the point clouds are sorted in Morton order, \e 0 otherwise */
+	int levels; /**< Number of point clouds needed to reach the requested density */
+	PointCloud *front; /**< Displayed point cloud */
+	int front_level; /**< Index of the displayed point cloud, \e -1 before the first one */
+	int front_density; /**< Density of the displayed point cloud */
+	double front_time; /**< Time in seconds from the start of the conversion to the completion of the displayed point cloud */
+	PointCloud *back; /**< Completed point cloud waiting to be displayed, or \e NULL */
+	int back_level; /**< Index of the waiting point cloud */
+	int back_density; /**< Density of the waiting point cloud */
+	double back_time; /**< Time in seconds from the start of the conversion to the completion of the waiting point cloud */
+	int stop; /**< \e 1 if the generation must stop after the current point cloud, \e 0 otherwise */
+	pthread_mutex_t mutex; /**< Mutex protecting the waiting point cloud and the stop flag */
+	pthread_t thread; /**< Generation thread */
+	double start; /**< Start time in seconds of the conversion */
+} Progressive;
+
+/**
+ * \brief Start the progressive conversion of a CSG tree
+ *
+ * \details A generation thread builds the active zones of the tree, then converts them at the density \e first,
+ * and at each following level adds as many new independent samples as needed to double the density reached, up to \e density.
+ * Each completed point cloud holds the points of all the previous levels, is allocated apart from the displayed one
+ * and replaces the waiting one, so the displaying thread never sees a point cloud being written
+ * and skips the levels completed faster than it takes them.
+ * The front point cloud is empty until the first level is taken with \e progressive_update.
+ * The program stops if the allocation or the creation of the thread has failed.
+ * This function allocate some memory that need to be freed with \e progressive_free.
+ *
+ * \param tree CSG tree to convert \n
+ * Can not take the value \e NULL \n
+ * Must be a valid CSG tree
+ *
+ * \param first Density of the first point cloud \n
+ * Must be strictly positive
+ *
+ * \param density Requested point density per unit area \n
+ * Must be strictly positive
+ *
+ * \param seed Seed of the sampling
+ *
+ * \param morton \e 1 to sort each point cloud in Morton order, \e 0 otherwise
+ *
+ * \return a pointer to the allocated progressive conversion
+ */
+Progressive * progressive_start(Tree tree, int first, int density, unsigned int seed, int morton);
+
+/**
+ * \brief Take the last completed point cloud of a progressive conversion as the displayed one
+ *
+ * \details Must only be called by the displaying thread, which owns the front point cloud.
+ * The previous front point cloud is freed.
+ *
+ * \param progressive Progressive conversion \n
+ * Can not take the value \e NULL
+ *
+ * \return \e 1 if the front point cloud has been replaced, \e 0 if no new point cloud was completed
+ */
+int progressive_update(Progressive *progressive);
+
+/**
+ * \brief Stop and free a progressive conversion
+ *
+ * \details The generation thread stops after its current point cloud and is joined.
+ * The pointed progressive conversion will be set to \e NULL.
+ *
+ * \param progressive Pointer to the progressive conversion to free \n
+ * Can not take the value \e NULL
+ */
+void progressive_free(Progressive **progressive);
+
+#endif
@@ -0,0 +1,78 @@
+/**
+ * \file pyramid.h
+ * \brief Multi-resolution point cloud module
+ */
+
+#ifndef __PYRAMID_H__
+#define __PYRAMID_H__
+
+#include "point_cloud.h"
+#include "zone.h"
+
+/**
+ * \brief Structure defining a point cloud whose prefixes are the point clouds of lower densities
+ *
+ * \details The points of each level follow the points of the previous ones,
+ * so the point cloud of a level is the prefix of the points made of its level and of the previous ones.
+ */
+typedef struct {
+	PointCloud *point_cloud; /**< Points of all the levels */
+	int *densities; /**< Density of each level, increasing */
+	int *sizes; /**< Number of points of the prefix of each level */
+	int levels; /**< Number of levels */
+} Pyramid;
+
+/**
+ * \brief Convert the leaves of a CSG tree to a multi-resolution point cloud
+ *
+ * \details The first level samples the leaves at the first density, and each following level adds the samples
+ * drawn independently at the difference between its density and the density of the previous level,
+ * so the prefix of a level is a uniform point cloud at the density of this level.
+ * With \e morton, the points of each level are sorted by their Morton code among themselves, which keeps the prefixes.
+ * The program stops if the allocation has failed.
+ * This function allocate some memory that need to be freed with \e pyramid_free.
+ *
+ * \param zones Active zones \n
+ * Can not take the value \e NULL
+ *
+ * \param densities Point densities per unit area of the levels \n
+ * Can not take the value \e NULL \n
+ * Must be strictly positive and strictly increasing
+ *
+ * \param levels Number of levels \n
+ * Must be strictly positive
+ *
+ * \param morton \e 1 to sort the points of each level in Morton order, \e 0 otherwise
+ *
+ * \return a pointer to the allocated multi-resolution point cloud
+ */
+Pyramid * pyramid_build(const Zones *zones, const int *densities, int levels, int morton);
+
+/**
+ * \brief Get the point cloud of a level of a multi-resolution point cloud
+ *
+ * \details No point is copied, the point cloud shares the arrays of the multi-resolution point cloud
+ * and must not be freed.
+ *
+ * \param pyramid Multi-resolution point cloud \n
+ * Can not take the value \e NULL
+ *
+ * \param level Index of the level \n
+ * Must be between \e 0 and the number of levels minus \e 1
+ *
+ * \param point_cloud Point cloud where to save the prefix of the level \n
+ * Can not take the value \e NULL
+ */
+void pyramid_level(const Pyramid *pyramid, int level, PointCloud *point_cloud);
+
+/**
+ * \brief Free a multi-resolution point cloud
+ *
+ * \details The pointed multi-resolution point cloud will be set to \e NULL.
+ *
+ * \param pyramid Pointer to the multi-resolution point cloud to free \n
+ * Can not take the value \e NULL
+ */
+void pyramid_free(Pyramid **pyramid);
+
+#endif
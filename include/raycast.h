@@ -0,0 +1,156 @@
+/**
+ * \file raycast.h
+ * \brief Ray casting module
+ */
+
+#ifndef __RAYCAST_H__
+#define __RAYCAST_H__
+
+#include "point_cloud.h"
+#include "tree.h"
+#include "view.h"
+#include <stdio.h>
+
+/**
+ * \brief Maximal number of spans of a ray kept for a subtree, the farthest ones being dropped
+ */
+#define RAYCAST_SPANS (32)
+
+/**
+ * \brief Width and height in pixels of the tiles rendered by a thread at once
+ */
+#define RAYCAST_TILE (32)
+
+/**
+ * \brief Relative depth difference under which a point is counted on the surface hit by the ray of its pixel
+ */
+#define RAYCAST_DEPTH_TOLERANCE (0.01)
+
+/**
+ * \brief Maximal number of rays of a family cast by \e raycast_to_point_cloud
+ */
+#define RAYCAST_MAX_RAYS (1L << 30)
+
+/**
+ * \brief Structure defining an image rendered by ray casting
+ */
+typedef struct {
+	int width; /**< Width in pixels */
+	int height; /**< Height in pixels */
+	unsigned char *pixels; /**< Red, green and blue bytes of the pixels, row by row from the top */
+	double *depth; /**< Distance from the camera to the surface seen by each pixel, \e -1 for the background */
+	unsigned long hits; /**< Number of pixels seeing a surface */
+	double time; /**< Time in seconds of the rendering */
+} RaycastImage;
+
+/**
+ * \brief Structure defining the counts of a conversion by ray casting
+ */
+typedef struct {
+	unsigned long rays; /**< Number of rays cast through the bounding box of the tree */
+	unsigned long endpoints; /**< Number of span endpoints found on the surfaces of the leaves */
+	unsigned long hits; /**< Number of span endpoints on the surface of the tree */
+	unsigned long kept; /**< Number of points kept by the density weighting */
+	double time; /**< Time in seconds of the conversion */
+} RaycastStatistics;
+
+/**
+ * \brief Render a CSG tree by casting one ray per pixel
+ *
+ * \details The ray through the center of each pixel is transformed to the frame of each node with its inverse points transformation,
+ * and each leaf gives the spans of the ray inside its canonical shape, solved analytically, the torus by a quartic equation.
+ * The spans of the subtrees are combined by the operator of their parent, the identity as a union,
+ * and a subtree is skipped when the ray misses its bounding box, or when its sibling already decides the result.
+ * At most \e RAYCAST_SPANS spans are kept for a subtree, the farthest ones being dropped.
+ * The first surface in front of the near plane is shaded with the color of its leaf, lit from the camera like the point clouds.
+ * The tiles of \e RAYCAST_TILE pixels are rendered by a thread pool.
+ * The program stops if the allocation has failed.
+ * This function allocate some memory that need to be freed with \e raycast_free.
+ *
+ * \param tree CSG tree to render \n
+ * Can not take the value \e NULL \n
+ * Must be a valid CSG tree
+ *
+ * \param view Camera and viewport \n
+ * Can not take the value \e NULL
+ *
+ * \param threads Number of threads, \e 0 for one thread per online processor \n
+ * Can not be negative
+ *
+ * \return a pointer to the allocated image
+ */
+RaycastImage * raycast_render(Tree tree, const View *view, int threads);
+
+/**
+ * \brief Convert a CSG tree to a point cloud by casting rays through it
+ *
+ * \details Three families of parallel rays along the axes cross the bounding box of the tree, each ray jittered in its cell of a grid
+ * of at least \b density rays per unit area, and the spans of each ray are combined like \e raycast_render.
+ * Every endpoint of a combined span lies on the surface of the tree, and gets the normal and the color of its leaf,
+ * so no sample is rejected by a point belonging test.
+ * As a family meets a surface at a density proportional to the absolute component of its normal along the rays,
+ * an endpoint is kept with the probability giving \b density points per unit area on the surface summed over the three families.
+ * The random generator of the calling thread is used, like the conversions of the canonical shapes.
+ * The program stops if a family needs more than \e RAYCAST_MAX_RAYS rays, if the point cloud would exceed the size of an \e int,
+ * or if the allocation has failed.
+ * This function allocate some memory that need to be freed with \e point_cloud_free.
+ *
+ * \param tree CSG tree to convert \n
+ * Can not take the value \e NULL \n
+ * Must be a valid CSG tree
+ *
+ * \param density Point density per unit area \n
+ * Must be strictly positive
+ *
+ * \param statistics Counts of the conversion \n
+ * Can not take the value \e NULL
+ *
+ * \return a pointer to the allocated point cloud
+ */
+PointCloud * raycast_to_point_cloud(Tree tree, int density, RaycastStatistics *statistics);
+
+/**
+ * \brief Compute the ratio of the surface pixels of a ray cast image covered by a point cloud
+ *
+ * \details Each point is projected like the point cloud drawing and covers a square of \e POINT_SIZE pixels.
+ * A surface pixel is covered if its nearest point lies at the depth of the ray cast surface, up to \e RAYCAST_DEPTH_TOLERANCE,
+ * so the points of hidden surfaces seen through holes do not count.
+ * The program stops if the allocation has failed.
+ *
+ * \param image Ray cast image \n
+ * Can not take the value \e NULL
+ *
+ * \param view Camera and viewport of the image \n
+ * Can not take the value \e NULL
+ *
+ * \param point_cloud Point cloud of the same scene \n
+ * Can not take the value \e NULL
+ *
+ * \return the ratio of the surface pixels covered, \e 1 if the image has no surface pixel
+ */
+double raycast_coverage(const RaycastImage *image, const View *view, const PointCloud *point_cloud);
+
+/**
+ * \brief Write a ray cast image in the binary PPM format
+ *
+ * \param image Image to write \n
+ * Can not take the value \e NULL
+ *
+ * \param file File where to write the image, opened in binary mode \n
+ * Can not take the value \e NULL
+ *
+ * \return \e 1 if the image has been written, \e 0 otherwise
+ */
+int raycast_write(const RaycastImage *image, FILE *file);
+
+/**
+ * \brief Free a ray cast image
+ *
+ * \details The pointed image will be set to \e NULL.
+ *
+ * \param image Pointer to the image to free \n
+ * Can not take the value \e NULL
+ */
+void raycast_free(RaycastImage **image);
+
+#endif
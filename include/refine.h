@@ -0,0 +1,59 @@
+/**
+ * \file refine.h
+ * \brief Time-budgeted conversion module
+ */
+
+#ifndef __REFINE_H__
+#define __REFINE_H__
+
+#include "point_cloud.h"
+#include "zone.h"
+
+/**
+ * \brief Number of times the density is doubled from the first pass to the requested density
+ */
+#define REFINE_LEVELS (6)
+
+/**
+ * \brief Structure defining the statistics of a time-budgeted conversion
+ */
+typedef struct {
+	int density; /**< Density of the returned point cloud */
+	int passes; /**< Number of complete passes */
+	int planned; /**< Number of passes needed to reach the requested density */
+	unsigned long discarded; /**< Number of points of the interrupted pass, thrown away */
+	double time; /**< Time in seconds of the conversion */
+} RefineStatistics;
+
+/**
+ * \brief Convert the leaves of a CSG tree to a point cloud within a time budget
+ *
+ * \details The conversion proceeds in passes through the active zones of the leaves.
+ * The first pass samples the leaves at the requested density divided by 2 to the power \e REFINE_LEVELS, at least \e 1,
+ * and each following pass adds the samples doubling the density reached, up to the requested density.
+ * The samples of a pass are drawn independently of the previous ones, so the points of the first passes
+ * are a uniform point cloud at the density they reach together.
+ * \n
+ * The first pass is always completed. A following pass is not started if the time of the previous one,
+ * scaled to its number of samples, would end it after the deadline, and it is interrupted and thrown away
+ * if the deadline is reached between two of its leaves.
+ * The points are ordered pass by pass, so any prefix made of whole passes is a uniform point cloud.
+ * This function allocate some memory that need to be freed with \e point_cloud_free.
+ *
+ * \param zones Active zones \n
+ * Can not take the value \e NULL
+ *
+ * \param density Requested point density per unit area \n
+ * Must be strictly positive
+ *
+ * \param deadline Time budget in seconds \n
+ * Can not be negative
+ *
+ * \param statistics Structure where to save the reached density and the statistics of the conversion \n
+ * Can not take the value \e NULL
+ *
+ * \return a pointer to the allocated point cloud of the complete passes
+ */
+PointCloud * refine_to_point_cloud(const Zones *zones, int density, double deadline, RefineStatistics *statistics);
+
+#endif
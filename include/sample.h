@@ -0,0 +1,105 @@
+/**
+ * \file sample.h
+ * \brief Shared canonical samples module
+ */
+
+#ifndef __SAMPLE_H__
+#define __SAMPLE_H__
+
+#include "types.h"
+#include "point_cloud.h"
+#include "shape.h"
+#include "cache.h"
+#include <stddef.h>
+
+/**
+ * \brief Default capacity of the cache of canonical samples in bytes
+ */
+#define SAMPLE_CAPACITY (1UL << 30)
+
+/**
+ * \brief Number of quantized values of a scaling factor per doubling of the scaling factor
+ */
+#define SAMPLE_SCALE_STEPS (16)
+
+/**
+ * \brief Structure defining a cache of canonical samples shared by the leaves of the same shape and scale
+ *
+ * \details The samples of a canonical shape are cached under the type of the shape, its scaling factors
+ * quantized on \e SAMPLE_SCALE_STEPS values per doubling, the radius of a torus, the density and the seed of the cache.
+ * The samples of a key are only kept from its second use, so the leaves whose key is used once cost no more than without cache.
+ * A cache of canonical samples is not thread-safe.
+ */
+typedef struct {
+	Cache *cache; /**< Least recently used cache of the canonical point clouds */
+	unsigned int seed; /**< Seed of the cached samples */
+	unsigned long sampled; /**< Number of conversions which have drawn their samples */
+	unsigned long shared; /**< Number of conversions which have transformed cached samples */
+} SampleCache;
+
+/**
+ * \brief Allocate an empty cache of canonical samples
+ *
+ * \details The program stops if the allocation has failed.
+ * This function allocate some memory that need to be freed with \e sample_cache_free.
+ *
+ * \param capacity Maximal total size of the cached samples in bytes
+ *
+ * \param seed Seed of the cached samples
+ *
+ * \return a pointer to the allocated cache
+ */
+SampleCache * sample_cache_allocate(size_t capacity, unsigned int seed);
+
+/**
+ * \brief Free the memory allocated by a cache of canonical samples
+ *
+ * \details The pointed cache will be set to \e NULL.
+ *
+ * \param samples Pointer to the cache to free \n
+ * Can not take the value \e NULL
+ */
+void sample_cache_free(SampleCache **samples);
+
+/**
+ * \brief Convert a canonical shape to a point cloud from the cached canonical samples
+ *
+ * \details The samples are drawn with \e shape_to_seeded_point_cloud at the quantized scaling factors and a seed hashed from the key,
+ * so the leaves sharing a key share the positions of their samples on the canonical shape
+ * and the random generator of the calling thread is not used.
+ * The first use of a key draws the samples in the world frame and only records the key.
+ * The second use draws them again in the canonical frame and keeps them without their colors,
+ * then this use and the following ones transform the kept samples to a new point cloud with the color of the shape.
+ * The density on the surface differs from the one of \e shape_to_point_cloud by less than the ratio of two quantized scaling factors.
+ * The program stops if the allocation has failed.
+ * This function allocate some memory that need to be freed with \e point_cloud_free.
+ *
+ * \param samples Cache of canonical samples \n
+ * Can not take the value \e NULL
+ *
+ * \param shape Canonical shape to convert \n
+ * Can not take the value \e NULL \n
+ * Must be a valid canonical shape
+ *
+ * \param density Point density per unit area \n
+ * Must be strictly positive
+ *
+ * \param transformations Points transformation
+ *
+ * \param norm_transformations Normals transformation
+ *
+ * \return a pointer to the allocated point cloud
+ */
+PointCloud * sample_to_point_cloud(SampleCache *samples, const Shape *shape, int density, const affine transformations, const affine norm_transformations);
+
+/**
+ * \brief Get the hit rate of a cache of canonical samples
+ *
+ * \param samples Cache of canonical samples \n
+ * Can not take the value \e NULL
+ *
+ * \return the ratio of the conversions which have transformed cached samples, \e 0 if no conversion has been made
+ */
+double sample_hit_rate(const SampleCache *samples);
+
+#endif
@@ -0,0 +1,129 @@
+/**
+ * \file scene.h
+ * \brief Compiled scene management module
+ */
+
+#ifndef __SCENE_H__
+#define __SCENE_H__
+
+#include "tree.h"
+#include <stdio.h>
+
+/**
+ * \brief Magic number at the beginning of a compiled scene file
+ */
+#define SCENE_MAGIC ("CSGB")
+
+/**
+ * \brief Version of the compiled scene format
+ */
+#define SCENE_VERSION (2)
+
+/**
+ * \brief Kind of a leaf record in a compiled scene file
+ */
+#define SCENE_LEAF (-1)
+
+/**
+ * \brief Structure defining the header of a compiled scene file
+ */
+typedef struct {
+	char magic[4]; /**< Magic number, equal to \e SCENE_MAGIC */
+	int version; /**< Version of the format, equal to \e SCENE_VERSION */
+	int size; /**< Number of node records following the header */
+	int reserved; /**< Padding, always \e 0 */
+} SceneHeader;
+
+/**
+ * \brief Structure defining a node record of a compiled scene file
+ *
+ * \details The records are stored in the order of a depth-first search of the CSG tree.
+ * The transformations and the scaling factors are the final ones of the node,
+ * so loading a compiled scene does not compose any transformation.
+ * The values are stored in the native byte order.
+ */
+typedef struct {
+	int kind; /**< Combination operator of an internal node, or \e SCENE_LEAF for a leaf */
+	int type; /**< Canonical shape type of a leaf */
+	int right; /**< Index of the record of the right subtree of an internal node, \e 0 for a leaf */
+	int reserved; /**< Padding, always \e 0 */
+	color4 color; /**< Color of the canonical shape of a leaf */
+	double scale[3]; /**< Accumulated scaling factors of the canonical shape of a leaf */
+	double radius; /**< Internal radius of a torus leaf, \e 0 otherwise */
+	affine transformations; /**< Points transformation */
+	affine inv_transformations; /**< Inverse points transformation */
+	affine norm_transformations; /**< Normals transformation */
+} SceneRecord;
+
+/**
+ * \brief Write a CSG tree as a compiled scene
+ *
+ * \details The program stops if the writing has failed.
+ *
+ * \param tree CSG tree to write \n
+ * Can not take the value \e NULL \n
+ * Must be a valid CSG tree
+ *
+ * \param file File where to write the compiled scene, opened in binary mode \n
+ * Can not take the value \e NULL
+ */
+void scene_compile(Tree tree, FILE *file);
+
+/**
+ * \brief Test if a file is a compiled scene
+ *
+ * \details The magic number is read at the current position of the file,
+ * which is restored before returning.
+ *
+ * \param file File to test \n
+ * Can not take the value \e NULL
+ *
+ * \return \e 1 if the file starts with the compiled scene magic number, \e 0 otherwise
+ */
+int scene_is_compiled(FILE *file);
+
+/**
+ * \brief Load a compiled scene
+ *
+ * \details The file is memory-mapped and the CSG tree is rebuilt from the records
+ * without parsing any text nor composing any transformation.
+ * The program stops if the file is not a valid compiled scene.
+ * This function allocate some memory that need to be freed with \e tree_free.
+ *
+ * \param file Compiled scene file, the header must be at the current position \n
+ * Can not take the value \e NULL
+ *
+ * \return the CSG tree stored in the file
+ */
+Tree scene_load(FILE *file);
+
+/**
+ * \brief Load a compiled scene from a memory buffer
+ *
+ * \details The program stops if the buffer is not a valid compiled scene.
+ * This function allocate some memory that need to be freed with \e tree_free.
+ *
+ * \param buffer Compiled scene, aligned on 8 bytes \n
+ * Can not take the value \e NULL
+ *
+ * \param length Size of the buffer in bytes
+ *
+ * \return the CSG tree stored in the buffer
+ */
+Tree scene_load_buffer(const void *buffer, size_t length);
+
+/**
+ * \brief Load a scene file, compiled or not
+ *
+ * \details A compiled scene is loaded with \e scene_load, any other file is parsed with \e parse_tree.
+ * The program stops if the file can not be opened or is not a valid scene.
+ * This function allocate some memory that need to be freed with \e tree_free.
+ *
+ * \param path Path of the scene file \n
+ * Can not take the value \e NULL
+ *
+ * \return the CSG tree stored in the file
+ */
+Tree scene_open(const char *path);
+
+#endif
@@ -0,0 +1,138 @@
+/**
+ * \file server.h
+ * \brief Generation daemon module
+ */
+
+#ifndef __SERVER_H__
+#define __SERVER_H__
+
+#include "point_cloud.h"
+#include <stddef.h>
+
+/**
+ * \brief Magic number at the beginning of the requests and responses
+ */
+#define SERVER_MAGIC ("CSGD")
+
+/**
+ * \brief Kind of a request converting a scene to a point cloud
+ */
+#define SERVER_CONVERT (0)
+
+/**
+ * \brief Kind of a request stopping the daemon
+ */
+#define SERVER_SHUTDOWN (1)
+
+/**
+ * \brief Maximal size of the scene text of a request in bytes
+ */
+#define SERVER_MAX_SCENE (1UL << 30)
+
+/**
+ * \brief Default capacity of the cache of parsed scenes in bytes
+ */
+#define SERVER_TREE_CAPACITY (64UL << 20)
+
+/**
+ * \brief Default capacity of the cache of point clouds in bytes
+ */
+#define SERVER_CLOUD_CAPACITY (1UL << 30)
+
+/**
+ * \brief Structure defining the header of a request
+ *
+ * \details A conversion request is followed by \b length bytes of scene text, in the scene file format.
+ * The values are sent in the native byte order.
+ */
+typedef struct {
+	char magic[4]; /**< Magic number, equal to \e SERVER_MAGIC */
+	int kind; /**< Kind of the request, \e SERVER_CONVERT or \e SERVER_SHUTDOWN */
+	int density; /**< Point density per unit area */
+	unsigned int seed; /**< Seed of the sampling */
+	unsigned long length; /**< Size of the scene text in bytes */
+} ServerRequest;
+
+/**
+ * \brief Structure defining the header of a response
+ *
+ * \details A successful conversion response is followed by the \b size points, normals and colors arrays of the point cloud.
+ * A failed response is followed by \b size bytes of error message.
+ */
+typedef struct {
+	char magic[4]; /**< Magic number, equal to \e SERVER_MAGIC */
+	int status; /**< \e 0 if the request has succeeded, \e 1 otherwise */
+	int size; /**< Number of points of the point cloud, or size of the error message */
+	int cached; /**< \e 1 if the point cloud was found in the cache, \e 0 otherwise */
+} ServerResponse;
+
+/**
+ * \brief Run the generation daemon
+ *
+ * \details The daemon listens on a UNIX socket and serves each connection in its own thread, up to 64 at once,
+ * each connection sending any number of requests.
+ * A connection that neither sends nor receives anything for 30 seconds is closed.
+ * Parsed scenes, with the active zones of their leaves, and converted point clouds are kept in least recently used caches,
+ * so a request for a known scene, density and seed is answered without any conversion.
+ * Both caches are keyed on the whole scene text, the point clouds also on the density and the seed.
+ * A request whose scene text is longer than \e SERVER_MAX_SCENE is refused and its connection closed,
+ * and any other request has its scene text read before being answered, so the connection stays in step.
+ * The sampling of a request only depends on its seed, so a cached point cloud is the one a new conversion would give.
+ * The daemon stops on a shutdown request or on an interruption signal, the connections ending after their current request,
+ * then writes the number of requests per second, the latency percentiles and the cache hit rates on the error output.
+ * The program stops if the socket can not be created.
+ *
+ * \param path Path of the UNIX socket, an existing socket at this path is replaced \n
+ * Can not take the value \e NULL
+ *
+ * \param tree_capacity Capacity of the cache of parsed scenes in bytes
+ *
+ * \param cloud_capacity Capacity of the cache of point clouds in bytes
+ */
+void server_run(const char *path, size_t tree_capacity, size_t cloud_capacity);
+
+/**
+ * \brief Connect to a generation daemon
+ *
+ * \param path Path of the UNIX socket of the daemon \n
+ * Can not take the value \e NULL
+ *
+ * \return the file descriptor of the connection, or \e -1 if the connection has failed
+ */
+int server_connect(const char *path);
+
+/**
+ * \brief Request the conversion of a scene to a generation daemon
+ *
+ * \details This function allocate some memory that need to be freed with \e point_cloud_free.
+ *
+ * \param fd File descriptor of the connection
+ *
+ * \param scene Scene text, does not need to be null terminated \n
+ * Can not take the value \e NULL
+ *
+ * \param length Size of the scene text in bytes
+ *
+ * \param density Point density per unit area \n
+ * Must be strictly positive
+ *
+ * \param seed Seed of the sampling
+ *
+ * \param error Buffer where to write the message describing why the request has failed, can take the value \e NULL
+ *
+ * \param error_size Size of the error buffer in characters
+ *
+ * \return a pointer to the allocated point cloud, or \e NULL if the request has failed
+ */
+PointCloud * server_convert(int fd, const char *scene, size_t length, int density, unsigned int seed, char *error, size_t error_size);
+
+/**
+ * \brief Request a generation daemon to stop
+ *
+ * \param fd File descriptor of the connection
+ *
+ * \return \e 1 if the daemon has acknowledged the request, \e 0 otherwise
+ */
+int server_shutdown(int fd);
+
+#endif
@@ -9,6 +9,26 @@
 #include "types.h"
 #include "point_cloud.h"
 
+/**
+ * \brief Maximal value returned by \e shape_random
+ */
+#define SHAPE_RANDOM_MAX (0x7FFFFFFF)
+
+/**
+ * \brief Classification of a box lying outside a canonical shape
+ */
+#define SHAPE_OUTSIDE (0)
+
+/**
+ * \brief Classification of a box lying inside a canonical shape
+ */
+#define SHAPE_INSIDE (1)
+
+/**
+ * \brief Classification of a box which may cross the surface of a canonical shape
+ */
+#define SHAPE_BOUNDARY (2)
+
 /**
  * \brief Enumeration of the different types of canonical shapes available
  * 
@@ -39,7 +59,7 @@ typedef struct {
 	double z_scale; /**< Scaling factor on \e z axis */
 	double *args; /**< real arguments (for parametric shapes) */
 	int (*contains_function)(double *, point3 *); /**< function pointer on the point belonging function */
-	PointCloud * (*point_cloud_converter)(int, color4, mat4, mat4, double, double, double, double *); /**< function pointer on the point cloud conversion function */
+	PointCloud * (*point_cloud_converter)(int, color4, const affine, const affine, double, double, double, double *); /**< function pointer on the point cloud conversion function */
 } Shape;
 
 /**
@@ -55,13 +75,65 @@ typedef struct {
  * \param density Point density per unit area \n
  * Must be strictly positive
  * 
- * \param transformations Points transformation matrix
+ * \param transformations Points transformation
  * 
- * \param norm_transformations Normals transformation matrix
+ * \param norm_transformations Normals transformation
  * 
  * \return a pointer to the allocated point cloud
  */ 
-PointCloud * shape_to_point_cloud(const Shape *shape, int density, mat4 transformations, mat4 norm_transformations);
+PointCloud * shape_to_point_cloud(const Shape *shape, int density, const affine transformations, const affine norm_transformations);
+
+/**
+ * \brief Convert a canonical shape to a point cloud with given scaling factors and seed
+ *
+ * \details The samples are drawn like \e shape_to_point_cloud for the given scaling factors instead of the ones of the shape,
+ * which set their number and their distribution on the surface.
+ * They are drawn from a random generator seeded with \e seed, and the random generator of the calling thread is left unchanged,
+ * so the point cloud only depends on its arguments.
+ * This function allocate some memory that need to be freed with \e point_cloud_free.
+ *
+ * \param shape Canonical shape to convert \n
+ * Can not take the value \e NULL \n
+ * Must be a valid canonical shape
+ *
+ * \param density Point density per unit area \n
+ * Must be strictly positive
+ *
+ * \param x_scale Scaling factor on \e x axis \n
+ * Must be strictly positive
+ *
+ * \param y_scale Scaling factor on \e y axis \n
+ * Must be strictly positive
+ *
+ * \param z_scale Scaling factor on \e z axis \n
+ * Must be strictly positive
+ *
+ * \param seed Seed of the samples
+ *
+ * \param transformations Points transformation
+ *
+ * \param norm_transformations Normals transformation
+ *
+ * \return a pointer to the allocated point cloud
+ */
+PointCloud * shape_to_seeded_point_cloud(const Shape *shape, int density, double x_scale, double y_scale, double z_scale, unsigned int seed, const affine transformations, const affine norm_transformations);
+
+/**
+ * \brief Seed the random generator used to sample the canonical shapes
+ *
+ * \details Each thread has its own random generator, seeded with \e 1 when the thread starts,
+ * so concurrent conversions do not share any state and a conversion only depends on its seed.
+ *
+ * \param seed Seed of the random generator of the calling thread
+ */
+void shape_seed(unsigned int seed);
+
+/**
+ * \brief Draw a number from the random generator used to sample the canonical shapes
+ *
+ * \return a number between \e 0 and \e SHAPE_RANDOM_MAX drawn from the random generator of the calling thread
+ */
+unsigned int shape_random(void);
 
 /**
  * \brief Allocate a canonical cone
@@ -101,6 +173,68 @@ Shape * shape_cube(color4 color);
  */ 
 int shape_contains_point(const Shape *shape, const point3 *point);
 
+/**
+ * \brief Classify a box against a canonical shape
+ *
+ * \details The point belonging function of the canonical shape is evaluated with interval arithmetic over the box,
+ * so the classification is conservative : a box classified inside or outside only contains points inside or outside the shape,
+ * but a box classified on the boundary may lie completely inside or outside.
+ *
+ * \param shape Canonical shape \n
+ * Can not take the value \e NULL \n
+ * Must be a valid canonical shape
+ *
+ * \param min Lowest corner of the box, axis-aligned in the frame of the canonical shape
+ *
+ * \param max Highest corner of the box, axis-aligned in the frame of the canonical shape
+ *
+ * \return \e SHAPE_INSIDE, \e SHAPE_OUTSIDE or \e SHAPE_BOUNDARY
+ */
+int shape_classify_box(const Shape *shape, const point3 min, const point3 max);
+
+/**
+ * \brief Get the relative cost of a point belonging test on a canonical shape
+ *
+ * \details The cost is expressed relatively to the test of a canonical sphere.
+ *
+ * \param shape Canonical shape \n
+ * Can not take the value \e NULL \n
+ * Must be a valid canonical shape
+ *
+ * \return the relative cost of \e shape_contains_point on the canonical shape
+ */ 
+double shape_contains_cost(const Shape *shape);
+
+/**
+ * \brief Get the area of the surface sampled on a canonical shape
+ *
+ * \details The area takes into account the scaling factors of the shape
+ * and is the one used by \e shape_to_point_cloud, so the number of points
+ * of the converted point cloud is close to the area times the density.
+ *
+ * \param shape Canonical shape \n
+ * Can not take the value \e NULL \n
+ * Must be a valid canonical shape
+ *
+ * \return the sampled area of the canonical shape
+ */ 
+double shape_area(const Shape *shape);
+
+/**
+ * \brief Get the bounding box of a canonical shape
+ *
+ * \details The box is axis-aligned in the frame of the canonical shape, before any transformation.
+ *
+ * \param shape Canonical shape \n
+ * Can not take the value \e NULL \n
+ * Must be a valid canonical shape
+ *
+ * \param min Point where to save the lowest corner of the box
+ *
+ * \param max Point where to save the highest corner of the box
+ */ 
+void shape_bounds(const Shape *shape, point3 min, point3 max);
+
 /**
  * \brief Allocate a canonical cylinder
  * 
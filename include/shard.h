@@ -0,0 +1,59 @@
+/**
+ * \file shard.h
+ * \brief Multi-process conversion module
+ */
+
+#ifndef __SHARD_H__
+#define __SHARD_H__
+
+#include "point_cloud.h"
+#include "tree.h"
+
+/**
+ * \brief Count the shards of a CSG tree cut at a given depth
+ *
+ * \details A shard is a subtree whose root is at the cut depth, or a leaf above it.
+ *
+ * \param tree CSG tree to cut \n
+ * Can not take the value \e NULL \n
+ * Must be a valid CSG tree
+ *
+ * \param depth Depth of the cut, \e 0 being the root \n
+ * Must be positive
+ *
+ * \return the number of shards
+ */
+int shard_count(Tree tree, int depth);
+
+/**
+ * \brief Convert a CSG tree to a point cloud with several worker processes
+ *
+ * \details The tree is cut at the given depth and the shards are distributed among forked worker processes,
+ * balancing the sampled areas of their leaves.
+ * Each worker converts its shards and writes their point clouds in its own memory file,
+ * which the parent process maps once the worker has exited.
+ * The upper levels of the tree are merged from the mapped files, without copying the shard point clouds,
+ * and the pages of each shard are released from its memory file once it has been merged.
+ * Each shard is sampled from its own seed, drawn from the random generator of the calling thread,
+ * so the result does not depend on the number of processes.
+ * The program stops if a worker has failed.
+ * This function allocate some memory that need to be freed with \e point_cloud_free.
+ *
+ * \param tree CSG tree to convert \n
+ * Can not take the value \e NULL \n
+ * Must be a valid CSG tree
+ *
+ * \param density Point density per unit area \n
+ * Must be strictly positive
+ *
+ * \param depth Depth of the cut, \e 0 being the root \n
+ * Must be positive
+ *
+ * \param processes Number of worker processes \n
+ * Must be strictly positive
+ *
+ * \return a pointer to the allocated point cloud
+ */
+PointCloud * shard_to_point_cloud(Tree tree, int density, int depth, int processes);
+
+#endif
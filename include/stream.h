@@ -0,0 +1,65 @@
+/**
+ * \file stream.h
+ * \brief Streamed conversion module
+ */
+
+#ifndef __STREAM_H__
+#define __STREAM_H__
+
+#include "zone.h"
+#include <stdio.h>
+
+/**
+ * \brief Number of samples of a leaf classified at once, bounding the number of points of a chunk
+ */
+#define STREAM_CHUNK (65536)
+
+/**
+ * \brief Number of chunks waiting to be written before the generation waits for the output
+ */
+#define STREAM_QUEUE (8)
+
+/**
+ * \brief Structure defining the statistics of a streamed conversion
+ */
+typedef struct {
+	unsigned long chunks; /**< Number of chunks written */
+	unsigned long points; /**< Number of points written */
+	unsigned long stalls; /**< Number of times the generation waited for the output */
+	double first_chunk; /**< Time in seconds until the first chunk is written */
+	double total; /**< Time in seconds until the end of the stream is written */
+} StreamStatistics;
+
+/**
+ * \brief Convert the leaves of a CSG tree to a stream of point cloud chunks
+ *
+ * \details A generation thread samples the leaves one by one and classifies their samples against their active zones
+ * by slices of \e STREAM_CHUNK samples, so the kept points of a slice are final and are queued at once as a chunk.
+ * The calling thread writes the queued chunks with \e point_cloud_write and flushes the file after each of them,
+ * then writes an empty point cloud to mark the end of the stream,
+ * so a consumer reads the chunks with \e point_cloud_read until it gets an empty point cloud.
+ * When \e STREAM_QUEUE chunks are waiting, the generation waits until the consumer has read one,
+ * so a slow consumer slows the generation down instead of filling the memory.
+ * The sampling only depends on the seed, and the chunks follow the order of \e zone_to_point_cloud.
+ * \n
+ * The \e SIGPIPE signal is ignored while streaming, so a consumer closing the stream stops the generation.
+ * The program stops if the allocation or the creation of the thread has failed.
+ *
+ * \param zones Active zones \n
+ * Can not take the value \e NULL
+ *
+ * \param density Point density per unit area \n
+ * Must be strictly positive
+ *
+ * \param seed Seed of the sampling
+ *
+ * \param file File where to write the stream, opened in binary mode \n
+ * Can not take the value \e NULL
+ *
+ * \param statistics Structure where to save the statistics of the conversion, or \e NULL
+ *
+ * \return \e 1 if the whole stream has been written, \e 0 otherwise
+ */
+int stream_write(const Zones *zones, int density, unsigned int seed, FILE *file, StreamStatistics *statistics);
+
+#endif
@@ -0,0 +1,67 @@
+/**
+ * \file synth.h
+ * \brief Synthetic scene generation module
+ */
+
+#ifndef __SYNTH_H__
+#define __SYNTH_H__
+
+#include "tree.h"
+#include <stdio.h>
+
+/**
+ * \brief Structure defining the parameters of a synthetic scene
+ *
+ * \details The leaves are canonical shapes of random type, color and orientation
+ * placed on a regular grid inside the cube [-1,1]^3.
+ * The internal nodes are drawn at random among the combination operators
+ * according to the operator weights.
+ */
+typedef struct {
+	int leaves; /**< Number of leaves */
+	int depth; /**< Maximal depth of the tree (raised to the minimal depth if too small) */
+	int mix[NumberOperator]; /**< Weight of each combination operator */
+	double overlap; /**< Overlap ratio between neighbouring leaves, between \e 0 and \e 1 excluded */
+	unsigned int seed; /**< Seed of the random draws */
+} SynthParameters;
+
+/**
+ * \brief Set the default parameters of a synthetic scene
+ *
+ * \details By default a scene has 16 leaves, a balanced tree, only union operators,
+ * an overlap ratio of \e 0.25 and a seed equal to \e 1.
+ *
+ * \param parameters Parameters to initialize \n
+ * Can not take the value \e NULL
+ */
+void synth_default_parameters(SynthParameters *parameters);
+
+/**
+ * \brief Compute the minimal depth of a tree
+ *
+ * \param leaves Number of leaves of the tree \n
+ * Must be strictly positive
+ *
+ * \return the depth of a balanced tree with \e leaves leaves
+ */
+int synth_minimal_depth(int leaves);
+
+/**
+ * \brief Write a synthetic scene in the scene file format
+ *
+ * \details The written scene can be read back with \e parse_tree.
+ * The random draws use their own generator so the scene only depends on the parameters.
+ *
+ * \param file File where to write the scene \n
+ * Can not take the value \e NULL
+ *
+ * \param parameters Parameters of the scene \n
+ * Can not take the value \e NULL \n
+ * \b leaves must be strictly positive, \b overlap must be in [0,1[
+ * and at least one operator weight must be strictly positive
+ *
+ * \return the number of nodes of the written scene
+ */
+int synth_write_scene(FILE *file, const SynthParameters *parameters);
+
+#endif
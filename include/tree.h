@@ -9,6 +9,7 @@
 #include "types.h"
 #include "point_cloud.h"
 #include "shape.h"
+#include <stddef.h>
 
 /**
  * \brief Enumeration of the different combination operations available
@@ -21,24 +22,60 @@ typedef enum {
 	NumberOperator /**< Number of combination operator */
 } Operator;
 
+/**
+ * \brief Default maximal depth of the membership grids built by \e tree_voxelize
+ */
+#define TREE_VOXEL_DEPTH (7)
+
+/**
+ * \brief Default memory capacity in bytes of the membership grids built by \e tree_voxelize
+ */
+#define TREE_VOXEL_CAPACITY (16UL << 20)
+
+/**
+ * \brief Membership grid of a CSG tree, defined in the tree module
+ */
+struct TreeVoxels;
+
 /**
  * \brief Structure defining a CSG tree
  * 
  * \details A CSG tree is a recursive structure.
  * If the tree is a leaf, it is defined by a canonical form.
  * If the tree is an internal node, it is defined by a combination operator, a left CSG tree child and a right CSG tree child.
- * In both cases, the tree also contains a points transformation matrix, an inverse points transformation matrix, and a normals transformation matrix.
+ * In both cases, the tree also contains a points transformation, an inverse points transformation, and a normals transformation, all of them affine.
+ * An internal node also records in which order its subtrees are evaluated when testing if a point belongs to it,
+ * and in which order they are converted to point clouds.
  */
 typedef struct Node {
 	Operator op; /**< Combination operator */
 	Shape* shape; /**< Canonical shape */
-	mat4 transformations; /**< Points transformation matrix */
-	mat4 inv_transformations; /**< Inverse points transformation matrix */
-	mat4 norm_transformations; /**< Normals transformation matrix */
+	affine transformations; /**< Points transformation */
+	affine inv_transformations; /**< Inverse points transformation */
+	affine norm_transformations; /**< Normals transformation */
 	struct Node *left; /**< Left CSG subtree */
 	struct Node *right; /**< Right CSG subtree */
+	int right_first; /**< \e 1 if the right subtree is evaluated first when testing a point, \e 0 otherwise */
+	int convert_right_first; /**< \e 1 if the right subtree is converted first to a point cloud, \e 0 otherwise */
+	double cost; /**< Estimated cost of a point belonging test, in canonical shape tests */
+	unsigned long tests; /**< Number of point belonging tests observed during the last pilot */
+	unsigned long hits; /**< Number of points found inside the tree during the last pilot */
+	struct TreeVoxels *voxels; /**< Membership grid of the tree in the frame of its parent, \e NULL if there is none */
+	int (*compiled)(const double *); /**< Compiled point belonging test of the tree, \e NULL if the tree is interpreted */
+	unsigned long compiled_generation; /**< Value of \e tree_generation when the test was compiled */
 } *Tree;
 
+/**
+ * \brief Structure defining the statistics of the conversions of CSG trees
+ */
+typedef struct {
+	unsigned long classifications; /**< Number of point belonging tests performed by the merges */
+	unsigned long primitive_tests; /**< Number of canonical shape tests performed by these point belonging tests */
+	unsigned long voxel_lookups; /**< Number of membership grid lookups performed by these point belonging tests */
+	unsigned long voxel_hits; /**< Number of these lookups answered without testing the subtree */
+	unsigned long materialized; /**< Number of points written in new arrays by the merges */
+} TreeStatistics;
+
 /**
  * \brief Allocate a leaf of a CSG tree
  * 
@@ -101,10 +138,188 @@ void tree_free (Tree *tree);
  */
 PointCloud * tree_to_point_cloud(Tree tree, int density);
 
+/**
+ * \brief Convert a CSG tree to a point cloud without copying the points at each merge
+ *
+ * \details The samples of each leaf stay in the arrays where they were generated until the end of the conversion.
+ * A merge only compacts in place the selection vector of each leaf, the indices of its samples still kept,
+ * and composes the transformation of the node with the one bringing the samples of the leaf to the frame of the node,
+ * each sample being transformed on the fly when it is tested.
+ * The kept samples are gathered once, transformed to the frame of the root in the same pass,
+ * so the points are written once instead of once per level.
+ * The result is the point cloud of \e tree_to_point_cloud with the same seed, up to rounding,
+ * but the samples of all the leaves are kept in memory until the end of the conversion.
+ * This function allocate some memory that need to be freed with \e point_cloud_free.
+ *
+ * \param tree CSG tree to convert \n
+ * Can not take the value \e NULL \n
+ * Must be a valid CSG tree
+ *
+ * \param density Point density per unit area \n
+ * Must be strictly positive
+ *
+ * \return a pointer to the allocated point cloud
+ */
+PointCloud * tree_to_point_cloud_late(Tree tree, int density);
+
+/**
+ * \brief Test if a point belongs to a CSG tree
+ *
+ * \details The point is given in the frame of the parent of the tree,
+ * it is brought to the frame of each node through the inverse points transformations.
+ * The subtrees are evaluated in the order recorded by the internal nodes.
+ *
+ * \param tree CSG tree \n
+ * Can not take the value \e NULL \n
+ * Must be a valid CSG tree
+ *
+ * \param point Point to test \n
+ * Can not take the value \e NULL
+ *
+ * \param tests Counter incremented by the number of canonical shape tests \n
+ * Can not take the value \e NULL
+ *
+ * \return \e 1 if the point belongs to the tree, \e 0 otherwise
+ */
+int tree_contains_point (Tree tree, point3 *point, unsigned long *tests);
+
+/**
+ * \brief Merge the point clouds of the subtrees of an internal node
+ *
+ * \details This is the merge step of \e tree_to_point_cloud, so converting the subtrees separately,
+ * for example in other processes, and merging their point clouds gives the same result.
+ * The points of both point clouds are tested against the other subtree and the kept points are transformed by the node.
+ * The given point clouds are only read, so they can point to read-only memory, and they still need to be freed.
+ * This function allocate some memory that need to be freed with \e point_cloud_free.
+ *
+ * \param tree Internal node \n
+ * Can not take the value \e NULL \n
+ * Must be a valid CSG tree which is not a leaf
+ *
+ * \param left Point cloud of the left subtree, in the frame of the node \n
+ * Can not take the value \e NULL
+ *
+ * \param right Point cloud of the right subtree, in the frame of the node \n
+ * Can not take the value \e NULL
+ *
+ * \return a pointer to the allocated point cloud of the node
+ */
+PointCloud * tree_merge_point_clouds(Tree tree, const PointCloud *left, const PointCloud *right);
+
+/**
+ * \brief Reorder the evaluation of the subtrees from a pilot conversion
+ *
+ * \details The tree is first converted at the pilot density while recording,
+ * for each node, how often the points tested by the merges belong to it.
+ * Then each internal node evaluates first the subtree minimizing the expected cost of a point belonging test,
+ * the cost of a leaf depending on its canonical shape type and the cost of an internal node on its depth.
+ * The points kept by the following conversions are the same, only the number of canonical shape tests changes.
+ *
+ * \param tree CSG tree to optimize \n
+ * Can not take the value \e NULL \n
+ * Must be a valid CSG tree
+ *
+ * \param pilot_density Point density per unit area of the pilot conversion \n
+ * Must be strictly positive
+ */
+void tree_optimize(Tree tree, int pilot_density);
+
+/**
+ * \brief Schedule the conversion of the subtrees to minimize the memory used
+ *
+ * \details The size of the point cloud of each subtree is estimated from the sampled areas of its leaves,
+ * since the number of points is proportional to the density.
+ * Then each internal node converts first the subtree minimizing the peak number of points alive at the same time,
+ * following the Sethi-Ullman register allocation scheme.
+ * The order of the points in the converted point clouds does not change.
+ *
+ * \param tree CSG tree to schedule \n
+ * Can not take the value \e NULL \n
+ * Must be a valid CSG tree
+ */
+void tree_schedule(Tree tree);
+
+/**
+ * \brief Build the membership grids of the subtrees tested by the merges
+ *
+ * \details Each internal subtree whose points are tested by the merge of its parent gets a multi-resolution grid over its bounding box,
+ * in the frame of its parent. The cells are classified as inside, outside or on the boundary of the subtree
+ * by evaluating the canonical shapes with interval arithmetic, and only the boundary cells are refined, coarsest first.
+ * Then a point belonging test is a single lookup, unless the point falls in a boundary cell where the subtree is tested as usual,
+ * so the points kept by the conversions do not change.
+ * The capacity is shared between the grids in proportion to the number of leaves of their subtrees,
+ * and bounds the peak memory of a build, the index of the parent of each cell kept while the grid grows included,
+ * so a grid holds at most half of its share.
+ * Transforming any CSG tree afterwards releases the grid of the transformed node and disables all the other grids,
+ * which are then ignored by the lookups until they are released with \e tree_unvoxelize, so a grid never answers for an old geometry.
+ * The program stops if the allocation has failed.
+ *
+ * \param tree CSG tree \n
+ * Can not take the value \e NULL \n
+ * Must be a valid CSG tree
+ *
+ * \param depth Maximal number of subdivisions of the cells \n
+ * Can not be negative
+ *
+ * \param capacity Maximal memory used by all the grids in bytes
+ *
+ * \return the memory used by the grids in bytes
+ */
+size_t tree_voxelize(Tree tree, int depth, size_t capacity);
+
+/**
+ * \brief Release the membership grids of a CSG tree
+ *
+ * \param tree CSG tree \n
+ * Can not take the value \e NULL \n
+ * Must be a valid CSG tree
+ */
+void tree_unvoxelize(Tree tree);
+
+/**
+ * \brief Test if the point belonging tests of a CSG tree call its compiled function or start with a lookup in its membership grid
+ *
+ * \details A compiled function or a grid disabled by a later transformation does not count.
+ *
+ * \param tree CSG tree \n
+ * Can not take the value \e NULL
+ *
+ * \return \e 1 if the tree has an enabled compiled function or membership grid, \e 0 otherwise
+ */
+int tree_is_accelerated(Tree tree);
+
+/**
+ * \brief Get the statistics of the conversions
+ *
+ * \details The statistics accumulate the work of all the calls to \e tree_to_point_cloud
+ * since the last call to \e tree_reset_statistics, pilot conversions excluded.
+ * They are updated once per merge and atomically, so parallel conversions can share them.
+ *
+ * \param statistics Structure where to save the statistics \n
+ * Can not take the value \e NULL
+ */
+void tree_statistics(TreeStatistics *statistics);
+
+/**
+ * \brief Reset the statistics of the conversions
+ */
+void tree_reset_statistics(void);
+
+/**
+ * \brief Add the work of a conversion performed outside of this module to the statistics
+ *
+ * \details The statistics are updated atomically,
+ * with the membership grid lookups made by \e tree_contains_point in the calling thread since its last conversion.
+ *
+ * \param statistics Work to add \n
+ * Can not take the value \e NULL
+ */
+void tree_add_statistics(const TreeStatistics *statistics);
+
 /**
  * \brief Perform an homothety on a CSG tree
  * 
- * \details Operation will update matrix fields of the tree.
+ * \details Operation will update transformation fields of the tree.
  * Scaling factors of canonical shapes at leaves are also updated.
  * 
  * \param shape CSG tree to modify \n
@@ -141,7 +356,7 @@ int tree_is_valid(Tree tree);
 /**
  * \brief Perform a rotation on a CSG tree
  * 
- * \details Operation will update matrix fields of the tree.
+ * \details Operation will update transformation fields of the tree.
  * 
  * \param shape CSG tree to modify \n
  * Can not take the value \e NULL \n
@@ -155,10 +370,20 @@ int tree_is_valid(Tree tree);
  */ 
 void tree_rotation (Tree tree, double x, double y, double z);
 
+/**
+ * \brief Get the generation of the geometry of the CSG trees
+ *
+ * \details The generation is incremented each time a CSG tree is transformed,
+ * so the membership grids and the compiled tests built at an older generation are not used anymore.
+ *
+ * \return the current generation
+ */
+unsigned long tree_generation(void);
+
 /**
  * \brief Perform a translation on a CSG tree
  * 
- * \details Operation will update matrix fields of the tree.
+ * \details Operation will update transformation fields of the tree.
  * 
  * \param shape CSG tree to modify \n
  * Can not take the value \e NULL \n
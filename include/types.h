@@ -65,6 +65,16 @@ typedef coord3 vec3;
  */
 typedef double mat4[16];
 
+/**
+ * \brief Structure defining a 3D affine transformation
+ *
+ * \details A 3D affine transformation is a 1D plain array
+ * containing the 3x3 linear part of the transformation in a column-major order
+ * followed by the translation vector.
+ * It is a homogeneous matrix without its last line, which is always (0, 0, 0, 1).
+ */
+typedef double affine[12];
+
 /**
  * \brief Set the values of a color
  *
@@ -467,4 +477,161 @@ void mat4_product_vec3(vec3 v_result, mat4 m, vec3 v);
  */
 void mat4_product_point3(point3 p_result, mat4 m, point3 p);
 
+/**
+ * \brief Set a value in the affine transformation
+ *
+ * \param m Affine transformation to modify
+ *
+ * \param col Column index, the column \e 3 is the translation vector
+ *
+ * \param line Line index
+ *
+ * \param val Value to set
+ */
+#define affine_set(m, col, line, val) ((m)[3*(col)+(line)]=(val))
+
+/**
+ * \brief Get a value in the affine transformation
+ *
+ * \param m Affine transformation
+ *
+ * \param col Column index, the column \e 3 is the translation vector
+ *
+ * \param line Line index
+ *
+ * \return value of the affine transformation at given indices
+ */
+#define affine_get(m, col, line) ((m)[3*(col)+(line)])
+
+/**
+ * \brief Set the identity in the affine transformation
+ *
+ * \param m Affine transformation to modify
+ */
+#define affine_set_identity(m) (memset((m), 0, sizeof(affine)),\
+                                (m)[0]=(m)[4]=(m)[8]=1)
+
+/**
+ * \brief Compute a translation
+ *
+ * \param m Affine transformation to modify
+ *
+ * \param tx Translation factor on \e x axis
+ *
+ * \param ty Translation factor on \e y axis
+ *
+ * \param tz Translation factor on \e z axis
+ */
+void affine_translation(affine m, double tx, double ty, double tz);
+
+/**
+ * \brief Compute a homothety
+ *
+ * \param m Affine transformation to modify
+ *
+ * \param hx Scaling factor on \e x axis
+ *
+ * \param hy Scaling factor on \e y axis
+ *
+ * \param hz Scaling factor on \e z axis
+ */
+void affine_homothety(affine m, double hx, double hy, double hz);
+
+/**
+ * \brief Compute a rotation around x axis
+ *
+ * \param m Affine transformation to modify
+ *
+ * \param alpha Rotation angle around \e x axis
+ */
+void affine_rotation_x(affine m, double alpha);
+
+/**
+ * \brief Compute a rotation around y axis
+ *
+ * \param m Affine transformation to modify
+ *
+ * \param alpha Rotation angle around \e y axis
+ */
+void affine_rotation_y(affine m, double alpha);
+
+/**
+ * \brief Compute a rotation around z axis
+ *
+ * \param m Affine transformation to modify
+ *
+ * \param alpha Rotation angle around \e z axis
+ */
+void affine_rotation_z(affine m, double alpha);
+
+/**
+ * \brief Compose affine transformations
+ *
+ * \details The result is the transformation applying \e m2 then \e m1.
+ * It costs 36 multiplications where a homogeneous matrix product costs 64.
+ * The result can be one of the operands.
+ *
+ * \param m_result Affine transformation to save the result
+ *
+ * \param m1 Left transformation of the product
+ *
+ * \param m2 Right transformation of the product
+ */
+void affine_product(affine m_result, const affine m1, const affine m2);
+
+/**
+ * \brief Apply an affine transformation to a point
+ *
+ * \param p_result Point to save the result
+ *
+ * \param m Affine transformation
+ *
+ * \param p Point to transform
+ */
+void affine_product_point3(point3 p_result, const affine m, const point3 p);
+
+/**
+ * \brief Apply the linear part of an affine transformation to a vector
+ *
+ * \details The vector is normalized.
+ *
+ * \param v_result Vector to save the result
+ *
+ * \param m Affine transformation
+ *
+ * \param v Vector to transform
+ */
+void affine_product_vec3(vec3 v_result, const affine m, const vec3 v);
+
+/**
+ * \brief Apply an affine transformation to an array of points
+ *
+ * \details The arrays can be the same to transform the points in place.
+ *
+ * \param m Affine transformation
+ *
+ * \param dst Array where to save the transformed points
+ *
+ * \param src Array of the points to transform
+ *
+ * \param size Number of points
+ */
+void affine_apply_points(const affine m, point3 *dst, const point3 *src, int size);
+
+/**
+ * \brief Apply the linear part of an affine transformation to an array of normals
+ *
+ * \details The transformed normals are normalized.
+ * The arrays can be the same to transform the normals in place.
+ *
+ * \param m Affine transformation
+ *
+ * \param dst Array where to save the transformed normals
+ *
+ * \param src Array of the normals to transform
+ *
+ * \param size Number of normals
+ */
+void affine_apply_normals(const affine m, vec3 *dst, const vec3 *src, int size);
+
 #endif
@@ -0,0 +1,148 @@
+/**
+ * \file view.h
+ * \brief View-dependent sampling module
+ */
+
+#ifndef __VIEW_H__
+#define __VIEW_H__
+
+#include "types.h"
+#include "point_cloud.h"
+#include "zone.h"
+
+/**
+ * \brief Default number of points per pixel covered by a leaf
+ */
+#define VIEW_POINTS_PER_PIXEL (1.0)
+
+/**
+ * \brief Size in pixels of the square cells of the coarse depth buffer
+ */
+#define VIEW_DEPTH_CELL (4)
+
+/**
+ * \brief Depth tolerance of the coarse depth buffer, in cell footprints at the depth of the cell
+ *
+ * \details A point is occluded if it lies deeper than the nearest point of its cell by more than this many cell widths,
+ * so the points of a surface seen at a grazing angle are not taken for occluded ones.
+ */
+#define VIEW_DEPTH_SLOPE (4.0)
+
+/**
+ * \brief Structure defining a perspective camera
+ */
+typedef struct {
+	point3 eye; /**< Position of the camera */
+	point3 target; /**< Point looked at by the camera */
+	vec3 up; /**< Up direction of the camera */
+	double fovy; /**< Vertical field of view in degrees */
+	double near; /**< Distance of the near clipping plane */
+	int width; /**< Width of the viewport in pixels */
+	int height; /**< Height of the viewport in pixels */
+} View;
+
+/**
+ * \brief Structure defining the number of points removed by each stage of a visibility-aware conversion
+ */
+typedef struct {
+	unsigned long sampled; /**< Number of points sampled on the leaves */
+	unsigned long back_facing; /**< Number of points removed because they face away from the camera */
+	unsigned long classified_out; /**< Number of points removed by the active zones of the leaves */
+	unsigned long occluded; /**< Number of points removed by the coarse depth buffer */
+	unsigned long kept; /**< Number of points kept */
+} ViewStatistics;
+
+/**
+ * \brief Compute the number of pixels covered by the projection of a bounding box
+ *
+ * \details The covered pixels are estimated by the screen rectangle bounding the projected corners of the box,
+ * clipped to the viewport. A box crossing the near plane covers the whole viewport.
+ *
+ * \param view Camera \n
+ * Can not take the value \e NULL
+ *
+ * \param min Lowest corner of the bounding box in the world frame
+ *
+ * \param max Highest corner of the bounding box in the world frame
+ *
+ * \return the number of covered pixels
+ */
+double view_pixels(const View *view, const point3 min, const point3 max);
+
+/**
+ * \brief Compute the point density of a leaf from its projected area
+ *
+ * \details About half of the sampled surface of a leaf faces the camera,
+ * so the density giving the requested number of points per covered pixel on this half is used,
+ * bounded by the given world-space density.
+ *
+ * \param view Camera \n
+ * Can not take the value \e NULL
+ *
+ * \param zones Active zones \n
+ * Can not take the value \e NULL
+ *
+ * \param leaf Index of the leaf
+ *
+ * \param density Maximal point density per unit area \n
+ * Must be strictly positive
+ *
+ * \param points_per_pixel Number of points per covered pixel \n
+ * Must be strictly positive
+ *
+ * \return the point density of the leaf, between \e 1 and \b density
+ */
+int view_leaf_density(const View *view, const Zones *zones, int leaf, int density, double points_per_pixel);
+
+/**
+ * \brief Convert the leaves of a CSG tree to a point cloud sampled in screen space
+ *
+ * \details Each leaf is converted through its active zone at the density given by \e view_leaf_density,
+ * so small or distant leaves get fewer points and the total is bounded by what the viewport can show.
+ * This function allocate some memory that need to be freed with \e point_cloud_free.
+ *
+ * \param view Camera \n
+ * Can not take the value \e NULL
+ *
+ * \param zones Active zones \n
+ * Can not take the value \e NULL
+ *
+ * \param density Maximal point density per unit area \n
+ * Must be strictly positive
+ *
+ * \param points_per_pixel Number of points per covered pixel \n
+ * Must be strictly positive
+ *
+ * \return a pointer to the allocated point cloud
+ */
+PointCloud * view_to_point_cloud(const View *view, const Zones *zones, int density, double points_per_pixel);
+
+/**
+ * \brief Convert the leaves of a CSG tree to the point cloud of the surface visible from a camera
+ *
+ * \details The points of each leaf whose oriented normal faces away from the camera are removed right after the sampling,
+ * since they lie on the back of a closed surface, before testing the survivors against the active zone of the leaf.
+ * Then all the kept points are projected in a coarse depth buffer, with cells of \e VIEW_DEPTH_CELL pixels,
+ * and the points lying behind the nearest point of their cell are removed before the point clouds of the leaves are gathered.
+ * This function allocate some memory that need to be freed with \e point_cloud_free.
+ *
+ * \param view Camera \n
+ * Can not take the value \e NULL
+ *
+ * \param zones Active zones \n
+ * Can not take the value \e NULL
+ *
+ * \param density Point density per unit area, maximal if the density is view-dependent \n
+ * Must be strictly positive
+ *
+ * \param points_per_pixel Number of points per covered pixel of a view-dependent density, \e 0 to sample all the leaves at \b density \n
+ * Can not be negative
+ *
+ * \param statistics Structure where to save the number of points removed by each stage \n
+ * Can not take the value \e NULL
+ *
+ * \return a pointer to the allocated point cloud
+ */
+PointCloud * view_visible_point_cloud(const View *view, const Zones *zones, int density, double points_per_pixel, ViewStatistics *statistics);
+
+#endif
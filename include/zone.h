@@ -0,0 +1,190 @@
+/**
+ * \file zone.h
+ * \brief Active zones management module
+ */
+
+#ifndef __ZONE_H__
+#define __ZONE_H__
+
+#include "types.h"
+#include "point_cloud.h"
+#include "shape.h"
+#include "tree.h"
+#include "sample.h"
+
+/**
+ * \brief Index of an empty reduced expression
+ */
+#define ZONE_EMPTY (-1)
+
+/**
+ * \brief Structure defining a term of a reduced expression
+ *
+ * \details A term is either a leaf of the CSG tree or a combination of two terms.
+ * A leaf term is tested in the world frame through the inverse transformation of its leaf,
+ * so no transformation is applied at the internal terms.
+ * Each term also keeps the subtree of the CSG tree it is reduced from, with the frame of the parent of this subtree.
+ */
+typedef struct {
+	Operator op; /**< Combination operator of an internal term */
+	int leaf; /**< Index of the leaf of a leaf term, \e -1 for an internal term */
+	int left; /**< Index of the left term of an internal term */
+	int right; /**< Index of the right term of an internal term */
+	int right_first; /**< \e 1 if the right term is evaluated first, \e 0 otherwise */
+	Tree tree; /**< Subtree of the CSG tree the term is reduced from */
+	int frame; /**< Index of the points transformation from the world frame to the frame of the parent of the subtree */
+} ZoneTerm;
+
+/**
+ * \brief Structure defining a constraint of an active zone
+ *
+ * \details A point of a leaf surface is kept if it belongs, or does not belong, to a reduced expression.
+ */
+typedef struct {
+	int term; /**< Index of the root term of the reduced expression */
+	int keep_inside; /**< \e 1 if the points inside the expression are kept, \e 0 if they are removed */
+} ZoneConstraint;
+
+/**
+ * \brief Structure defining a leaf of the CSG tree and its active zone
+ *
+ * \details The active zone of a leaf is the conjunction of its constraints.
+ * Each constraint comes from an ancestor of the leaf where the sibling subtree is reduced
+ * to the primitives whose bounding boxes overlap the bounding box of the leaf.
+ */
+typedef struct {
+	const Shape *shape; /**< Canonical shape of the leaf */
+	affine transformations; /**< Points transformation from the canonical frame to the world frame */
+	affine inv_transformations; /**< Points transformation from the world frame to the canonical frame */
+	affine norm_transformations; /**< Normals transformation from the canonical frame to the world frame */
+	point3 min; /**< Lowest corner of the bounding box of the leaf in the world frame */
+	point3 max; /**< Highest corner of the bounding box of the leaf in the world frame */
+	int flip; /**< \e 1 if the normals of the leaf are flipped, \e 0 otherwise */
+	int empty; /**< \e 1 if no point of the leaf can be kept, \e 0 otherwise */
+	int first; /**< Index of the first constraint of the leaf */
+	int constraints; /**< Number of constraints of the leaf */
+} ZoneLeaf;
+
+/**
+ * \brief Structure defining the active zones of all the leaves of a CSG tree
+ *
+ * \details The leaves are stored in the order of a depth-first search of the CSG tree,
+ * which is the order of the points produced by \e tree_to_point_cloud.
+ */
+typedef struct {
+	ZoneLeaf *leaves; /**< Leaves array */
+	int size; /**< Number of leaves */
+	ZoneConstraint *constraints; /**< Constraints array */
+	int constraints_size; /**< Number of constraints */
+	ZoneTerm *terms; /**< Terms array */
+	int terms_size; /**< Number of terms */
+	affine *frames; /**< Points transformations from the world frame to the frames of the parents of the nodes, in depth-first order */
+	SampleCache *samples; /**< Cache of canonical samples used to sample the leaves, \e NULL to sample each leaf apart, not owned by the zones */
+} Zones;
+
+/**
+ * \brief Compute the active zones of the leaves of a CSG tree
+ *
+ * \details The zones are built without a cache of canonical samples.
+ * The program stops if the allocation has failed.
+ * The zones keep pointers on the nodes and the canonical shapes of the tree,
+ * so the tree must not be modified nor freed while the zones are used,
+ * but its membership grids may be built or released at any time.
+ * This function allocate some memory that need to be freed with \e zone_free.
+ *
+ * \param tree CSG tree to analyze \n
+ * Can not take the value \e NULL \n
+ * Must be a valid CSG tree
+ *
+ * \return a pointer to the allocated active zones
+ */
+Zones * zone_build(Tree tree);
+
+/**
+ * \brief Free the memory allocated by active zones
+ *
+ * \details The pointed active zones will be set to \e NULL.
+ *
+ * \param zones Pointer to the active zones to free \n
+ * Can not take the value \e NULL
+ */
+void zone_free(Zones **zones);
+
+/**
+ * \brief Test if a point of the world frame belongs to a reduced expression
+ *
+ * \details A term whose subtree has an enabled compiled function or membership grid is tested by \e tree_contains_point on the whole subtree,
+ * which agrees with the reduced expression for the points of the bounding box of the leaf of the constraint.
+ *
+ * \param zones Active zones \n
+ * Can not take the value \e NULL
+ *
+ * \param term Index of the root term of the reduced expression
+ *
+ * \param point Point to test \n
+ * Can not take the value \e NULL
+ *
+ * \param tests Counter incremented by the number of canonical shape tests \n
+ * Can not take the value \e NULL
+ *
+ * \return \e 1 if the point belongs to the expression, \e 0 otherwise
+ */
+int zone_contains_point(const Zones *zones, int term, const point3 *point, unsigned long *tests);
+
+/**
+ * \brief Keep the points of a sampled leaf satisfying the constraints of its active zone
+ *
+ * \details The points are removed in place and the normals of a flipped leaf are flipped.
+ * The work is added to the statistics of the conversions.
+ *
+ * \param zones Active zones \n
+ * Can not take the value \e NULL
+ *
+ * \param leaf Index of the leaf
+ *
+ * \param cloud Points sampled on the surface of the leaf in the world frame \n
+ * Can not take the value \e NULL
+ */
+void zone_leaf_select(const Zones *zones, int leaf, PointCloud *cloud);
+
+/**
+ * \brief Convert a leaf of a CSG tree to the point cloud of its visible surface
+ *
+ * \details The surface of the leaf is sampled in the world frame and only the points
+ * satisfying the constraints of its active zone are kept.
+ * A leaf whose active zone is empty is sampled too, so it draws the same random numbers as in \e tree_to_point_cloud.
+ * The samples come from \e sample_to_point_cloud if the zones have a cache of canonical samples,
+ * then the zones must not be converted by several threads at once.
+ * The work is added to the statistics of the conversions.
+ * This function allocate some memory that need to be freed with \e point_cloud_free.
+ *
+ * \param zones Active zones \n
+ * Can not take the value \e NULL
+ *
+ * \param leaf Index of the leaf
+ *
+ * \param density Point density per unit area \n
+ * Must be strictly positive
+ *
+ * \return a pointer to the allocated point cloud
+ */
+PointCloud * zone_leaf_to_point_cloud(const Zones *zones, int leaf, int density);
+
+/**
+ * \brief Convert a CSG tree to a point cloud through the active zones of its leaves
+ *
+ * \details The points are the ones of \e tree_to_point_cloud for the same seed, in the same order and up to rounding,
+ * when the subtrees are converted left first, but each point is only tested against the reduced expressions of its leaf.
+ * This function allocate some memory that need to be freed with \e point_cloud_free.
+ *
+ * \param zones Active zones of the CSG tree \n
+ * Can not take the value \e NULL
+ *
+ * \param density Point density per unit area \n
+ * Must be strictly positive
+ *
+ * \return a pointer to the allocated point cloud
+ */
+PointCloud * zone_to_point_cloud(const Zones *zones, int density);
+
+#endif
@@ -0,0 +1,327 @@
+#include "animation.h"
+
+#include "types.h"
+#include "shape.h"
+#include "tree.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "point_cloud.h"
+
+#define ANIMATION_INITIAL_SIZE (64)
+#define ANIMATION_EPSILON (1e-9)
+
+static void * animation_grow(void *array, int *capacity, size_t size) {
+	assert(NULL != capacity);
+	*capacity = (*capacity > 0) ? 2*(*capacity) : ANIMATION_INITIAL_SIZE;
+	if (NULL == (array = realloc(array, (*capacity)*size))) {
+		fprintf(stderr, "memory allocation error (line %d file %s)\n", __LINE__, __FILE__);
+		exit(EXIT_FAILURE);
+	}
+	return array;
+}
+
+static int animation_index(Animation *animation, int *capacity, Tree tree, int parent) {
+	assert(NULL != animation);
+	assert(NULL != tree);
+	assert(tree_is_valid(tree));
+	if (animation->nodes_size == *capacity)
+		animation->nodes = (AnimationNode *) animation_grow(animation->nodes, capacity, sizeof(AnimationNode));
+	int index = animation->nodes_size++;
+	animation->nodes[index].tree = tree;
+	animation->nodes[index].parent = parent;
+	if (NULL == tree->shape) {
+		animation_index(animation, capacity, tree->left, index);
+		animation_index(animation, capacity, tree->right, index);
+	}
+	animation->nodes[index].end = animation->nodes_size;
+	return index;
+}
+
+static void animation_constrain(Animation *animation, int *capacity, int index, AnimationConstraint *ancestors, int depth, int flip, int density) {
+	assert(NULL != animation);
+	const AnimationNode *node = animation->nodes + index;
+	if (NULL != node->tree->shape) {
+		if (animation->leaves_size == *capacity)
+			animation->leaves = (AnimationLeaf *) animation_grow(animation->leaves, capacity, sizeof(AnimationLeaf));
+		AnimationLeaf *leaf = animation->leaves + animation->leaves_size++;
+		affine identity;
+		int k;
+		affine_set_identity(identity);
+		leaf->node = index;
+		leaf->flip = flip;
+		leaf->samples = shape_to_point_cloud(node->tree->shape, density, identity, identity);
+		leaf->first = animation->size;
+		leaf->constraints_size = depth;
+		if (NULL == (leaf->constraints = (AnimationConstraint *) malloc((depth > 0 ? depth : 1) * sizeof(AnimationConstraint)))) {
+			fprintf(stderr, "memory allocation error (line %d file %s)\n", __LINE__, __FILE__);
+			exit(EXIT_FAILURE);
+		}
+		for (k = 0; k < depth; k++) {
+			leaf->constraints[k] = ancestors[depth - 1 - k];
+		}
+		animation->size += leaf->samples->size;
+		return;
+	}
+	Operator op = node->tree->op;
+	int left = index + 1;
+	int right = animation->nodes[left].end;
+	if (op == Identity) {
+		animation_constrain(animation, capacity, left, ancestors, depth, flip, density);
+		animation_constrain(animation, capacity, right, ancestors, depth, flip, density);
+		return;
+	}
+	ancestors[depth].ancestor = index;
+	ancestors[depth].sibling = right;
+	ancestors[depth].keep_inside = (op == Intersection);
+	animation_constrain(animation, capacity, left, ancestors, depth + 1, flip, density);
+	ancestors[depth].sibling = left;
+	ancestors[depth].keep_inside = (op == Intersection || op == Difference);
+	animation_constrain(animation, capacity, right, ancestors, depth + 1, flip ^ (op == Difference), density);
+}
+
+static void animation_place(Animation *animation, int index) {
+	assert(NULL != animation);
+	int i, end = animation->nodes[index].end;
+	for (i = index; i < end; i++) {
+		AnimationNode *node = animation->nodes + i;
+		if (node->parent < 0) {
+			memcpy(node->transformations, node->tree->transformations, sizeof(affine));
+			memcpy(node->inv_transformations, node->tree->inv_transformations, sizeof(affine));
+			memcpy(node->norm_transformations, node->tree->norm_transformations, sizeof(affine));
+		} else {
+			const AnimationNode *parent = animation->nodes + node->parent;
+			affine_product(node->transformations, parent->transformations, node->tree->transformations);
+			affine_product(node->inv_transformations, node->tree->inv_transformations, parent->inv_transformations);
+			affine_product(node->norm_transformations, parent->norm_transformations, node->tree->norm_transformations);
+		}
+	}
+}
+
+static void animation_box(Animation *animation, int index) {
+	assert(NULL != animation);
+	AnimationNode *node = animation->nodes + index;
+	point3 corners[2], p, q;
+	int i, k;
+	if (NULL != node->tree->shape) {
+		shape_bounds(node->tree->shape, corners[0], corners[1]);
+		for (i = 0; i < 8; i++) {
+			point3_set(p, corners[i & 1][0], corners[(i >> 1) & 1][1], corners[(i >> 2) & 1][2]);
+			affine_product_point3(q, node->transformations, p);
+			for (k = 0; k < 3; k++) {
+				if (i == 0 || q[k] < node->min[k])
+					node->min[k] = q[k];
+				if (i == 0 || q[k] > node->max[k])
+					node->max[k] = q[k];
+			}
+		}
+		return;
+	}
+	const AnimationNode *l = animation->nodes + index + 1;
+	const AnimationNode *r = animation->nodes + l->end;
+	for (k = 0; k < 3; k++) {
+		node->min[k] = (l->min[k] < r->min[k]) ? l->min[k] : r->min[k];
+		node->max[k] = (l->max[k] > r->max[k]) ? l->max[k] : r->max[k];
+	}
+}
+
+static int animation_inside(const point3 p, const point3 min, const point3 max) {
+	int k;
+	for (k = 0; k < 3; k++) {
+		if (p[k] < min[k] - ANIMATION_EPSILON || p[k] > max[k] + ANIMATION_EPSILON)
+			return 0;
+	}
+	return 1;
+}
+
+static int animation_overlap(const point3 min1, const point3 max1, const point3 min2, const point3 max2) {
+	int k;
+	for (k = 0; k < 3; k++) {
+		if (min1[k] > max2[k] + ANIMATION_EPSILON || min2[k] > max1[k] + ANIMATION_EPSILON)
+			return 0;
+	}
+	return 1;
+}
+
+static int animation_classify(const Animation *animation, const AnimationLeaf *leaf, int from, const point3 point, TreeStatistics *statistics) {
+	assert(NULL != animation);
+	assert(NULL != leaf);
+	int c;
+	statistics->classifications++;
+	for (c = from; c < leaf->constraints_size; c++) {
+		const AnimationConstraint *constraint = leaf->constraints + c;
+		point3 p;
+		affine_product_point3(p, animation->nodes[constraint->ancestor].inv_transformations, point);
+		if (tree_contains_point(animation->nodes[constraint->sibling].tree, &p, &(statistics->primitive_tests)) != constraint->keep_inside)
+			return c;
+	}
+	return leaf->constraints_size;
+}
+
+static void animation_transform(Animation *animation, const AnimationLeaf *leaf) {
+	assert(NULL != animation);
+	assert(NULL != leaf);
+	const AnimationNode *node = animation->nodes + leaf->node;
+	point3 *vrtx = animation->vrtx + leaf->first;
+	vec3 *norm = animation->norm + leaf->first;
+	int i;
+	affine_apply_points(node->transformations, vrtx, (const point3 *) leaf->samples->vrtx, leaf->samples->size);
+	affine_apply_normals(node->norm_transformations, norm, (const vec3 *) leaf->samples->norm, leaf->samples->size);
+	if (leaf->flip) {
+		for (i = 0; i < leaf->samples->size; i++) {
+			vec3_set(norm[i], -(vec3_get_x(norm[i])), -(vec3_get_y(norm[i])), -(vec3_get_z(norm[i])));
+		}
+	}
+	animation->transformed += leaf->samples->size;
+}
+
+static void animation_gather(Animation *animation) {
+	assert(NULL != animation);
+	PointCloud *cloud = animation->point_cloud;
+	int l, i, size = 0;
+	for (l = 0; l < animation->leaves_size; l++) {
+		const AnimationLeaf *leaf = animation->leaves + l;
+		for (i = 0; i < leaf->samples->size; i++) {
+			if (animation->passed[leaf->first + i] != leaf->constraints_size)
+				continue;
+			point3_copy(cloud->vrtx[size], animation->vrtx[leaf->first + i]);
+			vec3_copy(cloud->norm[size], animation->norm[leaf->first + i]);
+			color4_copy(cloud->colors[size], leaf->samples->colors[i]);
+			size++;
+		}
+	}
+	cloud->size = size;
+}
+
+Animation * animation_allocate(Tree tree, int density) {
+	assert(NULL != tree);
+	assert(tree_is_valid(tree));
+	assert(density > 0);
+	Animation *animation = NULL;
+	if (NULL == (animation = (Animation *) malloc(sizeof(Animation)))) {
+		fprintf(stderr, "memory allocation error (line %d file %s)\n", __LINE__, __FILE__);
+		exit(EXIT_FAILURE);
+	}
+	memset(animation, 0, sizeof(Animation));
+	int nodes_capacity = 0, leaves_capacity = 0;
+	int i, l;
+	animation_index(animation, &nodes_capacity, tree, -1);
+	AnimationConstraint *ancestors = NULL;
+	if (NULL == (ancestors = (AnimationConstraint *) malloc(animation->nodes_size * sizeof(AnimationConstraint)))) {
+		fprintf(stderr, "memory allocation error (line %d file %s)\n", __LINE__, __FILE__);
+		exit(EXIT_FAILURE);
+	}
+	animation_constrain(animation, &leaves_capacity, 0, ancestors, 0, 0, density);
+	free(ancestors);
+	point3 *vrtx = NULL;
+	vec3 *norm = NULL;
+	color4 *colors = NULL;
+	if (NULL == (animation->vrtx = (point3 *) malloc(animation->size * sizeof(point3)))
+	|| NULL == (animation->norm = (vec3 *) malloc(animation->size * sizeof(vec3)))
+	|| NULL == (animation->passed = (int *) malloc(animation->size * sizeof(int)))
+	|| NULL == (vrtx = (point3 *) malloc(animation->size * sizeof(point3)))
+	|| NULL == (norm = (vec3 *) malloc(animation->size * sizeof(vec3)))
+	|| NULL == (colors = (color4 *) malloc(animation->size * sizeof(color4)))) {
+		fprintf(stderr, "memory allocation error (line %d file %s)\n", __LINE__, __FILE__);
+		exit(EXIT_FAILURE);
+	}
+	animation->point_cloud = point_cloud_allocate(vrtx, norm, colors, animation->size);
+	animation_place(animation, 0);
+	for (i = animation->nodes_size - 1; i >= 0; i--) {
+		animation_box(animation, i);
+	}
+	TreeStatistics statistics = {0, 0, 0, 0, 0};
+	for (l = 0; l < animation->leaves_size; l++) {
+		const AnimationLeaf *leaf = animation->leaves + l;
+		animation_transform(animation, leaf);
+		for (i = 0; i < leaf->samples->size; i++) {
+			animation->passed[leaf->first + i] = animation_classify(animation, leaf, 0, animation->vrtx[leaf->first + i], &statistics);
+		}
+	}
+	animation->classified = statistics.classifications;
+	tree_add_statistics(&statistics);
+	animation_gather(animation);
+	return animation;
+}
+
+void animation_free(Animation **animation) {
+	assert(NULL != animation);
+	assert(NULL != *animation);
+	int l;
+	for (l = 0; l < (*animation)->leaves_size; l++) {
+		point_cloud_free(&((*animation)->leaves[l].samples));
+		free((*animation)->leaves[l].constraints);
+	}
+	point_cloud_free(&((*animation)->point_cloud));
+	free((*animation)->leaves);
+	free((*animation)->nodes);
+	free((*animation)->vrtx);
+	free((*animation)->norm);
+	free((*animation)->passed);
+	free(*animation);
+	*animation = NULL;
+}
+
+static void animation_update(Animation *animation, int index) {
+	assert(NULL != animation);
+	AnimationNode *moved = animation->nodes + index;
+	point3 min, max;
+	int i, l, k;
+	point3_copy(min, moved->min);
+	point3_copy(max, moved->max);
+	animation_place(animation, index);
+	for (i = moved->end - 1; i >= index; i--) {
+		animation_box(animation, i);
+	}
+	for (i = moved->parent; i >= 0; i = animation->nodes[i].parent) {
+		animation_box(animation, i);
+	}
+	for (k = 0; k < 3; k++) {
+		min[k] = (moved->min[k] < min[k]) ? moved->min[k] : min[k];
+		max[k] = (moved->max[k] > max[k]) ? moved->max[k] : max[k];
+	}
+	TreeStatistics statistics = {0, 0, 0, 0, 0};
+	animation->transformed = 0;
+	for (l = 0; l < animation->leaves_size; l++) {
+		const AnimationLeaf *leaf = animation->leaves + l;
+		int *passed = animation->passed + leaf->first;
+		const point3 *vrtx = (const point3 *) (animation->vrtx + leaf->first);
+		int from = 0;
+		if (index <= leaf->node && leaf->node < moved->end) {
+			while (from < leaf->constraints_size && leaf->constraints[from].ancestor >= index)
+				from++;
+			animation_transform(animation, leaf);
+			for (i = 0; i < leaf->samples->size; i++) {
+				if (passed[i] >= from)
+					passed[i] = animation_classify(animation, leaf, from, vrtx[i], &statistics);
+			}
+			continue;
+		}
+		while (from < leaf->constraints_size && !(leaf->constraints[from].sibling <= index && index < animation->nodes[leaf->constraints[from].sibling].end))
+			from++;
+		if (from == leaf->constraints_size || !animation_overlap(animation->nodes[leaf->node].min, animation->nodes[leaf->node].max, min, max))
+			continue;
+		for (i = 0; i < leaf->samples->size; i++) {
+			if (passed[i] >= from && animation_inside(vrtx[i], min, max))
+				passed[i] = animation_classify(animation, leaf, from, vrtx[i], &statistics);
+		}
+	}
+	animation->classified = statistics.classifications;
+	tree_add_statistics(&statistics);
+	animation_gather(animation);
+}
+
+void animation_rotate(Animation *animation, int node, double x, double y, double z) {
+	assert(NULL != animation);
+	assert(0 <= node && node < animation->nodes_size);
+	tree_rotation(animation->nodes[node].tree, x, y, z);
+	animation_update(animation, node);
+}
+
+void animation_translate(Animation *animation, int node, double x, double y, double z) {
+	assert(NULL != animation);
+	assert(0 <= node && node < animation->nodes_size);
+	tree_translation(animation->nodes[node].tree, x, y, z);
+	animation_update(animation, node);
+}
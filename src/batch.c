@@ -0,0 +1,233 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "batch.h"
+
+#include "types.h"
+#include "shape.h"
+#include "tree.h"
+#include "scene.h"
+#include "zone.h"
+#include "pool.h"
+#include "pack.h"
+#include "chrono.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include "point_cloud.h"
+
+#define BATCH_LINE_SIZE (4096)
+#define BATCH_INITIAL_SIZE (16)
+#define BATCH_LEAF_SEED (0x9E3779B9U)
+
+typedef struct {
+	char *scene;
+	char *output;
+	int density;
+	unsigned int seed;
+	Tree tree;
+	Zones *zones;
+	PointCloud **clouds;
+	int remaining;
+	int points;
+} BatchJob;
+
+typedef struct {
+	BatchJob *job;
+	int leaf;
+	double cost;
+} BatchItem;
+
+typedef struct {
+	BatchItem *items;
+	int size;
+} BatchTask;
+
+static char * batch_copy(const char *s) {
+	assert(NULL != s);
+	char *copy = NULL;
+	if (NULL == (copy = (char *) malloc(strlen(s) + 1))) {
+		fprintf(stderr, "memory allocation error (line %d file %s)\n", __LINE__, __FILE__);
+		exit(EXIT_FAILURE);
+	}
+	strcpy(copy, s);
+	return copy;
+}
+
+static BatchJob * batch_parse(const char *manifest, int *size) {
+	assert(NULL != manifest);
+	assert(NULL != size);
+	FILE *f = NULL;
+	if (NULL == (f = fopen(manifest, "r"))) {
+		fprintf(stderr, "can not open file '%s'\n", manifest);
+		exit(EXIT_FAILURE);
+	}
+	BatchJob *jobs = NULL;
+	int capacity = 0, line = 0;
+	char buffer[BATCH_LINE_SIZE];
+	*size = 0;
+	while (NULL != fgets(buffer, BATCH_LINE_SIZE, f)) {
+		line++;
+		char *fields[5], *end = NULL;
+		int n = 0;
+		char *token = strtok(buffer, " \t\r\n");
+		while (NULL != token && n < 5) {
+			fields[n++] = token;
+			token = strtok(NULL, " \t\r\n");
+		}
+		if (n == 0 || fields[0][0] == '#')
+			continue;
+		if (n != 4) {
+			fprintf(stderr, "manifest '%s' line %d : expected 'scene density seed output'\n", manifest, line);
+			exit(EXIT_FAILURE);
+		}
+		long density = strtol(fields[1], &end, 10);
+		if (*end != '\0' || density <= 0 || density > 0x7FFFFFFF) {
+			fprintf(stderr, "manifest '%s' line %d : invalid density '%s'\n", manifest, line, fields[1]);
+			exit(EXIT_FAILURE);
+		}
+		unsigned long seed = strtoul(fields[2], &end, 10);
+		if (*end != '\0' || seed > 0xFFFFFFFFUL) {
+			fprintf(stderr, "manifest '%s' line %d : invalid seed '%s'\n", manifest, line, fields[2]);
+			exit(EXIT_FAILURE);
+		}
+		if (*size == capacity) {
+			capacity = (capacity > 0) ? 2*capacity : BATCH_INITIAL_SIZE;
+			if (NULL == (jobs = (BatchJob *) realloc(jobs, capacity * sizeof(BatchJob)))) {
+				fprintf(stderr, "memory allocation error (line %d file %s)\n", __LINE__, __FILE__);
+				exit(EXIT_FAILURE);
+			}
+		}
+		BatchJob *job = jobs + (*size)++;
+		job->scene = batch_copy(fields[0]);
+		job->output = batch_copy(fields[3]);
+		job->density = (int) density;
+		job->seed = (unsigned int) seed;
+		job->tree = NULL;
+		job->zones = NULL;
+		job->clouds = NULL;
+		job->remaining = 0;
+		job->points = 0;
+	}
+	fclose(f);
+	if (*size == 0) {
+		fprintf(stderr, "manifest '%s' has no job\n", manifest);
+		exit(EXIT_FAILURE);
+	}
+	return jobs;
+}
+
+static void batch_finish(BatchJob *job) {
+	assert(NULL != job);
+	PointCloud *cloud = point_cloud_concatenate(job->clouds, job->zones->size);
+	FILE *f = NULL;
+	if (NULL == (f = fopen(job->output, "wb"))) {
+		fprintf(stderr, "can not open file '%s'\n", job->output);
+		exit(EXIT_FAILURE);
+	}
+	size_t length = strlen(job->output), extension = strlen(PACK_EXTENSION);
+	int written;
+	if (length > extension && strcmp(job->output + length - extension, PACK_EXTENSION) == 0) {
+		PackedCloud *packed = pack_encode(cloud, 1);
+		written = pack_write(packed, f);
+		pack_free(&packed);
+	} else {
+		written = point_cloud_write(cloud, f);
+	}
+	if (!written || 0 != fclose(f)) {
+		fprintf(stderr, "can not write file '%s'\n", job->output);
+		exit(EXIT_FAILURE);
+	}
+	job->points = cloud->size;
+	point_cloud_free(&cloud);
+	free(job->clouds);
+	job->clouds = NULL;
+	zone_free(&(job->zones));
+	tree_free(&(job->tree));
+}
+
+static void batch_convert(void *arg) {
+	BatchTask *task = (BatchTask *) arg;
+	int i;
+	for (i = 0; i < task->size; i++) {
+		BatchJob *job = task->items[i].job;
+		int leaf = task->items[i].leaf;
+		shape_seed(job->seed + (unsigned int) leaf * BATCH_LEAF_SEED);
+		job->clouds[leaf] = zone_leaf_to_point_cloud(job->zones, leaf, job->density);
+		if (__sync_sub_and_fetch(&(job->remaining), 1) == 0)
+			batch_finish(job);
+	}
+}
+
+void batch_run(const char *manifest, int threads) {
+	assert(NULL != manifest);
+	assert(threads >= 0);
+	if (threads == 0) {
+		long online = sysconf(_SC_NPROCESSORS_ONLN);
+		threads = (online > 0) ? (int) online : 1;
+	}
+	double start = chrono_now();
+	int i, j, jobs_size, items_size = 0, tasks_size = 0;
+	BatchJob *jobs = batch_parse(manifest, &jobs_size);
+	for (i = 0; i < jobs_size; i++) {
+		jobs[i].tree = scene_open(jobs[i].scene);
+		jobs[i].zones = zone_build(jobs[i].tree);
+		jobs[i].remaining = jobs[i].zones->size;
+		if (NULL == (jobs[i].clouds = (PointCloud **) malloc(jobs[i].zones->size * sizeof(PointCloud *)))) {
+			fprintf(stderr, "memory allocation error (line %d file %s)\n", __LINE__, __FILE__);
+			exit(EXIT_FAILURE);
+		}
+		items_size += jobs[i].zones->size;
+	}
+	double loaded = chrono_now();
+	BatchItem *items = NULL;
+	BatchTask *tasks = NULL;
+	if (NULL == (items = (BatchItem *) malloc(items_size * sizeof(BatchItem)))
+	|| NULL == (tasks = (BatchTask *) malloc(items_size * sizeof(BatchTask)))) {
+		fprintf(stderr, "memory allocation error (line %d file %s)\n", __LINE__, __FILE__);
+		exit(EXIT_FAILURE);
+	}
+	double total = 0;
+	items_size = 0;
+	for (i = 0; i < jobs_size; i++) {
+		for (j = 0; j < jobs[i].zones->size; j++) {
+			const ZoneLeaf *leaf = jobs[i].zones->leaves + j;
+			items[items_size].job = jobs + i;
+			items[items_size].leaf = j;
+			items[items_size].cost = leaf->empty ? 1 : 1 + shape_area(leaf->shape) * jobs[i].density * (1 + leaf->constraints);
+			total += items[items_size].cost;
+			items_size++;
+		}
+	}
+	double target = total / (threads * BATCH_TASKS_PER_THREAD), cost = 0;
+	for (i = 0; i < items_size; i++) {
+		if (i == 0 || cost >= target) {
+			tasks[tasks_size].items = items + i;
+			tasks[tasks_size].size = 0;
+			tasks_size++;
+			cost = 0;
+		}
+		tasks[tasks_size - 1].size++;
+		cost += items[i].cost;
+	}
+	ThreadPool *pool = pool_allocate(threads);
+	for (i = 0; i < tasks_size; i++) {
+		pool_submit(pool, batch_convert, tasks + i);
+	}
+	pool_wait(pool);
+	pool_free(&pool);
+	double end = chrono_now();
+	unsigned long points = 0;
+	for (i = 0; i < jobs_size; i++) {
+		points += jobs[i].points;
+		free(jobs[i].scene);
+		free(jobs[i].output);
+	}
+	printf("jobs %d, leaves %d, tasks %d, threads %d\n", jobs_size, items_size, tasks_size, threads);
+	printf("load %.3f s, conversion %.3f s, total %.3f s\n", loaded - start, end - loaded, end - start);
+	printf("points %lu, %.0f points/s, %.2f jobs/s\n", points, points / (end - loaded), jobs_size / (end - start));
+	free(tasks);
+	free(items);
+	free(jobs);
+}
@@ -0,0 +1,178 @@
+#include "cache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#define CACHE_INITIAL_BUCKETS (64)
+
+unsigned long cache_hash(const void *key, size_t key_size) {
+	assert(NULL != key);
+	const unsigned char *p = (const unsigned char *) key;
+	unsigned long hash = 14695981039346656037UL;
+	size_t i;
+	for (i = 0; i < key_size; i++) {
+		hash ^= p[i];
+		hash *= 1099511628211UL;
+	}
+	return hash;
+}
+
+Cache * cache_allocate(size_t capacity, void (*release)(void *)) {
+	assert(NULL != release);
+	Cache *cache = NULL;
+	if (NULL == (cache = (Cache *) malloc(sizeof(Cache)))) {
+		fprintf(stderr, "memory allocation error (line %d file %s)\n", __LINE__, __FILE__);
+		exit(EXIT_FAILURE);
+	}
+	if (NULL == (cache->buckets = (CacheEntry **) calloc(CACHE_INITIAL_BUCKETS, sizeof(CacheEntry *)))) {
+		fprintf(stderr, "memory allocation error (line %d file %s)\n", __LINE__, __FILE__);
+		exit(EXIT_FAILURE);
+	}
+	cache->buckets_size = CACHE_INITIAL_BUCKETS;
+	cache->size = 0;
+	cache->newest = NULL;
+	cache->oldest = NULL;
+	cache->capacity = capacity;
+	cache->used = 0;
+	cache->release = release;
+	cache->hits = 0;
+	cache->misses = 0;
+	return cache;
+}
+
+static void cache_unlink(Cache *cache, CacheEntry *entry) {
+	assert(NULL != cache);
+	assert(NULL != entry);
+	if (NULL != entry->newer)
+		entry->newer->older = entry->older;
+	else
+		cache->newest = entry->older;
+	if (NULL != entry->older)
+		entry->older->newer = entry->newer;
+	else
+		cache->oldest = entry->newer;
+	entry->newer = entry->older = NULL;
+}
+
+static void cache_link(Cache *cache, CacheEntry *entry) {
+	assert(NULL != cache);
+	assert(NULL != entry);
+	entry->newer = NULL;
+	entry->older = cache->newest;
+	if (NULL != cache->newest)
+		cache->newest->newer = entry;
+	cache->newest = entry;
+	if (NULL == cache->oldest)
+		cache->oldest = entry;
+}
+
+static CacheEntry ** cache_find(Cache *cache, const void *key, size_t key_size, unsigned long hash) {
+	assert(NULL != cache);
+	CacheEntry **slot = cache->buckets + (hash & (cache->buckets_size - 1));
+	while (NULL != *slot) {
+		if ((*slot)->hash == hash && (*slot)->key_size == key_size && memcmp((*slot)->key, key, key_size) == 0)
+			break;
+		slot = &((*slot)->next);
+	}
+	return slot;
+}
+
+static void cache_remove(Cache *cache, CacheEntry **slot) {
+	assert(NULL != cache);
+	assert(NULL != slot);
+	CacheEntry *entry = *slot;
+	*slot = entry->next;
+	cache_unlink(cache, entry);
+	cache->used -= entry->size + entry->key_size;
+	cache->size--;
+	cache->release(entry->value);
+	free(entry->key);
+	free(entry);
+}
+
+static void cache_rehash(Cache *cache) {
+	assert(NULL != cache);
+	int size = 2*cache->buckets_size, i;
+	CacheEntry **buckets = NULL;
+	if (NULL == (buckets = (CacheEntry **) calloc(size, sizeof(CacheEntry *)))) {
+		fprintf(stderr, "memory allocation error (line %d file %s)\n", __LINE__, __FILE__);
+		exit(EXIT_FAILURE);
+	}
+	for (i = 0; i < cache->buckets_size; i++) {
+		CacheEntry *entry = cache->buckets[i];
+		while (NULL != entry) {
+			CacheEntry *next = entry->next;
+			entry->next = buckets[entry->hash & (size - 1)];
+			buckets[entry->hash & (size - 1)] = entry;
+			entry = next;
+		}
+	}
+	free(cache->buckets);
+	cache->buckets = buckets;
+	cache->buckets_size = size;
+}
+
+void * cache_get(Cache *cache, const void *key, size_t key_size) {
+	assert(NULL != cache);
+	assert(NULL != key);
+	CacheEntry **slot = cache_find(cache, key, key_size, cache_hash(key, key_size));
+	if (NULL == *slot) {
+		cache->misses++;
+		return NULL;
+	}
+	cache->hits++;
+	cache_unlink(cache, *slot);
+	cache_link(cache, *slot);
+	return (*slot)->value;
+}
+
+int cache_put(Cache *cache, const void *key, size_t key_size, void *value, size_t size) {
+	assert(NULL != cache);
+	assert(NULL != key);
+	assert(NULL != value);
+	unsigned long hash = cache_hash(key, key_size);
+	CacheEntry **slot = cache_find(cache, key, key_size, hash);
+	if (NULL != *slot)
+		cache_remove(cache, slot);
+	if (size + key_size > cache->capacity) {
+		cache->release(value);
+		return 0;
+	}
+	CacheEntry *entry = NULL;
+	if (NULL == (entry = (CacheEntry *) malloc(sizeof(CacheEntry))) || NULL == (entry->key = malloc(key_size > 0 ? key_size : 1))) {
+		fprintf(stderr, "memory allocation error (line %d file %s)\n", __LINE__, __FILE__);
+		exit(EXIT_FAILURE);
+	}
+	memcpy(entry->key, key, key_size);
+	entry->key_size = key_size;
+	entry->hash = hash;
+	entry->value = value;
+	entry->size = size;
+	while (cache->used + size + key_size > cache->capacity) {
+		CacheEntry *oldest = cache->oldest;
+		cache_remove(cache, cache_find(cache, oldest->key, oldest->key_size, oldest->hash));
+	}
+	if (cache->size >= cache->buckets_size)
+		cache_rehash(cache);
+	slot = cache->buckets + (hash & (cache->buckets_size - 1));
+	entry->next = *slot;
+	*slot = entry;
+	cache_link(cache, entry);
+	cache->used += size + key_size;
+	cache->size++;
+	return 1;
+}
+
+void cache_free(Cache **cache) {
+	assert(NULL != cache);
+	assert(NULL != *cache);
+	while (NULL != (*cache)->oldest) {
+		CacheEntry *oldest = (*cache)->oldest;
+		cache_remove(*cache, cache_find(*cache, oldest->key, oldest->key_size, oldest->hash));
+	}
+	free((*cache)->buckets);
+	free(*cache);
+	*cache = NULL;
+}
@@ -0,0 +1,11 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "chrono.h"
+
+#include <time.h>
+
+double chrono_now(void) {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec*1e-9;
+}
@@ -1,8 +1,25 @@
 #include "tree.h"
 #include "parser.h"
+#include "scene.h"
+#include "zone.h"
+#include "server.h"
+#include "batch.h"
+#include "animation.h"
+#include "view.h"
+#include "morton.h"
+#include "stream.h"
+#include "refine.h"
+#include "progressive.h"
+#include "pyramid.h"
+#include "sample.h"
+#include "raycast.h"
+#include "jit.h"
+#include "chrono.h"
 #include "point_cloud.h"
 #include <GL/glut.h>
+#include <GL/freeglut_ext.h>
 #include <time.h>
+#include <limits.h>
 
 #define WINDOW_WIDTH (768)
 #define WINDOW_HEIGHT (512)
@@ -11,6 +28,7 @@
 #define BGCOLOR_B (0.22)
 #define DISTANCE_NEAR (0.1)
 #define DISTANCE_FAR (1000.0)
+#define FIELD_OF_VIEW (60.0)
 #define CAMERA_X (0)
 #define CAMERA_Y (-3)
 #define CAMERA_Z (2)
@@ -27,15 +45,40 @@
 #define MEDIUM_DENSITY (20000)
 #define HIGH_TOKEN ("high")
 #define HIGH_DENSITY (100000)
+#define COMPILE_TOKEN ("--compile")
+#define SERVE_TOKEN ("--serve")
+#define BATCH_TOKEN ("--batch")
+#define STREAM_TOKEN ("--stream")
+#define STREAM_STDOUT ("-")
+#define ANIMATE_TOKEN ("--animate")
+#define VIEW_TOKEN ("--view")
+#define VISIBLE_TOKEN ("--visible")
+#define MORTON_TOKEN ("--morton")
+#define DEADLINE_TOKEN ("--deadline")
+#define PROGRESSIVE_TOKEN ("--progressive")
+#define PROGRESSIVE_FIRST_DENSITY (LOW_DENSITY)
+#define PROGRESSIVE_POLL (20)
+#define PYRAMID_TOKEN ("--pyramid")
+#define SHARE_TOKEN ("--share")
+#define VOXEL_TOKEN ("--voxel")
+#define JIT_TOKEN ("--jit")
+#define REORDER_TOKEN ("--reorder")
+#define REORDER_PILOT_RATIO (16)
+#define RAYCAST_TOKEN ("--raycast")
+#define RAYS_TOKEN ("--rays")
+#define RAYCAST_COVERAGE (0.99)
+#define RAYCAST_MAX_DENSITY (1 << 24)
+#define RAYCAST_MIN_POINTS_PER_PIXEL (0.25)
+#define RAYCAST_MAX_POINTS_PER_PIXEL (64.0)
+#define ANIMATE_SPEED (1.0)
+#define ANIMATE_TARGET_FPS (30)
 
-PointCloud *points_scene = NULL;
-
-void display() {
+void draw(const PointCloud *points_scene) {
     glMatrixMode(GL_PROJECTION);
     glLoadIdentity();
     double w = glutGet(GLUT_WINDOW_WIDTH);
     double h = glutGet(GLUT_WINDOW_HEIGHT);
-    gluPerspective(60.0, w/h, DISTANCE_NEAR, DISTANCE_FAR);
+    gluPerspective(FIELD_OF_VIEW, w/h, DISTANCE_NEAR, DISTANCE_FAR);
     glMatrixMode(GL_MODELVIEW);
     glLoadIdentity();
     gluLookAt(
@@ -49,6 +92,10 @@ void display() {
     glutSwapBuffers();
 }
 
+void display() {
+	draw((const PointCloud *) glutGetWindowData());
+}
+
 void init() {
 	GLfloat black[] = {0.2, 0.2, 0.2, 1};
 	GLfloat white[] = {0.75, 0.75, 0.75, 1};
@@ -63,47 +110,513 @@ void init() {
 	glDisable(GL_NORMALIZE);
 }
 
-int main (int argc, char *argv[]) {
+void compile_scene(const char *filescene, const char *filecompiled) {
+	Tree scene = scene_open(filescene);
+	FILE *f = NULL;
+	if (NULL == (f = fopen(filecompiled, "wb"))) {
+		fprintf(stderr, "can not open file '%s'\n", filecompiled);
+		exit(EXIT_FAILURE);
+	}
+	scene_compile(scene, f);
+	if (0 != fclose(f)) {
+		fprintf(stderr, "can not write file '%s'\n", filecompiled);
+		exit(EXIT_FAILURE);
+	}
+	tree_free(&scene);
+}
+
+int parse_density(const char *token) {
+	if (strcmp(token,LOW_TOKEN) == 0)
+		return LOW_DENSITY;
+	if (strcmp(token,MEDIUM_TOKEN) == 0)
+		return MEDIUM_DENSITY;
+	if (strcmp(token,HIGH_TOKEN) == 0)
+		return HIGH_DENSITY;
+	fprintf(stderr, "error bad value for argument density\ndensity : %s | %s | %s\n", LOW_TOKEN, MEDIUM_TOKEN, HIGH_TOKEN);
+	exit(EXIT_FAILURE);
+}
 
-	if (argc != 3) {
-		fprintf(stderr, "error bad arguments\nusage : %s scene_file density\n", argv[0]);
+int parse_threads(const char *token) {
+	char *end = NULL;
+	long threads = strtol(token, &end, 10);
+	if (end == token || *end != '\0' || threads < 0 || threads > INT_MAX) {
+		fprintf(stderr, "error bad value for argument threads\nthreads : 0 for one thread per processor, or a positive number of threads\n");
 		exit(EXIT_FAILURE);
 	}
+	return (int) threads;
+}
 
-	char *filescene = argv[1];
+int parse_deadline(const char *token) {
+	char *end = NULL;
+	long deadline = strtol(token, &end, 10);
+	if (end == token || *end != '\0' || deadline <= 0 || deadline > INT_MAX) {
+		fprintf(stderr, "error bad value for argument deadline\nms : a positive time budget in milliseconds\n");
+		exit(EXIT_FAILURE);
+	}
+	return (int) deadline;
+}
 
-	int density;
-	if (strcmp(argv[2],LOW_TOKEN) == 0) {
-		density = LOW_DENSITY;
-	} else if (strcmp(argv[2],MEDIUM_TOKEN) == 0) {
-		density = MEDIUM_DENSITY;
-	} else if (strcmp(argv[2],HIGH_TOKEN) == 0) {
-		density = HIGH_DENSITY;
-	} else {
-		fprintf(stderr, "error bad value for argument density\ndensity : %s | %s | %s\n", LOW_TOKEN, MEDIUM_TOKEN, HIGH_TOKEN);
+int parse_node(const char *token, int nodes) {
+	char *end = NULL;
+	long node = strtol(token, &end, 10);
+	if (end == token || *end != '\0' || node < 0 || node >= nodes) {
+		fprintf(stderr, "error bad value for argument node\nnode : 0 to %d\n", nodes - 1);
 		exit(EXIT_FAILURE);
 	}
+	return (int) node;
+}
+
+int parse_frames(const char *token) {
+	char *end = NULL;
+	long frames = strtol(token, &end, 10);
+	if (end == token || *end != '\0' || frames <= 0 || frames > INT_MAX) {
+		fprintf(stderr, "error bad value for argument frames\nframes : a positive number of frames\n");
+		exit(EXIT_FAILURE);
+	}
+	return (int) frames;
+}
+
+void stream_scene(const char *output, const char *filescene, int density) {
+	Tree scene = scene_open(filescene);
+	Zones *zones = zone_build(scene);
+	FILE *f = stdout;
+	if (strcmp(output,STREAM_STDOUT) != 0 && NULL == (f = fopen(output, "wb"))) {
+		fprintf(stderr, "can not open file '%s'\n", output);
+		exit(EXIT_FAILURE);
+	}
+	StreamStatistics statistics;
+	int written = stream_write(zones, density, (unsigned int) time(NULL), f, &statistics);
+	if (f != stdout && 0 != fclose(f))
+		written = 0;
+	fprintf(stderr, "%lu chunks, %lu points, first chunk %.3f s, total %.3f s, %.0f points/s, %lu stalls\n",
+		statistics.chunks, statistics.points, statistics.first_chunk, statistics.total,
+		statistics.total > 0 ? statistics.points / statistics.total : 0., statistics.stalls);
+	zone_free(&zones);
+	tree_free(&scene);
+	if (!written) {
+		fprintf(stderr, "can not write stream '%s'\n", output);
+		exit(EXIT_FAILURE);
+	}
+}
+
+void raycast_scene(const char *filescene, const char *output, int threads) {
+	Tree scene = scene_open(filescene);
+	View view = {
+		{CAMERA_X, CAMERA_Y, CAMERA_Z},
+		{CAMERA_TARGET_X, CAMERA_TARGET_Y, CAMERA_TARGET_Z},
+		{0, 0, 1},
+		FIELD_OF_VIEW, DISTANCE_NEAR, WINDOW_WIDTH, WINDOW_HEIGHT
+	};
+	RaycastImage *image = raycast_render(scene, &view, threads);
+	FILE *f = NULL;
+	if (NULL == (f = fopen(output, "wb"))) {
+		fprintf(stderr, "can not open file '%s'\n", output);
+		exit(EXIT_FAILURE);
+	}
+	int written = raycast_write(image, f);
+	if (0 != fclose(f) || !written) {
+		fprintf(stderr, "can not write file '%s'\n", output);
+		exit(EXIT_FAILURE);
+	}
+	int pixels = image->width * image->height;
+	printf("ray casting : %d pixels, %lu on a surface, %.3f s, %.0f pixels/s\n",
+		pixels, image->hits, image->time, image->time > 0 ? pixels / image->time : 0.);
+	fflush(stdout);
+	Zones *zones = zone_build(scene);
+	double points_per_pixel, coverage = 0, seconds = 0;
+	for (points_per_pixel = RAYCAST_MIN_POINTS_PER_PIXEL; points_per_pixel <= RAYCAST_MAX_POINTS_PER_PIXEL && coverage < RAYCAST_COVERAGE; points_per_pixel *= 2) {
+		double start = chrono_now();
+		PointCloud *cloud = view_to_point_cloud(&view, zones, RAYCAST_MAX_DENSITY, points_per_pixel);
+		seconds = chrono_now() - start;
+		coverage = raycast_coverage(image, &view, cloud);
+		printf("points : %.2f points per pixel, %d points, %.1f%% of the surface pixels covered, %.3f s, %.0f pixels/s\n",
+			points_per_pixel, cloud->size, 100. * coverage, seconds, seconds > 0 ? pixels / seconds : 0.);
+		fflush(stdout);
+		point_cloud_free(&cloud);
+	}
+	if (coverage >= RAYCAST_COVERAGE)
+		printf("equal quality : ray casting %.1f times %s than the point conversion, drawing the points not counted\n",
+			(seconds > image->time) ? seconds / image->time : image->time / seconds, (seconds > image->time) ? "faster" : "slower");
+	else
+		printf("equal quality : the point conversion does not cover %.0f%% of the surface pixels\n", 100. * RAYCAST_COVERAGE);
+	zone_free(&zones);
+	raycast_free(&image);
+	tree_free(&scene);
+}
+
+void print_rejection(const Zones *zones, int density) {
+	unsigned long sampled = 0, kept = 0;
+	int i;
+	clock_t start = clock();
+	for (i = 0; i < zones->size; i++) {
+		const ZoneLeaf *l = zones->leaves + i;
+		if (l->empty)
+			continue;
+		PointCloud *cloud = shape_to_point_cloud(l->shape, density, l->transformations, l->norm_transformations);
+		sampled += cloud->size;
+		zone_leaf_select(zones, i, cloud);
+		kept += cloud->size;
+		point_cloud_free(&cloud);
+	}
+	printf("rejection sampling : %lu samples, %lu points, %.2f wasted samples per kept point, %.3f s of processor time\n",
+		sampled, kept, kept > 0 ? (double) (sampled - kept) / kept : 0., (double) (clock() - start) / CLOCKS_PER_SEC);
+	fflush(stdout);
+}
+
+void print_samples(SampleCache *samples, clock_t start) {
+	printf("shared samples : %lu leaves sampled, %lu served from the cache (%.0f%% hit rate), conversion in %.3f s of processor time\n",
+		samples->sampled, samples->shared, 100. * sample_hit_rate(samples), (double) (clock() - start) / CLOCKS_PER_SEC);
+	fflush(stdout);
+	sample_cache_free(&samples);
+}
+
+void print_voxels(void) {
+	TreeStatistics statistics;
+	tree_statistics(&statistics);
+	printf("membership grids : %lu lookups, %.0f%% answered without testing the subtrees\n",
+		statistics.voxel_lookups, statistics.voxel_lookups > 0 ? 100. * statistics.voxel_hits / statistics.voxel_lookups : 0.);
+	fflush(stdout);
+}
+
+int progressive_started = 0;
+int progressive_drawn = -1;
+
+void display_progressive() {
+	Progressive *progressive = (Progressive *) glutGetWindowData();
+	draw(progressive->front);
+	if (progressive->front_level > progressive_drawn) {
+		int drawn = glutGet(GLUT_ELAPSED_TIME);
+		if (progressive_drawn < 0)
+			printf("time to first frame %d ms\n", drawn);
+		printf("density %d (%d of %d) : %d points, generated after %.0f ms, drawn after %d ms\n",
+			progressive->front_density, progressive->front_level + 1, progressive->levels, progressive->front->size,
+			progressive_started + 1e3 * progressive->front_time, drawn);
+		fflush(stdout);
+		progressive_drawn = progressive->front_level;
+	}
+}
+
+void poll_progressive(int value) {
+	Progressive *progressive = (Progressive *) glutGetWindowData();
+	if (progressive_update(progressive))
+		glutPostRedisplay();
+	if (progressive->front_level < progressive->levels - 1)
+		glutTimerFunc(PROGRESSIVE_POLL, poll_progressive, value);
+}
+
+int pyramid_shown = 0;
+
+void display_pyramid() {
+	PointCloud prefix;
+	pyramid_level((const Pyramid *) glutGetWindowData(), pyramid_shown, &prefix);
+	draw(&prefix);
+}
+
+void keyboard_pyramid(unsigned char key, int x, int y) {
+	const Pyramid *pyramid = (const Pyramid *) glutGetWindowData();
+	if (key < '1' || key >= '1' + pyramid->levels || key - '1' == pyramid_shown)
+		return;
+	pyramid_shown = key - '1';
+	printf("density %d : %d points\n", pyramid->densities[pyramid_shown], pyramid->sizes[pyramid_shown]);
+	fflush(stdout);
+	glutPostRedisplay();
+}
+
+int animated_node = 0;
+int animated_time = 0;
+
+void idle() {
+	Animation *animation = (Animation *) glutGetWindowData();
+	int time = glutGet(GLUT_ELAPSED_TIME);
+	animation_rotate(animation, animated_node, 0, 0, ANIMATE_SPEED * (time - animated_time) / 1000.);
+	animated_time = time;
+	glutPostRedisplay();
+}
+
+void display_animation() {
+	draw(((const Animation *) glutGetWindowData())->point_cloud);
+}
+
+void benchmark_animation(Tree scene, int density, int node, int frames) {
+	unsigned int seed = shape_random();
+	shape_seed(seed);
+	clock_t start = clock();
+	Animation *animation = animation_allocate(scene, density);
+	double setup = (double) (clock() - start) / CLOCKS_PER_SEC;
+	double transformed = 0, classified = 0;
+	int i;
+	start = clock();
+	for (i = 0; i < frames; i++) {
+		animation_rotate(animation, node, 0, 0, 2 * PI / frames);
+		transformed += animation->transformed;
+		classified += animation->classified;
+	}
+	double incremental = (double) (clock() - start) / CLOCKS_PER_SEC;
+	int size = animation->point_cloud->size;
+	Tree moved = animation->nodes[node].tree;
+	animation_free(&animation);
+	start = clock();
+	for (i = 0; i < frames; i++) {
+		tree_rotation(moved, 0, 0, 2 * PI / frames);
+		shape_seed(seed);
+		PointCloud *cloud = tree_to_point_cloud(scene, density);
+		if (i == frames - 1)
+			printf("points %d, rebuilt %d\n", size, cloud->size);
+		point_cloud_free(&cloud);
+	}
+	double rebuild = (double) (clock() - start) / CLOCKS_PER_SEC;
+	printf("setup %.3f s\n", setup);
+	printf("incremental %.1f fps, %.0f samples transformed and %.0f classified per frame\n", frames / incremental, transformed / frames, classified / frames);
+	printf("rebuild %.1f fps\n", frames / rebuild);
+	printf("target %d fps %s\n", ANIMATE_TARGET_FPS, (frames / incremental >= ANIMATE_TARGET_FPS) ? "met" : "missed");
+}
+
+int main (int argc, char *argv[]) {
+
+	if (argc == 4 && strcmp(argv[1],COMPILE_TOKEN) == 0) {
+		compile_scene(argv[2], argv[3]);
+		return EXIT_SUCCESS;
+	}
+
+	if (argc == 3 && strcmp(argv[1],SERVE_TOKEN) == 0) {
+		server_run(argv[2], SERVER_TREE_CAPACITY, SERVER_CLOUD_CAPACITY);
+		return EXIT_SUCCESS;
+	}
+
+	if ((argc == 3 || argc == 4) && strcmp(argv[1],BATCH_TOKEN) == 0) {
+		batch_run(argv[2], (argc == 4) ? parse_threads(argv[3]) : 0);
+		return EXIT_SUCCESS;
+	}
+
+	if (argc == 5 && strcmp(argv[1],STREAM_TOKEN) == 0) {
+		stream_scene(argv[2], argv[3], parse_density(argv[4]));
+		return EXIT_SUCCESS;
+	}
+
+	if ((argc == 4 || argc == 5) && strcmp(argv[1],RAYCAST_TOKEN) == 0) {
+		raycast_scene(argv[2], argv[3], (argc == 5) ? parse_threads(argv[4]) : 0);
+		return EXIT_SUCCESS;
+	}
+
+	int animate = (argc == 5 || argc == 6) && strcmp(argv[1],ANIMATE_TOKEN) == 0;
+
+	int view_dependent = 0, visible = 0, morton = 0, deadline = -1, progressive = 0, pyramid = 0, share = 0, rays = 0, voxel = 0, compile = 0, reorder = 0, i;
+	for (i = 3; !animate && i < argc; i++) {
+		if (strcmp(argv[i],VIEW_TOKEN) == 0) {
+			view_dependent = 1;
+		} else if (strcmp(argv[i],VISIBLE_TOKEN) == 0) {
+			visible = 1;
+		} else if (strcmp(argv[i],MORTON_TOKEN) == 0) {
+			morton = 1;
+		} else if (strcmp(argv[i],DEADLINE_TOKEN) == 0 && i + 1 < argc) {
+			deadline = parse_deadline(argv[++i]);
+		} else if (strcmp(argv[i],PROGRESSIVE_TOKEN) == 0) {
+			progressive = 1;
+		} else if (strcmp(argv[i],PYRAMID_TOKEN) == 0) {
+			pyramid = 1;
+		} else if (strcmp(argv[i],SHARE_TOKEN) == 0) {
+			share = 1;
+		} else if (strcmp(argv[i],RAYS_TOKEN) == 0) {
+			rays = 1;
+		} else if (strcmp(argv[i],VOXEL_TOKEN) == 0) {
+			voxel = 1;
+		} else if (strcmp(argv[i],JIT_TOKEN) == 0) {
+			compile = 1;
+		} else if (strcmp(argv[i],REORDER_TOKEN) == 0) {
+			reorder = 1;
+		} else {
+			break;
+		}
+	}
+
+	if ((argc < 3 || i < argc || (deadline >= 0 && (view_dependent || visible)) || (progressive && (view_dependent || visible || deadline >= 0))
+		|| (pyramid && (view_dependent || visible || deadline >= 0 || progressive))
+		|| (share && (view_dependent || visible || progressive))
+		|| (rays && (view_dependent || visible || deadline >= 0 || progressive || pyramid || share))) && !animate) {
+		fprintf(stderr, "error bad arguments\nusage : %s scene_file density [%s] [%s] [%s] [%s ms] [%s] [%s] [%s] [%s] [%s] [%s] [%s]\n       %s %s scene_file compiled_file\n       %s %s socket_path\n       %s %s manifest_file [threads]\n       %s %s scene_file density node [frames]\n       %s %s output_file|%s scene_file density\n       %s %s scene_file image_file [threads]\n", argv[0], VIEW_TOKEN, VISIBLE_TOKEN, MORTON_TOKEN, DEADLINE_TOKEN, PROGRESSIVE_TOKEN, PYRAMID_TOKEN, SHARE_TOKEN, RAYS_TOKEN, VOXEL_TOKEN, JIT_TOKEN, REORDER_TOKEN, argv[0], COMPILE_TOKEN, argv[0], SERVE_TOKEN, argv[0], BATCH_TOKEN, argv[0], ANIMATE_TOKEN, argv[0], STREAM_TOKEN, STREAM_STDOUT, argv[0], RAYCAST_TOKEN);
+		exit(EXIT_FAILURE);
+	}
+
+	char *filescene = animate ? argv[2] : argv[1];
+
+	int density = parse_density(animate ? argv[3] : argv[2]);
 
 	#ifndef NDEBUG
 	printf("Debug mode\n");
 	#endif
 
-	srand(time(NULL));
+	shape_seed(time(NULL));
 
-	FILE *f = NULL;
-	if (NULL == (f = fopen(filescene, "r"))) {
-		fprintf(stderr, "can not open file '%s'\n", filescene);
-		exit(EXIT_FAILURE);
+	Tree scene = scene_open(filescene);
+
+	if (animate) {
+		Animation *animation = animation_allocate(scene, density);
+		animated_node = parse_node(argv[4], animation->nodes_size);
+		if (argc == 6) {
+			int frames = parse_frames(argv[5]);
+			animation_free(&animation);
+			benchmark_animation(scene, density, animated_node, frames);
+			tree_free(&scene);
+			return EXIT_SUCCESS;
+		}
+		glutInit(&argc, argv);
+		glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH);
+		glutInitWindowSize(WINDOW_WIDTH, WINDOW_HEIGHT);
+		glutCreateWindow(WINDOW_NAME);
+		glutSetWindowData(animation);
+		init();
+		glutDisplayFunc(display_animation);
+		glutIdleFunc(idle);
+		animated_time = glutGet(GLUT_ELAPSED_TIME);
+		glutMainLoop();
+		animation_free(&animation);
+		tree_free(&scene);
+		return EXIT_SUCCESS;
 	}
-	Tree scene = parse_tree(f);
-	fclose(f);
 
-	points_scene = tree_to_point_cloud(scene, density);
+	if (reorder) {
+		int pilot = (density / REORDER_PILOT_RATIO > 0) ? density / REORDER_PILOT_RATIO : 1;
+		clock_t start = clock();
+		tree_optimize(scene, pilot);
+		printf("reordered subtrees : pilot conversion at density %d in %.3f s of processor time\n", pilot, (double) (clock() - start) / CLOCKS_PER_SEC);
+		fflush(stdout);
+	}
+
+	if (voxel) {
+		clock_t start = clock();
+		size_t bytes = tree_voxelize(scene, TREE_VOXEL_DEPTH, TREE_VOXEL_CAPACITY);
+		printf("membership grids : %lu kB built in %.3f s of processor time\n", (unsigned long) (bytes / 1024), (double) (clock() - start) / CLOCKS_PER_SEC);
+		fflush(stdout);
+	}
+
+	Jit *jit = NULL;
+	if (compile) {
+		double start = chrono_now();
+		if (NULL != (jit = jit_compile(scene)))
+			printf("compiled point belonging tests : %s in %.3f s\n", jit->cached ? "loaded from the cache" : "compiled", chrono_now() - start);
+		else
+			printf("compiled point belonging tests : compilation failed, the tree stays interpreted\n");
+		fflush(stdout);
+	}
+
+	if (progressive) {
+		glutInit(&argc, argv);
+		glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH);
+		glutInitWindowSize(WINDOW_WIDTH, WINDOW_HEIGHT);
+		glutCreateWindow(WINDOW_NAME);
+		init();
+		progressive_started = glutGet(GLUT_ELAPSED_TIME);
+		Progressive *conversion = progressive_start(scene, PROGRESSIVE_FIRST_DENSITY, density, shape_random(), morton);
+		glutSetWindowData(conversion);
+		glutDisplayFunc(display_progressive);
+		glutTimerFunc(PROGRESSIVE_POLL, poll_progressive, 0);
+		glutMainLoop();
+		progressive_free(&conversion);
+		if (NULL != jit)
+			jit_free(&jit);
+		tree_free(&scene);
+		return EXIT_SUCCESS;
+	}
+
+	Zones *zones = zone_build(scene);
+	clock_t convert_start = clock();
+	if (share)
+		zones->samples = sample_cache_allocate(SAMPLE_CAPACITY, shape_random());
+	if (pyramid) {
+		int densities[] = {LOW_DENSITY, MEDIUM_DENSITY, HIGH_DENSITY};
+		int levels = 0;
+		while (levels < 3 && densities[levels] <= density) {
+			levels++;
+		}
+		clock_t start = clock();
+		Pyramid *points_pyramid = pyramid_build(zones, densities, levels, morton);
+		printf("multi-resolution point cloud built in %.3f s of processor time, keys 1 to %d :", (double) (clock() - start) / CLOCKS_PER_SEC, levels);
+		for (i = 0; i < levels; i++) {
+			printf(" density %d (%d points)%s", densities[i], points_pyramid->sizes[i], (i < levels - 1) ? "," : "\n");
+		}
+		fflush(stdout);
+		if (voxel)
+			print_voxels();
+		if (share)
+			print_samples(zones->samples, convert_start);
+		zone_free(&zones);
+		if (NULL != jit)
+			jit_free(&jit);
+		pyramid_shown = levels - 1;
+		glutInit(&argc, argv);
+		glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH);
+		glutInitWindowSize(WINDOW_WIDTH, WINDOW_HEIGHT);
+		glutCreateWindow(WINDOW_NAME);
+		glutSetWindowData(points_pyramid);
+		init();
+		glutDisplayFunc(display_pyramid);
+		glutKeyboardFunc(keyboard_pyramid);
+		glutMainLoop();
+		pyramid_free(&points_pyramid);
+		tree_free(&scene);
+		return EXIT_SUCCESS;
+	}
+
+	PointCloud *points_scene = NULL;
+	View view = {
+		{CAMERA_X, CAMERA_Y, CAMERA_Z},
+		{CAMERA_TARGET_X, CAMERA_TARGET_Y, CAMERA_TARGET_Z},
+		{0, 0, 1},
+		FIELD_OF_VIEW, DISTANCE_NEAR, WINDOW_WIDTH, WINDOW_HEIGHT
+	};
+	if (visible) {
+		ViewStatistics statistics;
+		points_scene = view_visible_point_cloud(&view, zones, density, view_dependent ? VIEW_POINTS_PER_PIXEL : 0, &statistics);
+		printf("visibility-aware sampling : %lu samples, %lu back-facing, %lu outside the active zones, %lu occluded, %lu points\n",
+			statistics.sampled, statistics.back_facing, statistics.classified_out, statistics.occluded, statistics.kept);
+		fflush(stdout);
+	} else if (view_dependent) {
+		double uniform = 0, sampled = 0;
+		for (i = 0; i < zones->size; i++) {
+			if (zones->leaves[i].empty)
+				continue;
+			uniform += shape_area(zones->leaves[i].shape) * density;
+			sampled += shape_area(zones->leaves[i].shape) * view_leaf_density(&view, zones, i, density, VIEW_POINTS_PER_PIXEL);
+		}
+		points_scene = view_to_point_cloud(&view, zones, density, VIEW_POINTS_PER_PIXEL);
+		printf("view-dependent sampling : %d points, %.0f samples instead of %.0f\n", points_scene->size, sampled, uniform);
+		fflush(stdout);
+	} else if (deadline >= 0) {
+		RefineStatistics statistics;
+		points_scene = refine_to_point_cloud(zones, density, deadline / 1000., &statistics);
+		printf("deadline %d ms : %d of %d passes in %.0f ms, density %d of %d (%.0f%%), %d points, %lu points of an interrupted pass thrown away\n",
+			deadline, statistics.passes, statistics.planned, 1e3 * statistics.time, statistics.density, density,
+			100. * statistics.density / density, points_scene->size, statistics.discarded);
+		fflush(stdout);
+	} else if (rays) {
+		RaycastStatistics statistics;
+		points_scene = raycast_to_point_cloud(scene, density, &statistics);
+		printf("ray sampling : %lu rays, %lu crossings of the leaves, %lu on the surface, %lu points, %.2f wasted samples per kept point, %.3f s\n",
+			statistics.rays, statistics.endpoints, statistics.hits, statistics.kept,
+			statistics.kept > 0 ? (double) (statistics.endpoints - statistics.kept) / statistics.kept : 0., statistics.time);
+		print_rejection(zones, density);
+	} else {
+		points_scene = zone_to_point_cloud(zones, density);
+	}
+	if (voxel)
+		print_voxels();
+	if (share)
+		print_samples(zones->samples, convert_start);
+	zone_free(&zones);
+	if (NULL != jit)
+		jit_free(&jit);
+	if (morton) {
+		clock_t start = clock();
+		morton_sort(points_scene, 0);
+		printf("Morton ordering : %d points sorted in %.3f s of processor time\n", points_scene->size, (double) (clock() - start) / CLOCKS_PER_SEC);
+		fflush(stdout);
+	}
 
     glutInit(&argc, argv);
     glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH);
     glutInitWindowSize(WINDOW_WIDTH, WINDOW_HEIGHT);
     glutCreateWindow(WINDOW_NAME);
+    glutSetWindowData(points_scene);
     init();
     glutDisplayFunc(display);
     glutMainLoop();
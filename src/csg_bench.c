@@ -0,0 +1,862 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "tree.h"
+#include "parser.h"
+#include "scene.h"
+#include "synth.h"
+#include "zone.h"
+#include "shard.h"
+#include "server.h"
+#include "morton.h"
+#include "pack.h"
+#include "stream.h"
+#include "jit.h"
+#include "sample.h"
+#include "chrono.h"
+#include "point_cloud.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#define MAX_LIST (32)
+#define DEFAULT_LEAVES ("8,64")
+#define DEFAULT_DENSITIES ("3000,20000")
+#define DEFAULT_THREADS ("1,2,4")
+#define DEFAULT_PROCESSES ("1,2,4")
+#define DEFAULT_CUT (3)
+#define MIN_PARSE_TIME (0.05)
+#define DEFAULT_MODES ("plain")
+#define PILOT_DENSITY_RATIO (16)
+#define SERVE_SEEDS (4)
+#define SERVE_ERROR_SIZE (256)
+#define ORDER_CHUNK (1024)
+#define ORDER_QUERIES (4)
+#define ORDER_EXPORT_BITS (16)
+
+static size_t _bench_voxel_capacity_ = TREE_VOXEL_CAPACITY;
+static size_t _bench_voxel_bytes_ = 0;
+static unsigned long _bench_sample_hits_ = 0;
+static unsigned long _bench_sample_lookups_ = 0;
+
+typedef struct BenchJob BenchJob;
+
+typedef struct {
+	const char *name;
+	void * (*prepare)(Tree, int);
+	PointCloud * (*convert)(const BenchJob *);
+	void (*release)(void *);
+	int sharded;
+} BenchMode;
+
+struct BenchJob {
+	Tree tree;
+	int density;
+	int processes;
+	int cut;
+	unsigned int seed;
+	const BenchMode *mode;
+	void *prepared;
+	unsigned long points;
+};
+
+static PointCloud * bench_convert_tree(const BenchJob *job) {
+	return tree_to_point_cloud(job->tree, job->density);
+}
+
+static void * bench_prepare_reorder(Tree tree, int density) {
+	tree_optimize(tree, density/PILOT_DENSITY_RATIO > 0 ? density/PILOT_DENSITY_RATIO : 1);
+	return NULL;
+}
+
+static void * bench_prepare_schedule(Tree tree, int density) {
+	tree_schedule(tree);
+	return NULL;
+}
+
+static void * bench_prepare_zone(Tree tree, int density) {
+	return zone_build(tree);
+}
+
+static PointCloud * bench_convert_zone(const BenchJob *job) {
+	return zone_to_point_cloud((const Zones *) job->prepared, job->density);
+}
+
+static void bench_release_zone(void *prepared) {
+	Zones *zones = (Zones *) prepared;
+	zone_free(&zones);
+}
+
+static void * bench_prepare_voxel(Tree tree, int density) {
+	_bench_voxel_bytes_ = tree_voxelize(tree, TREE_VOXEL_DEPTH, _bench_voxel_capacity_);
+	return NULL;
+}
+
+static PointCloud * bench_convert_late(const BenchJob *job) {
+	return tree_to_point_cloud_late(job->tree, job->density);
+}
+
+static void * bench_prepare_jit(Tree tree, int density) {
+	return jit_compile(tree);
+}
+
+static void bench_release_jit(void *prepared) {
+	Jit *jit = (Jit *) prepared;
+	if (NULL != jit)
+		jit_free(&jit);
+}
+
+static void * bench_prepare_sample(Tree tree, int density) {
+	Zones *zones = zone_build(tree);
+	zones->samples = sample_cache_allocate(SAMPLE_CAPACITY, shape_random());
+	return zones;
+}
+
+static void bench_release_sample(void *prepared) {
+	Zones *zones = (Zones *) prepared;
+	_bench_sample_hits_ += zones->samples->shared;
+	_bench_sample_lookups_ += zones->samples->sampled + zones->samples->shared;
+	sample_cache_free(&(zones->samples));
+	zone_free(&zones);
+}
+
+static PointCloud * bench_convert_shard(const BenchJob *job) {
+	return shard_to_point_cloud(job->tree, job->density, job->cut, job->processes);
+}
+
+static const BenchMode _bench_modes_[] = {
+	{"plain", NULL, bench_convert_tree, NULL, 0},
+	{"reorder", bench_prepare_reorder, bench_convert_tree, NULL, 0},
+	{"schedule", bench_prepare_schedule, bench_convert_tree, NULL, 0},
+	{"zone", bench_prepare_zone, bench_convert_zone, bench_release_zone, 0},
+	{"shard", NULL, bench_convert_shard, NULL, 1},
+	{"voxel", bench_prepare_voxel, bench_convert_tree, NULL, 0},
+	{"late", NULL, bench_convert_late, NULL, 0},
+	{"jit", bench_prepare_jit, bench_convert_tree, bench_release_jit, 0},
+	{"sample", bench_prepare_sample, bench_convert_zone, bench_release_sample, 0}
+};
+
+#define NUMBER_MODES ((int) (sizeof(_bench_modes_)/sizeof(BenchMode)))
+
+static void bench_reset_peak_rss(void) {
+	FILE *f = fopen("/proc/self/clear_refs", "w");
+	if (NULL != f) {
+		fputs("5", f);
+		fclose(f);
+	}
+}
+
+static long bench_peak_rss(void) {
+	char line[128];
+	long kb = -1;
+	FILE *f = fopen("/proc/self/status", "r");
+	if (NULL == f)
+		return -1;
+	while (NULL != fgets(line, sizeof(line), f)) {
+		if (sscanf(line, "VmHWM: %ld", &kb) == 1)
+			break;
+	}
+	fclose(f);
+	return kb;
+}
+
+static int bench_parse_list(const char *str, int *values) {
+	int n = 0;
+	const char *s = str;
+	while (n < MAX_LIST) {
+		char *end;
+		long v = strtol(s, &end, 10);
+		if (end == s || v <= 0)
+			return -1;
+		values[n++] = (int) v;
+		if (*end == '\0')
+			return n;
+		if (*end != ',')
+			return -1;
+		s = end + 1;
+	}
+	return -1;
+}
+
+static int bench_parse_modes(const char *str, const BenchMode **modes) {
+	int n = 0, m;
+	const char *s = str;
+	while (n < MAX_LIST) {
+		size_t length = strcspn(s, ",");
+		for (m = 0; m < NUMBER_MODES; m++) {
+			if (strlen(_bench_modes_[m].name) == length && strncmp(s, _bench_modes_[m].name, length) == 0)
+				break;
+		}
+		if (m == NUMBER_MODES)
+			return -1;
+		modes[n++] = _bench_modes_ + m;
+		if (s[length] == '\0')
+			return n;
+		s += length + 1;
+	}
+	return -1;
+}
+
+static unsigned long bench_sample_leaves(Tree tree, int density) {
+	if (NULL != tree->shape) {
+		PointCloud *cloud = shape_to_point_cloud(tree->shape, density, tree->transformations, tree->norm_transformations);
+		unsigned long size = cloud->size;
+		point_cloud_free(&cloud);
+		return size;
+	}
+	return bench_sample_leaves(tree->left, density) + bench_sample_leaves(tree->right, density);
+}
+
+static void * bench_generate(void *arg) {
+	BenchJob *job = (BenchJob *) arg;
+	shape_seed(job->seed);
+	job->points = bench_sample_leaves(job->tree, job->density);
+	return NULL;
+}
+
+static void * bench_convert(void *arg) {
+	BenchJob *job = (BenchJob *) arg;
+	shape_seed(job->seed);
+	PointCloud *cloud = job->mode->convert(job);
+	job->points = cloud->size;
+	point_cloud_free(&cloud);
+	return NULL;
+}
+
+static double bench_run(BenchJob *jobs, int threads, void * (*function)(void *)) {
+	pthread_t ids[MAX_LIST];
+	int i;
+	double start = chrono_now();
+	for (i = 0; i < threads; i++) {
+		if (0 != pthread_create(ids + i, NULL, function, jobs + i)) {
+			fprintf(stderr, "thread creation error (line %d file %s)\n", __LINE__, __FILE__);
+			exit(EXIT_FAILURE);
+		}
+	}
+	for (i = 0; i < threads; i++) {
+		pthread_join(ids[i], NULL);
+	}
+	return chrono_now() - start;
+}
+
+static Tree bench_parse(FILE *scene) {
+	rewind(scene);
+	return parse_tree(scene);
+}
+
+static int bench_compare(const void *a, const void *b) {
+	double x = *((const double *) a), y = *((const double *) b);
+	return (x > y) - (x < y);
+}
+
+static void bench_serve(FILE *scene, int leaves, int nodes, int density, int requests, unsigned int seed) {
+	char path[64], error[SERVE_ERROR_SIZE];
+	long length = ftell(scene);
+	char *text = NULL;
+	double *latencies = NULL;
+	if (NULL == (text = (char *) malloc(length > 0 ? length : 1)) || NULL == (latencies = (double *) malloc(requests*sizeof(double)))) {
+		fprintf(stderr, "memory allocation error (line %d file %s)\n", __LINE__, __FILE__);
+		exit(EXIT_FAILURE);
+	}
+	rewind(scene);
+	if (fread(text, 1, length, scene) != (size_t) length) {
+		fprintf(stderr, "can not read temporary scene file\n");
+		exit(EXIT_FAILURE);
+	}
+	sprintf(path, "/tmp/csg_bench.%ld.sock", (long) getpid());
+	fflush(stdout);
+	pid_t pid = fork();
+	if (pid < 0) {
+		fprintf(stderr, "can not fork the daemon\n");
+		exit(EXIT_FAILURE);
+	}
+	if (pid == 0) {
+		server_run(path, SERVER_TREE_CAPACITY, SERVER_CLOUD_CAPACITY);
+		_exit(EXIT_SUCCESS);
+	}
+	int fd, i;
+	double start = chrono_now();
+	while ((fd = server_connect(path)) < 0) {
+		if (chrono_now() - start > 10) {
+			fprintf(stderr, "can not connect to the daemon\n");
+			kill(pid, SIGTERM);
+			exit(EXIT_FAILURE);
+		}
+		struct timespec pause = {0, 1000000};
+		nanosleep(&pause, NULL);
+	}
+	unsigned long points = 0;
+	start = chrono_now();
+	for (i = 0; i < requests; i++) {
+		double request_start = chrono_now();
+		PointCloud *cloud = server_convert(fd, text, length, density, seed + i%SERVE_SEEDS, error, sizeof(error));
+		if (NULL == cloud) {
+			fprintf(stderr, "request failed : %s\n", error);
+			kill(pid, SIGTERM);
+			exit(EXIT_FAILURE);
+		}
+		latencies[i] = chrono_now() - request_start;
+		points += cloud->size;
+		point_cloud_free(&cloud);
+	}
+	double total = chrono_now() - start;
+	server_shutdown(fd);
+	close(fd);
+	waitpid(pid, NULL, 0);
+	double cold = latencies[0];
+	qsort(latencies, requests, sizeof(double), bench_compare);
+	printf("%d,%d,%ld,%d,%d,%.3f,%.1f,%.3f,%.3f,%.3f,%lu\n",
+		leaves, nodes, length, density, requests, 1e3*cold, requests/total,
+		1e3*latencies[(int) (0.5*(requests - 1) + 0.5)], 1e3*latencies[(int) (0.9*(requests - 1) + 0.5)],
+		1e3*latencies[(int) (0.99*(requests - 1) + 0.5)], points/requests);
+	fflush(stdout);
+	free(latencies);
+	free(text);
+}
+
+static PointCloud * bench_copy_cloud(const PointCloud *cloud) {
+	point3 *vrtx = NULL;
+	vec3 *norm = NULL;
+	color4 *colors = NULL;
+	if (NULL == (vrtx = (point3 *) malloc(cloud->size * sizeof(point3)))
+	|| NULL == (norm = (vec3 *) malloc(cloud->size * sizeof(vec3)))
+	|| NULL == (colors = (color4 *) malloc(cloud->size * sizeof(color4)))) {
+		fprintf(stderr, "memory allocation error (line %d file %s)\n", __LINE__, __FILE__);
+		exit(EXIT_FAILURE);
+	}
+	memcpy(vrtx, cloud->vrtx, cloud->size * sizeof(point3));
+	memcpy(norm, cloud->norm, cloud->size * sizeof(vec3));
+	memcpy(colors, cloud->colors, cloud->size * sizeof(color4));
+	return point_cloud_allocate(vrtx, norm, colors, cloud->size);
+}
+
+static void bench_bounds(const PointCloud *cloud, int begin, int end, point3 min, point3 max) {
+	int i, k;
+	point3_copy(min, cloud->vrtx[begin]);
+	point3_copy(max, cloud->vrtx[begin]);
+	for (i = begin + 1; i < end; i++) {
+		for (k = 0; k < 3; k++) {
+			if (cloud->vrtx[i][k] < min[k])
+				min[k] = cloud->vrtx[i][k];
+			if (cloud->vrtx[i][k] > max[k])
+				max[k] = cloud->vrtx[i][k];
+		}
+	}
+}
+
+static double bench_cull(const PointCloud *cloud, unsigned long *tested, unsigned long *inside) {
+	int chunks = (cloud->size + ORDER_CHUNK - 1) / ORDER_CHUNK;
+	point3 *bounds = NULL, min, max;
+	if (NULL == (bounds = (point3 *) malloc(2 * chunks * sizeof(point3)))) {
+		fprintf(stderr, "memory allocation error (line %d file %s)\n", __LINE__, __FILE__);
+		exit(EXIT_FAILURE);
+	}
+	int c, i, k, q;
+	*tested = 0;
+	*inside = 0;
+	double start = chrono_now();
+	bench_bounds(cloud, 0, cloud->size, min, max);
+	for (c = 0; c < chunks; c++) {
+		int end = (c + 1) * ORDER_CHUNK < cloud->size ? (c + 1) * ORDER_CHUNK : cloud->size;
+		bench_bounds(cloud, c * ORDER_CHUNK, end, bounds[2*c], bounds[2*c + 1]);
+	}
+	for (q = 0; q < ORDER_QUERIES * ORDER_QUERIES * ORDER_QUERIES; q++) {
+		point3 low, high;
+		int cell[3] = {q % ORDER_QUERIES, q / ORDER_QUERIES % ORDER_QUERIES, q / ORDER_QUERIES / ORDER_QUERIES};
+		for (k = 0; k < 3; k++) {
+			low[k] = min[k] + (max[k] - min[k]) * cell[k] / ORDER_QUERIES;
+			high[k] = min[k] + (max[k] - min[k]) * (cell[k] + 1) / ORDER_QUERIES;
+		}
+		for (c = 0; c < chunks; c++) {
+			for (k = 0; k < 3; k++) {
+				if (bounds[2*c][k] > high[k] || bounds[2*c + 1][k] < low[k])
+					break;
+			}
+			if (k < 3)
+				continue;
+			int end = (c + 1) * ORDER_CHUNK < cloud->size ? (c + 1) * ORDER_CHUNK : cloud->size;
+			for (i = c * ORDER_CHUNK; i < end; i++) {
+				for (k = 0; k < 3; k++) {
+					if (cloud->vrtx[i][k] < low[k] || cloud->vrtx[i][k] >= high[k])
+						break;
+				}
+				*inside += (k == 3);
+			}
+			*tested += end - c * ORDER_CHUNK;
+		}
+	}
+	double time = chrono_now() - start;
+	free(bounds);
+	return time;
+}
+
+static unsigned long bench_export_bytes(const PointCloud *cloud) {
+	point3 min, max;
+	long previous[3] = {0, 0, 0};
+	unsigned long bytes = 0;
+	int i, k;
+	bench_bounds(cloud, 0, cloud->size, min, max);
+	for (i = 0; i < cloud->size; i++) {
+		for (k = 0; k < 3; k++) {
+			double extent = max[k] > min[k] ? max[k] - min[k] : 1;
+			long q = (long) ((cloud->vrtx[i][k] - min[k]) / extent * ((1 << ORDER_EXPORT_BITS) - 1) + 0.5);
+			long delta = q - previous[k];
+			unsigned long zigzag = delta < 0 ? ((unsigned long) -delta << 1) - 1 : (unsigned long) delta << 1;
+			previous[k] = q;
+			do {
+				bytes++;
+				zigzag >>= 7;
+			} while (zigzag != 0);
+		}
+	}
+	return bytes;
+}
+
+static void bench_order(FILE *scene, int leaves, int nodes, int density, const int *threads, int nthreads, unsigned int seed) {
+	Tree tree = bench_parse(scene);
+	shape_seed(seed);
+	double start = chrono_now();
+	PointCloud *cloud = tree_to_point_cloud(tree, density);
+	double convert_time = chrono_now() - start;
+	tree_free(&tree);
+	unsigned long tree_tested, morton_tested = 0, inside, morton_bytes = 0;
+	double tree_cull = bench_cull(cloud, &tree_tested, &inside), morton_cull = 0;
+	unsigned long tree_bytes = bench_export_bytes(cloud);
+	int t;
+	for (t = 0; t < nthreads; t++) {
+		PointCloud *sorted = bench_copy_cloud(cloud);
+		start = chrono_now();
+		morton_sort(sorted, threads[t]);
+		double sort_time = chrono_now() - start;
+		if (t == 0) {
+			morton_cull = bench_cull(sorted, &morton_tested, &inside);
+			morton_bytes = bench_export_bytes(sorted);
+		}
+		point_cloud_free(&sorted);
+		printf("%d,%d,%d,%d,%d,%.6f,%.6f,%.0f,%.6f,%.6f,%lu,%lu,%lu,%lu,%lu,%lu\n",
+			leaves, nodes, density, threads[t], cloud->size, convert_time, sort_time, sort_time > 0 ? cloud->size/sort_time : 0.,
+			tree_cull, morton_cull, inside, tree_tested, morton_tested,
+			(unsigned long) cloud->size * 3 * ORDER_EXPORT_BITS / 8, tree_bytes, morton_bytes);
+		fflush(stdout);
+	}
+	point_cloud_free(&cloud);
+}
+
+static void bench_pack(FILE *scene, int leaves, int nodes, int density, unsigned int seed) {
+	Tree tree = bench_parse(scene);
+	shape_seed(seed);
+	PointCloud *cloud = tree_to_point_cloud(tree, density);
+	tree_free(&tree);
+	PointCloud *sorted = bench_copy_cloud(cloud);
+	double start = chrono_now();
+	PackedCloud *packed = pack_encode(sorted, 1);
+	double encode_time = chrono_now() - start;
+	FILE *file = NULL;
+	if (NULL == (file = tmpfile()) || !pack_write(packed, file)) {
+		fprintf(stderr, "can not write temporary compressed point cloud file\n");
+		exit(EXIT_FAILURE);
+	}
+	long packed_bytes = ftell(file);
+	rewind(file);
+	pack_free(&packed);
+	if (NULL == (packed = pack_read(file))) {
+		fprintf(stderr, "can not read temporary compressed point cloud file\n");
+		exit(EXIT_FAILURE);
+	}
+	fclose(file);
+	int decodes = 0, i, k;
+	double decode_time;
+	PointCloud *decoded = NULL;
+	start = chrono_now();
+	do {
+		if (NULL != decoded)
+			point_cloud_free(&decoded);
+		decoded = pack_decode(packed);
+		decodes++;
+		decode_time = chrono_now() - start;
+	} while (decode_time < MIN_PARSE_TIME);
+	decode_time /= decodes;
+	double bound = 0, position_error = 0, normal_error = 0;
+	unsigned long wrong_colors = 0;
+	for (k = 0; k < 3; k++) {
+		bound = pack_position_error(packed, k) > bound ? pack_position_error(packed, k) : bound;
+	}
+	for (i = 0; i < sorted->size; i++) {
+		for (k = 0; k < 3; k++) {
+			double error = fabs(decoded->vrtx[i][k] - sorted->vrtx[i][k]);
+			position_error = error > position_error ? error : position_error;
+		}
+		vec3 n;
+		vec3_copy(n, sorted->norm[i]);
+		vec3_normalize(n);
+		double cosine = vec3_dot(n, decoded->norm[i]);
+		double angle = acos(cosine > 1 ? 1 : cosine < -1 ? -1 : cosine) * 180 / PI;
+		normal_error = angle > normal_error ? angle : normal_error;
+		wrong_colors += memcmp(decoded->colors[i], sorted->colors[i], sizeof(color4)) != 0;
+	}
+	double raw_bytes = (double) cloud->size * (sizeof(point3) + sizeof(vec3) + sizeof(color4));
+	printf("%d,%d,%d,%d,%.0f,%ld,%.2f,%d,%.6f,%.3f,%.6f,%.3f,%.3g,%.3g,%.3f,%lu\n",
+		leaves, nodes, density, cloud->size, raw_bytes, packed_bytes, packed_bytes > 0 ? raw_bytes/packed_bytes : 0., packed->palette_size,
+		encode_time, raw_bytes/encode_time/1e9, decode_time, raw_bytes/decode_time/1e9,
+		bound, position_error, normal_error, wrong_colors);
+	fflush(stdout);
+	pack_free(&packed);
+	point_cloud_free(&decoded);
+	point_cloud_free(&sorted);
+	point_cloud_free(&cloud);
+}
+
+typedef struct {
+	const Zones *zones;
+	int density;
+	unsigned int seed;
+	FILE *file;
+	StreamStatistics statistics;
+} BenchStream;
+
+static void * bench_produce_stream(void *arg) {
+	BenchStream *producer = (BenchStream *) arg;
+	if (!stream_write(producer->zones, producer->density, producer->seed, producer->file, &(producer->statistics))) {
+		fprintf(stderr, "can not write the stream\n");
+		exit(EXIT_FAILURE);
+	}
+	fclose(producer->file);
+	return NULL;
+}
+
+static void * bench_produce_whole(void *arg) {
+	BenchStream *producer = (BenchStream *) arg;
+	shape_seed(producer->seed);
+	PointCloud *cloud = zone_to_point_cloud(producer->zones, producer->density);
+	if (!point_cloud_write(cloud, producer->file)) {
+		fprintf(stderr, "can not write the point cloud\n");
+		exit(EXIT_FAILURE);
+	}
+	fclose(producer->file);
+	point_cloud_free(&cloud);
+	return NULL;
+}
+
+static double bench_consume(BenchStream *producer, void * (*function)(void *), int framed, double *first, unsigned long *points) {
+	int fd[2];
+	pthread_t id;
+	if (0 != pipe(fd) || NULL == (producer->file = fdopen(fd[1], "wb"))) {
+		fprintf(stderr, "can not create the pipe\n");
+		exit(EXIT_FAILURE);
+	}
+	FILE *in = fdopen(fd[0], "rb");
+	double start = chrono_now();
+	if (NULL == in || 0 != pthread_create(&id, NULL, function, producer)) {
+		fprintf(stderr, "thread creation error (line %d file %s)\n", __LINE__, __FILE__);
+		exit(EXIT_FAILURE);
+	}
+	int size;
+	*points = 0;
+	*first = 0;
+	do {
+		PointCloud *chunk = point_cloud_read(in);
+		if (NULL == chunk) {
+			fprintf(stderr, "can not read the stream\n");
+			exit(EXIT_FAILURE);
+		}
+		if (*points == 0)
+			*first = chrono_now() - start;
+		size = chunk->size;
+		*points += size;
+		point_cloud_free(&chunk);
+	} while (framed && size > 0);
+	double total = chrono_now() - start;
+	pthread_join(id, NULL);
+	fclose(in);
+	return total;
+}
+
+static void bench_stream(FILE *scene, int leaves, int nodes, int density, unsigned int seed) {
+	Tree tree = bench_parse(scene);
+	Zones *zones = zone_build(tree);
+	BenchStream producer;
+	unsigned long points, whole_points;
+	double first, whole_first;
+	producer.zones = zones;
+	producer.density = density;
+	producer.seed = seed;
+	double whole = bench_consume(&producer, bench_produce_whole, 0, &whole_first, &whole_points);
+	double streamed = bench_consume(&producer, bench_produce_stream, 1, &first, &points);
+	printf("%d,%d,%d,%lu,%lu,%lu,%.6f,%.6f,%.0f,%.2f,%.6f,%lu\n",
+		leaves, nodes, density, points, producer.statistics.chunks, producer.statistics.stalls,
+		first, streamed, points/streamed, points * (sizeof(point3) + sizeof(vec3) + sizeof(color4)) / streamed / 1e6,
+		whole, whole_points);
+	fflush(stdout);
+	zone_free(&zones);
+	tree_free(&tree);
+}
+
+static void usage(const char *name) {
+	fprintf(stderr,
+		"usage : %s [-l leaves] [-d depth] [-m mix] [-o overlap] [-s seed] [-p densities] [-t threads] [-M modes] [-P processes] [-c cut] [-r requests] [-V capacity] [-z] [-q] [-S]\n"
+		"\t-l leaves : comma separated numbers of leaves (default %s)\n"
+		"\t-d depth : maximal depth of the trees (default balanced)\n"
+		"\t-m mix : weights of union:intersection:difference:identity (default 1:0:0:0)\n"
+		"\t-o overlap : overlap ratio of the leaves in [0,1[ (default 0.25)\n"
+		"\t-s seed : seed of the scenes and of the sampling (default 1)\n"
+		"\t-p densities : comma separated point densities (default %s)\n"
+		"\t-t threads : comma separated numbers of concurrent conversions (default %s)\n"
+		"\t-M modes : comma separated conversion modes among plain, reorder, schedule, zone, shard, voxel, late, jit and sample (default %s)\n"
+		"\t-P processes : comma separated numbers of worker processes of the shard mode (default %s)\n"
+		"\t-c cut : depth where the shard mode cuts the trees (default %d)\n"
+		"\t-r requests : number of requests sent to a generation daemon instead of the conversions\n"
+		"\t-V capacity : memory capacity of the membership grids of the voxel mode in bytes (default %lu)\n"
+		"\t-z : sort the point clouds in Morton order instead of running the conversion modes, and measure the downstream costs in both orders\n"
+		"\t-q : compress the point clouds instead of running the conversion modes, and measure the compression ratio, speeds and errors\n"
+		"\t-S : stream the point clouds to a consumer thread through a pipe instead of running the conversion modes, and measure the time to the first chunk and the throughput\n",
+		name, DEFAULT_LEAVES, DEFAULT_DENSITIES, DEFAULT_THREADS, DEFAULT_MODES, DEFAULT_PROCESSES, DEFAULT_CUT, TREE_VOXEL_CAPACITY);
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[]) {
+	int leaves[MAX_LIST], densities[MAX_LIST], threads[MAX_LIST], processes[MAX_LIST];
+	int nprocesses = bench_parse_list(DEFAULT_PROCESSES, processes);
+	int cut = DEFAULT_CUT;
+	int requests = 0;
+	int order = 0;
+	int compress = 0;
+	int streamed = 0;
+	int nleaves = bench_parse_list(DEFAULT_LEAVES, leaves);
+	int ndensities = bench_parse_list(DEFAULT_DENSITIES, densities);
+	int nthreads = bench_parse_list(DEFAULT_THREADS, threads);
+	const BenchMode *modes[MAX_LIST];
+	int nmodes = bench_parse_modes(DEFAULT_MODES, modes);
+	SynthParameters parameters;
+	synth_default_parameters(&parameters);
+	int opt;
+	while ((opt = getopt(argc, argv, "l:d:m:o:s:p:t:M:P:c:r:V:zqSh")) != -1) {
+		switch (opt) {
+			case 'l':
+				nleaves = bench_parse_list(optarg, leaves);
+				break;
+			case 'd':
+				parameters.depth = atoi(optarg);
+				break;
+			case 'm':
+				if (sscanf(optarg, "%d:%d:%d:%d", parameters.mix + Union, parameters.mix + Intersection, parameters.mix + Difference, parameters.mix + Identity) != 4
+				|| parameters.mix[Union] + parameters.mix[Intersection] + parameters.mix[Difference] + parameters.mix[Identity] <= 0)
+					usage(argv[0]);
+				break;
+			case 'o':
+				parameters.overlap = atof(optarg);
+				if (parameters.overlap < 0 || parameters.overlap >= 1)
+					usage(argv[0]);
+				break;
+			case 's':
+				parameters.seed = (unsigned int) strtoul(optarg, NULL, 10);
+				break;
+			case 'p':
+				ndensities = bench_parse_list(optarg, densities);
+				break;
+			case 't':
+				nthreads = bench_parse_list(optarg, threads);
+				break;
+			case 'M':
+				nmodes = bench_parse_modes(optarg, modes);
+				break;
+			case 'P':
+				nprocesses = bench_parse_list(optarg, processes);
+				break;
+			case 'c':
+				cut = atoi(optarg);
+				if (cut < 0)
+					usage(argv[0]);
+				break;
+			case 'r':
+				requests = atoi(optarg);
+				if (requests <= 0)
+					usage(argv[0]);
+				break;
+			case 'V':
+				_bench_voxel_capacity_ = (size_t) strtoul(optarg, NULL, 10);
+				break;
+			case 'z':
+				order = 1;
+				break;
+			case 'q':
+				compress = 1;
+				break;
+			case 'S':
+				streamed = 1;
+				break;
+			default:
+				usage(argv[0]);
+		}
+	}
+	if (nleaves <= 0 || ndensities <= 0 || nthreads <= 0 || nmodes <= 0 || nprocesses <= 0 || optind != argc)
+		usage(argv[0]);
+	int l, d, t, m, p, i;
+	for (t = 0; t < nthreads; t++) {
+		if (threads[t] > MAX_LIST)
+			usage(argv[0]);
+	}
+	for (p = 0; p < nprocesses; p++) {
+		if (processes[p] <= 0)
+			usage(argv[0]);
+	}
+
+	if (streamed)
+		printf("leaves,nodes,density,points,chunks,stalls,first_chunk_s,stream_s,points_per_s,mb_per_s,whole_s,whole_points\n");
+	else if (compress)
+		printf("leaves,nodes,density,points,raw_bytes,packed_bytes,ratio,colors,encode_s,encode_gb_per_s,decode_s,decode_gb_per_s,position_bound,position_error,normal_error_deg,wrong_colors\n");
+	else if (order)
+		printf("leaves,nodes,density,threads,points,convert_s,sort_s,sort_points_per_s,tree_cull_s,morton_cull_s,cull_points,tree_cull_tested,morton_cull_tested,raw_bytes,tree_delta_bytes,morton_delta_bytes\n");
+	else if (requests > 0)
+		printf("leaves,nodes,scene_bytes,density,requests,cold_ms,requests_per_s,p50_ms,p90_ms,p99_ms,points\n");
+	else
+		printf("leaves,depth,mix,overlap,nodes,scene_bytes,density,threads,mode,processes,parse_s,parse_mb_per_s,parse_nodes_per_s,load_s,generate_s,prepare_s,merge_s,points,points_per_s,classifications,classifications_per_s,primitive_tests,peak_rss_kb,voxel_kb,voxel_lookups,voxel_hit_rate,materialized,sample_hit_rate\n");
+	for (l = 0; l < nleaves; l++) {
+		parameters.leaves = leaves[l];
+		int depth = parameters.depth < synth_minimal_depth(leaves[l]) ? synth_minimal_depth(leaves[l]) : parameters.depth;
+		FILE *scene = NULL;
+		if (NULL == (scene = tmpfile())) {
+			fprintf(stderr, "can not create temporary scene file\n");
+			exit(EXIT_FAILURE);
+		}
+		int nodes = synth_write_scene(scene, &parameters);
+		long bytes = ftell(scene);
+		if (requests > 0) {
+			for (d = 0; d < ndensities; d++) {
+				fseek(scene, bytes, SEEK_SET);
+				bench_serve(scene, leaves[l], nodes, densities[d], requests, parameters.seed);
+			}
+			fclose(scene);
+			continue;
+		}
+		if (streamed) {
+			for (d = 0; d < ndensities; d++) {
+				bench_stream(scene, leaves[l], nodes, densities[d], parameters.seed);
+			}
+			fclose(scene);
+			continue;
+		}
+		if (compress) {
+			for (d = 0; d < ndensities; d++) {
+				bench_pack(scene, leaves[l], nodes, densities[d], parameters.seed);
+			}
+			fclose(scene);
+			continue;
+		}
+		if (order) {
+			for (d = 0; d < ndensities; d++) {
+				bench_order(scene, leaves[l], nodes, densities[d], threads, nthreads, parameters.seed);
+			}
+			fclose(scene);
+			continue;
+		}
+		int parses = 0;
+		double start = chrono_now(), parse_time;
+		do {
+			Tree tree = bench_parse(scene);
+			tree_free(&tree);
+			parses++;
+			parse_time = chrono_now() - start;
+		} while (parse_time < MIN_PARSE_TIME);
+		parse_time /= parses;
+		FILE *compiled = NULL;
+		if (NULL == (compiled = tmpfile())) {
+			fprintf(stderr, "can not create temporary compiled scene file\n");
+			exit(EXIT_FAILURE);
+		}
+		Tree tree = bench_parse(scene);
+		scene_compile(tree, compiled);
+		tree_free(&tree);
+		fflush(compiled);
+		int loads = 0;
+		double load_time;
+		start = chrono_now();
+		do {
+			rewind(compiled);
+			tree = scene_load(compiled);
+			tree_free(&tree);
+			loads++;
+			load_time = chrono_now() - start;
+		} while (load_time < MIN_PARSE_TIME);
+		load_time /= loads;
+		fclose(compiled);
+		for (d = 0; d < ndensities; d++) {
+			for (t = 0; t < nthreads; t++) {
+				BenchJob jobs[MAX_LIST];
+				for (i = 0; i < threads[t]; i++) {
+					jobs[i].tree = bench_parse(scene);
+					jobs[i].density = densities[d];
+					jobs[i].seed = parameters.seed;
+				}
+				double generate_time = bench_run(jobs, threads[t], bench_generate);
+				for (i = 0; i < threads[t]; i++) {
+					tree_free(&(jobs[i].tree));
+				}
+				/* the zone mode samples the leaves in the order of the plain mode, so both give the same points */
+				long plain_points = -1, zone_points = -1;
+				for (m = 0; m < nmodes; m++) {
+					for (p = 0; p < (modes[m]->sharded ? nprocesses : 1); p++) {
+						double prepare_time = 0;
+						_bench_voxel_bytes_ = 0;
+						_bench_sample_hits_ = 0;
+						_bench_sample_lookups_ = 0;
+						shape_seed(parameters.seed);
+						for (i = 0; i < threads[t]; i++) {
+							jobs[i].tree = bench_parse(scene);
+							jobs[i].mode = modes[m];
+							jobs[i].prepared = NULL;
+							jobs[i].processes = modes[m]->sharded ? processes[p] : 1;
+							jobs[i].cut = cut;
+							if (NULL != modes[m]->prepare) {
+								start = chrono_now();
+								jobs[i].prepared = modes[m]->prepare(jobs[i].tree, densities[d]);
+								prepare_time += chrono_now() - start;
+							}
+						}
+						prepare_time /= threads[t];
+						tree_reset_statistics();
+						bench_reset_peak_rss();
+						double total_time = bench_run(jobs, threads[t], bench_convert);
+						long peak_rss = bench_peak_rss();
+						TreeStatistics statistics;
+						tree_statistics(&statistics);
+						unsigned long points = 0;
+						for (i = 0; i < threads[t]; i++) {
+							points += jobs[i].points;
+							if (NULL != modes[m]->release)
+								modes[m]->release(jobs[i].prepared);
+							tree_free(&(jobs[i].tree));
+						}
+						if (strcmp(modes[m]->name, "plain") == 0)
+							plain_points = (long) points;
+						else if (strcmp(modes[m]->name, "zone") == 0)
+							zone_points = (long) points;
+						double merge_time = total_time > generate_time ? total_time - generate_time : 0;
+						printf("%d,%d,%d:%d:%d:%d,%g,%d,%ld,%d,%d,%s,%d,%.6f,%.2f,%.0f,%.6f,%.6f,%.6f,%.6f,%lu,%.0f,%lu,%.0f,%lu,%ld,%lu,%lu,%.4f,%lu,%.4f\n",
+							leaves[l], depth,
+							parameters.mix[Union], parameters.mix[Intersection], parameters.mix[Difference], parameters.mix[Identity],
+							parameters.overlap, nodes, bytes, densities[d], threads[t], modes[m]->name, jobs[0].processes,
+							parse_time, bytes/parse_time/1e6, nodes/parse_time, load_time, generate_time, prepare_time, merge_time,
+							points, points/total_time,
+							statistics.classifications, merge_time > 0 ? statistics.classifications/merge_time : 0.,
+							statistics.primitive_tests, peak_rss, (unsigned long) (_bench_voxel_bytes_ / 1024),
+							statistics.voxel_lookups, statistics.voxel_lookups > 0 ? (double) statistics.voxel_hits / statistics.voxel_lookups : 0.,
+							statistics.materialized, _bench_sample_lookups_ > 0 ? (double) _bench_sample_hits_ / _bench_sample_lookups_ : 0.);
+						fflush(stdout);
+					}
+				}
+				if (plain_points >= 0 && zone_points >= 0 && plain_points != zone_points) {
+					fprintf(stderr, "the zone mode gives %ld points instead of the %ld points of the plain mode\n", zone_points, plain_points);
+					exit(EXIT_FAILURE);
+				}
+			}
+		}
+		fclose(scene);
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,305 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "jit.h"
+
+#include "types.h"
+#include "shape.h"
+#include "tree.h"
+#include "chrono.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dlfcn.h>
+#include <sys/stat.h>
+
+#define JIT_PATH_SIZE (512)
+#define JIT_TABLE ("csg_functions")
+#define JIT_SOURCE ("source.c")
+#define JIT_OBJECT ("object.so")
+
+typedef int (*JitFunction)(const double *);
+
+static const char *_jit_prologue_ =
+	"static int jit_sphere(double x, double y, double z) {\n"
+	"\treturn x * x + y * y + z * z <= 1.;\n"
+	"}\n"
+	"static int jit_cube(double x, double y, double z) {\n"
+	"\treturn (x < 0. ? -x : x) <= 1. && (y < 0. ? -y : y) <= 1. && (z < 0. ? -z : z) <= 1.;\n"
+	"}\n"
+	"static int jit_cylinder(double x, double y, double z) {\n"
+	"\treturn (z < 0. ? -z : z) <= 1. && x * x + y * y <= 1.;\n"
+	"}\n"
+	"static int jit_cone(double x, double y, double z) {\n"
+	"\tdouble rz = 1 - z;\n"
+	"\treturn (z < 0. ? -z : z) <= 1. && x * x + y * y <= rz * rz / 4.;\n"
+	"}\n"
+	"static int jit_torus(double x, double y, double z, double r) {\n"
+	"\tdouble q = x * x + y * y;\n"
+	"\tdouble s = q + z * z + 1 - r * r;\n"
+	"\treturn s * s <= 4 * q;\n"
+	"}\n";
+
+static void jit_emit_coordinate(FILE *source, const affine m, int line) {
+	int col, terms = 0;
+	fprintf(source, "\tdouble p%c = ", "xyz"[line]);
+	for (col = 0; col < 3; col++) {
+		double c = affine_get(m, col, line);
+		if (c == 0)
+			continue;
+		if (terms > 0)
+			fputs(" + ", source);
+		if (c == 1)
+			fprintf(source, "%c", "xyz"[col]);
+		else
+			fprintf(source, "%.17g * %c", c, "xyz"[col]);
+		terms++;
+	}
+	if (affine_get(m, 3, line) != 0) {
+		fprintf(source, "%s%.17g", terms > 0 ? " + " : "", affine_get(m, 3, line));
+		terms++;
+	}
+	fprintf(source, "%s;\n", terms > 0 ? "" : "0.");
+}
+
+static int jit_emit(FILE *source, Tree tree, int *next) {
+	assert(NULL != tree);
+	int index = (*next)++;
+	int left = -1, right = -1;
+	if (NULL == tree->shape) {
+		left = jit_emit(source, tree->left, next);
+		right = jit_emit(source, tree->right, next);
+	}
+	fprintf(source, "static int n%d(double x, double y, double z) {\n", index);
+	jit_emit_coordinate(source, tree->inv_transformations, 0);
+	jit_emit_coordinate(source, tree->inv_transformations, 1);
+	jit_emit_coordinate(source, tree->inv_transformations, 2);
+	if (NULL != tree->shape) {
+		switch (tree->shape->type) {
+			case Sphere:
+				fprintf(source, "\treturn jit_sphere(px, py, pz);\n");
+				break;
+			case Cube:
+				fprintf(source, "\treturn jit_cube(px, py, pz);\n");
+				break;
+			case Cylinder:
+				fprintf(source, "\treturn jit_cylinder(px, py, pz);\n");
+				break;
+			case Cone:
+				fprintf(source, "\treturn jit_cone(px, py, pz);\n");
+				break;
+			case Torus:
+				fprintf(source, "\treturn jit_torus(px, py, pz, %.17g);\n", tree->shape->args[0]);
+				break;
+			default:
+				fprintf(stderr, "Invalid Shape type descriptor '%u' (line %d file %s)", tree->shape->type, __LINE__, __FILE__);
+				exit(EXIT_FAILURE);
+		}
+	} else {
+		int first = tree->right_first ? right : left;
+		int second = tree->right_first ? left : right;
+		switch (tree->op) {
+			case Union:
+			case Identity:
+				fprintf(source, "\treturn n%d(px, py, pz) || n%d(px, py, pz);\n", first, second);
+				break;
+			case Intersection:
+				fprintf(source, "\treturn n%d(px, py, pz) && n%d(px, py, pz);\n", first, second);
+				break;
+			case Difference:
+				if (tree->right_first)
+					fprintf(source, "\treturn !n%d(px, py, pz) && n%d(px, py, pz);\n", right, left);
+				else
+					fprintf(source, "\treturn n%d(px, py, pz) && !n%d(px, py, pz);\n", left, right);
+				break;
+			default:
+				fprintf(stderr, "Invalid Tree Operator descriptor '%u' (line %d file %s)", tree->op, __LINE__, __FILE__);
+				exit(EXIT_FAILURE);
+		}
+	}
+	fprintf(source, "}\n");
+	return index;
+}
+
+static void jit_assign(Tree tree, const JitFunction *functions, int *next) {
+	tree->compiled = (NULL != functions) ? functions[(*next)++] : NULL;
+	tree->compiled_generation = tree_generation();
+	if (NULL == tree->shape) {
+		jit_assign(tree->left, functions, next);
+		jit_assign(tree->right, functions, next);
+	}
+}
+
+static unsigned long jit_hash(const char *text, size_t size) {
+	unsigned long hash = 2166136261UL;
+	size_t i;
+	for (i = 0; i < size; i++) {
+		hash = (hash ^ (unsigned char) text[i]) * 16777619UL;
+	}
+	return hash;
+}
+
+static int jit_owned(const struct stat *st, int directory) {
+	if (st->st_uid != geteuid())
+		return 0;
+	if (directory)
+		return S_ISDIR(st->st_mode) && 0 == (st->st_mode & (S_IRWXG | S_IRWXO));
+	return S_ISREG(st->st_mode) && 0 == (st->st_mode & (S_IWGRP | S_IWOTH));
+}
+
+static int jit_directory(char *directory) {
+	const char *cache = getenv("XDG_CACHE_HOME");
+	const char *home = getenv("HOME");
+	struct stat st;
+	int length;
+	if (NULL != cache && '/' == cache[0]) {
+		length = snprintf(directory, JIT_PATH_SIZE, "%s/%s", cache, JIT_DIRECTORY);
+	} else if (NULL != home && '/' == home[0]) {
+		length = snprintf(directory, JIT_PATH_SIZE, "%s/.cache", home);
+		if (length > 0 && length < JIT_PATH_SIZE)
+			mkdir(directory, 0700);
+		length = snprintf(directory, JIT_PATH_SIZE, "%s/.cache/%s", home, JIT_DIRECTORY);
+	} else {
+		length = snprintf(directory, JIT_PATH_SIZE, "/tmp/%s_XXXXXX", JIT_DIRECTORY);
+		return NULL != mkdtemp(directory);
+	}
+	if (length <= 0 || length >= JIT_PATH_SIZE / 2 || NULL != strchr(directory, '\''))
+		return 0;
+	mkdir(directory, 0700);
+	return 0 == lstat(directory, &st) && jit_owned(&st, 1);
+}
+
+static int jit_matches(const char *entry, const char *text, size_t size) {
+	char path[JIT_PATH_SIZE], buffer[4096];
+	struct stat st;
+	size_t offset = 0;
+	ssize_t got;
+	int fd;
+	if (0 != lstat(entry, &st) || !jit_owned(&st, 1))
+		return 0;
+	snprintf(path, JIT_PATH_SIZE, "%s/%s", entry, JIT_OBJECT);
+	if (0 != lstat(path, &st) || !jit_owned(&st, 0))
+		return 0;
+	snprintf(path, JIT_PATH_SIZE, "%s/%s", entry, JIT_SOURCE);
+	if (0 > (fd = open(path, O_RDONLY | O_NOFOLLOW)))
+		return 0;
+	int matches = 0 == fstat(fd, &st) && jit_owned(&st, 0) && (size_t) st.st_size == size;
+	while (matches && 0 < (got = read(fd, buffer, sizeof(buffer)))) {
+		matches = offset + got <= size && 0 == memcmp(buffer, text + offset, got);
+		offset += got;
+	}
+	close(fd);
+	return matches && offset == size;
+}
+
+static int jit_build(const char *work, const char *text, size_t size) {
+	char source_path[JIT_PATH_SIZE], object_path[JIT_PATH_SIZE], command[3 * JIT_PATH_SIZE];
+	size_t written = 0;
+	ssize_t put = 0;
+	int fd;
+	snprintf(source_path, JIT_PATH_SIZE, "%s/%s", work, JIT_SOURCE);
+	snprintf(object_path, JIT_PATH_SIZE, "%s/%s", work, JIT_OBJECT);
+	snprintf(command, sizeof(command), "%s -o '%s' '%s'", JIT_COMPILER, object_path, source_path);
+	if (0 > (fd = open(source_path, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW, 0600)))
+		return 0;
+	while (written < size && 0 < (put = write(fd, text + written, size - written))) {
+		written += put;
+	}
+	return (0 == close(fd)) && written == size && system(command) == 0 && chmod(object_path, 0700) == 0;
+}
+
+static void jit_remove(const char *work) {
+	char path[JIT_PATH_SIZE];
+	snprintf(path, JIT_PATH_SIZE, "%s/%s", work, JIT_SOURCE);
+	remove(path);
+	snprintf(path, JIT_PATH_SIZE, "%s/%s", work, JIT_OBJECT);
+	remove(path);
+	rmdir(work);
+}
+
+Jit * jit_compile(Tree tree) {
+	assert(NULL != tree);
+	assert(tree_is_valid(tree));
+	char *text = NULL;
+	size_t size = 0;
+	int nodes = 0, i;
+	FILE *source = NULL;
+	if (NULL == (source = open_memstream(&text, &size))) {
+		fprintf(stderr, "memory allocation error (line %d file %s)\n", __LINE__, __FILE__);
+		exit(EXIT_FAILURE);
+	}
+	fputs(_jit_prologue_, source);
+	jit_emit(source, tree, &nodes);
+	for (i = 0; i < nodes; i++) {
+		fprintf(source, "static int t%d(const double *p) {\n\treturn n%d(p[0], p[1], p[2]);\n}\n", i, i);
+	}
+	fprintf(source, "int (*const %s[])(const double *) = {", JIT_TABLE);
+	for (i = 0; i < nodes; i++) {
+		fprintf(source, "%st%d", (i > 0) ? ", " : "", i);
+	}
+	fprintf(source, "};\n");
+	fclose(source);
+
+	Jit *jit = NULL;
+	if (NULL == (jit = (Jit *) malloc(sizeof(Jit)))) {
+		fprintf(stderr, "memory allocation error (line %d file %s)\n", __LINE__, __FILE__);
+		exit(EXIT_FAILURE);
+	}
+	char directory[JIT_PATH_SIZE], entry[JIT_PATH_SIZE], work[JIT_PATH_SIZE], path[JIT_PATH_SIZE];
+	jit->tree = tree;
+	jit->hash = jit_hash(text, size);
+	jit->compile_time = 0;
+	work[0] = '\0';
+	if (!jit_directory(directory)) {
+		fprintf(stderr, "can not use '%s' as a private cache directory\n", directory);
+		free(text);
+		free(jit);
+		return NULL;
+	}
+	snprintf(entry, JIT_PATH_SIZE, "%s/%08lx", directory, jit->hash);
+	jit->cached = jit_matches(entry, text, size);
+	if (!jit->cached) {
+		double start = chrono_now();
+		snprintf(work, JIT_PATH_SIZE, "%s/build_XXXXXX", directory);
+		int built = NULL != mkdtemp(work);
+		if (built && !(built = jit_build(work, text, size)))
+			jit_remove(work);
+		if (!built) {
+			fprintf(stderr, "can not compile the point belonging tests with '%s'\n", JIT_COMPILER);
+			free(text);
+			free(jit);
+			return NULL;
+		}
+		if (0 == rename(work, entry))
+			work[0] = '\0';
+		jit->compile_time = chrono_now() - start;
+	}
+	free(text);
+	snprintf(path, JIT_PATH_SIZE, "%s/%s", ('\0' != work[0]) ? work : entry, JIT_OBJECT);
+	const JitFunction *functions = NULL;
+	jit->handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+	if ('\0' != work[0])
+		jit_remove(work);
+	if (NULL == jit->handle || NULL == (functions = (const JitFunction *) dlsym(jit->handle, JIT_TABLE))) {
+		fprintf(stderr, "can not load '%s'\n", path);
+		if (NULL != jit->handle)
+			dlclose(jit->handle);
+		free(jit);
+		return NULL;
+	}
+	nodes = 0;
+	jit_assign(tree, functions, &nodes);
+	return jit;
+}
+
+void jit_free(Jit **jit) {
+	assert(NULL != jit);
+	assert(NULL != *jit);
+	int nodes = 0;
+	jit_assign((*jit)->tree, NULL, &nodes);
+	dlclose((*jit)->handle);
+	free(*jit);
+	*jit = NULL;
+}
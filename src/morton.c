@@ -0,0 +1,239 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "morton.h"
+
+#include "types.h"
+#include "pool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include "point_cloud.h"
+
+#define MORTON_DIGITS (1 << MORTON_RADIX_BITS)
+#define MORTON_PASSES ((3 * MORTON_BITS + MORTON_RADIX_BITS - 1) / MORTON_RADIX_BITS)
+
+typedef struct MortonSort MortonSort;
+
+typedef struct {
+	MortonSort *sort;
+	int begin;
+	int end;
+	point3 min;
+	point3 max;
+	int counts[MORTON_DIGITS];
+} MortonRange;
+
+struct MortonSort {
+	PointCloud *point_cloud;
+	point3 min;
+	point3 max;
+	unsigned int *keys;
+	unsigned int *sorted_keys;
+	int *indices;
+	int *sorted_indices;
+	int shift;
+	point3 *vrtx;
+	vec3 *norm;
+	color4 *colors;
+};
+
+static unsigned int morton_spread(unsigned int x) {
+	x &= 0x3FF;
+	x = (x | (x << 16)) & 0x030000FF;
+	x = (x | (x << 8)) & 0x0300F00F;
+	x = (x | (x << 4)) & 0x030C30C3;
+	x = (x | (x << 2)) & 0x09249249;
+	return x;
+}
+
+static unsigned int morton_quantize(double value, double min, double max) {
+	if (max <= min)
+		return 0;
+	double q = (value - min) / (max - min) * (1 << MORTON_BITS);
+	if (q <= 0)
+		return 0;
+	return (q >= (1 << MORTON_BITS)) ? (1 << MORTON_BITS) - 1 : (unsigned int) q;
+}
+
+unsigned int morton_code(const point3 point, const point3 min, const point3 max) {
+	return morton_spread(morton_quantize(point[0], min[0], max[0]))
+		| (morton_spread(morton_quantize(point[1], min[1], max[1])) << 1)
+		| (morton_spread(morton_quantize(point[2], min[2], max[2])) << 2);
+}
+
+static void morton_bounds(void *arg) {
+	MortonRange *range = (MortonRange *) arg;
+	const PointCloud *point_cloud = range->sort->point_cloud;
+	int i, k;
+	point3_copy(range->min, point_cloud->vrtx[range->begin]);
+	point3_copy(range->max, point_cloud->vrtx[range->begin]);
+	for (i = range->begin + 1; i < range->end; i++) {
+		for (k = 0; k < 3; k++) {
+			if (point_cloud->vrtx[i][k] < range->min[k])
+				range->min[k] = point_cloud->vrtx[i][k];
+			if (point_cloud->vrtx[i][k] > range->max[k])
+				range->max[k] = point_cloud->vrtx[i][k];
+		}
+	}
+}
+
+static void morton_encode(void *arg) {
+	MortonRange *range = (MortonRange *) arg;
+	MortonSort *sort = range->sort;
+	int i;
+	for (i = range->begin; i < range->end; i++) {
+		sort->keys[i] = morton_code(sort->point_cloud->vrtx[i], sort->min, sort->max);
+		sort->indices[i] = i;
+	}
+}
+
+static void morton_count(void *arg) {
+	MortonRange *range = (MortonRange *) arg;
+	const MortonSort *sort = range->sort;
+	int i;
+	memset(range->counts, 0, sizeof(range->counts));
+	for (i = range->begin; i < range->end; i++) {
+		range->counts[(sort->keys[i] >> sort->shift) & (MORTON_DIGITS - 1)]++;
+	}
+}
+
+static void morton_scatter(void *arg) {
+	MortonRange *range = (MortonRange *) arg;
+	MortonSort *sort = range->sort;
+	int i;
+	for (i = range->begin; i < range->end; i++) {
+		int position = range->counts[(sort->keys[i] >> sort->shift) & (MORTON_DIGITS - 1)]++;
+		sort->sorted_keys[position] = sort->keys[i];
+		sort->sorted_indices[position] = sort->indices[i];
+	}
+}
+
+static void morton_gather(void *arg) {
+	MortonRange *range = (MortonRange *) arg;
+	MortonSort *sort = range->sort;
+	const PointCloud *point_cloud = sort->point_cloud;
+	int i;
+	for (i = range->begin; i < range->end; i++) {
+		int j = sort->indices[i];
+		point3_copy(sort->vrtx[i], point_cloud->vrtx[j]);
+		vec3_copy(sort->norm[i], point_cloud->norm[j]);
+		color4_copy(sort->colors[i], point_cloud->colors[j]);
+	}
+}
+
+static void morton_run(ThreadPool *pool, MortonRange *ranges, int size, void (*function)(void *)) {
+	int i;
+	if (NULL == pool) {
+		for (i = 0; i < size; i++) {
+			function(ranges + i);
+		}
+		return;
+	}
+	for (i = 0; i < size; i++) {
+		pool_submit(pool, function, ranges + i);
+	}
+	pool_wait(pool);
+}
+
+static int morton_offsets(MortonRange *ranges, int size, int total) {
+	int d, r, offset = 0;
+	for (d = 0; d < MORTON_DIGITS; d++) {
+		int digit = 0;
+		for (r = 0; r < size; r++) {
+			digit += ranges[r].counts[d];
+		}
+		if (digit == total)
+			return 0;
+	}
+	for (d = 0; d < MORTON_DIGITS; d++) {
+		for (r = 0; r < size; r++) {
+			int count = ranges[r].counts[d];
+			ranges[r].counts[d] = offset;
+			offset += count;
+		}
+	}
+	return 1;
+}
+
+void morton_sort(PointCloud *point_cloud, int threads) {
+	assert(NULL != point_cloud);
+	assert(point_cloud_is_valid(point_cloud));
+	assert(threads >= 0);
+	int size = point_cloud->size;
+	if (size < 2)
+		return;
+	if (threads == 0) {
+		long online = sysconf(_SC_NPROCESSORS_ONLN);
+		threads = (online > 0) ? (int) online : 1;
+	}
+	if (threads > size / MORTON_MIN_POINTS)
+		threads = (size / MORTON_MIN_POINTS > 0) ? size / MORTON_MIN_POINTS : 1;
+	MortonSort sort;
+	MortonRange *ranges = NULL;
+	sort.point_cloud = point_cloud;
+	if (NULL == (ranges = (MortonRange *) malloc(threads * sizeof(MortonRange)))
+	|| NULL == (sort.keys = (unsigned int *) malloc(size * sizeof(unsigned int)))
+	|| NULL == (sort.sorted_keys = (unsigned int *) malloc(size * sizeof(unsigned int)))
+	|| NULL == (sort.indices = (int *) malloc(size * sizeof(int)))
+	|| NULL == (sort.sorted_indices = (int *) malloc(size * sizeof(int)))) {
+		fprintf(stderr, "memory allocation error (line %d file %s)\n", __LINE__, __FILE__);
+		exit(EXIT_FAILURE);
+	}
+	int r, k, pass;
+	for (r = 0; r < threads; r++) {
+		ranges[r].sort = &sort;
+		ranges[r].begin = (int) ((long) size * r / threads);
+		ranges[r].end = (int) ((long) size * (r + 1) / threads);
+	}
+	ThreadPool *pool = (threads > 1) ? pool_allocate(threads) : NULL;
+
+	morton_run(pool, ranges, threads, morton_bounds);
+	point3_copy(sort.min, ranges[0].min);
+	point3_copy(sort.max, ranges[0].max);
+	for (r = 1; r < threads; r++) {
+		for (k = 0; k < 3; k++) {
+			if (ranges[r].min[k] < sort.min[k])
+				sort.min[k] = ranges[r].min[k];
+			if (ranges[r].max[k] > sort.max[k])
+				sort.max[k] = ranges[r].max[k];
+		}
+	}
+	morton_run(pool, ranges, threads, morton_encode);
+
+	for (pass = 0; pass < MORTON_PASSES; pass++) {
+		sort.shift = pass * MORTON_RADIX_BITS;
+		morton_run(pool, ranges, threads, morton_count);
+		if (!morton_offsets(ranges, threads, size))
+			continue;
+		morton_run(pool, ranges, threads, morton_scatter);
+		unsigned int *keys = sort.keys;
+		int *indices = sort.indices;
+		sort.keys = sort.sorted_keys;
+		sort.indices = sort.sorted_indices;
+		sort.sorted_keys = keys;
+		sort.sorted_indices = indices;
+	}
+
+	if (NULL == (sort.vrtx = (point3 *) malloc(size * sizeof(point3)))
+	|| NULL == (sort.norm = (vec3 *) malloc(size * sizeof(vec3)))
+	|| NULL == (sort.colors = (color4 *) malloc(size * sizeof(color4)))) {
+		fprintf(stderr, "memory allocation error (line %d file %s)\n", __LINE__, __FILE__);
+		exit(EXIT_FAILURE);
+	}
+	morton_run(pool, ranges, threads, morton_gather);
+	if (NULL != pool)
+		pool_free(&pool);
+	free(point_cloud->vrtx);
+	free(point_cloud->norm);
+	free(point_cloud->colors);
+	point_cloud->vrtx = sort.vrtx;
+	point_cloud->norm = sort.norm;
+	point_cloud->colors = sort.colors;
+	free(sort.keys);
+	free(sort.sorted_keys);
+	free(sort.indices);
+	free(sort.sorted_indices);
+	free(ranges);
+}
@@ -0,0 +1,347 @@
+#include "pack.h"
+
+#include "types.h"
+#include "morton.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+#include "point_cloud.h"
+
+#define PACK_POSITION_LEVELS ((1 << PACK_POSITION_BITS) - 1)
+#define PACK_NORMAL_LEVELS ((1 << PACK_NORMAL_BITS) - 1)
+#define PACK_MAX_COLORS (65536)
+#define PACK_HEADER_BYTES (9)
+#define PACK_POINT_BYTES (10)
+
+static int pack_blocks(int size) {
+	return (size + PACK_BLOCK - 1) / PACK_BLOCK;
+}
+
+static int pack_block_points(int size, int block) {
+	return (size - block * PACK_BLOCK < PACK_BLOCK) ? size - block * PACK_BLOCK : PACK_BLOCK;
+}
+
+static size_t pack_block_bytes(const unsigned char *block, int points) {
+	int widths = block[6];
+	return 7 + ((((widths >> 6) & 3) == 0) ? 2 : 0)
+		+ (size_t) points * (((widths) & 3) + ((widths >> 2) & 3) + ((widths >> 4) & 3) + 2 + ((widths >> 6) & 3));
+}
+
+static double pack_step(const PackedCloud *packed, int axis) {
+	return (packed->max[axis] - packed->min[axis]) / PACK_POSITION_LEVELS;
+}
+
+double pack_position_error(const PackedCloud *packed, int axis) {
+	assert(NULL != packed);
+	assert(0 <= axis && axis < 3);
+	return pack_step(packed, axis) / 2;
+}
+
+static int pack_width(unsigned int range) {
+	return (range == 0) ? 0 : (range < 256) ? 1 : 2;
+}
+
+static int pack_color(PackedCloud *packed, const color4 color, int last) {
+	int i;
+	if (last >= 0 && memcmp(packed->palette[last], color, sizeof(color4)) == 0)
+		return last;
+	for (i = 0; i < packed->palette_size; i++) {
+		if (memcmp(packed->palette[i], color, sizeof(color4)) == 0)
+			return i;
+	}
+	if (packed->palette_size == PACK_MAX_COLORS) {
+		fprintf(stderr, "too many colors to compress the point cloud (line %d file %s)\n", __LINE__, __FILE__);
+		exit(EXIT_FAILURE);
+	}
+	if (packed->palette_size > 0 && (packed->palette_size & (packed->palette_size - 1)) == 0) {
+		color4 *palette = NULL;
+		if (NULL == (palette = (color4 *) realloc(packed->palette, 2 * packed->palette_size * sizeof(color4)))) {
+			fprintf(stderr, "memory allocation error (line %d file %s)\n", __LINE__, __FILE__);
+			exit(EXIT_FAILURE);
+		}
+		packed->palette = palette;
+	}
+	color4_copy(packed->palette[packed->palette_size], color);
+	return packed->palette_size++;
+}
+
+static unsigned int pack_quantize(double value, double min, double max) {
+	if (max <= min)
+		return 0;
+	return (unsigned int) floor((value - min) / (max - min) * PACK_POSITION_LEVELS + 0.5);
+}
+
+static void pack_octahedral(const vec3 normal, unsigned char *u, unsigned char *v) {
+	double l1 = fabs(normal[0]) + fabs(normal[1]) + fabs(normal[2]);
+	double x = (l1 > 0) ? normal[0] / l1 : 0;
+	double y = (l1 > 0) ? normal[1] / l1 : 0;
+	if (normal[2] < 0) {
+		double folded = (1 - fabs(y)) * (x >= 0 ? 1 : -1);
+		y = (1 - fabs(x)) * (y >= 0 ? 1 : -1);
+		x = folded;
+	}
+	*u = (unsigned char) floor((x + 1) / 2 * PACK_NORMAL_LEVELS + 0.5);
+	*v = (unsigned char) floor((y + 1) / 2 * PACK_NORMAL_LEVELS + 0.5);
+}
+
+static unsigned char * pack_plane(unsigned char *data, const unsigned int *values, int points, int width) {
+	int i;
+	if (width >= 1) {
+		for (i = 0; i < points; i++) {
+			*data++ = (unsigned char) (values[i] & 0xFF);
+		}
+	}
+	if (width == 2) {
+		for (i = 0; i < points; i++) {
+			*data++ = (unsigned char) (values[i] >> 8);
+		}
+	}
+	return data;
+}
+
+PackedCloud * pack_encode(PointCloud *point_cloud, int threads) {
+	assert(NULL != point_cloud);
+	assert(point_cloud_is_valid(point_cloud));
+	assert(threads >= 0);
+	PackedCloud *packed = NULL;
+	int size = point_cloud->size, blocks = pack_blocks(size);
+	if (NULL == (packed = (PackedCloud *) malloc(sizeof(PackedCloud)))
+	|| NULL == (packed->palette = (color4 *) malloc(sizeof(color4)))
+	|| NULL == (packed->data = (unsigned char *) malloc((size_t) blocks * PACK_HEADER_BYTES + (size_t) size * PACK_POINT_BYTES + 1))) {
+		fprintf(stderr, "memory allocation error (line %d file %s)\n", __LINE__, __FILE__);
+		exit(EXIT_FAILURE);
+	}
+	packed->palette_size = 0;
+	packed->size = size;
+	morton_sort(point_cloud, threads);
+	int b, i, k, color = -1;
+	for (i = 0; i < size; i++) {
+		for (k = 0; k < 3; k++) {
+			if (i == 0 || point_cloud->vrtx[i][k] < packed->min[k])
+				packed->min[k] = point_cloud->vrtx[i][k];
+			if (i == 0 || point_cloud->vrtx[i][k] > packed->max[k])
+				packed->max[k] = point_cloud->vrtx[i][k];
+		}
+	}
+	if (size == 0) {
+		point3_set(packed->min, 0, 0, 0);
+		point3_set(packed->max, 0, 0, 0);
+	}
+	unsigned char *data = packed->data;
+	for (b = 0; b < blocks; b++) {
+		unsigned int values[4][PACK_BLOCK], base[4], top[4];
+		int first = b * PACK_BLOCK, points = pack_block_points(size, b), widths = 0;
+		unsigned char u[PACK_BLOCK], v[PACK_BLOCK];
+		for (i = 0; i < points; i++) {
+			for (k = 0; k < 3; k++) {
+				values[k][i] = pack_quantize(point_cloud->vrtx[first + i][k], packed->min[k], packed->max[k]);
+			}
+			color = pack_color(packed, point_cloud->colors[first + i], color);
+			values[3][i] = color;
+			pack_octahedral(point_cloud->norm[first + i], u + i, v + i);
+		}
+		for (k = 0; k < 4; k++) {
+			base[k] = top[k] = values[k][0];
+			for (i = 1; i < points; i++) {
+				base[k] = (values[k][i] < base[k]) ? values[k][i] : base[k];
+				top[k] = (values[k][i] > top[k]) ? values[k][i] : top[k];
+			}
+			if (k < 3) {
+				for (i = 0; i < points; i++) {
+					values[k][i] -= base[k];
+				}
+			}
+			widths |= ((k < 3) ? pack_width(top[k] - base[k]) : (top[k] == base[k]) ? 0 : pack_width(top[k])) << (2 * k);
+		}
+		for (k = 0; k < 3; k++) {
+			*data++ = (unsigned char) (base[k] & 0xFF);
+			*data++ = (unsigned char) (base[k] >> 8);
+		}
+		*data++ = (unsigned char) widths;
+		if (((widths >> 6) & 3) == 0) {
+			*data++ = (unsigned char) (base[3] & 0xFF);
+			*data++ = (unsigned char) (base[3] >> 8);
+		}
+		for (k = 0; k < 3; k++) {
+			data = pack_plane(data, values[k], points, (widths >> (2 * k)) & 3);
+		}
+		memcpy(data, u, points);
+		data += points;
+		memcpy(data, v, points);
+		data += points;
+		data = pack_plane(data, values[3], points, (widths >> 6) & 3);
+	}
+	packed->bytes = data - packed->data;
+	unsigned char *shrunk = (unsigned char *) realloc(packed->data, packed->bytes + 1);
+	if (NULL != shrunk)
+		packed->data = shrunk;
+	return packed;
+}
+
+static void pack_decode_axis(const unsigned char *low, const unsigned char *high, int width, int points, double origin, double step, point3 *vrtx, int axis) {
+	int i;
+	if (width == 0) {
+		for (i = 0; i < points; i++) {
+			vrtx[i][axis] = origin;
+		}
+	} else if (width == 1) {
+		for (i = 0; i < points; i++) {
+			vrtx[i][axis] = origin + low[i] * step;
+		}
+	} else {
+		for (i = 0; i < points; i++) {
+			vrtx[i][axis] = origin + (low[i] | (high[i] << 8)) * step;
+		}
+	}
+}
+
+static void pack_decode_normals(const unsigned char *u, const unsigned char *v, int points, vec3 *norm) {
+	int i;
+	for (i = 0; i < points; i++) {
+		double x = u[i] * (2. / PACK_NORMAL_LEVELS) - 1;
+		double y = v[i] * (2. / PACK_NORMAL_LEVELS) - 1;
+		double z = 1 - fabs(x) - fabs(y);
+		double t = (z < 0) ? -z : 0;
+		x += (x >= 0) ? -t : t;
+		y += (y >= 0) ? -t : t;
+		double length = sqrt(x * x + y * y + z * z);
+		norm[i][0] = x / length;
+		norm[i][1] = y / length;
+		norm[i][2] = z / length;
+	}
+}
+
+PointCloud * pack_decode(const PackedCloud *packed) {
+	assert(NULL != packed);
+	int size = packed->size, blocks = pack_blocks(size);
+	PointCloud *point_cloud = point_cloud_allocate_size(size);
+	point3 *vrtx = point_cloud->vrtx;
+	vec3 *norm = point_cloud->norm;
+	color4 *colors = point_cloud->colors;
+	const unsigned char *data = packed->data;
+	int b, i, k;
+	for (b = 0; b < blocks; b++) {
+		int first = b * PACK_BLOCK, points = pack_block_points(size, b), widths = data[6];
+		const unsigned char *planes = data + 7;
+		unsigned int color = 0;
+		if (((widths >> 6) & 3) == 0) {
+			color = data[7] | (data[8] << 8);
+			planes += 2;
+		}
+		for (k = 0; k < 3; k++) {
+			int width = (widths >> (2 * k)) & 3;
+			double step = pack_step(packed, k);
+			pack_decode_axis(planes, planes + points, width, points, packed->min[k] + (data[2*k] | (data[2*k + 1] << 8)) * step, step, vrtx + first, k);
+			planes += width * points;
+		}
+		pack_decode_normals(planes, planes + points, points, norm + first);
+		planes += 2 * points;
+		switch ((widths >> 6) & 3) {
+			case 0:
+				for (i = 0; i < points; i++) {
+					color4_copy(colors[first + i], packed->palette[color]);
+				}
+				break;
+			case 1:
+				for (i = 0; i < points; i++) {
+					color4_copy(colors[first + i], packed->palette[planes[i]]);
+				}
+				break;
+			default:
+				for (i = 0; i < points; i++) {
+					color4_copy(colors[first + i], packed->palette[planes[i] | (planes[points + i] << 8)]);
+				}
+		}
+		data += pack_block_bytes(data, points);
+	}
+	return point_cloud;
+}
+
+int pack_write(const PackedCloud *packed, FILE *file) {
+	assert(NULL != packed);
+	assert(NULL != file);
+	return fwrite(PACK_MAGIC, 4, 1, file) == 1
+		&& fwrite(&(packed->size), sizeof(int), 1, file) == 1
+		&& fwrite(&(packed->palette_size), sizeof(int), 1, file) == 1
+		&& fwrite(packed->min, sizeof(point3), 1, file) == 1
+		&& fwrite(packed->max, sizeof(point3), 1, file) == 1
+		&& fwrite(packed->palette, sizeof(color4), packed->palette_size, file) == (size_t) packed->palette_size
+		&& fwrite(&(packed->bytes), sizeof(size_t), 1, file) == 1
+		&& fwrite(packed->data, 1, packed->bytes, file) == packed->bytes;
+}
+
+static int pack_is_valid(const PackedCloud *packed) {
+	int b, blocks = pack_blocks(packed->size);
+	size_t offset = 0;
+	for (b = 0; b < blocks; b++) {
+		int points = pack_block_points(packed->size, b);
+		if (offset + 7 > packed->bytes)
+			return 0;
+		const unsigned char *block = packed->data + offset;
+		int widths = block[6], k;
+		for (k = 0; k < 4; k++) {
+			if (((widths >> (2 * k)) & 3) == 3)
+				return 0;
+		}
+		if (((widths >> 6) & 3) == 0 && (offset + 9 > packed->bytes || (block[7] | (block[8] << 8)) >= packed->palette_size))
+			return 0;
+		offset += pack_block_bytes(block, points);
+		if (offset > packed->bytes)
+			return 0;
+		if (((widths >> 6) & 3) != 0) {
+			const unsigned char *indices = packed->data + offset - ((widths >> 6) & 3) * points;
+			int i;
+			for (i = 0; i < points; i++) {
+				if ((((widths >> 6) & 3) == 1 ? indices[i] : indices[i] | (indices[points + i] << 8)) >= packed->palette_size)
+					return 0;
+			}
+		}
+	}
+	return offset == packed->bytes;
+}
+
+PackedCloud * pack_read(FILE *file) {
+	assert(NULL != file);
+	char magic[4];
+	int size, palette_size;
+	if (fread(magic, 4, 1, file) != 1 || memcmp(magic, PACK_MAGIC, 4) != 0
+	|| fread(&size, sizeof(int), 1, file) != 1 || size < 0
+	|| fread(&palette_size, sizeof(int), 1, file) != 1 || palette_size < 0 || palette_size > PACK_MAX_COLORS)
+		return NULL;
+	PackedCloud *packed = NULL;
+	if (NULL == (packed = (PackedCloud *) malloc(sizeof(PackedCloud)))
+	|| NULL == (packed->palette = (color4 *) malloc((palette_size > 0 ? palette_size : 1) * sizeof(color4)))) {
+		fprintf(stderr, "memory allocation error (line %d file %s)\n", __LINE__, __FILE__);
+		exit(EXIT_FAILURE);
+	}
+	packed->size = size;
+	packed->palette_size = palette_size;
+	packed->data = NULL;
+	if (fread(packed->min, sizeof(point3), 1, file) != 1 || fread(packed->max, sizeof(point3), 1, file) != 1
+	|| fread(packed->palette, sizeof(color4), palette_size, file) != (size_t) palette_size
+	|| fread(&(packed->bytes), sizeof(size_t), 1, file) != 1
+	|| packed->bytes > (size_t) pack_blocks(size) * PACK_HEADER_BYTES + (size_t) size * PACK_POINT_BYTES) {
+		pack_free(&packed);
+		return NULL;
+	}
+	if (NULL == (packed->data = (unsigned char *) malloc(packed->bytes + 1))) {
+		fprintf(stderr, "memory allocation error (line %d file %s)\n", __LINE__, __FILE__);
+		exit(EXIT_FAILURE);
+	}
+	if (fread(packed->data, 1, packed->bytes, file) != packed->bytes || !pack_is_valid(packed)) {
+		pack_free(&packed);
+		return NULL;
+	}
+	return packed;
+}
+
+void pack_free(PackedCloud **packed) {
+	assert(NULL != packed);
+	assert(NULL != *packed);
+	free((*packed)->palette);
+	free((*packed)->data);
+	free(*packed);
+	*packed = NULL;
+}
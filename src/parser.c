@@ -1,183 +1,359 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include "parser.h"
 
 #include "types.h"
 #include "shape.h"
 #include "tree.h"
 #include <stdlib.h>
+#include <stdarg.h>
 #include <string.h>
 #include <assert.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
-#define MAX_LEN_NODE_TOKEN (30)
-#define STR_MAX_LEN_NODE_TOKEN "30"
-#define MAX_DOUBLE_DIGIT (20)
-#define MAX_LEN_LINE (MAX_LEN_NODE_TOKEN +  13*MAX_DOUBLE_DIGIT + 22)
+#define PARSER_STACK_SIZE (64)
+#define PARSER_READ_SIZE (65536)
+#define PARSER_MAX_EXACT_DIGITS (19)
+#define PARSER_MAX_EXACT_POWER (22)
+#define PARSER_ERROR_SIZE (256)
 
-int _parser_number_line_;
+typedef struct {
+	const char *cursor;
+	const char *end;
+	int line;
+	char *error;
+	size_t error_size;
+} Parser;
 
-static Tree parse_sphere(char *args) {
-	assert(NULL != args);
-	color4 color;
-	double tx,ty,tz;
-	double rx,ry,rz;
-	double hx,hy,hz;
-	int read = sscanf(args, "(%f,%f,%f,%f) (%lf,%lf,%lf) (%lf,%lf,%lf) (%lf,%lf,%lf)", color, color + 1, color + 2, color + 3, &tx, &ty, &tz, &rx, &ry, &rz, &hx, &hy, &hz); 
-	if (read != 13) {
-		fprintf(stderr, "line %d : invalid shape arguments\n", _parser_number_line_);
-		exit(EXIT_FAILURE);
-	} 
-	Tree tree = tree_allocate_leaf(shape_sphere(color));
-	tree_translation(tree,tx,ty,tz);
-	tree_rotation(tree,rx,ry,rz);
-	tree_homothety(tree,hx,hy,hz);
-	return tree;
+typedef struct {
+	Operator op;
+	Tree left;
+	double args[9];
+} ParserFrame;
+
+static const double _parser_powers_[PARSER_MAX_EXACT_POWER + 1] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static void parser_fail(Parser *parser, const char *format, ...) {
+	assert(NULL != parser);
+	assert(NULL != format);
+	va_list args;
+	if (NULL == parser->error || 0 == parser->error_size)
+		return;
+	va_start(args, format);
+	vsnprintf(parser->error, parser->error_size, format, args);
+	va_end(args);
 }
 
-static Tree parse_cube(char *args) {
-	assert(NULL != args);
-	color4 color;
-	double tx,ty,tz;
-	double rx,ry,rz;
-	double hx,hy,hz;
-	int read = sscanf(args, "(%f,%f,%f,%f) (%lf,%lf,%lf) (%lf,%lf,%lf) (%lf,%lf,%lf)", color, color + 1, color + 2, color + 3, &tx, &ty, &tz, &rx, &ry, &rz, &hx, &hy, &hz); 
-	if (read != 13) {
-		fprintf(stderr, "line %d : invalid shape arguments\n", _parser_number_line_);
-		exit(EXIT_FAILURE);
-	} 
-	Tree tree = tree_allocate_leaf(shape_cube(color));
-	tree_translation(tree,tx,ty,tz);
-	tree_rotation(tree,rx,ry,rz);
-	tree_homothety(tree,hx,hy,hz);
-	return tree;
+static void parser_skip_blanks(Parser *parser) {
+	assert(NULL != parser);
+	while (parser->cursor < parser->end && (*parser->cursor == ' ' || *parser->cursor == '\t' || *parser->cursor == '\r')) {
+		parser->cursor++;
+	}
 }
 
-static Tree parse_cylinder(char *args) {
-	assert(NULL != args);
-	color4 color;
-	double tx,ty,tz;
-	double rx,ry,rz;
-	double hx,hy,hz;
-	int read = sscanf(args, "(%f,%f,%f,%f) (%lf,%lf,%lf) (%lf,%lf,%lf) (%lf,%lf,%lf)", color, color + 1, color + 2, color + 3, &tx, &ty, &tz, &rx, &ry, &rz, &hx, &hy, &hz); 
-	if (read != 13) {
-		fprintf(stderr, "line %d : invalid shape arguments\n", _parser_number_line_);
-		exit(EXIT_FAILURE);
-	} 
-	Tree tree = tree_allocate_leaf(shape_cylinder(color));
-	tree_translation(tree,tx,ty,tz);
-	tree_rotation(tree,rx,ry,rz);
-	tree_homothety(tree,hx,hy,hz);
-	return tree;
+static void parser_next_line(Parser *parser) {
+	assert(NULL != parser);
+	const char *eol = memchr(parser->cursor, '\n', parser->end - parser->cursor);
+	parser->cursor = (NULL == eol) ? parser->end : eol + 1;
 }
 
-static Tree parse_cone(char *args) {
-	assert(NULL != args);
-	color4 color;
-	double tx,ty,tz;
-	double rx,ry,rz;
-	double hx,hy,hz;
-	int read = sscanf(args, "(%f,%f,%f,%f) (%lf,%lf,%lf) (%lf,%lf,%lf) (%lf,%lf,%lf)", color, color + 1, color + 2, color + 3, &tx, &ty, &tz, &rx, &ry, &rz, &hx, &hy, &hz); 
-	if (read != 13) {
-		fprintf(stderr, "line %d : invalid shape arguments\n", _parser_number_line_);
-		exit(EXIT_FAILURE);
-	} 
-	Tree tree = tree_allocate_leaf(shape_cone(color));
-	tree_translation(tree,tx,ty,tz);
-	tree_rotation(tree,rx,ry,rz);
-	tree_homothety(tree,hx,hy,hz);
-	return tree;
+static int parser_expect(Parser *parser, char c) {
+	assert(NULL != parser);
+	parser_skip_blanks(parser);
+	if (parser->cursor < parser->end && *parser->cursor == c) {
+		parser->cursor++;
+		return 1;
+	}
+	return 0;
 }
 
-static Tree parse_torus(char *args) {
+static int parser_number(Parser *parser, double *value) {
+	assert(NULL != parser);
+	assert(NULL != value);
+	parser_skip_blanks(parser);
+	const char *start = parser->cursor;
+	const char *s = start;
+	const char *end = parser->end;
+	int negative = 0;
+	unsigned long mantissa = 0;
+	int digits = 0, significant = 0, exponent = 0;
+	if (s < end && (*s == '-' || *s == '+')) {
+		negative = (*s == '-');
+		s++;
+	}
+	while (s < end && *s >= '0' && *s <= '9') {
+		if (significant < PARSER_MAX_EXACT_DIGITS) {
+			mantissa = 10*mantissa + (*s - '0');
+			if (mantissa > 0)
+				significant++;
+		} else {
+			exponent++;
+		}
+		digits++;
+		s++;
+	}
+	if (s < end && *s == '.') {
+		s++;
+		while (s < end && *s >= '0' && *s <= '9') {
+			if (significant < PARSER_MAX_EXACT_DIGITS) {
+				mantissa = 10*mantissa + (*s - '0');
+				if (mantissa > 0)
+					significant++;
+				exponent--;
+			}
+			digits++;
+			s++;
+		}
+	}
+	if (digits == 0)
+		return 0;
+	if (s < end && (*s == 'e' || *s == 'E')) {
+		const char *e = s + 1;
+		int exp_negative = 0, exp_value = 0, exp_digits = 0;
+		if (e < end && (*e == '-' || *e == '+')) {
+			exp_negative = (*e == '-');
+			e++;
+		}
+		while (e < end && *e >= '0' && *e <= '9') {
+			if (exp_value < 10000)
+				exp_value = 10*exp_value + (*e - '0');
+			exp_digits++;
+			e++;
+		}
+		if (exp_digits > 0) {
+			exponent += exp_negative ? -exp_value : exp_value;
+			s = e;
+		}
+	}
+	if (significant < PARSER_MAX_EXACT_DIGITS && mantissa < (1UL << 53) && exponent >= -PARSER_MAX_EXACT_POWER && exponent <= PARSER_MAX_EXACT_POWER) {
+		*value = (exponent < 0) ? mantissa/_parser_powers_[-exponent] : mantissa*_parser_powers_[exponent];
+		if (negative)
+			*value = -*value;
+	} else {
+		char buffer[128];
+		size_t length = s - start;
+		if (length >= sizeof(buffer))
+			return 0;
+		memcpy(buffer, start, length);
+		buffer[length] = '\0';
+		*value = strtod(buffer, NULL);
+	}
+	parser->cursor = s;
+	return 1;
+}
+
+static int parser_tuple(Parser *parser, double *values, int size) {
+	assert(NULL != parser);
+	assert(NULL != values);
+	int i;
+	if (!parser_expect(parser, '('))
+		return 0;
+	for (i = 0; i < size; i++) {
+		if (i > 0 && !parser_expect(parser, ','))
+			return 0;
+		if (!parser_number(parser, values + i))
+			return 0;
+	}
+	return parser_expect(parser, ')');
+}
+
+static int parser_transformations(Parser *parser, double *args) {
+	assert(NULL != parser);
 	assert(NULL != args);
-	double r;
-	color4 color;
-	double tx,ty,tz;
-	double rx,ry,rz;
-	double hx,hy,hz;
-	int read = sscanf(args, "%lf (%f,%f,%f,%f) (%lf,%lf,%lf) (%lf,%lf,%lf) (%lf,%lf,%lf)", &r, color, color + 1, color + 2, color + 3, &tx, &ty, &tz, &rx, &ry, &rz, &hx, &hy, &hz); 
-	if (read != 14 || r <= 0) {
-		fprintf(stderr, "line %d : invalid shape arguments\n", _parser_number_line_);
-		exit(EXIT_FAILURE);
-	} 
-	Tree tree = tree_allocate_leaf(shape_torus(color,r));
-	tree_translation(tree,tx,ty,tz);
-	tree_rotation(tree,rx,ry,rz);
-	tree_homothety(tree,hx,hy,hz);
-	return tree;
+	return parser_tuple(parser, args, 3) && parser_tuple(parser, args + 3, 3) && parser_tuple(parser, args + 6, 3);
 }
 
-static Tree parse_leaf(char *strshape, char *args) {
-	assert(NULL != strshape);
+static void parser_apply(Tree tree, const double *args) {
+	assert(NULL != tree);
 	assert(NULL != args);
-	if (strncmp(strshape,SHAPE_SPHERE,MAX_LEN_NODE_TOKEN) == 0) {
-		return parse_sphere(args);
-	}
-	if (strncmp(strshape,SHAPE_CUBE,MAX_LEN_NODE_TOKEN) == 0) {
-		return parse_cube(args);
+	if (args[0] != 0 || args[1] != 0 || args[2] != 0)
+		tree_translation(tree, args[0], args[1], args[2]);
+	if (args[3] != 0 || args[4] != 0 || args[5] != 0)
+		tree_rotation(tree, args[3], args[4], args[5]);
+	if (args[6] != 1 || args[7] != 1 || args[8] != 1)
+		tree_homothety(tree, args[6], args[7], args[8]);
+}
+
+static int parser_token_is(const char *token, size_t length, const char *expected) {
+	return strlen(expected) == length && strncmp(token, expected, length) == 0;
+}
+
+static Tree parser_leaf(Parser *parser, const char *token, size_t length) {
+	assert(NULL != parser);
+	assert(NULL != token);
+	Shape *shape = NULL;
+	double r = 0;
+	double values[4];
+	double args[9];
+	color4 color;
+	int torus = parser_token_is(token, length, SHAPE_TORUS);
+	if (!torus && !parser_token_is(token, length, SHAPE_SPHERE) && !parser_token_is(token, length, SHAPE_CUBE)
+	&& !parser_token_is(token, length, SHAPE_CYLINDER) && !parser_token_is(token, length, SHAPE_CONE)) {
+		parser_fail(parser, "line %d : invalid token '%.*s'", parser->line, (int) length, token);
+		return NULL;
 	}
-	if (strncmp(strshape,SHAPE_CYLINDER,MAX_LEN_NODE_TOKEN) == 0) {
-		return parse_cylinder(args);
+	if ((torus && (!parser_number(parser, &r) || r <= 0)) || !parser_tuple(parser, values, 4) || !parser_transformations(parser, args)) {
+		parser_fail(parser, "line %d : invalid shape arguments", parser->line);
+		return NULL;
 	}
-	if (strncmp(strshape,SHAPE_CONE,MAX_LEN_NODE_TOKEN) == 0) {
-		return parse_cone(args);
+	color4_set(color, values[0], values[1], values[2], values[3]);
+	if (torus) {
+		shape = shape_torus(color, r);
+	} else if (parser_token_is(token, length, SHAPE_SPHERE)) {
+		shape = shape_sphere(color);
+	} else if (parser_token_is(token, length, SHAPE_CUBE)) {
+		shape = shape_cube(color);
+	} else if (parser_token_is(token, length, SHAPE_CYLINDER)) {
+		shape = shape_cylinder(color);
+	} else {
+		shape = shape_cone(color);
 	}
-	if (strncmp(strshape,SHAPE_TORUS,MAX_LEN_NODE_TOKEN) == 0) {
-		return parse_torus(args);
+	Tree tree = tree_allocate_leaf(shape);
+	parser_apply(tree, args);
+	return tree;
+}
+
+static int parser_operator(const char *token, size_t length, Operator *op) {
+	assert(NULL != token);
+	assert(NULL != op);
+	if (parser_token_is(token, length, OPERATOR_IDENTITY)) {
+		*op = Identity;
+	} else if (parser_token_is(token, length, OPERATOR_UNION)) {
+		*op = Union;
+	} else if (parser_token_is(token, length, OPERATOR_INTERSECTION)) {
+		*op = Intersection;
+	} else if (parser_token_is(token, length, OPERATOR_DIFFERENCE)) {
+		*op = Difference;
+	} else {
+		return 0;
 	}
-	fprintf(stderr, "line %d : invalid token '%s'\n", _parser_number_line_, strshape);
-	exit(EXIT_FAILURE);
+	return 1;
 }
 
-Tree parse_tree_aux(FILE *file) {
-	assert(NULL != file);
-	Tree tree = NULL, left = NULL, right = NULL;
-	char *line = NULL;
-	char node[MAX_LEN_NODE_TOKEN];
-	if(NULL == (line = (char *) malloc(MAX_LEN_LINE*sizeof(char)))) {
+static Tree parser_run(Parser *parser) {
+	assert(NULL != parser);
+	ParserFrame *stack = NULL;
+	int capacity = PARSER_STACK_SIZE, top = 0;
+	if (NULL == (stack = (ParserFrame *) malloc(capacity*sizeof(ParserFrame)))) {
 		fprintf(stderr, "memory allocation error (line %d file %s)\n", __LINE__, __FILE__);
 		exit(EXIT_FAILURE);
 	}
-	if (NULL == fgets(line,MAX_LEN_LINE,file)) {
-		fprintf(stderr, "line %d : unexpected end of file\n", _parser_number_line_);
-		exit(EXIT_FAILURE);
+	for (;;) {
+		parser_skip_blanks(parser);
+		if (parser->cursor >= parser->end) {
+			parser_fail(parser, "line %d : unexpected end of file", parser->line);
+			break;
+		}
+		parser->line++;
+		if (*parser->cursor == '\n') {
+			parser->cursor++;
+			continue;
+		}
+		const char *token = parser->cursor;
+		while (parser->cursor < parser->end && *parser->cursor != ' ' && *parser->cursor != '\t'
+		&& *parser->cursor != '\r' && *parser->cursor != '\n') {
+			parser->cursor++;
+		}
+		size_t length = parser->cursor - token;
+		Operator op;
+		if (parser_operator(token, length, &op)) {
+			if (top == capacity) {
+				capacity *= 2;
+				if (NULL == (stack = (ParserFrame *) realloc(stack, capacity*sizeof(ParserFrame)))) {
+					fprintf(stderr, "memory allocation error (line %d file %s)\n", __LINE__, __FILE__);
+					exit(EXIT_FAILURE);
+				}
+			}
+			ParserFrame *frame = stack + top++;
+			frame->op = op;
+			frame->left = NULL;
+			if (!parser_transformations(parser, frame->args)) {
+				parser_fail(parser, "line %d : invalid operator arguments", parser->line);
+				break;
+			}
+			parser_next_line(parser);
+			continue;
+		}
+		Tree tree = parser_leaf(parser, token, length);
+		if (NULL == tree)
+			break;
+		parser_next_line(parser);
+		while (top > 0 && NULL != stack[top - 1].left) {
+			ParserFrame *frame = stack + --top;
+			tree = tree_allocate_node(frame->op, frame->left, tree);
+			parser_apply(tree, frame->args);
+		}
+		if (top == 0) {
+			free(stack);
+			return tree;
+		}
+		stack[top - 1].left = tree;
 	}
-	int l = ++_parser_number_line_;
-	sscanf(line, "%" STR_MAX_LEN_NODE_TOKEN "s",node);
-	line += 1 + strlen(node);
-	if (strncmp(node,OPERATOR_IDENTITY,MAX_LEN_NODE_TOKEN) == 0) {
-		left = parse_tree_aux(file);
-		right = parse_tree_aux(file);
-		tree = tree_allocate_node(Identity, left, right);
-	} else if (strncmp(node,OPERATOR_UNION,MAX_LEN_NODE_TOKEN) == 0) {
-		left = parse_tree_aux(file);
-		right = parse_tree_aux(file);
-		tree = tree_allocate_node(Union, left, right);
-	} else if (strncmp(node,OPERATOR_INTERSECTION,MAX_LEN_NODE_TOKEN) == 0) {
-		left = parse_tree_aux(file);
-		right = parse_tree_aux(file);
-		tree = tree_allocate_node(Intersection, left, right);
-	} else if (strncmp(node,OPERATOR_DIFFERENCE,MAX_LEN_NODE_TOKEN) == 0) {
-		left = parse_tree_aux(file);
-		right = parse_tree_aux(file);
-		tree = tree_allocate_node(Difference, left, right);
-	} else {
-		return parse_leaf(node,line);
-	}
-	double tx,ty,tz;
-	double rx,ry,rz;
-	double hx,hy,hz;
-	int read = sscanf(line, "(%lf,%lf,%lf) (%lf,%lf,%lf) (%lf,%lf,%lf)", &tx, &ty, &tz, &rx, &ry, &rz, &hx, &hy, &hz); 
-	if (read != 9) {
-		fprintf(stderr, "line %d : invalid operator arguments\n", l);
+	while (top > 0) {
+		if (NULL != stack[--top].left)
+			tree_free(&(stack[top].left));
+	}
+	free(stack);
+	return NULL;
+}
+
+Tree parse_scene_buffer(const char *buffer, size_t length, char *error, size_t error_size) {
+	assert(NULL != buffer || 0 == length);
+	Parser parser;
+	parser.cursor = buffer;
+	parser.end = buffer + length;
+	parser.line = 0;
+	parser.error = error;
+	parser.error_size = error_size;
+	return parser_run(&parser);
+}
+
+Tree parse_tree_buffer(const char *buffer, size_t length) {
+	assert(NULL != buffer || 0 == length);
+	char error[PARSER_ERROR_SIZE];
+	Tree tree = parse_scene_buffer(buffer, length, error, sizeof(error));
+	if (NULL == tree) {
+		fprintf(stderr, "%s\n", error);
 		exit(EXIT_FAILURE);
-	} 
-	tree_translation(tree,tx,ty,tz);
-	tree_rotation(tree,rx,ry,rz);
-	tree_homothety(tree,hx,hy,hz);
+	}
 	return tree;
 }
 
 Tree parse_tree(FILE *file) {
 	assert(NULL != file);
-	_parser_number_line_ = 0;
-	return parse_tree_aux(file); 
+	struct stat info;
+	long offset = ftell(file);
+	if (offset >= 0 && 0 == fstat(fileno(file), &info) && S_ISREG(info.st_mode) && info.st_size > offset) {
+		void *map = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fileno(file), 0);
+		if (MAP_FAILED != map) {
+			posix_madvise(map, info.st_size, POSIX_MADV_SEQUENTIAL);
+			Tree tree = parse_tree_buffer((const char *) map + offset, info.st_size - offset);
+			munmap(map, info.st_size);
+			return tree;
+		}
+	}
+	char *buffer = NULL;
+	size_t size = 0, capacity = PARSER_READ_SIZE, read;
+	if (NULL == (buffer = (char *) malloc(capacity))) {
+		fprintf(stderr, "memory allocation error (line %d file %s)\n", __LINE__, __FILE__);
+		exit(EXIT_FAILURE);
+	}
+	while ((read = fread(buffer + size, 1, capacity - size, file)) > 0) {
+		size += read;
+		if (size == capacity) {
+			capacity *= 2;
+			if (NULL == (buffer = (char *) realloc(buffer, capacity))) {
+				fprintf(stderr, "memory allocation error (line %d file %s)\n", __LINE__, __FILE__);
+				exit(EXIT_FAILURE);
+			}
+		}
+	}
+	Tree tree = parse_tree_buffer(buffer, size);
+	free(buffer);
+	return tree;
 }
@@ -2,6 +2,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <GL/gl.h>
+#include <string.h>
 #include <assert.h>
 #include "point_cloud.h"
 
@@ -35,6 +36,72 @@ PointCloud * point_cloud_allocate(point3 *vrtx, vec3 *norm, color4 *colors, int
 	return point_cloud;
 }
 
+PointCloud * point_cloud_allocate_size(int size) {
+	assert(size >= 0);
+	point3 *vrtx = NULL;
+	vec3 *norm = NULL;
+	color4 *colors = NULL;
+	if (NULL == (vrtx = (point3 *) malloc((size > 0 ? size : 1) * sizeof(point3)))
+	|| NULL == (norm = (vec3 *) malloc((size > 0 ? size : 1) * sizeof(vec3)))
+	|| NULL == (colors = (color4 *) malloc((size > 0 ? size : 1) * sizeof(color4)))) {
+		fprintf(stderr, "memory allocation error (line %d file %s)\n", __LINE__, __FILE__);
+		exit(EXIT_FAILURE);
+	}
+	return point_cloud_allocate(vrtx, norm, colors, size);
+}
+
+PointCloud * point_cloud_slice(const PointCloud *point_cloud, int first, int size) {
+	assert(NULL != point_cloud);
+	assert(first >= 0 && size >= 0 && first + size <= point_cloud->size);
+	PointCloud *slice = point_cloud_allocate_size(size);
+	memcpy(slice->vrtx, point_cloud->vrtx + first, size * sizeof(point3));
+	memcpy(slice->norm, point_cloud->norm + first, size * sizeof(vec3));
+	memcpy(slice->colors, point_cloud->colors + first, size * sizeof(color4));
+	return slice;
+}
+
+void point_cloud_append(PointCloud *point_cloud, PointCloud **clouds, int size) {
+	assert(NULL != point_cloud);
+	assert(NULL != clouds);
+	assert(size >= 0);
+	point3 *vrtx = NULL;
+	vec3 *norm = NULL;
+	color4 *colors = NULL;
+	int i, total = point_cloud->size;
+	for (i = 0; i < size; i++) {
+		total += clouds[i]->size;
+	}
+	if (NULL == (vrtx = (point3 *) realloc(point_cloud->vrtx, (total > 0 ? total : 1) * sizeof(point3)))
+	|| NULL == (norm = (vec3 *) realloc(point_cloud->norm, (total > 0 ? total : 1) * sizeof(vec3)))
+	|| NULL == (colors = (color4 *) realloc(point_cloud->colors, (total > 0 ? total : 1) * sizeof(color4)))) {
+		fprintf(stderr, "memory allocation error (line %d file %s)\n", __LINE__, __FILE__);
+		exit(EXIT_FAILURE);
+	}
+	point_cloud->vrtx = vrtx;
+	point_cloud->norm = norm;
+	point_cloud->colors = colors;
+	for (i = 0; i < size; i++) {
+		memcpy(point_cloud->vrtx + point_cloud->size, clouds[i]->vrtx, clouds[i]->size * sizeof(point3));
+		memcpy(point_cloud->norm + point_cloud->size, clouds[i]->norm, clouds[i]->size * sizeof(vec3));
+		memcpy(point_cloud->colors + point_cloud->size, clouds[i]->colors, clouds[i]->size * sizeof(color4));
+		point_cloud->size += clouds[i]->size;
+		point_cloud_free(clouds + i);
+	}
+}
+
+PointCloud * point_cloud_concatenate(PointCloud **clouds, int size) {
+	assert(NULL != clouds);
+	assert(size >= 0);
+	int i, total = 0;
+	for (i = 0; i < size; i++) {
+		total += clouds[i]->size;
+	}
+	PointCloud *point_cloud = point_cloud_allocate_size(total);
+	point_cloud->size = 0;
+	point_cloud_append(point_cloud, clouds, size);
+	return point_cloud;
+}
+
 void set_material(color4 color) {
 	GLfloat specular[] = {0.6, 0.6, 0.6, 1};
 	GLfloat shininess = 30;
@@ -75,3 +142,47 @@ void point_cloud_free (PointCloud **point_cloud) {
 	free((*point_cloud));
 	(*point_cloud) = NULL;
 }
+
+int point_cloud_write(const PointCloud *point_cloud, FILE *file) {
+	assert(NULL != point_cloud);
+	assert(point_cloud->size >= 0);
+	assert(NULL != file);
+	size_t size = point_cloud->size;
+	return fwrite(POINT_CLOUD_MAGIC, 4, 1, file) == 1
+		&& fwrite(&(point_cloud->size), sizeof(int), 1, file) == 1
+		&& fwrite(point_cloud->vrtx, sizeof(point3), size, file) == size
+		&& fwrite(point_cloud->norm, sizeof(vec3), size, file) == size
+		&& fwrite(point_cloud->colors, sizeof(color4), size, file) == size;
+}
+
+PointCloud * point_cloud_read(FILE *file) {
+	assert(NULL != file);
+	char magic[4];
+	int size;
+	if (fread(magic, 4, 1, file) != 1 || memcmp(magic, POINT_CLOUD_MAGIC, 4) != 0
+	|| fread(&size, sizeof(int), 1, file) != 1 || size < 0)
+		return NULL;
+	point3 *vrtx = NULL;
+	vec3 *norm = NULL;
+	color4 *colors = NULL;
+	if (NULL == (vrtx = (point3 *) malloc(size * sizeof(point3)))) {
+		fprintf(stderr, "memory allocation error (line %d file %s)", __LINE__, __FILE__);
+		exit(EXIT_FAILURE);
+	}
+	if (NULL == (norm = (vec3 *) malloc(size * sizeof(vec3)))) {
+		fprintf(stderr, "memory allocation error (line %d file %s)", __LINE__, __FILE__);
+		exit(EXIT_FAILURE);
+	}
+	if (NULL == (colors = (color4 *) malloc(size * sizeof(color4)))) {
+		fprintf(stderr, "memory allocation error (line %d file %s)", __LINE__, __FILE__);
+		exit(EXIT_FAILURE);
+	}
+	if (fread(vrtx, sizeof(point3), size, file) != (size_t) size || fread(norm, sizeof(vec3), size, file) != (size_t) size
+	|| fread(colors, sizeof(color4), size, file) != (size_t) size) {
+		free(vrtx);
+		free(norm);
+		free(colors);
+		return NULL;
+	}
+	return point_cloud_allocate(vrtx, norm, colors, size);
+}
@@ -0,0 +1,113 @@
+#include "pool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#define POOL_INITIAL_CAPACITY (64)
+
+static void * pool_work(void *arg) {
+	ThreadPool *pool = (ThreadPool *) arg;
+	pthread_mutex_lock(&(pool->mutex));
+	for (;;) {
+		while (pool->count == 0 && !pool->stop) {
+			pthread_cond_wait(&(pool->available), &(pool->mutex));
+		}
+		if (pool->count == 0)
+			break;
+		PoolTask task = pool->tasks[pool->head];
+		pool->head = (pool->head + 1) % pool->capacity;
+		pool->count--;
+		pthread_mutex_unlock(&(pool->mutex));
+		task.function(task.arg);
+		pthread_mutex_lock(&(pool->mutex));
+		if (--(pool->pending) == 0)
+			pthread_cond_broadcast(&(pool->done));
+	}
+	pthread_mutex_unlock(&(pool->mutex));
+	return NULL;
+}
+
+ThreadPool * pool_allocate(int threads) {
+	assert(threads > 0);
+	ThreadPool *pool = NULL;
+	int i;
+	if (NULL == (pool = (ThreadPool *) malloc(sizeof(ThreadPool)))
+	|| NULL == (pool->threads = (pthread_t *) malloc(threads*sizeof(pthread_t)))
+	|| NULL == (pool->tasks = (PoolTask *) malloc(POOL_INITIAL_CAPACITY*sizeof(PoolTask)))) {
+		fprintf(stderr, "memory allocation error (line %d file %s)\n", __LINE__, __FILE__);
+		exit(EXIT_FAILURE);
+	}
+	pool->size = threads;
+	pool->capacity = POOL_INITIAL_CAPACITY;
+	pool->head = 0;
+	pool->count = 0;
+	pool->pending = 0;
+	pool->stop = 0;
+	pthread_mutex_init(&(pool->mutex), NULL);
+	pthread_cond_init(&(pool->available), NULL);
+	pthread_cond_init(&(pool->done), NULL);
+	for (i = 0; i < threads; i++) {
+		if (0 != pthread_create(pool->threads + i, NULL, pool_work, pool)) {
+			fprintf(stderr, "thread creation error (line %d file %s)\n", __LINE__, __FILE__);
+			exit(EXIT_FAILURE);
+		}
+	}
+	return pool;
+}
+
+void pool_submit(ThreadPool *pool, void (*function)(void *), void *arg) {
+	assert(NULL != pool);
+	assert(NULL != function);
+	pthread_mutex_lock(&(pool->mutex));
+	if (pool->count == pool->capacity) {
+		PoolTask *tasks = NULL;
+		int i;
+		if (NULL == (tasks = (PoolTask *) malloc(2*pool->capacity*sizeof(PoolTask)))) {
+			fprintf(stderr, "memory allocation error (line %d file %s)\n", __LINE__, __FILE__);
+			exit(EXIT_FAILURE);
+		}
+		for (i = 0; i < pool->count; i++) {
+			tasks[i] = pool->tasks[(pool->head + i) % pool->capacity];
+		}
+		free(pool->tasks);
+		pool->tasks = tasks;
+		pool->capacity *= 2;
+		pool->head = 0;
+	}
+	pool->tasks[(pool->head + pool->count) % pool->capacity].function = function;
+	pool->tasks[(pool->head + pool->count) % pool->capacity].arg = arg;
+	pool->count++;
+	pool->pending++;
+	pthread_cond_signal(&(pool->available));
+	pthread_mutex_unlock(&(pool->mutex));
+}
+
+void pool_wait(ThreadPool *pool) {
+	assert(NULL != pool);
+	pthread_mutex_lock(&(pool->mutex));
+	while (pool->pending > 0) {
+		pthread_cond_wait(&(pool->done), &(pool->mutex));
+	}
+	pthread_mutex_unlock(&(pool->mutex));
+}
+
+void pool_free(ThreadPool **pool) {
+	assert(NULL != pool);
+	assert(NULL != *pool);
+	int i;
+	pthread_mutex_lock(&((*pool)->mutex));
+	(*pool)->stop = 1;
+	pthread_cond_broadcast(&((*pool)->available));
+	pthread_mutex_unlock(&((*pool)->mutex));
+	for (i = 0; i < (*pool)->size; i++) {
+		pthread_join((*pool)->threads[i], NULL);
+	}
+	pthread_mutex_destroy(&((*pool)->mutex));
+	pthread_cond_destroy(&((*pool)->available));
+	pthread_cond_destroy(&((*pool)->done));
+	free((*pool)->tasks);
+	free((*pool)->threads);
+	free(*pool);
+	*pool = NULL;
+}
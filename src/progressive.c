@@ -0,0 +1,112 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "progressive.h"
+
+#include "types.h"
+#include "shape.h"
+#include "zone.h"
+#include "morton.h"
+#include "chrono.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include "point_cloud.h"
+
+static void * progressive_generate(void *arg) {
+	Progressive *progressive = (Progressive *) arg;
+	Zones *zones = zone_build(progressive->tree);
+	PointCloud *previous = progressive->front;
+	int level, reached = 0, stop = 0;
+	shape_seed(progressive->seed);
+	for (level = 0; !stop && level < progressive->levels; level++) {
+		int target = (progressive->first << level) < progressive->density ? progressive->first << level : progressive->density;
+		PointCloud *pass = zone_to_point_cloud(zones, target - reached);
+		PointCloud *next = point_cloud_slice(previous, 0, previous->size);
+		point_cloud_append(next, &pass, 1);
+		if (progressive->morton)
+			morton_sort(next, 0);
+		reached = target;
+		pthread_mutex_lock(&(progressive->mutex));
+		if (NULL != progressive->back)
+			point_cloud_free(&(progressive->back));
+		progressive->back = next;
+		progressive->back_level = level;
+		progressive->back_density = target;
+		progressive->back_time = chrono_now() - progressive->start;
+		stop = progressive->stop;
+		pthread_mutex_unlock(&(progressive->mutex));
+		previous = next;
+	}
+	zone_free(&zones);
+	return NULL;
+}
+
+Progressive * progressive_start(Tree tree, int first, int density, unsigned int seed, int morton) {
+	assert(NULL != tree);
+	assert(tree_is_valid(tree));
+	assert(first > 0);
+	assert(density > 0);
+	Progressive *progressive = NULL;
+	if (NULL == (progressive = (Progressive *) malloc(sizeof(Progressive)))) {
+		fprintf(stderr, "memory allocation error (line %d file %s)\n", __LINE__, __FILE__);
+		exit(EXIT_FAILURE);
+	}
+	progressive->tree = tree;
+	progressive->first = (first < density) ? first : density;
+	progressive->density = density;
+	progressive->seed = seed;
+	progressive->morton = morton;
+	progressive->levels = 1;
+	while ((progressive->first << (progressive->levels - 1)) < density) {
+		progressive->levels++;
+	}
+	progressive->front = point_cloud_allocate_size(0);
+	progressive->front_level = -1;
+	progressive->front_density = 0;
+	progressive->front_time = 0;
+	progressive->back = NULL;
+	progressive->back_level = -1;
+	progressive->back_density = 0;
+	progressive->back_time = 0;
+	progressive->stop = 0;
+	pthread_mutex_init(&(progressive->mutex), NULL);
+	progressive->start = chrono_now();
+	if (0 != pthread_create(&(progressive->thread), NULL, progressive_generate, progressive)) {
+		fprintf(stderr, "thread creation error (line %d file %s)\n", __LINE__, __FILE__);
+		exit(EXIT_FAILURE);
+	}
+	return progressive;
+}
+
+int progressive_update(Progressive *progressive) {
+	assert(NULL != progressive);
+	PointCloud *previous = NULL;
+	pthread_mutex_lock(&(progressive->mutex));
+	if (NULL != progressive->back) {
+		previous = progressive->front;
+		progressive->front = progressive->back;
+		progressive->front_level = progressive->back_level;
+		progressive->front_density = progressive->back_density;
+		progressive->front_time = progressive->back_time;
+		progressive->back = NULL;
+	}
+	pthread_mutex_unlock(&(progressive->mutex));
+	if (NULL == previous)
+		return 0;
+	point_cloud_free(&previous);
+	return 1;
+}
+
+void progressive_free(Progressive **progressive) {
+	assert(NULL != progressive);
+	assert(NULL != *progressive);
+	pthread_mutex_lock(&((*progressive)->mutex));
+	(*progressive)->stop = 1;
+	pthread_mutex_unlock(&((*progressive)->mutex));
+	pthread_join((*progressive)->thread, NULL);
+	progressive_update(*progressive);
+	point_cloud_free(&((*progressive)->front));
+	pthread_mutex_destroy(&((*progressive)->mutex));
+	free(*progressive);
+	*progressive = NULL;
+}
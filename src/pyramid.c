@@ -0,0 +1,58 @@
+#include "pyramid.h"
+
+#include "types.h"
+#include "zone.h"
+#include "morton.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include "point_cloud.h"
+
+Pyramid * pyramid_build(const Zones *zones, const int *densities, int levels, int morton) {
+	assert(NULL != zones);
+	assert(NULL != densities);
+	assert(levels > 0);
+	Pyramid *pyramid = NULL;
+	PointCloud **clouds = NULL;
+	int level, size = 0;
+	if (NULL == (pyramid = (Pyramid *) malloc(sizeof(Pyramid)))
+	|| NULL == (pyramid->densities = (int *) malloc(levels * sizeof(int)))
+	|| NULL == (pyramid->sizes = (int *) malloc(levels * sizeof(int)))
+	|| NULL == (clouds = (PointCloud **) malloc(levels * sizeof(PointCloud *)))) {
+		fprintf(stderr, "memory allocation error (line %d file %s)\n", __LINE__, __FILE__);
+		exit(EXIT_FAILURE);
+	}
+	pyramid->levels = levels;
+	for (level = 0; level < levels; level++) {
+		assert(densities[level] > (level > 0 ? densities[level - 1] : 0));
+		pyramid->densities[level] = densities[level];
+		clouds[level] = zone_to_point_cloud(zones, densities[level] - (level > 0 ? densities[level - 1] : 0));
+		if (morton)
+			morton_sort(clouds[level], 0);
+		size += clouds[level]->size;
+		pyramid->sizes[level] = size;
+	}
+	pyramid->point_cloud = point_cloud_concatenate(clouds, levels);
+	free(clouds);
+	return pyramid;
+}
+
+void pyramid_level(const Pyramid *pyramid, int level, PointCloud *point_cloud) {
+	assert(NULL != pyramid);
+	assert(level >= 0 && level < pyramid->levels);
+	assert(NULL != point_cloud);
+	point_cloud->vrtx = pyramid->point_cloud->vrtx;
+	point_cloud->norm = pyramid->point_cloud->norm;
+	point_cloud->colors = pyramid->point_cloud->colors;
+	point_cloud->size = pyramid->sizes[level];
+}
+
+void pyramid_free(Pyramid **pyramid) {
+	assert(NULL != pyramid);
+	assert(NULL != *pyramid);
+	point_cloud_free(&((*pyramid)->point_cloud));
+	free((*pyramid)->densities);
+	free((*pyramid)->sizes);
+	free(*pyramid);
+	*pyramid = NULL;
+}
@@ -0,0 +1,790 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "raycast.h"
+
+#include "types.h"
+#include "shape.h"
+#include "tree.h"
+#include "view.h"
+#include "pool.h"
+#include "chrono.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <limits.h>
+#include <assert.h>
+#include <unistd.h>
+#include "point_cloud.h"
+
+#define RAYCAST_EPSILON (1e-9)
+#define RAYCAST_NEWTON_STEPS (2)
+#define RAYCAST_BACKGROUND (0.22)
+#define RAYCAST_AMBIENT (0.4)
+#define RAYCAST_DIFFUSE (0.75)
+#define RAYCAST_SPECULAR (0.45)
+#define RAYCAST_SHININESS (30)
+#define RAYCAST_INITIAL_POINTS (1024)
+
+typedef struct {
+	Tree tree;
+	int left;
+	int right;
+	point3 min;
+	point3 max;
+	affine world_inv;
+} RaycastNode;
+
+typedef struct {
+	double t;
+	int node;
+	int flip;
+} RaycastHit;
+
+typedef struct {
+	RaycastHit in[RAYCAST_SPANS];
+	RaycastHit out[RAYCAST_SPANS];
+	int size;
+	double limit;
+} RaycastSpans;
+
+typedef struct {
+	RaycastNode *nodes;
+	int size;
+	double near;
+	const View *view;
+	vec3 forward;
+	vec3 right;
+	vec3 up;
+	double tangent;
+	double aspect;
+	RaycastImage *image;
+} Raycast;
+
+typedef struct {
+	const Raycast *raycast;
+	int x;
+	int y;
+	unsigned long hits;
+} RaycastTile;
+
+static void raycast_basis(const View *view, vec3 forward, vec3 right, vec3 up) {
+	vec3_set(forward, view->target[0] - view->eye[0], view->target[1] - view->eye[1], view->target[2] - view->eye[2]);
+	vec3_normalize(forward);
+	vec3_cross(right, forward, view->up);
+	vec3_normalize(right);
+	vec3_cross(up, right, forward);
+}
+
+static int raycast_count(Tree tree) {
+	return (NULL == tree->shape) ? 1 + raycast_count(tree->left) + raycast_count(tree->right) : 1;
+}
+
+static int raycast_flatten(Raycast *raycast, Tree tree, const affine parent_inv) {
+	int index = raycast->size++;
+	RaycastNode *node = raycast->nodes + index;
+	point3 min, max, p, q;
+	int i, k;
+	node->tree = tree;
+	affine_product(node->world_inv, tree->inv_transformations, parent_inv);
+	if (NULL == tree->shape) {
+		node->left = raycast_flatten(raycast, tree->left, node->world_inv);
+		node->right = raycast_flatten(raycast, tree->right, node->world_inv);
+		const RaycastNode *left = raycast->nodes + node->left;
+		const RaycastNode *right = raycast->nodes + node->right;
+		for (k = 0; k < 3; k++) {
+			switch (tree->op) {
+				case Intersection:
+					min[k] = (left->min[k] > right->min[k]) ? left->min[k] : right->min[k];
+					max[k] = (left->max[k] < right->max[k]) ? left->max[k] : right->max[k];
+					break;
+				case Difference:
+					min[k] = left->min[k];
+					max[k] = left->max[k];
+					break;
+				default:
+					min[k] = (left->min[k] < right->min[k]) ? left->min[k] : right->min[k];
+					max[k] = (left->max[k] > right->max[k]) ? left->max[k] : right->max[k];
+			}
+		}
+	} else {
+		node->left = node->right = -1;
+		shape_bounds(tree->shape, min, max);
+	}
+	for (i = 0; i < 8; i++) {
+		point3_set(p, (i & 1) ? max[0] : min[0], (i & 2) ? max[1] : min[1], (i & 4) ? max[2] : min[2]);
+		affine_product_point3(q, tree->transformations, p);
+		for (k = 0; k < 3; k++) {
+			if (i == 0 || q[k] < node->min[k])
+				node->min[k] = q[k];
+			if (i == 0 || q[k] > node->max[k])
+				node->max[k] = q[k];
+		}
+	}
+	return index;
+}
+
+static int raycast_box(const point3 min, const point3 max, const point3 o, const vec3 d, double near) {
+	double t0 = near, t1 = HUGE_VAL;
+	int k;
+	for (k = 0; k < 3; k++) {
+		if (min[k] > max[k])
+			return 0;
+		if (fabs(d[k]) < RAYCAST_EPSILON) {
+			if (o[k] < min[k] || o[k] > max[k])
+				return 0;
+			continue;
+		}
+		double a = (min[k] - o[k]) / d[k];
+		double b = (max[k] - o[k]) / d[k];
+		if (a > b) {
+			double tmp = a;
+			a = b;
+			b = tmp;
+		}
+		t0 = (a > t0) ? a : t0;
+		t1 = (b < t1) ? b : t1;
+		if (t0 > t1)
+			return 0;
+	}
+	return 1;
+}
+
+static void raycast_add(RaycastSpans *spans, double t0, double t1, int node, double near) {
+	if (t0 > t1 || t1 < near || spans->size == RAYCAST_SPANS)
+		return;
+	spans->in[spans->size].t = t0;
+	spans->in[spans->size].node = node;
+	spans->in[spans->size].flip = 0;
+	spans->out[spans->size].t = t1;
+	spans->out[spans->size].node = node;
+	spans->out[spans->size].flip = 0;
+	spans->size++;
+}
+
+static int raycast_quadratic(double a, double b, double c, double *roots) {
+	double discriminant = b * b - 4 * a * c;
+	if (discriminant < 0)
+		return 0;
+	double q = -0.5 * (b + ((b < 0) ? -sqrt(discriminant) : sqrt(discriminant)));
+	if (q == 0) {
+		roots[0] = roots[1] = 0;
+		return 2;
+	}
+	roots[0] = q / a;
+	roots[1] = c / q;
+	if (roots[0] > roots[1]) {
+		double tmp = roots[0];
+		roots[0] = roots[1];
+		roots[1] = tmp;
+	}
+	return 2;
+}
+
+static double raycast_cbrt(double x) {
+	return (x > 0) ? pow(x, 1. / 3.) : ((x < 0) ? -pow(-x, 1. / 3.) : 0.);
+}
+
+static int raycast_cubic(double a, double b, double c, double *roots) {
+	double sq_a = a * a;
+	double p = (-sq_a / 3. + b) / 3.;
+	double q = (2. / 27. * a * sq_a - a * b / 3. + c) / 2.;
+	double cb_p = p * p * p;
+	double discriminant = q * q + cb_p;
+	int i, n;
+	if (fabs(discriminant) < RAYCAST_EPSILON) {
+		if (fabs(q) < RAYCAST_EPSILON) {
+			roots[0] = 0;
+			n = 1;
+		} else {
+			double u = raycast_cbrt(-q);
+			roots[0] = 2 * u;
+			roots[1] = -u;
+			n = 2;
+		}
+	} else if (discriminant < 0) {
+		double phi = acos(-q / sqrt(-cb_p)) / 3.;
+		double t = 2 * sqrt(-p);
+		roots[0] = t * cos(phi);
+		roots[1] = -t * cos(phi + PI / 3.);
+		roots[2] = -t * cos(phi - PI / 3.);
+		n = 3;
+	} else {
+		double s = sqrt(discriminant);
+		roots[0] = raycast_cbrt(s - q) - raycast_cbrt(s + q);
+		n = 1;
+	}
+	for (i = 0; i < n; i++) {
+		roots[i] -= a / 3.;
+	}
+	return n;
+}
+
+static int raycast_quartic(const double *c, double *roots) {
+	double a = c[3], b = c[2], d = c[1], e = c[0];
+	double sq_a = a * a;
+	double p = -3. / 8. * sq_a + b;
+	double q = sq_a * a / 8. - a * b / 2. + d;
+	double r = -3. / 256. * sq_a * sq_a + sq_a * b / 16. - a * d / 4. + e;
+	double cubic[3];
+	int i, n = 0;
+	if (fabs(r) < RAYCAST_EPSILON) {
+		n = raycast_cubic(0, p, q, roots);
+		roots[n++] = 0;
+	} else {
+		raycast_cubic(-p / 2., -r, r * p / 2. - q * q / 8., cubic);
+		double z = cubic[0];
+		double u = z * z - r;
+		double v = 2 * z - p;
+		if (fabs(u) < RAYCAST_EPSILON)
+			u = 0;
+		else if (u > 0)
+			u = sqrt(u);
+		else
+			return 0;
+		if (fabs(v) < RAYCAST_EPSILON)
+			v = 0;
+		else if (v > 0)
+			v = sqrt(v);
+		else
+			return 0;
+		n = raycast_quadratic(1, (q < 0) ? -v : v, z - u, roots);
+		n += raycast_quadratic(1, (q < 0) ? v : -v, z + u, roots + n);
+	}
+	for (i = 0; i < n; i++) {
+		roots[i] -= a / 4.;
+	}
+	return n;
+}
+
+static double raycast_polynomial(const double *c, double x, double *derivative) {
+	*derivative = ((4 * x + 3 * c[3]) * x + 2 * c[2]) * x + c[1];
+	return (((x + c[3]) * x + c[2]) * x + c[1]) * x + c[0];
+}
+
+static void raycast_torus(double r, const point3 o, const vec3 d, int node, double near, RaycastSpans *spans) {
+	double length = sqrt(vec3_dot(d, d));
+	vec3 u;
+	point3 s;
+	double c[5], roots[4], derivative;
+	int i, j, k, n;
+	vec3_set(u, d[0] / length, d[1] / length, d[2] / length);
+	double m = vec3_dot(o, u);
+	double bound = m * m - (vec3_dot(o, o) - (1 + r) * (1 + r));
+	if (bound < 0)
+		return;
+	double shift = -m - sqrt(bound);
+	point3_set(s, o[0] + shift * u[0], o[1] + shift * u[1], o[2] + shift * u[2]);
+	double h = vec3_dot(s, s) + 1 - r * r;
+	m = vec3_dot(s, u);
+	c[4] = 1;
+	c[3] = 4 * m;
+	c[2] = 4 * m * m + 2 * h - 4 * (u[0] * u[0] + u[1] * u[1]);
+	c[1] = 4 * m * h - 8 * (s[0] * u[0] + s[1] * u[1]);
+	c[0] = h * h - 4 * (s[0] * s[0] + s[1] * s[1]);
+	n = raycast_quartic(c, roots);
+	for (i = 0; i < n; i++) {
+		for (k = 0; k < RAYCAST_NEWTON_STEPS; k++) {
+			double f = raycast_polynomial(c, roots[i], &derivative);
+			if (fabs(derivative) > RAYCAST_EPSILON)
+				roots[i] -= f / derivative;
+		}
+		for (j = i; j > 0 && roots[j - 1] > roots[j]; j--) {
+			double tmp = roots[j];
+			roots[j] = roots[j - 1];
+			roots[j - 1] = tmp;
+		}
+	}
+	for (i = 0; i + 1 < n; i++) {
+		if (raycast_polynomial(c, (roots[i] + roots[i + 1]) / 2, &derivative) < 0)
+			raycast_add(spans, (shift + roots[i]) / length, (shift + roots[i + 1]) / length, node, near);
+	}
+}
+
+static int raycast_slab(double o, double d, double *t0, double *t1) {
+	if (fabs(d) < RAYCAST_EPSILON)
+		return fabs(o) <= 1;
+	double a = (-1 - o) / d, b = (1 - o) / d;
+	*t0 = (a < b) ? ((a > *t0) ? a : *t0) : ((b > *t0) ? b : *t0);
+	*t1 = (a < b) ? ((b < *t1) ? b : *t1) : ((a < *t1) ? a : *t1);
+	return *t0 <= *t1;
+}
+
+static void raycast_cone(const point3 o, const vec3 d, int node, double near, RaycastSpans *spans) {
+	double w = 1 - o[2];
+	double a = d[0] * d[0] + d[1] * d[1] - d[2] * d[2] / 4;
+	double b = 2 * (o[0] * d[0] + o[1] * d[1]) + w * d[2] / 2;
+	double c = o[0] * o[0] + o[1] * o[1] - w * w / 4;
+	double pieces[4], roots[2];
+	int i, n = 0;
+	if (fabs(a) < RAYCAST_EPSILON) {
+		if (fabs(b) < RAYCAST_EPSILON) {
+			if (c > 0)
+				return;
+			pieces[n++] = -HUGE_VAL;
+			pieces[n++] = HUGE_VAL;
+		} else {
+			pieces[n++] = (b < 0) ? -c / b : -HUGE_VAL;
+			pieces[n++] = (b < 0) ? HUGE_VAL : -c / b;
+		}
+	} else if (raycast_quadratic(a, b, c, roots) == 0) {
+		if (a > 0)
+			return;
+		pieces[n++] = -HUGE_VAL;
+		pieces[n++] = HUGE_VAL;
+	} else if (a > 0) {
+		pieces[n++] = roots[0];
+		pieces[n++] = roots[1];
+	} else {
+		pieces[n++] = -HUGE_VAL;
+		pieces[n++] = roots[0];
+		pieces[n++] = roots[1];
+		pieces[n++] = HUGE_VAL;
+	}
+	for (i = 0; i < n; i += 2) {
+		double t0 = pieces[i], t1 = pieces[i + 1];
+		if (raycast_slab(o[2], d[2], &t0, &t1))
+			raycast_add(spans, t0, t1, node, near);
+	}
+}
+
+static void raycast_leaf(const Shape *shape, const point3 o, const vec3 d, int node, double near, RaycastSpans *spans) {
+	double roots[2], t0 = -HUGE_VAL, t1 = HUGE_VAL;
+	double a, b, c;
+	switch (shape->type) {
+		case Sphere:
+			if (raycast_quadratic(vec3_dot(d, d), 2 * vec3_dot(o, d), vec3_dot(o, o) - 1, roots) > 0)
+				raycast_add(spans, roots[0], roots[1], node, near);
+			break;
+		case Cube:
+			if (raycast_slab(o[0], d[0], &t0, &t1) && raycast_slab(o[1], d[1], &t0, &t1) && raycast_slab(o[2], d[2], &t0, &t1))
+				raycast_add(spans, t0, t1, node, near);
+			break;
+		case Cylinder:
+			a = d[0] * d[0] + d[1] * d[1];
+			b = 2 * (o[0] * d[0] + o[1] * d[1]);
+			c = o[0] * o[0] + o[1] * o[1] - 1;
+			if (a < RAYCAST_EPSILON) {
+				if (c > 0)
+					break;
+			} else if (raycast_quadratic(a, b, c, roots) > 0) {
+				t0 = roots[0];
+				t1 = roots[1];
+			} else {
+				break;
+			}
+			if (raycast_slab(o[2], d[2], &t0, &t1))
+				raycast_add(spans, t0, t1, node, near);
+			break;
+		case Cone:
+			raycast_cone(o, d, node, near, spans);
+			break;
+		case Torus:
+			raycast_torus(shape->args[0], o, d, node, near, spans);
+			break;
+		default:
+			fprintf(stderr, "Invalid Shape type descriptor '%u' (line %d file %s)", shape->type, __LINE__, __FILE__);
+			exit(EXIT_FAILURE);
+	}
+}
+
+static int raycast_inside(Operator op, int a, int b) {
+	switch (op) {
+		case Intersection:
+			return a && b;
+		case Difference:
+			return a && !b;
+		default:
+			return a || b;
+	}
+}
+
+static void raycast_combine(Operator op, const RaycastSpans *a, const RaycastSpans *b, RaycastSpans *result) {
+	int i = 0, j = 0, in_a = 0, in_b = 0, inside = 0;
+	result->size = 0;
+	result->limit = (a->limit < b->limit) ? a->limit : b->limit;
+	while (i < 2 * a->size || j < 2 * b->size) {
+		const RaycastHit *ha = (i < 2 * a->size) ? ((i & 1) ? a->out + i / 2 : a->in + i / 2) : NULL;
+		const RaycastHit *hb = (j < 2 * b->size) ? ((j & 1) ? b->out + j / 2 : b->in + j / 2) : NULL;
+		int from_b = (NULL == ha) || (NULL != hb && hb->t < ha->t);
+		const RaycastHit *h = from_b ? hb : ha;
+		if (h->t >= result->limit)
+			break;
+		if (from_b) {
+			in_b = !in_b;
+			j++;
+		} else {
+			in_a = !in_a;
+			i++;
+		}
+		int now = raycast_inside(op, in_a, in_b);
+		if (now == inside)
+			continue;
+		if (now && result->size == RAYCAST_SPANS) {
+			result->limit = h->t;
+			break;
+		}
+		RaycastHit *r = now ? result->in + result->size : result->out + result->size;
+		*r = *h;
+		r->flip ^= (from_b && op == Difference);
+		if (!now)
+			result->size++;
+		inside = now;
+	}
+	if (inside) {
+		result->out[result->size].t = result->limit;
+		result->out[result->size].node = -1;
+		result->out[result->size].flip = 0;
+		result->size++;
+	}
+}
+
+static void raycast_trace(const Raycast *raycast, int index, const point3 o, const vec3 d, RaycastSpans *spans, unsigned long *endpoints) {
+	const RaycastNode *node = raycast->nodes + index;
+	const double *m = node->tree->inv_transformations;
+	double near = raycast->near;
+	point3 lo;
+	vec3 ld;
+	int k;
+	spans->size = 0;
+	spans->limit = HUGE_VAL;
+	if (!raycast_box(node->min, node->max, o, d, near))
+		return;
+	for (k = 0; k < 3; k++) {
+		ld[k] = affine_get(m, 0, k) * d[0] + affine_get(m, 1, k) * d[1] + affine_get(m, 2, k) * d[2];
+		lo[k] = affine_get(m, 0, k) * o[0] + affine_get(m, 1, k) * o[1] + affine_get(m, 2, k) * o[2] + affine_get(m, 3, k);
+	}
+	if (node->left < 0) {
+		raycast_leaf(node->tree->shape, lo, ld, index, near, spans);
+		*endpoints += 2 * spans->size;
+		return;
+	}
+	RaycastSpans left, right;
+	Operator op = node->tree->op;
+	raycast_trace(raycast, node->left, lo, ld, &left, endpoints);
+	if (left.size == 0 && left.limit == HUGE_VAL && (op == Intersection || op == Difference))
+		return;
+	raycast_trace(raycast, node->right, lo, ld, &right, endpoints);
+	if (right.size == 0 && right.limit == HUGE_VAL && op != Intersection) {
+		*spans = left;
+		return;
+	}
+	raycast_combine(op, &left, &right, spans);
+}
+
+static void raycast_normal(const RaycastNode *leaf, const point3 eye, const vec3 d, double t, int flip, vec3 normal) {
+	const double *m = leaf->world_inv;
+	point3 w, p;
+	vec3 g;
+	int k;
+	point3_set(w, eye[0] + t * d[0], eye[1] + t * d[1], eye[2] + t * d[2]);
+	affine_product_point3(p, m, w);
+	double radial = sqrt(p[0] * p[0] + p[1] * p[1]);
+	switch (leaf->tree->shape->type) {
+		case Sphere:
+			vec3_set(g, p[0], p[1], p[2]);
+			break;
+		case Cube:
+			k = (fabs(p[0]) > fabs(p[1])) ? ((fabs(p[0]) > fabs(p[2])) ? 0 : 2) : ((fabs(p[1]) > fabs(p[2])) ? 1 : 2);
+			vec3_set(g, 0, 0, 0);
+			g[k] = (p[k] < 0) ? -1 : 1;
+			break;
+		case Cylinder:
+			if (1 - fabs(p[2]) < 1 - radial)
+				vec3_set(g, 0, 0, (p[2] < 0) ? -1 : 1);
+			else
+				vec3_set(g, p[0], p[1], 0);
+			break;
+		case Cone:
+			if (p[2] + 1 < fabs(radial - (1 - p[2]) / 2))
+				vec3_set(g, 0, 0, -1);
+			else
+				vec3_set(g, 2 * p[0], 2 * p[1], (1 - p[2]) / 2);
+			break;
+		default: {
+			double r = leaf->tree->shape->args[0];
+			double s = vec3_dot(p, p) + 1 - r * r;
+			vec3_set(g, 4 * s * p[0] - 8 * p[0], 4 * s * p[1] - 8 * p[1], 4 * s * p[2]);
+		}
+	}
+	for (k = 0; k < 3; k++) {
+		normal[k] = affine_get(m, k, 0) * g[0] + affine_get(m, k, 1) * g[1] + affine_get(m, k, 2) * g[2];
+	}
+	vec3_normalize(normal);
+	if (flip)
+		vec3_set(normal, -normal[0], -normal[1], -normal[2]);
+}
+
+static void raycast_tile(void *arg) {
+	RaycastTile *tile = (RaycastTile *) arg;
+	const Raycast *raycast = tile->raycast;
+	const View *view = raycast->view;
+	RaycastImage *image = raycast->image;
+	RaycastSpans spans;
+	vec3 d, normal;
+	unsigned long endpoints = 0;
+	int x, y, i, k;
+	for (y = tile->y; y < tile->y + RAYCAST_TILE && y < image->height; y++) {
+		for (x = tile->x; x < tile->x + RAYCAST_TILE && x < image->width; x++) {
+			double sx = (2 * (x + 0.5) / image->width - 1) * raycast->tangent * raycast->aspect;
+			double sy = (1 - 2 * (y + 0.5) / image->height) * raycast->tangent;
+			for (k = 0; k < 3; k++) {
+				d[k] = raycast->forward[k] + sx * raycast->right[k] + sy * raycast->up[k];
+			}
+			vec3_normalize(d);
+			raycast_trace(raycast, 0, view->eye, d, &spans, &endpoints);
+			const RaycastHit *hit = NULL;
+			for (i = 0; NULL == hit && i < spans.size; i++) {
+				if (spans.in[i].t > view->near)
+					hit = spans.in + i;
+				else if (spans.out[i].t > view->near)
+					hit = spans.out + i;
+			}
+			unsigned char *pixel = image->pixels + 3 * (y * image->width + x);
+			if (NULL == hit || hit->node < 0) {
+				pixel[0] = pixel[1] = pixel[2] = (unsigned char) (255 * RAYCAST_BACKGROUND + 0.5);
+				image->depth[y * image->width + x] = -1;
+				continue;
+			}
+			const RaycastNode *leaf = raycast->nodes + hit->node;
+			raycast_normal(leaf, view->eye, d, hit->t, hit->flip, normal);
+			double lambert = -vec3_dot(normal, d);
+			lambert = (lambert > 0) ? lambert : 0;
+			double specular = RAYCAST_SPECULAR * pow(lambert, RAYCAST_SHININESS);
+			for (k = 0; k < 3; k++) {
+				double value = leaf->tree->shape->color[k] * (RAYCAST_AMBIENT + RAYCAST_DIFFUSE * lambert) + specular;
+				pixel[k] = (unsigned char) (255 * ((value < 1) ? value : 1) + 0.5);
+			}
+			image->depth[y * image->width + x] = hit->t;
+			tile->hits++;
+		}
+	}
+}
+
+RaycastImage * raycast_render(Tree tree, const View *view, int threads) {
+	assert(NULL != tree);
+	assert(tree_is_valid(tree));
+	assert(NULL != view);
+	assert(threads >= 0);
+	if (threads == 0) {
+		long online = sysconf(_SC_NPROCESSORS_ONLN);
+		threads = (online > 0) ? (int) online : 1;
+	}
+	Raycast raycast;
+	RaycastImage *image = NULL;
+	RaycastTile *tiles = NULL;
+	int columns = (view->width + RAYCAST_TILE - 1) / RAYCAST_TILE;
+	int rows = (view->height + RAYCAST_TILE - 1) / RAYCAST_TILE;
+	int i, size = raycast_count(tree);
+	if (NULL == (image = (RaycastImage *) malloc(sizeof(RaycastImage)))
+	|| NULL == (image->pixels = (unsigned char *) malloc(3 * view->width * view->height))
+	|| NULL == (image->depth = (double *) malloc(view->width * view->height * sizeof(double)))
+	|| NULL == (raycast.nodes = (RaycastNode *) malloc(size * sizeof(RaycastNode)))
+	|| NULL == (tiles = (RaycastTile *) malloc(columns * rows * sizeof(RaycastTile)))) {
+		fprintf(stderr, "memory allocation error (line %d file %s)\n", __LINE__, __FILE__);
+		exit(EXIT_FAILURE);
+	}
+	double start = chrono_now();
+	affine identity;
+	affine_set_identity(identity);
+	raycast.size = 0;
+	raycast_flatten(&raycast, tree, identity);
+	raycast.near = view->near;
+	raycast.view = view;
+	raycast_basis(view, raycast.forward, raycast.right, raycast.up);
+	raycast.tangent = tan(view->fovy * PI / 360.);
+	raycast.aspect = (double) view->width / view->height;
+	raycast.image = image;
+	image->width = view->width;
+	image->height = view->height;
+	image->hits = 0;
+	ThreadPool *pool = pool_allocate(threads);
+	for (i = 0; i < columns * rows; i++) {
+		tiles[i].raycast = &raycast;
+		tiles[i].x = (i % columns) * RAYCAST_TILE;
+		tiles[i].y = (i / columns) * RAYCAST_TILE;
+		tiles[i].hits = 0;
+		pool_submit(pool, raycast_tile, tiles + i);
+	}
+	pool_wait(pool);
+	pool_free(&pool);
+	for (i = 0; i < columns * rows; i++) {
+		image->hits += tiles[i].hits;
+	}
+	image->time = chrono_now() - start;
+	free(tiles);
+	free(raycast.nodes);
+	return image;
+}
+
+static void raycast_push(point3 **vrtx, vec3 **norm, color4 **colors, int *capacity, int size) {
+	if (size < *capacity)
+		return;
+	if (*capacity > INT_MAX / 2) {
+		fprintf(stderr, "too many points cast on the surface of the tree\n");
+		exit(EXIT_FAILURE);
+	}
+	*capacity *= 2;
+	if (NULL == (*vrtx = (point3 *) realloc(*vrtx, *capacity * sizeof(point3)))
+	|| NULL == (*norm = (vec3 *) realloc(*norm, *capacity * sizeof(vec3)))
+	|| NULL == (*colors = (color4 *) realloc(*colors, *capacity * sizeof(color4)))) {
+		fprintf(stderr, "memory allocation error (line %d file %s)\n", __LINE__, __FILE__);
+		exit(EXIT_FAILURE);
+	}
+}
+
+PointCloud * raycast_to_point_cloud(Tree tree, int density, RaycastStatistics *statistics) {
+	assert(NULL != tree);
+	assert(tree_is_valid(tree));
+	assert(density > 0);
+	assert(NULL != statistics);
+	Raycast raycast;
+	RaycastSpans spans;
+	point3 *vrtx = NULL;
+	vec3 *norm = NULL;
+	color4 *colors = NULL;
+	int capacity = RAYCAST_INITIAL_POINTS, size = 0;
+	int axis, i, j, k;
+	if (NULL == (raycast.nodes = (RaycastNode *) malloc(raycast_count(tree) * sizeof(RaycastNode)))
+	|| NULL == (vrtx = (point3 *) malloc(capacity * sizeof(point3)))
+	|| NULL == (norm = (vec3 *) malloc(capacity * sizeof(vec3)))
+	|| NULL == (colors = (color4 *) malloc(capacity * sizeof(color4)))) {
+		fprintf(stderr, "memory allocation error (line %d file %s)\n", __LINE__, __FILE__);
+		exit(EXIT_FAILURE);
+	}
+	double start = chrono_now();
+	affine identity;
+	affine_set_identity(identity);
+	raycast.size = 0;
+	raycast_flatten(&raycast, tree, identity);
+	raycast.near = -HUGE_VAL;
+	raycast.view = NULL;
+	raycast.image = NULL;
+	memset(statistics, 0, sizeof(RaycastStatistics));
+	const double *min = raycast.nodes[0].min;
+	const double *max = raycast.nodes[0].max;
+	for (axis = 0; axis < 3; axis++) {
+		int a = (axis + 1) % 3, b = (axis + 2) % 3;
+		double width = max[a] - min[a], height = max[b] - min[b];
+		if (width <= 0 || height <= 0)
+			continue;
+		double columns_size = ceil(width * sqrt((double) density));
+		double rows_size = ceil(height * sqrt((double) density));
+		if (columns_size * rows_size > RAYCAST_MAX_RAYS) {
+			fprintf(stderr, "too many rays to cast through the bounding box of the tree at density %d\n", density);
+			exit(EXIT_FAILURE);
+		}
+		int columns = (int) columns_size, rows = (int) rows_size;
+		double rays = columns_size * rows_size / (width * height);
+		point3 o;
+		vec3 d;
+		vec3_set(d, 0, 0, 0);
+		d[axis] = 1;
+		o[axis] = min[axis];
+		for (j = 0; j < rows; j++) {
+			for (i = 0; i < columns; i++) {
+				o[a] = min[a] + (i + (double) shape_random() / SHAPE_RANDOM_MAX) * width / columns;
+				o[b] = min[b] + (j + (double) shape_random() / SHAPE_RANDOM_MAX) * height / rows;
+				raycast_trace(&raycast, 0, o, d, &spans, &(statistics->endpoints));
+				statistics->rays++;
+				for (k = 0; k < 2 * spans.size; k++) {
+					const RaycastHit *hit = (k & 1) ? spans.out + k / 2 : spans.in + k / 2;
+					if (hit->node < 0)
+						continue;
+					statistics->hits++;
+					const RaycastNode *leaf = raycast.nodes + hit->node;
+					raycast_push(&vrtx, &norm, &colors, &capacity, size);
+					raycast_normal(leaf, o, d, hit->t, hit->flip, norm[size]);
+					double weight = density / (rays * (fabs(norm[size][0]) + fabs(norm[size][1]) + fabs(norm[size][2])));
+					if ((double) shape_random() / SHAPE_RANDOM_MAX >= weight)
+						continue;
+					point3_set(vrtx[size], o[0] + hit->t * d[0], o[1] + hit->t * d[1], o[2] + hit->t * d[2]);
+					color4_copy(colors[size], leaf->tree->shape->color);
+					size++;
+				}
+			}
+		}
+	}
+	statistics->kept = size;
+	statistics->time = chrono_now() - start;
+	free(raycast.nodes);
+	return point_cloud_allocate(vrtx, norm, colors, size);
+}
+
+static int raycast_matches(const RaycastImage *image, double distance, int x, int y) {
+	int i, j;
+	for (j = y - POINT_SIZE + 1; j < y + POINT_SIZE; j++) {
+		for (i = x - POINT_SIZE + 1; i < x + POINT_SIZE; i++) {
+			if (i < 0 || j < 0 || i >= image->width || j >= image->height)
+				continue;
+			double depth = image->depth[j * image->width + i];
+			if (depth >= 0 && fabs(distance - depth) <= RAYCAST_DEPTH_TOLERANCE * depth)
+				return 1;
+		}
+	}
+	return 0;
+}
+
+double raycast_coverage(const RaycastImage *image, const View *view, const PointCloud *point_cloud) {
+	assert(NULL != image);
+	assert(NULL != view);
+	assert(NULL != point_cloud);
+	double *nearest = NULL;
+	vec3 forward, right, up, d;
+	double tangent = tan(view->fovy * PI / 360.);
+	double aspect = (double) image->width / image->height;
+	int i, x, y, size = image->width * image->height;
+	unsigned long covered = 0;
+	if (image->hits == 0)
+		return 1;
+	if (NULL == (nearest = (double *) malloc(size * sizeof(double)))) {
+		fprintf(stderr, "memory allocation error (line %d file %s)\n", __LINE__, __FILE__);
+		exit(EXIT_FAILURE);
+	}
+	for (i = 0; i < size; i++) {
+		nearest[i] = -1;
+	}
+	raycast_basis(view, forward, right, up);
+	for (i = 0; i < point_cloud->size; i++) {
+		const double *p = point_cloud->vrtx[i];
+		vec3_set(d, p[0] - view->eye[0], p[1] - view->eye[1], p[2] - view->eye[2]);
+		double z = vec3_dot(d, forward);
+		if (z < view->near)
+			continue;
+		double px = (vec3_dot(d, right) / (z * tangent * aspect) + 1) / 2 * image->width;
+		double py = (1 - vec3_dot(d, up) / (z * tangent)) / 2 * image->height;
+		double distance = vec3_norm(d);
+		int x0 = (int) floor(px - POINT_SIZE / 2. + 0.5);
+		int y0 = (int) floor(py - POINT_SIZE / 2. + 0.5);
+		for (y = (y0 > 0) ? y0 : 0; y < y0 + POINT_SIZE && y < image->height; y++) {
+			for (x = (x0 > 0) ? x0 : 0; x < x0 + POINT_SIZE && x < image->width; x++) {
+				double *n = nearest + y * image->width + x;
+				if (*n < 0 || distance < *n)
+					*n = distance;
+			}
+		}
+	}
+	for (i = 0; i < size; i++) {
+		if (image->depth[i] >= 0 && nearest[i] >= 0 && raycast_matches(image, nearest[i], i % image->width, i / image->width))
+			covered++;
+	}
+	free(nearest);
+	return (double) covered / image->hits;
+}
+
+int raycast_write(const RaycastImage *image, FILE *file) {
+	assert(NULL != image);
+	assert(NULL != file);
+	size_t size = 3 * (size_t) image->width * image->height;
+	return fprintf(file, "P6\n%d %d\n255\n", image->width, image->height) > 0
+		&& fwrite(image->pixels, 1, size, file) == size;
+}
+
+void raycast_free(RaycastImage **image) {
+	assert(NULL != image);
+	assert(NULL != *image);
+	free((*image)->pixels);
+	free((*image)->depth);
+	free(*image);
+	*image = NULL;
+}
@@ -0,0 +1,61 @@
+#include "refine.h"
+
+#include "types.h"
+#include "zone.h"
+#include "chrono.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "point_cloud.h"
+
+PointCloud * refine_to_point_cloud(const Zones *zones, int density, double deadline, RefineStatistics *statistics) {
+	assert(NULL != zones);
+	assert(density > 0);
+	assert(deadline >= 0);
+	assert(NULL != statistics);
+	int first = (density >> REFINE_LEVELS) > 0 ? density >> REFINE_LEVELS : 1;
+	int reached = 0, pass, i;
+	PointCloud **leaves = NULL, *result = NULL;
+	memset(statistics, 0, sizeof(RefineStatistics));
+	while (reached < density) {
+		reached = (first << statistics->planned) < density ? first << statistics->planned : density;
+		statistics->planned++;
+	}
+	if (NULL == (leaves = (PointCloud **) malloc((zones->size > 0 ? zones->size : 1) * sizeof(PointCloud *)))) {
+		fprintf(stderr, "memory allocation error (line %d file %s)\n", __LINE__, __FILE__);
+		exit(EXIT_FAILURE);
+	}
+	result = point_cloud_allocate_size(0);
+	double start = chrono_now(), previous_time = 0;
+	int previous_increment = 0;
+	reached = 0;
+	for (pass = 0; pass < statistics->planned; pass++) {
+		int target = (first << pass) < density ? first << pass : density;
+		int increment = target - reached;
+		double pass_start = chrono_now();
+		if (pass > 0 && pass_start - start + previous_time * increment / previous_increment > deadline)
+			break;
+		for (i = 0; i < zones->size; i++) {
+			if (pass > 0 && chrono_now() - start > deadline)
+				break;
+			leaves[i] = zone_leaf_to_point_cloud(zones, i, increment);
+		}
+		if (i < zones->size) {
+			while (i-- > 0) {
+				statistics->discarded += leaves[i]->size;
+				point_cloud_free(leaves + i);
+			}
+			break;
+		}
+		point_cloud_append(result, leaves, zones->size);
+		previous_time = chrono_now() - pass_start;
+		previous_increment = increment;
+		reached = target;
+	}
+	statistics->passes = pass;
+	statistics->density = reached;
+	statistics->time = chrono_now() - start;
+	free(leaves);
+	return result;
+}
@@ -0,0 +1,124 @@
+#include "sample.h"
+
+#include "types.h"
+#include "shape.h"
+#include "cache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+#include "point_cloud.h"
+
+typedef struct {
+	int type;
+	int scales[3];
+	double radius;
+	int density;
+	unsigned int seed;
+} SampleKey;
+
+typedef struct {
+	PointCloud *canonical;
+} SampleEntry;
+
+static void sample_release(void *value) {
+	SampleEntry *entry = (SampleEntry *) value;
+	if (NULL != entry->canonical)
+		point_cloud_free(&(entry->canonical));
+	free(entry);
+}
+
+static int sample_quantize(double scale) {
+	return (int) floor(log(scale) / log(2.) * SAMPLE_SCALE_STEPS + 0.5);
+}
+
+SampleCache * sample_cache_allocate(size_t capacity, unsigned int seed) {
+	SampleCache *samples = NULL;
+	if (NULL == (samples = (SampleCache *) malloc(sizeof(SampleCache)))) {
+		fprintf(stderr, "memory allocation error (line %d file %s)\n", __LINE__, __FILE__);
+		exit(EXIT_FAILURE);
+	}
+	samples->cache = cache_allocate(capacity, sample_release);
+	samples->seed = seed;
+	samples->sampled = 0;
+	samples->shared = 0;
+	return samples;
+}
+
+void sample_cache_free(SampleCache **samples) {
+	assert(NULL != samples);
+	assert(NULL != *samples);
+	cache_free(&((*samples)->cache));
+	free(*samples);
+	*samples = NULL;
+}
+
+PointCloud * sample_to_point_cloud(SampleCache *samples, const Shape *shape, int density, const affine transformations, const affine norm_transformations) {
+	assert(NULL != samples);
+	assert(NULL != shape);
+	assert(shape_is_valid(shape));
+	assert(density > 0);
+	SampleKey key;
+	memset(&key, 0, sizeof(SampleKey));
+	key.type = shape->type;
+	key.scales[0] = sample_quantize(shape->x_scale);
+	key.scales[1] = sample_quantize(shape->y_scale);
+	key.scales[2] = sample_quantize(shape->z_scale);
+	key.radius = (shape->type == Torus) ? shape->args[0] : 0;
+	key.density = density;
+	key.seed = samples->seed;
+	double x = pow(2., (double) key.scales[0] / SAMPLE_SCALE_STEPS);
+	double y = pow(2., (double) key.scales[1] / SAMPLE_SCALE_STEPS);
+	double z = pow(2., (double) key.scales[2] / SAMPLE_SCALE_STEPS);
+	unsigned int seed = (unsigned int) cache_hash(&key, sizeof(SampleKey));
+	SampleEntry *entry = (SampleEntry *) cache_get(samples->cache, &key, sizeof(SampleKey));
+	if (NULL == entry) {
+		if (NULL == (entry = (SampleEntry *) malloc(sizeof(SampleEntry)))) {
+			fprintf(stderr, "memory allocation error (line %d file %s)\n", __LINE__, __FILE__);
+			exit(EXIT_FAILURE);
+		}
+		entry->canonical = NULL;
+		cache_put(samples->cache, &key, sizeof(SampleKey), entry, sizeof(SampleEntry));
+		samples->sampled++;
+		return shape_to_seeded_point_cloud(shape, density, x, y, z, seed, transformations, norm_transformations);
+	}
+	PointCloud *canonical = entry->canonical;
+	if (NULL == canonical) {
+		affine identity;
+		affine_set_identity(identity);
+		canonical = shape_to_seeded_point_cloud(shape, density, x, y, z, seed, identity, identity);
+		color4 *color = NULL;
+		if (NULL == (color = (color4 *) realloc(canonical->colors, sizeof(color4)))) {
+			fprintf(stderr, "memory allocation error (line %d file %s)\n", __LINE__, __FILE__);
+			exit(EXIT_FAILURE);
+		}
+		canonical->colors = color;
+		samples->sampled++;
+	} else {
+		samples->shared++;
+	}
+	int i, size = canonical->size;
+	PointCloud *point_cloud = point_cloud_allocate_size(size);
+	affine_apply_points(transformations, point_cloud->vrtx, (const point3 *) canonical->vrtx, size);
+	affine_apply_normals(norm_transformations, point_cloud->norm, (const vec3 *) canonical->norm, size);
+	for (i = 0; i < size; i++) {
+		color4_copy(point_cloud->colors[i], shape->color);
+	}
+	if (NULL == entry->canonical) {
+		if (NULL == (entry = (SampleEntry *) malloc(sizeof(SampleEntry)))) {
+			fprintf(stderr, "memory allocation error (line %d file %s)\n", __LINE__, __FILE__);
+			exit(EXIT_FAILURE);
+		}
+		entry->canonical = canonical;
+		cache_put(samples->cache, &key, sizeof(SampleKey), entry,
+			sizeof(SampleEntry) + sizeof(PointCloud) + sizeof(color4) + size * (sizeof(point3) + sizeof(vec3)));
+	}
+	return point_cloud;
+}
+
+double sample_hit_rate(const SampleCache *samples) {
+	assert(NULL != samples);
+	unsigned long conversions = samples->sampled + samples->shared;
+	return conversions > 0 ? (double) samples->shared / conversions : 0.;
+}
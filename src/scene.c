@@ -0,0 +1,222 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "scene.h"
+
+#include "types.h"
+#include "shape.h"
+#include "tree.h"
+#include "parser.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SCENE_STACK_SIZE (64)
+
+typedef struct {
+	Tree tree;
+	int parent;
+} SceneFrame;
+
+static void * scene_grow(void *array, int *capacity, size_t size) {
+	assert(NULL != capacity);
+	*capacity *= 2;
+	if (NULL == (array = realloc(array, (*capacity)*size))) {
+		fprintf(stderr, "memory allocation error (line %d file %s)\n", __LINE__, __FILE__);
+		exit(EXIT_FAILURE);
+	}
+	return array;
+}
+
+static void scene_record(SceneRecord *record, Tree tree) {
+	assert(NULL != record);
+	assert(NULL != tree);
+	memset(record, 0, sizeof(SceneRecord));
+	if (NULL != tree->shape) {
+		record->kind = SCENE_LEAF;
+		record->type = tree->shape->type;
+		color4_copy(record->color, tree->shape->color);
+		record->scale[0] = tree->shape->x_scale;
+		record->scale[1] = tree->shape->y_scale;
+		record->scale[2] = tree->shape->z_scale;
+		if (tree->shape->type == Torus)
+			record->radius = tree->shape->args[0];
+	} else {
+		record->kind = tree->op;
+	}
+	memcpy(record->transformations, tree->transformations, sizeof(affine));
+	memcpy(record->inv_transformations, tree->inv_transformations, sizeof(affine));
+	memcpy(record->norm_transformations, tree->norm_transformations, sizeof(affine));
+}
+
+void scene_compile(Tree tree, FILE *file) {
+	assert(NULL != tree);
+	assert(tree_is_valid(tree));
+	assert(NULL != file);
+	SceneRecord *records = NULL;
+	SceneFrame *stack = NULL;
+	int capacity = SCENE_STACK_SIZE, stack_capacity = SCENE_STACK_SIZE;
+	int size = 0, top = 0;
+	if (NULL == (records = (SceneRecord *) malloc(capacity*sizeof(SceneRecord)))) {
+		fprintf(stderr, "memory allocation error (line %d file %s)\n", __LINE__, __FILE__);
+		exit(EXIT_FAILURE);
+	}
+	if (NULL == (stack = (SceneFrame *) malloc(stack_capacity*sizeof(SceneFrame)))) {
+		fprintf(stderr, "memory allocation error (line %d file %s)\n", __LINE__, __FILE__);
+		exit(EXIT_FAILURE);
+	}
+	stack[top].tree = tree;
+	stack[top++].parent = -1;
+	while (top > 0) {
+		SceneFrame frame = stack[--top];
+		if (size == capacity)
+			records = (SceneRecord *) scene_grow(records, &capacity, sizeof(SceneRecord));
+		scene_record(records + size, frame.tree);
+		if (frame.parent >= 0)
+			records[frame.parent].right = size;
+		if (NULL == frame.tree->shape) {
+			if (top + 2 > stack_capacity)
+				stack = (SceneFrame *) scene_grow(stack, &stack_capacity, sizeof(SceneFrame));
+			stack[top].tree = frame.tree->right;
+			stack[top++].parent = size;
+			stack[top].tree = frame.tree->left;
+			stack[top++].parent = -1;
+		}
+		size++;
+	}
+	SceneHeader header;
+	memset(&header, 0, sizeof(SceneHeader));
+	memcpy(header.magic, SCENE_MAGIC, sizeof(header.magic));
+	header.version = SCENE_VERSION;
+	header.size = size;
+	if (fwrite(&header, sizeof(SceneHeader), 1, file) != 1 || fwrite(records, sizeof(SceneRecord), size, file) != (size_t) size) {
+		fprintf(stderr, "can not write compiled scene\n");
+		exit(EXIT_FAILURE);
+	}
+	free(stack);
+	free(records);
+}
+
+int scene_is_compiled(FILE *file) {
+	assert(NULL != file);
+	char magic[4];
+	long position = ftell(file);
+	int compiled = fread(magic, sizeof(magic), 1, file) == 1 && memcmp(magic, SCENE_MAGIC, sizeof(magic)) == 0;
+	fseek(file, position, SEEK_SET);
+	return compiled;
+}
+
+static Tree scene_leaf(const SceneRecord *record) {
+	assert(NULL != record);
+	Shape *shape = NULL;
+	color4 color;
+	color4_copy(color, record->color);
+	switch (record->type) {
+		case Sphere:
+			shape = shape_sphere(color);
+			break;
+		case Cube:
+			shape = shape_cube(color);
+			break;
+		case Cylinder:
+			shape = shape_cylinder(color);
+			break;
+		case Cone:
+			shape = shape_cone(color);
+			break;
+		case Torus:
+			if (record->radius <= 0)
+				return NULL;
+			shape = shape_torus(color, record->radius);
+			break;
+		default:
+			return NULL;
+	}
+	if (record->scale[0] <= 0 || record->scale[1] <= 0 || record->scale[2] <= 0) {
+		shape_free(&shape);
+		return NULL;
+	}
+	shape->x_scale = record->scale[0];
+	shape->y_scale = record->scale[1];
+	shape->z_scale = record->scale[2];
+	return tree_allocate_leaf(shape);
+}
+
+Tree scene_load_buffer(const void *buffer, size_t length) {
+	assert(NULL != buffer);
+	const SceneHeader *header = (const SceneHeader *) buffer;
+	if (length < sizeof(SceneHeader) || memcmp(header->magic, SCENE_MAGIC, sizeof(header->magic)) != 0
+	|| header->version != SCENE_VERSION || header->size <= 0
+	|| (length - sizeof(SceneHeader))/sizeof(SceneRecord) < (size_t) header->size) {
+		fprintf(stderr, "invalid compiled scene\n");
+		exit(EXIT_FAILURE);
+	}
+	const SceneRecord *records = (const SceneRecord *) (header + 1);
+	Tree *stack = NULL;
+	int capacity = SCENE_STACK_SIZE, top = 0, i;
+	if (NULL == (stack = (Tree *) malloc(capacity*sizeof(Tree)))) {
+		fprintf(stderr, "memory allocation error (line %d file %s)\n", __LINE__, __FILE__);
+		exit(EXIT_FAILURE);
+	}
+	for (i = header->size - 1; i >= 0; i--) {
+		const SceneRecord *record = records + i;
+		Tree tree = NULL;
+		if (record->kind == SCENE_LEAF) {
+			tree = scene_leaf(record);
+		} else if (record->kind >= 0 && record->kind < NumberOperator && top >= 2) {
+			Tree left = stack[--top];
+			Tree right = stack[--top];
+			tree = tree_allocate_node((Operator) record->kind, left, right);
+		}
+		if (NULL == tree) {
+			fprintf(stderr, "invalid compiled scene record %d\n", i);
+			exit(EXIT_FAILURE);
+		}
+		memcpy(tree->transformations, record->transformations, sizeof(affine));
+		memcpy(tree->inv_transformations, record->inv_transformations, sizeof(affine));
+		memcpy(tree->norm_transformations, record->norm_transformations, sizeof(affine));
+		if (top == capacity)
+			stack = (Tree *) scene_grow(stack, &capacity, sizeof(Tree));
+		stack[top++] = tree;
+	}
+	if (top != 1) {
+		fprintf(stderr, "invalid compiled scene\n");
+		exit(EXIT_FAILURE);
+	}
+	Tree tree = stack[0];
+	free(stack);
+	return tree;
+}
+
+Tree scene_open(const char *path) {
+	assert(NULL != path);
+	FILE *file = NULL;
+	if (NULL == (file = fopen(path, "rb"))) {
+		fprintf(stderr, "can not open file '%s'\n", path);
+		exit(EXIT_FAILURE);
+	}
+	Tree tree = scene_is_compiled(file) ? scene_load(file) : parse_tree(file);
+	fclose(file);
+	return tree;
+}
+
+Tree scene_load(FILE *file) {
+	assert(NULL != file);
+	struct stat info;
+	long offset = ftell(file);
+	if (offset < 0 || 0 != fstat(fileno(file), &info) || !S_ISREG(info.st_mode) || info.st_size <= offset) {
+		fprintf(stderr, "invalid compiled scene\n");
+		exit(EXIT_FAILURE);
+	}
+	void *map = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fileno(file), 0);
+	if (MAP_FAILED == map) {
+		fprintf(stderr, "can not map compiled scene\n");
+		exit(EXIT_FAILURE);
+	}
+	Tree tree = scene_load_buffer((const char *) map + offset, info.st_size - offset);
+	munmap(map, info.st_size);
+	return tree;
+}
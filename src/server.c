@@ -0,0 +1,506 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "server.h"
+
+#include "types.h"
+#include "tree.h"
+#include "parser.h"
+#include "zone.h"
+#include "cache.h"
+#include "chrono.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "point_cloud.h"
+
+#define SERVER_BACKLOG (16)
+#define SERVER_ERROR_SIZE (256)
+#define SERVER_LATENCIES (1024)
+#define SERVER_SESSIONS (64)
+#define SERVER_POLL_MS (250)
+#define SERVER_TIMEOUT (30.)
+
+/* the scenes and point clouds are pinned by the sessions using them, an evicted entry is freed by its last user */
+typedef struct {
+	Tree tree;
+	Zones *zones;
+	int users;
+	int evicted;
+} ServerScene;
+
+typedef struct {
+	PointCloud *cloud;
+	int users;
+	int evicted;
+} ServerCloud;
+
+typedef struct {
+	int density;
+	unsigned int seed;
+} ServerCloudKey;
+
+typedef struct {
+	Cache *trees;
+	Cache *clouds;
+	double *latencies;
+	unsigned long requests;
+	unsigned long capacity;
+	double busy;
+	int sessions;
+	pthread_mutex_t mutex;
+	pthread_cond_t ended;
+} Server;
+
+typedef struct {
+	Server *server;
+	int fd;
+} ServerSession;
+
+/* set by an interruption signal or a shutdown request */
+static volatile sig_atomic_t _server_interrupted_ = 0;
+
+static void server_interrupt(int signal) {
+	_server_interrupted_ = 1;
+}
+
+/* returns 1 if a failed transfer must be retried, the sockets of the daemon time out every SERVER_POLL_MS */
+static int server_retry(double last) {
+	if (_server_interrupted_)
+		return 0;
+	if (errno == EINTR)
+		return 1;
+	return (errno == EAGAIN || errno == EWOULDBLOCK) && chrono_now() - last < SERVER_TIMEOUT;
+}
+
+static int server_read(int fd, void *data, size_t size) {
+	char *p = (char *) data;
+	double last = chrono_now();
+	while (size > 0) {
+		ssize_t r = read(fd, p, size);
+		if (r < 0 && server_retry(last))
+			continue;
+		if (r <= 0)
+			return 0;
+		p += r;
+		size -= r;
+		last = chrono_now();
+	}
+	return 1;
+}
+
+static int server_write(int fd, const void *data, size_t size) {
+	const char *p = (const char *) data;
+	double last = chrono_now();
+	while (size > 0) {
+		ssize_t w = write(fd, p, size);
+		if (w < 0 && server_retry(last))
+			continue;
+		if (w <= 0)
+			return 0;
+		p += w;
+		size -= w;
+		last = chrono_now();
+	}
+	return 1;
+}
+
+static void server_free_scene(ServerScene *scene) {
+	zone_free(&(scene->zones));
+	tree_free(&(scene->tree));
+	free(scene);
+}
+
+static void server_free_cloud(ServerCloud *cloud) {
+	point_cloud_free(&(cloud->cloud));
+	free(cloud);
+}
+
+static void server_release_scene(void *value) {
+	ServerScene *scene = (ServerScene *) value;
+	if (scene->users > 0)
+		scene->evicted = 1;
+	else
+		server_free_scene(scene);
+}
+
+static void server_release_cloud(void *value) {
+	ServerCloud *cloud = (ServerCloud *) value;
+	if (cloud->users > 0)
+		cloud->evicted = 1;
+	else
+		server_free_cloud(cloud);
+}
+
+static size_t server_scene_size(const ServerScene *scene) {
+	assert(NULL != scene);
+	const Zones *zones = scene->zones;
+	return sizeof(ServerScene) + sizeof(Zones)
+		+ (2*zones->size - 1)*(sizeof(struct Node) + sizeof(affine)) + zones->size*(sizeof(Shape) + sizeof(ZoneLeaf))
+		+ zones->constraints_size*sizeof(ZoneConstraint) + zones->terms_size*sizeof(ZoneTerm);
+}
+
+static size_t server_cloud_size(const ServerCloud *cloud) {
+	assert(NULL != cloud);
+	return sizeof(ServerCloud) + sizeof(PointCloud) + cloud->cloud->size*(sizeof(point3) + sizeof(vec3) + sizeof(color4));
+}
+
+static int server_respond(int fd, int status, int size, int cached) {
+	ServerResponse response;
+	memset(&response, 0, sizeof(ServerResponse));
+	memcpy(response.magic, SERVER_MAGIC, sizeof(response.magic));
+	response.status = status;
+	response.size = size;
+	response.cached = cached;
+	return server_write(fd, &response, sizeof(ServerResponse));
+}
+
+static int server_fail(int fd, const char *message) {
+	assert(NULL != message);
+	size_t length = strlen(message);
+	return server_respond(fd, 1, (int) length, 0) && server_write(fd, message, length);
+}
+
+static int server_send_cloud(int fd, const PointCloud *cloud, int cached) {
+	assert(NULL != cloud);
+	return server_respond(fd, 0, cloud->size, cached)
+		&& server_write(fd, cloud->vrtx, cloud->size*sizeof(point3))
+		&& server_write(fd, cloud->norm, cloud->size*sizeof(vec3))
+		&& server_write(fd, cloud->colors, cloud->size*sizeof(color4));
+}
+
+static void server_record(Server *server, double latency) {
+	assert(NULL != server);
+	if (server->requests == server->capacity) {
+		server->capacity = (server->capacity > 0) ? 2*server->capacity : SERVER_LATENCIES;
+		if (NULL == (server->latencies = (double *) realloc(server->latencies, server->capacity*sizeof(double)))) {
+			fprintf(stderr, "memory allocation error (line %d file %s)\n", __LINE__, __FILE__);
+			exit(EXIT_FAILURE);
+		}
+	}
+	server->latencies[server->requests++] = latency;
+	server->busy += latency;
+}
+
+static int server_convert_request(Server *server, int fd, const ServerRequest *request) {
+	assert(NULL != server);
+	assert(NULL != request);
+	if (request->length > SERVER_MAX_SCENE) {
+		server_fail(fd, "invalid request");
+		return 0;
+	}
+	char *key = NULL;
+	if (NULL == (key = (char *) malloc(sizeof(ServerCloudKey) + request->length))) {
+		fprintf(stderr, "memory allocation error (line %d file %s)\n", __LINE__, __FILE__);
+		exit(EXIT_FAILURE);
+	}
+	char *text = key + sizeof(ServerCloudKey);
+	if (!server_read(fd, text, request->length)) {
+		free(key);
+		return 0;
+	}
+	if (request->density <= 0) {
+		free(key);
+		return server_fail(fd, "invalid request");
+	}
+	double start = chrono_now();
+	pthread_mutex_lock(&(server->mutex));
+	ServerScene *scene = (ServerScene *) cache_get(server->trees, text, request->length);
+	if (NULL != scene)
+		scene->users++;
+	pthread_mutex_unlock(&(server->mutex));
+	int new_scene = (NULL == scene);
+	if (new_scene) {
+		char error[SERVER_ERROR_SIZE];
+		Tree tree = parse_scene_buffer(text, request->length, error, sizeof(error));
+		if (NULL == tree) {
+			free(key);
+			return server_fail(fd, error);
+		}
+		if (NULL == (scene = (ServerScene *) malloc(sizeof(ServerScene)))) {
+			fprintf(stderr, "memory allocation error (line %d file %s)\n", __LINE__, __FILE__);
+			exit(EXIT_FAILURE);
+		}
+		scene->tree = tree;
+		scene->zones = zone_build(tree);
+		scene->users = 1;
+		scene->evicted = 0;
+	}
+	ServerCloudKey header;
+	memset(&header, 0, sizeof(ServerCloudKey));
+	header.density = request->density;
+	header.seed = request->seed;
+	memcpy(key, &header, sizeof(ServerCloudKey));
+	size_t key_size = sizeof(ServerCloudKey) + request->length;
+	pthread_mutex_lock(&(server->mutex));
+	ServerCloud *cloud = (ServerCloud *) cache_get(server->clouds, key, key_size);
+	if (NULL != cloud)
+		cloud->users++;
+	pthread_mutex_unlock(&(server->mutex));
+	int cached = (NULL != cloud);
+	if (!cached) {
+		if (NULL == (cloud = (ServerCloud *) malloc(sizeof(ServerCloud)))) {
+			fprintf(stderr, "memory allocation error (line %d file %s)\n", __LINE__, __FILE__);
+			exit(EXIT_FAILURE);
+		}
+		shape_seed(request->seed);
+		cloud->cloud = zone_to_point_cloud(scene->zones, request->density);
+		cloud->users = 1;
+		cloud->evicted = 0;
+	}
+	int sent = server_send_cloud(fd, cloud->cloud, cached);
+	pthread_mutex_lock(&(server->mutex));
+	server_record(server, chrono_now() - start);
+	if (!cached)
+		cache_put(server->clouds, key, key_size, cloud, server_cloud_size(cloud));
+	if (new_scene)
+		cache_put(server->trees, text, request->length, scene, server_scene_size(scene));
+	if (--(cloud->users) == 0 && cloud->evicted)
+		server_free_cloud(cloud);
+	if (--(scene->users) == 0 && scene->evicted)
+		server_free_scene(scene);
+	pthread_mutex_unlock(&(server->mutex));
+	free(key);
+	return sent;
+}
+
+static void server_session(Server *server, int fd) {
+	assert(NULL != server);
+	ServerRequest request;
+	while (!_server_interrupted_ && server_read(fd, &request, sizeof(ServerRequest))) {
+		if (memcmp(request.magic, SERVER_MAGIC, sizeof(request.magic)) != 0) {
+			server_fail(fd, "invalid request");
+			return;
+		}
+		if (request.kind == SERVER_SHUTDOWN) {
+			_server_interrupted_ = 1;
+			server_respond(fd, 0, 0, 0);
+			return;
+		}
+		if (request.kind != SERVER_CONVERT) {
+			server_fail(fd, "invalid request");
+			return;
+		}
+		if (!server_convert_request(server, fd, &request))
+			return;
+	}
+}
+
+static void * server_session_work(void *arg) {
+	ServerSession *session = (ServerSession *) arg;
+	Server *server = session->server;
+	server_session(server, session->fd);
+	close(session->fd);
+	free(session);
+	pthread_mutex_lock(&(server->mutex));
+	server->sessions--;
+	pthread_cond_signal(&(server->ended));
+	pthread_mutex_unlock(&(server->mutex));
+	return NULL;
+}
+
+static int server_compare(const void *a, const void *b) {
+	double x = *((const double *) a), y = *((const double *) b);
+	return (x > y) - (x < y);
+}
+
+static double server_percentile(const double *sorted, unsigned long size, double q) {
+	assert(NULL != sorted);
+	assert(size > 0);
+	return sorted[(unsigned long) (q*(size - 1) + 0.5)];
+}
+
+static void server_report(const Server *server, double elapsed) {
+	assert(NULL != server);
+	fprintf(stderr, "requests %lu, %.1f requests/s over %.3f s, %.1f requests/s of service\n",
+		server->requests, server->requests/elapsed, elapsed, server->busy > 0 ? server->requests/server->busy : 0.);
+	if (server->requests > 0) {
+		qsort(server->latencies, server->requests, sizeof(double), server_compare);
+		fprintf(stderr, "latency p50 %.3f ms, p90 %.3f ms, p99 %.3f ms, max %.3f ms\n",
+			1e3*server_percentile(server->latencies, server->requests, 0.5),
+			1e3*server_percentile(server->latencies, server->requests, 0.9),
+			1e3*server_percentile(server->latencies, server->requests, 0.99),
+			1e3*server->latencies[server->requests - 1]);
+	}
+	fprintf(stderr, "scene cache %lu hits %lu misses, point cloud cache %lu hits %lu misses\n",
+		server->trees->hits, server->trees->misses, server->clouds->hits, server->clouds->misses);
+}
+
+void server_run(const char *path, size_t tree_capacity, size_t cloud_capacity) {
+	assert(NULL != path);
+	struct sockaddr_un address;
+	struct stat info;
+	if (strlen(path) >= sizeof(address.sun_path)) {
+		fprintf(stderr, "socket path '%s' is too long\n", path);
+		exit(EXIT_FAILURE);
+	}
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path, path);
+	if (0 == stat(path, &info) && S_ISSOCK(info.st_mode))
+		unlink(path);
+	int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listener < 0 || 0 != bind(listener, (struct sockaddr *) &address, sizeof(address)) || 0 != listen(listener, SERVER_BACKLOG)) {
+		fprintf(stderr, "can not listen on socket '%s'\n", path);
+		exit(EXIT_FAILURE);
+	}
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = SIG_IGN;
+	sigaction(SIGPIPE, &action, NULL);
+	action.sa_handler = server_interrupt;
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+	Server server;
+	memset(&server, 0, sizeof(Server));
+	server.trees = cache_allocate(tree_capacity, server_release_scene);
+	server.clouds = cache_allocate(cloud_capacity, server_release_cloud);
+	pthread_mutex_init(&(server.mutex), NULL);
+	pthread_cond_init(&(server.ended), NULL);
+	pthread_attr_t attributes;
+	pthread_attr_init(&attributes);
+	pthread_attr_setdetachstate(&attributes, PTHREAD_CREATE_DETACHED);
+	struct timeval timeout;
+	timeout.tv_sec = SERVER_POLL_MS / 1000;
+	timeout.tv_usec = (SERVER_POLL_MS % 1000) * 1000;
+	double start = chrono_now();
+	while (!_server_interrupted_) {
+		struct pollfd waiting;
+		waiting.fd = listener;
+		waiting.events = POLLIN;
+		waiting.revents = 0;
+		int ready = poll(&waiting, 1, SERVER_POLL_MS);
+		if (ready <= 0) {
+			if (ready == 0 || errno == EINTR)
+				continue;
+			fprintf(stderr, "can not wait connection on socket '%s'\n", path);
+			break;
+		}
+		int fd = accept(listener, NULL, NULL);
+		if (fd < 0) {
+			if (errno == EINTR || errno == ECONNABORTED || errno == EAGAIN || errno == EWOULDBLOCK)
+				continue;
+			fprintf(stderr, "can not accept connection on socket '%s'\n", path);
+			break;
+		}
+		if (0 != setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout))
+		|| 0 != setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout))) {
+			fprintf(stderr, "can not set the timeouts of a connection on socket '%s'\n", path);
+			close(fd);
+			continue;
+		}
+		ServerSession *session = NULL;
+		if (NULL == (session = (ServerSession *) malloc(sizeof(ServerSession)))) {
+			fprintf(stderr, "memory allocation error (line %d file %s)\n", __LINE__, __FILE__);
+			exit(EXIT_FAILURE);
+		}
+		session->server = &server;
+		session->fd = fd;
+		pthread_t thread;
+		pthread_mutex_lock(&(server.mutex));
+		while (server.sessions >= SERVER_SESSIONS)
+			pthread_cond_wait(&(server.ended), &(server.mutex));
+		server.sessions++;
+		pthread_mutex_unlock(&(server.mutex));
+		if (0 != pthread_create(&thread, &attributes, server_session_work, session)) {
+			fprintf(stderr, "thread creation error (line %d file %s)\n", __LINE__, __FILE__);
+			exit(EXIT_FAILURE);
+		}
+	}
+	pthread_mutex_lock(&(server.mutex));
+	while (server.sessions > 0)
+		pthread_cond_wait(&(server.ended), &(server.mutex));
+	pthread_mutex_unlock(&(server.mutex));
+	pthread_attr_destroy(&attributes);
+	server_report(&server, chrono_now() - start);
+	close(listener);
+	unlink(path);
+	cache_free(&(server.clouds));
+	cache_free(&(server.trees));
+	pthread_cond_destroy(&(server.ended));
+	pthread_mutex_destroy(&(server.mutex));
+	free(server.latencies);
+}
+
+int server_connect(const char *path) {
+	assert(NULL != path);
+	struct sockaddr_un address;
+	if (strlen(path) >= sizeof(address.sun_path))
+		return -1;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path, path);
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+		return -1;
+	if (0 != connect(fd, (struct sockaddr *) &address, sizeof(address))) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static int server_request(int fd, int kind, int density, unsigned int seed, unsigned long length) {
+	ServerRequest request;
+	memset(&request, 0, sizeof(ServerRequest));
+	memcpy(request.magic, SERVER_MAGIC, sizeof(request.magic));
+	request.kind = kind;
+	request.density = density;
+	request.seed = seed;
+	request.length = length;
+	return server_write(fd, &request, sizeof(ServerRequest));
+}
+
+static int server_response(int fd, ServerResponse *response) {
+	assert(NULL != response);
+	return server_read(fd, response, sizeof(ServerResponse))
+		&& memcmp(response->magic, SERVER_MAGIC, sizeof(response->magic)) == 0
+		&& response->size >= 0;
+}
+
+PointCloud * server_convert(int fd, const char *scene, size_t length, int density, unsigned int seed, char *error, size_t error_size) {
+	assert(NULL != scene);
+	assert(density > 0);
+	ServerResponse response;
+	if (NULL != error && error_size > 0)
+		error[0] = '\0';
+	if (!server_request(fd, SERVER_CONVERT, density, seed, length) || !server_write(fd, scene, length) || !server_response(fd, &response)) {
+		if (NULL != error && error_size > 0)
+			snprintf(error, error_size, "connection to the daemon lost");
+		return NULL;
+	}
+	if (response.status != 0) {
+		char message[SERVER_ERROR_SIZE];
+		size_t size = (size_t) response.size < sizeof(message) ? (size_t) response.size : sizeof(message) - 1;
+		if (!server_read(fd, message, size))
+			size = 0;
+		message[size] = '\0';
+		if (NULL != error && error_size > 0)
+			snprintf(error, error_size, "%s", message);
+		return NULL;
+	}
+	PointCloud *point_cloud = point_cloud_allocate_size(response.size);
+	if (!server_read(fd, point_cloud->vrtx, response.size * sizeof(point3)) || !server_read(fd, point_cloud->norm, response.size * sizeof(vec3))
+	|| !server_read(fd, point_cloud->colors, response.size * sizeof(color4))) {
+		point_cloud_free(&point_cloud);
+		if (NULL != error && error_size > 0)
+			snprintf(error, error_size, "connection to the daemon lost");
+		return NULL;
+	}
+	return point_cloud;
+}
+
+int server_shutdown(int fd) {
+	ServerResponse response;
+	return server_request(fd, SERVER_SHUTDOWN, 0, 0, 0) && server_response(fd, &response) && response.status == 0;
+}
@@ -8,8 +8,27 @@
 #include "point_cloud.h"
 
 
+static const double _shape_contains_costs_[NumberShapeType] = {
+	1.0, /* Sphere */
+	1.2, /* Cube */
+	1.3, /* Cylinder */
+	1.5, /* Cone */
+	2.5 /* Torus */
+};
+
+static __thread unsigned long _shape_random_ = 1;
+
+void shape_seed(unsigned int seed) {
+	_shape_random_ = seed;
+}
+
+unsigned int shape_random(void) {
+	_shape_random_ = _shape_random_ * 6364136223846793005UL + 1442695040888963407UL;
+	return (unsigned int) ((_shape_random_ >> 33) & SHAPE_RANDOM_MAX);
+}
+
 double random_double(double min, double max) {
-    return (max - min) * ((double) rand() / (double) RAND_MAX) + min;
+    return (max - min) * ((double) shape_random() / (double) SHAPE_RANDOM_MAX) + min;
 }
 
 int shape_is_valid(const Shape *shape) {
@@ -23,7 +42,7 @@ int shape_is_valid(const Shape *shape) {
 	return 1;
 }
 
-static Shape * shape_allocate(ShapeType type, color4 color, int(*contains_function)(double *, point3 *), PointCloud * (*point_cloud_converter)(int, color4, mat4, mat4, double, double, double, double *), double *args) {
+static Shape * shape_allocate(ShapeType type, color4 color, int(*contains_function)(double *, point3 *), PointCloud * (*point_cloud_converter)(int, color4, const affine, const affine, double, double, double, double *), double *args) {
 	assert(0 <= type && type < NumberShapeType);
 	assert(NULL != contains_function);
 	assert(NULL != point_cloud_converter);
@@ -82,18 +101,19 @@ static void min_max(double *a, double *b, double *c) {
 	}	
 } 
 
-static PointCloud * point_cloud_sphere(int density, color4 color, mat4 transformations, mat4 norm_transformations, double x_scale, double y_scale, double z_scale, double *args) {
-	assert(density > 0);
+static double area_sphere(double x_scale, double y_scale, double z_scale) {
 	double a = x_scale, b = y_scale, c = z_scale;
 	min_max(&a, &b, &c);
 	double sqr_c = SQUARE(c);
-	int size;
-	if (a == c) {
-		size = density*4*PI*sqr_c;
-	} else {
-		double sqrt_sasc = sqrt(SQUARE(a) - sqr_c);
-		size = density*2*PI*(sqr_c + ((b*sqr_c)/(sqrt_sasc)) + b*sqrt_sasc);
-	}
+	if (a == c)
+		return 4*PI*sqr_c;
+	double sqrt_sasc = sqrt(SQUARE(a) - sqr_c);
+	return 2*PI*(sqr_c + ((b*sqr_c)/(sqrt_sasc)) + b*sqrt_sasc);
+}
+
+static PointCloud * point_cloud_sphere(int density, color4 color, const affine transformations, const affine norm_transformations, double x_scale, double y_scale, double z_scale, double *args) {
+	assert(density > 0);
+	int size = density*area_sphere(x_scale, y_scale, z_scale);
 	point3 *vrtx = NULL;
 	vec3 *norm = NULL;
 	if (NULL == (vrtx = (point3 *) malloc(size * sizeof(point3)))) {
@@ -107,18 +127,17 @@ static PointCloud * point_cloud_sphere(int density, color4 color, mat4 transform
 	int i;
 	point3 *v = vrtx;
 	vec3 *n = norm;
-	double half_pi = PI/2;
 	for (i = 0; i < size; i++) {
 		double alpha = random_double(0, 2*PI);
 		double phi = random_double(0, PI) + random_double(0, PI)/2;
 		double sin_phi = sin(phi);
 		vec3_set((*n), cos(alpha)*sin_phi, sin(alpha)*sin_phi, cos(phi));
 		point3_set((*v), cos(alpha)*sin_phi, sin(alpha)*sin_phi, cos(phi));
-		mat4_product_point3((*v), transformations, (*v));
-		mat4_product_vec3((*n), norm_transformations, (*n));
 		n++;
 		v++;
 	}
+	affine_apply_points(transformations, vrtx, (const point3 *) vrtx, size);
+	affine_apply_normals(norm_transformations, norm, (const vec3 *) norm, size);
 	return point_cloud_allocate(vrtx, norm, n_color(size, color), size);
 }
 
@@ -140,13 +159,17 @@ static int contains_cube(double *args, point3 *point) {
 	return MAX3(x,y,z) <= 1.;
 }
 
-static PointCloud * point_cloud_cube(int density, color4 color, mat4 transformations, mat4 norm_transformations, double x_scale, double y_scale, double z_scale, double *args) {
+static double area_cube_face(double u_scale, double v_scale) {
+	return 4*u_scale*v_scale;
+}
+
+static PointCloud * point_cloud_cube(int density, color4 color, const affine transformations, const affine norm_transformations, double x_scale, double y_scale, double z_scale, double *args) {
 	assert(density > 0);
 	point3 *vrtx = NULL;
 	vec3 *norm = NULL;
-	int xface = 4*density*y_scale*z_scale;
-	int yface = 4*density*x_scale*z_scale;
-	int zface = 4*density*x_scale*y_scale;
+	int xface = density*area_cube_face(y_scale, z_scale);
+	int yface = density*area_cube_face(x_scale, z_scale);
+	int zface = density*area_cube_face(x_scale, y_scale);
 	int size = 2*(xface + yface + zface);
 	if (NULL == (vrtx = (point3 *) malloc(size * sizeof(point3)))) {
 		fprintf(stderr, "memory allocation error (line %d file %s)", __LINE__, __FILE__);
@@ -166,8 +189,6 @@ static PointCloud * point_cloud_cube(int density, color4 color, mat4 transformat
 			y = random_double(-1, 1);
 			vec3_set((*n), 0, 0, z);
 			point3_set((*v), x, y, z);
-			mat4_product_point3((*v), transformations, (*v));
-			mat4_product_vec3((*n), norm_transformations, (*n));
 			n++;
 			v++;
 		}
@@ -178,8 +199,6 @@ static PointCloud * point_cloud_cube(int density, color4 color, mat4 transformat
 			z = random_double(-1, 1);
 			vec3_set((*n), 0, y, 0);
 			point3_set((*v), x, y, z);
-			mat4_product_point3((*v), transformations, (*v));
-			mat4_product_vec3((*n), norm_transformations, (*n));
 			n++;
 			v++;
 		}
@@ -190,12 +209,12 @@ static PointCloud * point_cloud_cube(int density, color4 color, mat4 transformat
 			z = random_double(-1, 1);
 			vec3_set((*n), x, 0, 0);
 			point3_set((*v), x, y, z);
-			mat4_product_point3((*v), transformations, (*v));
-			mat4_product_vec3((*n), norm_transformations, (*n));
 			n++;
 			v++;
 		}
 	}
+	affine_apply_points(transformations, vrtx, (const point3 *) vrtx, size);
+	affine_apply_normals(norm_transformations, norm, (const vec3 *) norm, size);
 	return point_cloud_allocate(vrtx, norm, n_color(size, color), size);
 }
 
@@ -211,10 +230,18 @@ static int contains_cylinder(double *args, point3 *point){
 	return (z <= 1.) && (SQUARE(point3_get_x((*point))) + SQUARE(point3_get_y((*point))) <= 1.);
 }
 
-static PointCloud * point_cloud_cylinder(int density, color4 color, mat4 transformations, mat4 norm_transformations, double x_scale, double y_scale, double z_scale, double *args) {
+static double area_disc(double x_scale, double y_scale) {
+	return PI*x_scale*y_scale;
+}
+
+static double area_cylinder_side(double x_scale, double y_scale, double z_scale) {
+	return 2*z_scale*PI*sqrt(2*(SQUARE(x_scale) + SQUARE(y_scale)));
+}
+
+static PointCloud * point_cloud_cylinder(int density, color4 color, const affine transformations, const affine norm_transformations, double x_scale, double y_scale, double z_scale, double *args) {
 	assert(density > 0);
-	int face = density*PI*x_scale*y_scale;
-	int side = density*2*z_scale*PI*sqrt(2*(SQUARE(x_scale) + SQUARE(y_scale)));
+	int face = density*area_disc(x_scale, y_scale);
+	int side = density*area_cylinder_side(x_scale, y_scale, z_scale);
 	int size = side + 2*face;
 	point3 *vrtx = NULL;
 	vec3 *norm = NULL;
@@ -235,8 +262,6 @@ static PointCloud * point_cloud_cylinder(int density, color4 color, mat4 transfo
 		double alpha = random_double(0, 2*PI);
 		vec3_set((*n), cos(alpha), sin(alpha), 0);
 		point3_set((*v), cos(alpha), sin(alpha), z);
-		mat4_product_point3((*v), transformations, (*v));
-		mat4_product_vec3((*n), norm_transformations, (*n));
 		n++;
 		v++;
 	}
@@ -249,13 +274,13 @@ static PointCloud * point_cloud_cylinder(int density, color4 color, mat4 transfo
 				continue;
 			vec3_set((*n), 0, 0, z);
 			point3_set((*v), x, y, z);
-			mat4_product_point3((*v), transformations, (*v));
-			mat4_product_vec3((*n), norm_transformations, (*n));
 			n++;
 			v++;
 			i++;
 		}
 	}
+	affine_apply_points(transformations, vrtx, (const point3 *) vrtx, size);
+	affine_apply_normals(norm_transformations, norm, (const vec3 *) norm, size);
 	return point_cloud_allocate(vrtx, norm, n_color(size, color), size);
 }
 
@@ -272,12 +297,14 @@ static int contains_cone(double *args, point3 *point){
 	return (z <= 1.) && (SQUARE(point3_get_x((*point))) + SQUARE(point3_get_y((*point))) <= SQUARE(rz)/4.);
 }
 
-static PointCloud * point_cloud_cone(int density, color4 color, mat4 transformations, mat4 norm_transformations, double x_scale, double y_scale, double z_scale, double *args) {
+static double area_cone_side(double x_scale, double y_scale, double z_scale) {
+	return area_disc(x_scale, y_scale)*sqrt(1 + (4.*SQUARE(z_scale))/(x_scale*y_scale));
+}
+
+static PointCloud * point_cloud_cone(int density, color4 color, const affine transformations, const affine norm_transformations, double x_scale, double y_scale, double z_scale, double *args) {
 	assert(density > 0);
-	double r = x_scale*y_scale;
-	double b = density*PI*r;
-	int face = b;
-	int side = b*sqrt(1 + (4.*SQUARE(z_scale))/r); 
+	int face = density*area_disc(x_scale, y_scale);
+	int side = density*area_cone_side(x_scale, y_scale, z_scale);
 	int size = side + face;
 	point3 *vrtx = NULL;
 	vec3 *norm = NULL;
@@ -300,8 +327,6 @@ static PointCloud * point_cloud_cone(int density, color4 color, mat4 transformat
 		double sin_alpha = sin(alpha);
 		vec3_set((*n), cos_alpha, sin_alpha, 1);
 		point3_set((*v), rz*cos_alpha, rz*sin_alpha, z);
-		mat4_product_point3((*v), transformations, (*v));
-		mat4_product_vec3((*n), norm_transformations, (*n));
 		n++;
 		v++;
 	}
@@ -313,12 +338,12 @@ static PointCloud * point_cloud_cone(int density, color4 color, mat4 transformat
 			continue;
 		vec3_set((*n), 0, 0, -1);
 		point3_set((*v), x, y, -1);
-		mat4_product_point3((*v), transformations, (*v));
-		mat4_product_vec3((*n), norm_transformations, (*n));
 		n++;
 		v++;
 		i++;
 	}
+	affine_apply_points(transformations, vrtx, (const point3 *) vrtx, size);
+	affine_apply_normals(norm_transformations, norm, (const vec3 *) norm, size);
 	return point_cloud_allocate(vrtx, norm, n_color(size, color), size);
 }
 
@@ -335,11 +360,15 @@ static int contains_torus(double *args, point3 *point) {
 	return SQUARE(s) <= 4*sqrx_sqry;
 }
 
-static PointCloud * point_cloud_torus(int density, color4 color, mat4 transformations, mat4 norm_transformations, double x_scale, double y_scale, double z_scale, double *args) {
+static double area_torus(double x_scale, double y_scale, double z_scale, double r) {
+	return 2*SQUARE(PI)*sqrt((SQUARE(x_scale) + SQUARE(y_scale))/2.)*sqrt(2*(SQUARE(r*z_scale) + SQUARE(r*((x_scale+y_scale)/2))));
+}
+
+static PointCloud * point_cloud_torus(int density, color4 color, const affine transformations, const affine norm_transformations, double x_scale, double y_scale, double z_scale, double *args) {
 	assert(density > 0);
 	assert(NULL != args);
 	double r = args[0];
-	int size = density*2*SQUARE(PI)*sqrt((SQUARE(x_scale) + SQUARE(y_scale))/2.)*sqrt(2*(SQUARE(r*z_scale) + SQUARE(r*((x_scale+y_scale)/2))));
+	int size = density*area_torus(x_scale, y_scale, z_scale, r);
 	point3 *vrtx = NULL;
 	vec3 *norm = NULL;
 	if (NULL == (vrtx = (point3 *) malloc(size * sizeof(point3)))) {
@@ -365,11 +394,11 @@ static PointCloud * point_cloud_torus(int density, color4 color, mat4 transforma
 		double sin_alpha = sin(alpha);
 		vec3_set((*n), cos_phi*cos_alpha, cos_phi*sin_alpha, sin_phi);
 		point3_set((*v), r_cos_phi*cos_alpha, r_cos_phi*sin_alpha, r*sin_phi);
-		mat4_product_point3((*v), transformations, (*v));
-		mat4_product_vec3((*n), norm_transformations, (*n));
 		n++;
 		v++;
 	}
+	affine_apply_points(transformations, vrtx, (const point3 *) vrtx, size);
+	affine_apply_normals(norm_transformations, norm, (const vec3 *) norm, size);
 	return point_cloud_allocate(vrtx, norm, n_color(size, color), size);
 }
 
@@ -391,7 +420,112 @@ int shape_contains_point(const Shape *shape, const point3 *point) {
 	return shape->contains_function(shape->args, (point3 *) point);
 }
 	
-PointCloud * shape_to_point_cloud(const Shape *shape, int density, mat4 transformations, mat4 norm_transformations) {
+static void interval_square(double *lo, double *hi, double a, double b) {
+	if (a >= 0) {
+		*lo = SQUARE(a);
+		*hi = SQUARE(b);
+	} else if (b <= 0) {
+		*lo = SQUARE(b);
+		*hi = SQUARE(a);
+	} else {
+		*lo = 0;
+		*hi = (-a > b) ? SQUARE(a) : SQUARE(b);
+	}
+}
+
+static void interval_abs(double *lo, double *hi, double a, double b) {
+	if (a >= 0) {
+		*lo = a;
+		*hi = b;
+	} else if (b <= 0) {
+		*lo = -b;
+		*hi = -a;
+	} else {
+		*lo = 0;
+		*hi = (-a > b) ? -a : b;
+	}
+}
+
+int shape_classify_box(const Shape *shape, const point3 min, const point3 max) {
+	assert(NULL != shape);
+	assert(shape_is_valid(shape));
+	double x_lo, x_hi, y_lo, y_hi, z_lo, z_hi, r_lo, r_hi, q_lo, q_hi;
+	interval_square(&x_lo, &x_hi, min[0], max[0]);
+	interval_square(&y_lo, &y_hi, min[1], max[1]);
+	interval_square(&z_lo, &z_hi, min[2], max[2]);
+	r_lo = x_lo + y_lo;
+	r_hi = x_hi + y_hi;
+	switch (shape->type) {
+		case Sphere:
+			if (r_hi + z_hi <= 1.)
+				return SHAPE_INSIDE;
+			return (r_lo + z_lo > 1.) ? SHAPE_OUTSIDE : SHAPE_BOUNDARY;
+		case Cube:
+			interval_abs(&x_lo, &x_hi, min[0], max[0]);
+			interval_abs(&y_lo, &y_hi, min[1], max[1]);
+			interval_abs(&z_lo, &z_hi, min[2], max[2]);
+			if (x_hi <= 1. && y_hi <= 1. && z_hi <= 1.)
+				return SHAPE_INSIDE;
+			return (x_lo > 1. || y_lo > 1. || z_lo > 1.) ? SHAPE_OUTSIDE : SHAPE_BOUNDARY;
+		case Cylinder:
+			interval_abs(&z_lo, &z_hi, min[2], max[2]);
+			if (z_hi <= 1. && r_hi <= 1.)
+				return SHAPE_INSIDE;
+			return (z_lo > 1. || r_lo > 1.) ? SHAPE_OUTSIDE : SHAPE_BOUNDARY;
+		case Cone:
+			interval_square(&q_lo, &q_hi, 1 - max[2], 1 - min[2]);
+			interval_abs(&z_lo, &z_hi, min[2], max[2]);
+			if (z_hi <= 1. && r_hi <= q_lo/4.)
+				return SHAPE_INSIDE;
+			return (z_lo > 1. || r_lo > q_hi/4.) ? SHAPE_OUTSIDE : SHAPE_BOUNDARY;
+		default: {
+			double c = 1 - SQUARE(shape->args[0]);
+			interval_square(&q_lo, &q_hi, r_lo + z_lo + c, r_hi + z_hi + c);
+			if (q_hi <= 4*r_lo)
+				return SHAPE_INSIDE;
+			return (q_lo > 4*r_hi) ? SHAPE_OUTSIDE : SHAPE_BOUNDARY;
+		}
+	}
+}
+
+double shape_contains_cost(const Shape *shape) {
+	assert(NULL != shape);
+	assert(shape_is_valid(shape));
+	return _shape_contains_costs_[shape->type];
+}
+
+double shape_area(const Shape *shape) {
+	assert(NULL != shape);
+	assert(shape_is_valid(shape));
+	double x = shape->x_scale, y = shape->y_scale, z = shape->z_scale;
+	switch (shape->type) {
+		case Sphere:
+			return area_sphere(x, y, z);
+		case Cube:
+			return 2*(area_cube_face(y, z) + area_cube_face(x, z) + area_cube_face(x, y));
+		case Cylinder:
+			return 2*area_disc(x, y) + area_cylinder_side(x, y, z);
+		case Cone:
+			return area_disc(x, y) + area_cone_side(x, y, z);
+		default:
+			return area_torus(x, y, z, shape->args[0]);
+	}
+}
+
+void shape_bounds(const Shape *shape, point3 min, point3 max) {
+	assert(NULL != shape);
+	assert(shape_is_valid(shape));
+	if (shape->type == Torus) {
+		double r = shape->args[0];
+		point3_set(min, -1 - r, -1 - r, -r);
+		point3_set(max, 1 + r, 1 + r, r);
+	} else {
+		point3_set(min, -1, -1, -1);
+		point3_set(max, 1, 1, 1);
+	}
+}
+	
+PointCloud * shape_to_point_cloud(const Shape *shape, int density, const affine transformations, const affine norm_transformations) {
 	assert(NULL != shape);
 	assert(shape_is_valid(shape));
 	assert(density > 0);
@@ -399,6 +533,21 @@ PointCloud * shape_to_point_cloud(const Shape *shape, int density, mat4 transfor
 	return shape->point_cloud_converter(density, *color, transformations, norm_transformations, shape->x_scale, shape->y_scale, shape->z_scale, shape->args);
 }
 
+PointCloud * shape_to_seeded_point_cloud(const Shape *shape, int density, double x_scale, double y_scale, double z_scale, unsigned int seed, const affine transformations, const affine norm_transformations) {
+	assert(NULL != shape);
+	assert(shape_is_valid(shape));
+	assert(density > 0);
+	assert(x_scale > 0);
+	assert(y_scale > 0);
+	assert(z_scale > 0);
+	color4 *color = (color4 *) &(shape->color);
+	unsigned long state = _shape_random_;
+	_shape_random_ = seed;
+	PointCloud *cloud = shape->point_cloud_converter(density, *color, transformations, norm_transformations, x_scale, y_scale, z_scale, shape->args);
+	_shape_random_ = state;
+	return cloud;
+}
+
 void shape_free(Shape **shape) {
 	assert(NULL != shape);
 	assert(NULL != (*shape));
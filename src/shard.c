@@ -0,0 +1,335 @@
+#define _GNU_SOURCE
+
+#include "shard.h"
+
+#include "types.h"
+#include "shape.h"
+#include "tree.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "point_cloud.h"
+
+#define SHARD_POLL_NS (1000000L)
+
+typedef struct {
+	int index;
+	int size;
+} ShardHeader;
+
+typedef struct {
+	PointCloud cloud;
+	int fd;
+	off_t offset;
+} ShardCloud;
+
+typedef struct {
+	Tree *shards;
+	int size;
+	int capacity;
+} ShardList;
+
+static void shard_collect(Tree tree, int depth, ShardList *list) {
+	assert(NULL != tree);
+	assert(NULL != list);
+	if (depth == 0 || NULL != tree->shape) {
+		if (list->size == list->capacity) {
+			list->capacity = (list->capacity > 0) ? 2*list->capacity : 64;
+			if (NULL == (list->shards = (Tree *) realloc(list->shards, list->capacity*sizeof(Tree)))) {
+				fprintf(stderr, "memory allocation error (line %d file %s)\n", __LINE__, __FILE__);
+				exit(EXIT_FAILURE);
+			}
+		}
+		list->shards[list->size++] = tree;
+		return;
+	}
+	shard_collect(tree->left, depth - 1, list);
+	shard_collect(tree->right, depth - 1, list);
+}
+
+static double shard_area(Tree tree) {
+	assert(NULL != tree);
+	if (NULL != tree->shape)
+		return shape_area(tree->shape);
+	return shard_area(tree->left) + shard_area(tree->right);
+}
+
+int shard_count(Tree tree, int depth) {
+	assert(NULL != tree);
+	assert(tree_is_valid(tree));
+	assert(depth >= 0);
+	if (depth == 0 || NULL != tree->shape)
+		return 1;
+	return shard_count(tree->left, depth - 1) + shard_count(tree->right, depth - 1);
+}
+
+static int shard_write(int fd, const void *data, size_t size) {
+	const char *p = (const char *) data;
+	while (size > 0) {
+		ssize_t written = write(fd, p, size);
+		if (written < 0) {
+			if (errno == EINTR)
+				continue;
+			return 0;
+		}
+		p += written;
+		size -= written;
+	}
+	return 1;
+}
+
+static void shard_work(const ShardList *list, const int *owner, int process, unsigned int seed, int density, int fd) {
+	assert(NULL != list);
+	assert(NULL != owner);
+	int i;
+	for (i = 0; i < list->size; i++) {
+		if (owner[i] != process)
+			continue;
+		shape_seed(seed + i);
+		PointCloud *cloud = tree_to_point_cloud(list->shards[i], density);
+		ShardHeader header;
+		header.index = i;
+		header.size = cloud->size;
+		if (!shard_write(fd, &header, sizeof(ShardHeader))
+		|| !shard_write(fd, cloud->vrtx, cloud->size*sizeof(point3))
+		|| !shard_write(fd, cloud->norm, cloud->size*sizeof(vec3))
+		|| !shard_write(fd, cloud->colors, cloud->size*sizeof(color4))) {
+			fprintf(stderr, "shard worker %d can not write its point clouds\n", process);
+			_exit(EXIT_FAILURE);
+		}
+		point_cloud_free(&cloud);
+	}
+	_exit(EXIT_SUCCESS);
+}
+
+static void * shard_map(int fd, ShardCloud *clouds, int size, size_t *length) {
+	assert(NULL != clouds);
+	assert(NULL != length);
+	struct stat info;
+	if (0 != fstat(fd, &info)) {
+		fprintf(stderr, "can not read shard point clouds\n");
+		exit(EXIT_FAILURE);
+	}
+	*length = info.st_size;
+	if (info.st_size == 0)
+		return NULL;
+	void *map = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (MAP_FAILED == map) {
+		fprintf(stderr, "can not map shard point clouds\n");
+		exit(EXIT_FAILURE);
+	}
+	const char *p = (const char *) map;
+	const char *end = p + info.st_size;
+	while (p < end) {
+		ShardHeader header;
+		if ((size_t) (end - p) < sizeof(ShardHeader)) {
+			fprintf(stderr, "invalid shard point clouds\n");
+			exit(EXIT_FAILURE);
+		}
+		memcpy(&header, p, sizeof(ShardHeader));
+		p += sizeof(ShardHeader);
+		if (header.index < 0 || header.index >= size || NULL != clouds[header.index].cloud.vrtx || header.size < 0
+		|| (size_t) (end - p) < header.size*(sizeof(point3) + sizeof(vec3) + sizeof(color4))) {
+			fprintf(stderr, "invalid shard point clouds\n");
+			exit(EXIT_FAILURE);
+		}
+		PointCloud *cloud = &(clouds[header.index].cloud);
+		clouds[header.index].fd = fd;
+		clouds[header.index].offset = p - (const char *) map;
+		cloud->vrtx = (point3 *) p;
+		p += header.size*sizeof(point3);
+		cloud->norm = (vec3 *) p;
+		p += header.size*sizeof(vec3);
+		cloud->colors = (color4 *) p;
+		p += header.size*sizeof(color4);
+		cloud->size = header.size;
+	}
+	return map;
+}
+
+static void shard_release(const ShardCloud *shard) {
+	assert(NULL != shard);
+	off_t page = sysconf(_SC_PAGESIZE);
+	off_t first = (shard->offset + page - 1) / page * page;
+	off_t last = (shard->offset + (off_t) shard->cloud.size*(sizeof(point3) + sizeof(vec3) + sizeof(color4))) / page * page;
+	/* a failure only keeps the pages until the memory file is closed */
+	if (last > first)
+		fallocate(shard->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, first, last - first);
+}
+
+static PointCloud * shard_merge(Tree tree, int depth, const ShardCloud *clouds, int *next) {
+	assert(NULL != tree);
+	assert(NULL != clouds);
+	assert(NULL != next);
+	assert(depth > 0 && NULL == tree->shape);
+	const ShardCloud *a_shard = NULL, *b_shard = NULL;
+	PointCloud *a = NULL, *b = NULL;
+	if (depth == 1 || NULL != tree->left->shape) {
+		a_shard = clouds + (*next)++;
+	} else {
+		a = shard_merge(tree->left, depth - 1, clouds, next);
+	}
+	if (depth == 1 || NULL != tree->right->shape) {
+		b_shard = clouds + (*next)++;
+	} else {
+		b = shard_merge(tree->right, depth - 1, clouds, next);
+	}
+	PointCloud *result = tree_merge_point_clouds(tree, (NULL != a) ? a : &(a_shard->cloud), (NULL != b) ? b : &(b_shard->cloud));
+	if (NULL != a)
+		point_cloud_free(&a);
+	else
+		shard_release(a_shard);
+	if (NULL != b)
+		point_cloud_free(&b);
+	else
+		shard_release(b_shard);
+	return result;
+}
+
+/* kills and reaps the workers still running (pid not 0) and closes the shard files before exiting */
+static void shard_abort(const pid_t *pids, int workers, const int *fds, int files) {
+	assert(NULL != pids);
+	assert(NULL != fds);
+	int p;
+	for (p = 0; p < workers; p++) {
+		if (pids[p] > 0)
+			kill(pids[p], SIGKILL);
+	}
+	for (p = 0; p < workers; p++) {
+		if (pids[p] > 0) {
+			while (waitpid(pids[p], NULL, 0) < 0 && errno == EINTR)
+				continue;
+		}
+	}
+	for (p = 0; p < files; p++) {
+		close(fds[p]);
+	}
+	exit(EXIT_FAILURE);
+}
+
+PointCloud * shard_to_point_cloud(Tree tree, int density, int depth, int processes) {
+	assert(NULL != tree);
+	assert(tree_is_valid(tree));
+	assert(density > 0);
+	assert(depth >= 0);
+	assert(processes > 0);
+	ShardList list;
+	list.shards = NULL;
+	list.size = list.capacity = 0;
+	shard_collect(tree, depth, &list);
+	if (processes > list.size)
+		processes = list.size;
+	int *owner = NULL;
+	double *load = NULL;
+	int *fds = NULL;
+	pid_t *pids = NULL;
+	void **maps = NULL;
+	size_t *lengths = NULL;
+	ShardCloud *clouds = NULL;
+	if (NULL == (owner = (int *) malloc(list.size*sizeof(int)))
+	|| NULL == (load = (double *) calloc(processes, sizeof(double)))
+	|| NULL == (fds = (int *) malloc(processes*sizeof(int)))
+	|| NULL == (pids = (pid_t *) malloc(processes*sizeof(pid_t)))
+	|| NULL == (maps = (void **) malloc(processes*sizeof(void *)))
+	|| NULL == (lengths = (size_t *) malloc(processes*sizeof(size_t)))
+	|| NULL == (clouds = (ShardCloud *) calloc(list.size, sizeof(ShardCloud)))) {
+		fprintf(stderr, "memory allocation error (line %d file %s)\n", __LINE__, __FILE__);
+		exit(EXIT_FAILURE);
+	}
+	int i, p;
+	for (i = 0; i < list.size; i++) {
+		int lightest = 0;
+		for (p = 1; p < processes; p++) {
+			if (load[p] < load[lightest])
+				lightest = p;
+		}
+		owner[i] = lightest;
+		load[lightest] += shard_area(list.shards[i]);
+	}
+	unsigned int seed = shape_random();
+	fflush(stdout);
+	fflush(stderr);
+	pid_t parent = getpid();
+	for (p = 0; p < processes; p++) {
+		if ((fds[p] = memfd_create("csg-shard", MFD_CLOEXEC)) < 0) {
+			fprintf(stderr, "can not create shard memory file\n");
+			shard_abort(pids, p, fds, p);
+		}
+		if ((pids[p] = fork()) < 0) {
+			fprintf(stderr, "can not fork shard worker\n");
+			shard_abort(pids, p, fds, p + 1);
+		}
+		if (pids[p] == 0) {
+			/* a worker is killed when the program exits, even from another thread converting with its own workers */
+			if (0 != prctl(PR_SET_PDEATHSIG, SIGKILL) || getppid() != parent)
+				_exit(EXIT_FAILURE);
+			shard_work(&list, owner, p, seed, density, fds[p]);
+		}
+	}
+	/* polls the own workers only, as other threads may be waiting for theirs, so that a failure stops the others at once */
+	int running = processes;
+	while (running > 0) {
+		for (p = 0; p < processes; p++) {
+			int status;
+			pid_t pid;
+			if (pids[p] == 0)
+				continue;
+			while ((pid = waitpid(pids[p], &status, WNOHANG)) < 0) {
+				if (errno != EINTR) {
+					fprintf(stderr, "can not wait shard worker %d\n", p);
+					shard_abort(pids, processes, fds, processes);
+				}
+			}
+			if (pid == 0)
+				continue;
+			pids[p] = 0;
+			running--;
+			if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+				fprintf(stderr, "shard worker %d has failed\n", p);
+				shard_abort(pids, processes, fds, processes);
+			}
+		}
+		if (running > 0) {
+			struct timespec pause = {0, SHARD_POLL_NS};
+			nanosleep(&pause, NULL);
+		}
+	}
+	for (p = 0; p < processes; p++) {
+		maps[p] = shard_map(fds[p], clouds, list.size, lengths + p);
+	}
+	for (i = 0; i < list.size; i++) {
+		if (NULL == clouds[i].cloud.vrtx) {
+			fprintf(stderr, "missing shard point cloud %d\n", i);
+			exit(EXIT_FAILURE);
+		}
+	}
+	int next = 0;
+	PointCloud *result = (depth == 0 || NULL != tree->shape)
+		? point_cloud_slice(&(clouds[0].cloud), 0, clouds[0].cloud.size)
+		: shard_merge(tree, depth, clouds, &next);
+	for (p = 0; p < processes; p++) {
+		if (NULL != maps[p])
+			munmap(maps[p], lengths[p]);
+		close(fds[p]);
+	}
+	free(clouds);
+	free(lengths);
+	free(maps);
+	free(pids);
+	free(fds);
+	free(load);
+	free(owner);
+	free(list.shards);
+	return result;
+}
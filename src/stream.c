@@ -0,0 +1,162 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "stream.h"
+
+#include "types.h"
+#include "shape.h"
+#include "zone.h"
+#include "chrono.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <signal.h>
+#include <pthread.h>
+#include "point_cloud.h"
+
+typedef struct {
+	const Zones *zones;
+	int density;
+	unsigned int seed;
+	PointCloud *chunks[STREAM_QUEUE];
+	int head;
+	int count;
+	int finished;
+	int failed;
+	unsigned long stalls;
+	pthread_mutex_t mutex;
+	pthread_cond_t available;
+	pthread_cond_t space;
+} Stream;
+
+static int stream_push(Stream *stream, PointCloud *chunk) {
+	pthread_mutex_lock(&(stream->mutex));
+	if (stream->count == STREAM_QUEUE && !stream->failed) {
+		stream->stalls++;
+		while (stream->count == STREAM_QUEUE && !stream->failed) {
+			pthread_cond_wait(&(stream->space), &(stream->mutex));
+		}
+	}
+	int failed = stream->failed;
+	if (!failed) {
+		stream->chunks[(stream->head + stream->count) % STREAM_QUEUE] = chunk;
+		stream->count++;
+		pthread_cond_signal(&(stream->available));
+	}
+	pthread_mutex_unlock(&(stream->mutex));
+	if (failed)
+		point_cloud_free(&chunk);
+	return !failed;
+}
+
+static PointCloud * stream_pop(Stream *stream) {
+	PointCloud *chunk = NULL;
+	pthread_mutex_lock(&(stream->mutex));
+	while (stream->count == 0 && !stream->finished) {
+		pthread_cond_wait(&(stream->available), &(stream->mutex));
+	}
+	if (stream->count > 0) {
+		chunk = stream->chunks[stream->head];
+		stream->head = (stream->head + 1) % STREAM_QUEUE;
+		stream->count--;
+		pthread_cond_signal(&(stream->space));
+	}
+	pthread_mutex_unlock(&(stream->mutex));
+	return chunk;
+}
+
+static void * stream_generate(void *arg) {
+	Stream *stream = (Stream *) arg;
+	const Zones *zones = stream->zones;
+	int i, first, alive = 1;
+	shape_seed(stream->seed);
+	for (i = 0; alive && i < zones->size; i++) {
+		const ZoneLeaf *leaf = zones->leaves + i;
+		if (leaf->empty)
+			continue;
+		PointCloud *samples = shape_to_point_cloud(leaf->shape, stream->density, leaf->transformations, leaf->norm_transformations);
+		for (first = 0; alive && first < samples->size; first += STREAM_CHUNK) {
+			PointCloud *chunk = point_cloud_slice(samples, first, (samples->size - first < STREAM_CHUNK) ? samples->size - first : STREAM_CHUNK);
+			zone_leaf_select(zones, i, chunk);
+			if (chunk->size == 0)
+				point_cloud_free(&chunk);
+			else
+				alive = stream_push(stream, chunk);
+		}
+		point_cloud_free(&samples);
+	}
+	pthread_mutex_lock(&(stream->mutex));
+	stream->finished = 1;
+	pthread_cond_signal(&(stream->available));
+	pthread_mutex_unlock(&(stream->mutex));
+	return NULL;
+}
+
+int stream_write(const Zones *zones, int density, unsigned int seed, FILE *file, StreamStatistics *statistics) {
+	assert(NULL != zones);
+	assert(density > 0);
+	assert(NULL != file);
+	Stream stream;
+	StreamStatistics local;
+	struct sigaction ignore, previous;
+	pthread_t generator;
+	statistics = (NULL != statistics) ? statistics : &local;
+	memset(statistics, 0, sizeof(StreamStatistics));
+	stream.zones = zones;
+	stream.density = density;
+	stream.seed = seed;
+	stream.head = 0;
+	stream.count = 0;
+	stream.finished = 0;
+	stream.failed = 0;
+	stream.stalls = 0;
+	pthread_mutex_init(&(stream.mutex), NULL);
+	pthread_cond_init(&(stream.available), NULL);
+	pthread_cond_init(&(stream.space), NULL);
+	memset(&ignore, 0, sizeof(ignore));
+	ignore.sa_handler = SIG_IGN;
+	sigemptyset(&(ignore.sa_mask));
+	sigaction(SIGPIPE, &ignore, &previous);
+	double start = chrono_now();
+	if (0 != pthread_create(&generator, NULL, stream_generate, &stream)) {
+		fprintf(stderr, "thread creation error (line %d file %s)\n", __LINE__, __FILE__);
+		exit(EXIT_FAILURE);
+	}
+	int written = 1;
+	PointCloud *chunk;
+	while (NULL != (chunk = stream_pop(&stream))) {
+		if (written && (!point_cloud_write(chunk, file) || 0 != fflush(file))) {
+			written = 0;
+			pthread_mutex_lock(&(stream.mutex));
+			stream.failed = 1;
+			pthread_cond_signal(&(stream.space));
+			pthread_mutex_unlock(&(stream.mutex));
+		}
+		if (written) {
+			if (statistics->chunks == 0)
+				statistics->first_chunk = chrono_now() - start;
+			statistics->chunks++;
+			statistics->points += chunk->size;
+		}
+		point_cloud_free(&chunk);
+	}
+	pthread_join(generator, NULL);
+	if (written) {
+		point3 vrtx;
+		vec3 norm;
+		color4 color;
+		PointCloud end;
+		end.vrtx = &vrtx;
+		end.norm = &norm;
+		end.colors = &color;
+		end.size = 0;
+		written = point_cloud_write(&end, file) && 0 == fflush(file);
+	}
+	statistics->stalls = stream.stalls;
+	statistics->total = chrono_now() - start;
+	sigaction(SIGPIPE, &previous, NULL);
+	pthread_cond_destroy(&(stream.space));
+	pthread_cond_destroy(&(stream.available));
+	pthread_mutex_destroy(&(stream.mutex));
+	return written;
+}
@@ -0,0 +1,158 @@
+#include "synth.h"
+
+#include "types.h"
+#include "parser.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <assert.h>
+
+typedef struct {
+	const SynthParameters *parameters;
+	unsigned long random;
+	int total_weight;
+	int grid;
+	double spacing;
+	double radius;
+	int leaf;
+	int nodes;
+	FILE *file;
+} SynthState;
+
+static double synth_random(SynthState *state, double min, double max) {
+	assert(NULL != state);
+	state->random = state->random * 6364136223846793005UL + 1442695040888963407UL;
+	return (max - min) * ((double) ((state->random >> 33) & 0x7FFFFFFF) / (double) 0x7FFFFFFF) + min;
+}
+
+void synth_default_parameters(SynthParameters *parameters) {
+	assert(NULL != parameters);
+	parameters->leaves = 16;
+	parameters->depth = 0;
+	parameters->mix[Union] = 1;
+	parameters->mix[Intersection] = 0;
+	parameters->mix[Difference] = 0;
+	parameters->mix[Identity] = 0;
+	parameters->overlap = 0.25;
+	parameters->seed = 1;
+}
+
+int synth_minimal_depth(int leaves) {
+	assert(leaves > 0);
+	int depth = 0;
+	while ((1L << depth) < leaves) {
+		depth++;
+	}
+	return depth;
+}
+
+static void synth_write_leaf(SynthState *state) {
+	assert(NULL != state);
+	int grid = state->grid;
+	int i = state->leaf++;
+	double tx = -1 + state->spacing*(0.5 + i%grid);
+	double ty = -1 + state->spacing*(0.5 + (i/grid)%grid);
+	double tz = -1 + state->spacing*(0.5 + (i/(grid*grid))%grid);
+	double r = synth_random(state, 0, 1);
+	double g = synth_random(state, 0, 1);
+	double b = synth_random(state, 0, 1);
+	double rx = synth_random(state, 0, PI);
+	double ry = synth_random(state, 0, PI);
+	double rz = synth_random(state, 0, PI);
+	double scale = state->radius;
+	double hx = scale*synth_random(state, 0.8, 1);
+	double hy = scale*synth_random(state, 0.8, 1);
+	double hz = scale*synth_random(state, 0.8, 1);
+	switch ((int) synth_random(state, 0, NumberShapeType - 0.001)) {
+		case Sphere:
+			fprintf(state->file, "%s ", SHAPE_SPHERE);
+			break;
+		case Cube:
+			fprintf(state->file, "%s ", SHAPE_CUBE);
+			break;
+		case Cylinder:
+			fprintf(state->file, "%s ", SHAPE_CYLINDER);
+			break;
+		case Cone:
+			fprintf(state->file, "%s ", SHAPE_CONE);
+			break;
+		default: {
+			double radius = synth_random(state, 0.3, 0.5);
+			hx /= 1 + radius;
+			hy /= 1 + radius;
+			hz /= 1 + radius;
+			fprintf(state->file, "%s %g ", SHAPE_TORUS, radius);
+		}
+	}
+	fprintf(state->file, "(%g,%g,%g,1) (%g,%g,%g) (%g,%g,%g) (%g,%g,%g)\n", r, g, b, tx, ty, tz, rx, ry, rz, hx, hy, hz);
+	state->nodes++;
+}
+
+static const char * synth_operator(SynthState *state) {
+	assert(NULL != state);
+	int draw = (int) synth_random(state, 0, state->total_weight - 0.001);
+	Operator op;
+	for (op = 0; op < NumberOperator; op++) {
+		draw -= state->parameters->mix[op];
+		if (draw < 0)
+			break;
+	}
+	switch (op) {
+		case Intersection:
+			return OPERATOR_INTERSECTION;
+		case Difference:
+			return OPERATOR_DIFFERENCE;
+		case Identity:
+			return OPERATOR_IDENTITY;
+		default:
+			return OPERATOR_UNION;
+	}
+}
+
+static void synth_write_subtree(SynthState *state, int leaves, int depth) {
+	assert(NULL != state);
+	assert(leaves > 0);
+	while (leaves > 1) {
+		int right = leaves - 1;
+		if (depth - 1 < 30 && right > (1 << (depth - 1)))
+			right = 1 << (depth - 1);
+		fprintf(state->file, "%s (0,0,0) (0,0,0) (1,1,1)\n", synth_operator(state));
+		state->nodes++;
+		synth_write_subtree(state, leaves - right, depth - 1);
+		leaves = right;
+		depth--;
+	}
+	synth_write_leaf(state);
+}
+
+int synth_write_scene(FILE *file, const SynthParameters *parameters) {
+	assert(NULL != file);
+	assert(NULL != parameters);
+	assert(parameters->leaves > 0);
+	assert(parameters->overlap >= 0 && parameters->overlap < 1);
+	SynthState state;
+	Operator op;
+	state.parameters = parameters;
+	state.random = parameters->seed;
+	state.total_weight = 0;
+	for (op = 0; op < NumberOperator; op++) {
+		assert(parameters->mix[op] >= 0);
+		state.total_weight += parameters->mix[op];
+	}
+	assert(state.total_weight > 0);
+	state.grid = 1;
+	while (state.grid*state.grid*state.grid < parameters->leaves) {
+		state.grid++;
+	}
+	state.spacing = 2./state.grid;
+	state.radius = (state.spacing/2)/(1 - parameters->overlap);
+	state.leaf = 0;
+	state.nodes = 0;
+	state.file = file;
+	int depth = parameters->depth;
+	int minimal_depth = synth_minimal_depth(parameters->leaves);
+	if (depth < minimal_depth)
+		depth = minimal_depth;
+	synth_write_subtree(&state, parameters->leaves, depth);
+	return state.nodes;
+}
@@ -4,9 +4,35 @@
 #include "shape.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 #include "point_cloud.h"
 
+#define TRANSFORM_COST (0.5)
+#define VOXEL_EPSILON (1e-9)
+#define VOXEL_INITIAL_CELLS (64)
+
+struct TreeVoxels {
+	point3 min;
+	point3 max;
+	int *cells;
+	int size;
+	unsigned long generation;
+};
+
+static TreeStatistics _tree_statistics_ = {0, 0, 0, 0, 0};
+static unsigned long _tree_generation_ = 0;
+static __thread unsigned long _tree_voxel_lookups_ = 0;
+static __thread unsigned long _tree_voxel_hits_ = 0;
+
+typedef struct {
+	PointCloud *samples;
+	int *indices;
+	int size;
+	affine transformations;
+	affine norm_transformations;
+	int flip;
+} TreeSelection;
 
 static Tree tree_allocate(Shape * shape, Operator op, Tree left, Tree right) {
 	Tree t = NULL;
@@ -18,9 +44,17 @@ static Tree tree_allocate(Shape * shape, Operator op, Tree left, Tree right) {
 	t->left = left;
 	t->right = right;
 	t->op = op;
-	mat4_set_identity(t->transformations);
-	mat4_set_identity(t->inv_transformations);
-	mat4_set_identity(t->norm_transformations);
+	t->right_first = 0;
+	t->convert_right_first = 0;
+	t->cost = 0;
+	t->tests = 0;
+	t->hits = 0;
+	t->voxels = NULL;
+	t->compiled = NULL;
+	t->compiled_generation = 0;
+	affine_set_identity(t->transformations);
+	affine_set_identity(t->inv_transformations);
+	affine_set_identity(t->norm_transformations);
 	return t;
 }
 
@@ -50,20 +84,35 @@ Tree tree_allocate_node (Operator op, Tree left, Tree right) {
 	return tree_allocate(NULL, op, left, right);
 }
 
-static void tree_transform(Tree tree, mat4 transformation, mat4 inv_transformation, mat4 norm_transformation) {
+static void tree_voxels_free(Tree tree) {
+	if (NULL != tree->voxels) {
+		free(tree->voxels->cells);
+		free(tree->voxels);
+		tree->voxels = NULL;
+	}
+}
+
+static void tree_transform(Tree tree, const affine transformation, const affine inv_transformation, const affine norm_transformation) {
 	assert(NULL != tree);
 	assert(tree_is_valid(tree));
-	mat4_product_mat4(tree->transformations, tree->transformations, transformation);
-	mat4_product_mat4(tree->inv_transformations, inv_transformation, tree->inv_transformations);
-	mat4_product_mat4(tree->norm_transformations, tree->norm_transformations, norm_transformation);
+	tree_voxels_free(tree);
+	tree->compiled = NULL;
+	__sync_fetch_and_add(&_tree_generation_, 1);
+	affine_product(tree->transformations, tree->transformations, transformation);
+	affine_product(tree->inv_transformations, inv_transformation, tree->inv_transformations);
+	affine_product(tree->norm_transformations, tree->norm_transformations, norm_transformation);
 }  
 
+unsigned long tree_generation(void) {
+	return _tree_generation_;
+}
+
 void tree_translation(Tree tree, double x, double y, double z) {
 	assert(NULL != tree);
 	assert(tree_is_valid(tree));
-	mat4 translation, inv_translation;
-	mat4_translation(translation, x, y, z);
-	mat4_translation(inv_translation, -x, -y, -z);
+	affine translation, inv_translation;
+	affine_translation(translation, x, y, z);
+	affine_translation(inv_translation, -x, -y, -z);
 	tree_transform(tree, translation, inv_translation, translation);
 }
 
@@ -87,10 +136,10 @@ void tree_homothety (Tree tree, double x, double y, double z) {
 	assert(x > 0);
 	assert(y > 0);
 	assert(z > 0);
-	mat4 homothetie, inv_homothetie, norm_homothetie;
-	mat4_homothety(homothetie, x, y, z);
-	mat4_homothety(inv_homothetie, 1./x, 1./y, 1./z);
-	mat4_homothety(norm_homothetie, y/z, z/x, x/y);
+	affine homothetie, inv_homothetie, norm_homothetie;
+	affine_homothety(homothetie, x, y, z);
+	affine_homothety(inv_homothetie, 1./x, 1./y, 1./z);
+	affine_homothety(norm_homothetie, y/z, z/x, x/y);
 	tree_transform(tree, homothetie, inv_homothetie, norm_homothetie);
 	rescale_node(tree, x, y, z);
 }
@@ -98,92 +147,122 @@ void tree_homothety (Tree tree, double x, double y, double z) {
 void tree_rotation (Tree tree, double x, double y, double z) {
 	assert(NULL != tree);
 	assert(tree_is_valid(tree));
-	mat4 rotation, inv_rotation;
-	mat4_rotation_x(rotation, x);
-	mat4_rotation_x(inv_rotation, -x);
+	affine rotation, inv_rotation;
+	affine_rotation_x(rotation, x);
+	affine_rotation_x(inv_rotation, -x);
 	tree_transform(tree, rotation, inv_rotation, rotation);
-	mat4_rotation_y(rotation, y);
-	mat4_rotation_y(inv_rotation, -y);
+	affine_rotation_y(rotation, y);
+	affine_rotation_y(inv_rotation, -y);
 	tree_transform(tree, rotation, inv_rotation, rotation);
-	mat4_rotation_z(rotation, z);
-	mat4_rotation_z(inv_rotation, -z);
+	affine_rotation_z(rotation, z);
+	affine_rotation_z(inv_rotation, -z);
 	tree_transform(tree, rotation, inv_rotation, rotation);
 }
 
-static int tree_contains_point (Tree tree, point3 *point) {
+static int tree_voxel_lookup(const struct TreeVoxels *voxels, const point3 point) {
+	assert(NULL != voxels);
+	point3 min, max;
+	int k, cell = 0;
+	for (k = 0; k < 3; k++) {
+		if (point[k] < voxels->min[k] || point[k] > voxels->max[k])
+			return SHAPE_OUTSIDE;
+	}
+	point3_copy(min, voxels->min);
+	point3_copy(max, voxels->max);
+	while (voxels->cells[cell] >= 0) {
+		int octant = 0;
+		for (k = 0; k < 3; k++) {
+			double middle = (min[k] + max[k]) / 2;
+			if (point[k] >= middle) {
+				octant |= 1 << k;
+				min[k] = middle;
+			} else {
+				max[k] = middle;
+			}
+		}
+		cell = voxels->cells[cell] + octant;
+	}
+	return -voxels->cells[cell] - 1;
+}
+
+int tree_contains_point (Tree tree, point3 *point, unsigned long *tests) {
 	assert(NULL != tree);
 	assert(tree_is_valid(tree));
 	assert(NULL != point);
+	assert(NULL != tests);
+	if (NULL != tree->compiled && tree->compiled_generation == _tree_generation_)
+		return tree->compiled(*point);
+	if (NULL != tree->voxels && tree->voxels->generation == _tree_generation_) {
+		int state = tree_voxel_lookup(tree->voxels, *point);
+		_tree_voxel_lookups_++;
+		if (state != SHAPE_BOUNDARY) {
+			_tree_voxel_hits_++;
+			return state == SHAPE_INSIDE;
+		}
+	}
 	point3 p;
-	mat4_product_point3(p, tree->inv_transformations, *point);
+	affine_product_point3(p, tree->inv_transformations, *point);
 	if(tree->shape != NULL){
+		(*tests)++;
 		return shape_contains_point(tree->shape, (const point3 *) &p);
 	}
+	Tree first = tree->right_first ? tree->right : tree->left;
+	Tree second = tree->right_first ? tree->left : tree->right;
 	switch (tree->op) {
 		case Union: 
-			return tree_contains_point(tree->left, &p) || tree_contains_point(tree->right, &p);
+			return tree_contains_point(first, &p, tests) || tree_contains_point(second, &p, tests);
 		case Intersection:
-			return tree_contains_point(tree->left, &p) && tree_contains_point(tree->right, &p);
+			return tree_contains_point(first, &p, tests) && tree_contains_point(second, &p, tests);
 		case Difference:
-			return tree_contains_point(tree->left, &p) && !tree_contains_point(tree->right, &p);
+			if (tree->right_first)
+				return !tree_contains_point(tree->right, &p, tests) && tree_contains_point(tree->left, &p, tests);
+			return tree_contains_point(tree->left, &p, tests) && !tree_contains_point(tree->right, &p, tests);
 		case Identity:
-			return tree_contains_point(tree->left, &p) || tree_contains_point(tree->right, &p);		
+			return tree_contains_point(first, &p, tests) || tree_contains_point(second, &p, tests);		
 		default:
 			fprintf(stderr, "Invalid Tree Operator descriptor '%u' (line %d file %s)", tree->op, __LINE__, __FILE__);
 			exit(EXIT_FAILURE);
 	}
 }
 
-static PointCloud * op_identity(mat4 transformations, mat4 norm_transformations, Tree left, Tree right, int density) {
-	assert(NULL != left); 
-	assert(tree_is_valid(left)); 
-	assert(NULL != right); 
-	assert(tree_is_valid(right)); 
-	point3 *vrtx = NULL;
-	vec3 *norm = NULL;
-	color4 *colors = NULL;
-	PointCloud *a = tree_to_point_cloud(left, density);
-	PointCloud *b = tree_to_point_cloud(right, density);
-	int size = a->size + b->size;
-	if (NULL == (vrtx = (point3 *) malloc(size * sizeof(point3)))) {
-		fprintf(stderr, "memory allocation error (line %d file %s)", __LINE__, __FILE__);
-		exit(EXIT_FAILURE);
-	}
-	if (NULL == (norm = (vec3 *) malloc(size * sizeof(vec3)))) {
-		fprintf(stderr, "memory allocation error (line %d file %s)", __LINE__, __FILE__);
-		exit(EXIT_FAILURE);
-	}
-	if (NULL == (colors = (color4 *) malloc(size * sizeof(color4)))) {
-		fprintf(stderr, "memory allocation error (line %d file %s)", __LINE__, __FILE__);
-		exit(EXIT_FAILURE);
-	}
-	int i;
-	for(i = 0; i < a->size; i++){
-		mat4_product_point3(vrtx[i], transformations, a->vrtx[i]);
-		mat4_product_vec3(norm[i], norm_transformations, a->norm[i]);
-		color4_copy(colors[i], a->colors[i]);
-	}
-	for(i = 0; i < b->size; i++){
-		mat4_product_point3(vrtx[i + a->size], transformations, b->vrtx[i]);
-		mat4_product_vec3(norm[i + a->size], norm_transformations, b->norm[i]);
-		color4_copy(colors[(i+a->size)], b->colors[i]);
+static int tree_profile_point (Tree tree, point3 *point) {
+	assert(NULL != tree);
+	assert(tree_is_valid(tree));
+	assert(NULL != point);
+	point3 p;
+	int inside;
+	affine_product_point3(p, tree->inv_transformations, *point);
+	if(tree->shape != NULL){
+		inside = shape_contains_point(tree->shape, (const point3 *) &p);
+	} else {
+		int left = tree_profile_point(tree->left, &p);
+		int right = tree_profile_point(tree->right, &p);
+		switch (tree->op) {
+			case Union: 
+			case Identity:
+				inside = left || right;
+				break;
+			case Intersection:
+				inside = left && right;
+				break;
+			case Difference:
+				inside = left && !right;
+				break;
+			default:
+				fprintf(stderr, "Invalid Tree Operator descriptor '%u' (line %d file %s)", tree->op, __LINE__, __FILE__);
+				exit(EXIT_FAILURE);
+		}
 	}
-	point_cloud_free(&a);
-	point_cloud_free(&b);
-	return point_cloud_allocate(vrtx, norm, colors, size);
+	tree->tests++;
+	tree->hits += inside;
+	return inside;
 }
 
-static PointCloud * op_union(mat4 transformations, mat4 norm_transformations, Tree left, Tree right, int density) {
-	assert(NULL != left); 
-	assert(tree_is_valid(left)); 
-	assert(NULL != right); 
-	assert(tree_is_valid(right)); 
+static PointCloud * op_allocate(int size) {
+	assert(size >= 0);
 	point3 *vrtx = NULL;
 	vec3 *norm = NULL;
 	color4 *colors = NULL;
-	PointCloud *a = tree_to_point_cloud(left, density);
-	PointCloud *b = tree_to_point_cloud(right, density);
-	int size = a->size + b->size;
 	if (NULL == (vrtx = (point3 *) malloc(size * sizeof(point3)))) {
 		fprintf(stderr, "memory allocation error (line %d file %s)", __LINE__, __FILE__);
 		exit(EXIT_FAILURE);
@@ -196,145 +275,577 @@ static PointCloud * op_union(mat4 transformations, mat4 norm_transformations, Tr
 		fprintf(stderr, "memory allocation error (line %d file %s)", __LINE__, __FILE__);
 		exit(EXIT_FAILURE);
 	}
-	size = 0;
-	int i;
-	for(i = 0; i < a->size; i++){
-		if(!tree_contains_point(right, a->vrtx + i)) {
-			mat4_product_point3(vrtx[size], transformations, a->vrtx[i]);
-			mat4_product_vec3(norm[size], norm_transformations, a->norm[i]);
-			color4_copy(colors[size], a->colors[i]);
+	return point_cloud_allocate(vrtx, norm, colors, size);
+}
+
+static void tree_flush_statistics(unsigned long classifications, unsigned long tests) {
+	__sync_fetch_and_add(&(_tree_statistics_.classifications), classifications);
+	__sync_fetch_and_add(&(_tree_statistics_.primitive_tests), tests);
+	__sync_fetch_and_add(&(_tree_statistics_.voxel_lookups), _tree_voxel_lookups_);
+	__sync_fetch_and_add(&(_tree_statistics_.voxel_hits), _tree_voxel_hits_);
+	_tree_voxel_lookups_ = 0;
+	_tree_voxel_hits_ = 0;
+}
+
+static void op_select(PointCloud *result, const PointCloud *cloud, Tree other, int keep_inside, int flip, int profile) {
+	assert(NULL != result);
+	assert(NULL != cloud);
+	assert(NULL != other);
+	int i, size = result->size;
+	unsigned long tests = 0;
+	for (i = 0; i < cloud->size; i++) {
+		int inside = profile ? tree_profile_point(other, cloud->vrtx + i) : tree_contains_point(other, cloud->vrtx + i, &tests);
+		if (inside == keep_inside) {
+			point3_copy(result->vrtx[size], cloud->vrtx[i]);
+			if (flip) {
+				vec3_set(
+					result->norm[size],
+					-(vec3_get_x(cloud->norm[i])),
+					-(vec3_get_y(cloud->norm[i])),
+					-(vec3_get_z(cloud->norm[i]))
+				);
+			} else {
+				vec3_copy(result->norm[size], cloud->norm[i]);
+			}
+			color4_copy(result->colors[size], cloud->colors[i]);
 			size++;
 		}
 	}
-	for(i = 0; i < b->size; i++){
-		if(!tree_contains_point(left, b->vrtx + i)) {
-			mat4_product_point3(vrtx[size], transformations, b->vrtx[i]);
-			mat4_product_vec3(norm[size], norm_transformations, b->norm[i]);
-			color4_copy(colors[size], b->colors[i]);
-			size++;
-		} 
+	if (!profile) {
+		__sync_fetch_and_add(&(_tree_statistics_.materialized), (unsigned long) (size - result->size));
+		tree_flush_statistics((unsigned long) cloud->size, tests);
 	}
+	result->size = size;
+}
+
+static void op_transform(PointCloud *result, const affine transformations, const affine norm_transformations) {
+	assert(NULL != result);
+	affine_apply_points(transformations, result->vrtx, (const point3 *) result->vrtx, result->size);
+	affine_apply_normals(norm_transformations, result->norm, (const vec3 *) result->norm, result->size);
+}
+
+static PointCloud * tree_select(Tree tree, const PointCloud *a, const PointCloud *b, int profile) {
+	assert(NULL != tree); 
+	assert(tree_is_valid(tree)); 
+	assert(NULL == tree->shape); 
+	assert(NULL != a); 
+	assert(NULL != b); 
+	PointCloud *result = op_allocate(a->size + b->size);
+	result->size = 0;
+	switch (tree->op) {
+		case Union:
+			op_select(result, a, tree->right, 0, 0, profile);
+			op_select(result, b, tree->left, 0, 0, profile);
+			break;
+		case Intersection:
+			op_select(result, a, tree->right, 1, 0, profile);
+			op_select(result, b, tree->left, 1, 0, profile);
+			break;
+		case Difference:
+			op_select(result, a, tree->right, 0, 0, profile);
+			op_select(result, b, tree->left, 1, 1, profile);
+			break;
+		case Identity:
+			memcpy(result->vrtx, a->vrtx, a->size * sizeof(point3));
+			memcpy(result->norm, a->norm, a->size * sizeof(vec3));
+			memcpy(result->colors, a->colors, a->size * sizeof(color4));
+			memcpy(result->vrtx + a->size, b->vrtx, b->size * sizeof(point3));
+			memcpy(result->norm + a->size, b->norm, b->size * sizeof(vec3));
+			memcpy(result->colors + a->size, b->colors, b->size * sizeof(color4));
+			result->size = a->size + b->size;
+			if (!profile)
+				__sync_fetch_and_add(&(_tree_statistics_.materialized), (unsigned long) result->size);
+			break;
+		default:
+			fprintf(stderr, "Invalid Tree Operator descriptor '%u' (line %d file %s)", tree->op, __LINE__, __FILE__);
+			exit(EXIT_FAILURE);
+	}
+	op_transform(result, tree->transformations, tree->norm_transformations);
+	return result;
+}
+
+static PointCloud * tree_merge(Tree tree, PointCloud *a, PointCloud *b, int profile) {
+	PointCloud *result = tree_select(tree, a, b, profile);
 	point_cloud_free(&a);
 	point_cloud_free(&b);
-	return point_cloud_allocate(vrtx, norm, colors, size);
+	return result;
 }
 
-static PointCloud * op_intersection(mat4 transformations, mat4 norm_transformations, Tree left, Tree right, int density) {
+static PointCloud * tree_convert(Tree tree, int density, int profile) {
+	assert(NULL != tree); 
+	assert(tree_is_valid(tree)); 
+	if(tree->shape != NULL){
+		return shape_to_point_cloud(tree->shape, density, tree->transformations, tree->norm_transformations);
+	}
+	PointCloud *a, *b;
+	if (tree->convert_right_first) {
+		b = tree_convert(tree->right, density, profile);
+		a = tree_convert(tree->left, density, profile);
+	} else {
+		a = tree_convert(tree->left, density, profile);
+		b = tree_convert(tree->right, density, profile);
+	}
+	return tree_merge(tree, a, b, profile);
+}
+
+PointCloud * tree_to_point_cloud(Tree tree, int density) {
+	assert(NULL != tree); 
+	assert(tree_is_valid(tree)); 
+	return tree_convert(tree, density, 0);
+}
+
+PointCloud * tree_merge_point_clouds(Tree tree, const PointCloud *left, const PointCloud *right) {
+	assert(NULL != tree); 
+	assert(tree_is_valid(tree)); 
+	assert(NULL == tree->shape); 
 	assert(NULL != left); 
-	assert(tree_is_valid(left)); 
 	assert(NULL != right); 
-	assert(tree_is_valid(right)); 
-	point3 *vrtx = NULL;
-	vec3 *norm = NULL;
-	color4 *colors = NULL;
-	PointCloud *a = tree_to_point_cloud(left, density);
-	PointCloud *b = tree_to_point_cloud(right, density);
-	int size = a->size + b->size;
-	if (NULL == (vrtx = (point3 *) malloc(size * sizeof(point3)))) {
-		fprintf(stderr, "memory allocation error (line %d file %s)", __LINE__, __FILE__);
-		exit(EXIT_FAILURE);
+	return tree_select(tree, left, right, 0);
+}
+
+static void late_select(TreeSelection *selection, Tree other, int keep_inside) {
+	assert(NULL != selection);
+	assert(NULL != other);
+	const point3 *vrtx = (const point3 *) selection->samples->vrtx;
+	int i, size = 0;
+	unsigned long tests = 0;
+	for (i = 0; i < selection->size; i++) {
+		point3 p;
+		affine_product_point3(p, selection->transformations, vrtx[selection->indices[i]]);
+		if (tree_contains_point(other, &p, &tests) == keep_inside)
+			selection->indices[size++] = selection->indices[i];
 	}
-	if (NULL == (norm = (vec3 *) malloc(size * sizeof(vec3)))) {
-		fprintf(stderr, "memory allocation error (line %d file %s)", __LINE__, __FILE__);
-		exit(EXIT_FAILURE);
+	tree_flush_statistics((unsigned long) selection->size, tests);
+	selection->size = size;
+}
+
+static TreeSelection * late_convert(Tree tree, int density, int *size) {
+	assert(NULL != tree);
+	assert(tree_is_valid(tree));
+	assert(NULL != size);
+	TreeSelection *selections = NULL;
+	int i;
+	if (tree->shape != NULL) {
+		if (NULL == (selections = (TreeSelection *) malloc(sizeof(TreeSelection)))) {
+			fprintf(stderr, "memory allocation error (line %d file %s)\n", __LINE__, __FILE__);
+			exit(EXIT_FAILURE);
+		}
+		selections->samples = shape_to_point_cloud(tree->shape, density, tree->transformations, tree->norm_transformations);
+		selections->size = selections->samples->size;
+		if (NULL == (selections->indices = (int *) malloc((selections->size > 0 ? selections->size : 1) * sizeof(int)))) {
+			fprintf(stderr, "memory allocation error (line %d file %s)\n", __LINE__, __FILE__);
+			exit(EXIT_FAILURE);
+		}
+		for (i = 0; i < selections->size; i++) {
+			selections->indices[i] = i;
+		}
+		affine_set_identity(selections->transformations);
+		affine_set_identity(selections->norm_transformations);
+		selections->flip = 0;
+		*size = 1;
+		return selections;
 	}
-	if (NULL == (colors = (color4 *) malloc(size * sizeof(color4)))) {
-		fprintf(stderr, "memory allocation error (line %d file %s)", __LINE__, __FILE__);
-		exit(EXIT_FAILURE);
+	TreeSelection *a, *b;
+	int a_size, b_size;
+	if (tree->convert_right_first) {
+		b = late_convert(tree->right, density, &b_size);
+		a = late_convert(tree->left, density, &a_size);
+	} else {
+		a = late_convert(tree->left, density, &a_size);
+		b = late_convert(tree->right, density, &b_size);
 	}
-	size = 0;
-	int i;
-	for(i = 0; i < a->size; i++){
-		if(tree_contains_point(right, a->vrtx + i)) {
-			mat4_product_point3(vrtx[size], transformations, a->vrtx[i]);
-			mat4_product_vec3(norm[size], norm_transformations, a->norm[i]);
-			color4_copy(colors[size], a->colors[i]);
-			size++;
+	for (i = 0; i < a_size + b_size; i++) {
+		TreeSelection *selection = (i < a_size) ? a + i : b + i - a_size;
+		switch (tree->op) {
+			case Union:
+				late_select(selection, (i < a_size) ? tree->right : tree->left, 0);
+				break;
+			case Intersection:
+				late_select(selection, (i < a_size) ? tree->right : tree->left, 1);
+				break;
+			case Difference:
+				late_select(selection, (i < a_size) ? tree->right : tree->left, i >= a_size);
+				selection->flip ^= (i >= a_size);
+				break;
+			case Identity:
+				break;
+			default:
+				fprintf(stderr, "Invalid Tree Operator descriptor '%u' (line %d file %s)", tree->op, __LINE__, __FILE__);
+				exit(EXIT_FAILURE);
 		}
+		affine_product(selection->transformations, tree->transformations, selection->transformations);
+		affine_product(selection->norm_transformations, tree->norm_transformations, selection->norm_transformations);
 	}
-	for(i = 0; i < b->size; i++){
-		if(tree_contains_point(left, b->vrtx + i)) {
-			mat4_product_point3(vrtx[size], transformations, b->vrtx[i]);
-			mat4_product_vec3(norm[size], norm_transformations, b->norm[i]);
-			color4_copy(colors[size], b->colors[i]);
-			size++;
-		} 
+	if (NULL == (selections = (TreeSelection *) realloc(a, (a_size + b_size) * sizeof(TreeSelection)))) {
+		fprintf(stderr, "memory allocation error (line %d file %s)\n", __LINE__, __FILE__);
+		exit(EXIT_FAILURE);
 	}
-	point_cloud_free(&a);
-	point_cloud_free(&b);
-	return point_cloud_allocate(vrtx, norm, colors, size);
+	memcpy(selections + a_size, b, b_size * sizeof(TreeSelection));
+	free(b);
+	*size = a_size + b_size;
+	return selections;
 }
 
-static PointCloud * op_difference(mat4 transformations, mat4 norm_transformations, Tree left, Tree right, int density) {
-	assert(NULL != left); 
-	assert(tree_is_valid(left)); 
-	assert(NULL != right); 
-	assert(tree_is_valid(right)); 
-	point3 *vrtx = NULL;
-	vec3 *norm = NULL;
-	color4 *colors = NULL;
-	PointCloud *a = tree_to_point_cloud(left, density);
-	PointCloud *b = tree_to_point_cloud(right, density);
-	int size = a->size + b->size;
-	if (NULL == (vrtx = (point3 *) malloc(size * sizeof(point3)))) {
-		fprintf(stderr, "memory allocation error (line %d file %s)", __LINE__, __FILE__);
-		exit(EXIT_FAILURE);
+PointCloud * tree_to_point_cloud_late(Tree tree, int density) {
+	assert(NULL != tree);
+	assert(tree_is_valid(tree));
+	assert(density > 0);
+	int size, i, j, total = 0;
+	TreeSelection *selections = late_convert(tree, density, &size);
+	for (i = 0; i < size; i++) {
+		total += selections[i].size;
 	}
-	if (NULL == (norm = (vec3 *) malloc(size * sizeof(vec3)))) {
-		fprintf(stderr, "memory allocation error (line %d file %s)", __LINE__, __FILE__);
-		exit(EXIT_FAILURE);
+	PointCloud *result = op_allocate(total);
+	total = 0;
+	for (i = 0; i < size; i++) {
+		const TreeSelection *selection = selections + i;
+		const PointCloud *samples = selection->samples;
+		for (j = 0; j < selection->size; j++) {
+			int k = selection->indices[j];
+			affine_product_point3(result->vrtx[total], selection->transformations, samples->vrtx[k]);
+			affine_product_vec3(result->norm[total], selection->norm_transformations, samples->norm[k]);
+			if (selection->flip)
+				vec3_set(result->norm[total], -(vec3_get_x(result->norm[total])), -(vec3_get_y(result->norm[total])), -(vec3_get_z(result->norm[total])));
+			color4_copy(result->colors[total], samples->colors[k]);
+			total++;
+		}
+		point_cloud_free(&(selections[i].samples));
+		free(selections[i].indices);
 	}
-	if (NULL == (colors = (color4 *) malloc(size * sizeof(color4)))) {
-		fprintf(stderr, "memory allocation error (line %d file %s)", __LINE__, __FILE__);
-		exit(EXIT_FAILURE);
+	free(selections);
+	__sync_fetch_and_add(&(_tree_statistics_.materialized), (unsigned long) total);
+	return result;
+}
+
+static void tree_reset_profile(Tree tree) {
+	assert(NULL != tree); 
+	tree->tests = 0;
+	tree->hits = 0;
+	if (tree->shape == NULL) {
+		tree_reset_profile(tree->left);
+		tree_reset_profile(tree->right);
 	}
-	size = 0;
-	int i;
-	for(i = 0; i < a->size; i++){
-		if(!tree_contains_point(right, a->vrtx + i)) {
-			mat4_product_point3(vrtx[size], transformations, a->vrtx[i]);
-			mat4_product_vec3(norm[size], norm_transformations, a->norm[i]);
-			color4_copy(colors[size], a->colors[i]);
-			size++;
-		}
+}
+
+static double tree_selectivity(Tree tree) {
+	assert(NULL != tree); 
+	return (tree->hits + 1.)/(tree->tests + 2.);
+}
+
+static void tree_order(Tree tree) {
+	assert(NULL != tree); 
+	assert(tree_is_valid(tree)); 
+	if (tree->shape != NULL) {
+		tree->cost = TRANSFORM_COST + shape_contains_cost(tree->shape);
+		return;
 	}
-	for(i = 0; i < b->size; i++){
-		if(tree_contains_point(left, b->vrtx + i)) {
-			mat4_product_point3(vrtx[size], transformations, b->vrtx[i]);
-			vec3_set(
-				norm[size],
-				-(vec3_get_x(b->norm[i])),
-				-(vec3_get_y(b->norm[i])),
-				-(vec3_get_z(b->norm[i]))
-			);
-			mat4_product_vec3(norm[size], norm_transformations, norm[size]);
-			color4_copy(colors[size], b->colors[i]);
-			size++;
-		} 
+	tree_order(tree->left);
+	tree_order(tree->right);
+	double cl = tree->left->cost, cr = tree->right->cost;
+	double sl = tree_selectivity(tree->left), sr = tree_selectivity(tree->right);
+	double left_first, right_first;
+	switch (tree->op) {
+		case Intersection:
+			left_first = cl + sl*cr;
+			right_first = cr + sr*cl;
+			break;
+		case Difference:
+			left_first = cl + sl*cr;
+			right_first = cr + (1 - sr)*cl;
+			break;
+		default:
+			left_first = cl + (1 - sl)*cr;
+			right_first = cr + (1 - sr)*cl;
 	}
-	point_cloud_free(&a);
-	point_cloud_free(&b);
-	return point_cloud_allocate(vrtx, norm, colors, size);
+	tree->right_first = right_first < left_first;
+	tree->cost = TRANSFORM_COST + (tree->right_first ? right_first : left_first);
 }
 
-PointCloud * tree_to_point_cloud(Tree tree, int density) {
+void tree_optimize(Tree tree, int pilot_density) {
 	assert(NULL != tree); 
 	assert(tree_is_valid(tree)); 
-	if(tree->shape != NULL){
-		return shape_to_point_cloud(tree->shape, density, tree->transformations, tree->norm_transformations);
+	assert(pilot_density > 0); 
+	tree_reset_profile(tree);
+	PointCloud *pilot = tree_convert(tree, pilot_density, 1);
+	point_cloud_free(&pilot);
+	tree_order(tree);
+}
+
+static double tree_plan(Tree tree, double *size) {
+	assert(NULL != tree); 
+	assert(tree_is_valid(tree)); 
+	assert(NULL != size); 
+	if (tree->shape != NULL) {
+		*size = shape_area(tree->shape);
+		return *size;
+	}
+	double sl, sr;
+	double nl = tree_plan(tree->left, &sl);
+	double nr = tree_plan(tree->right, &sr);
+	double left_first = (nl > sl + nr) ? nl : sl + nr;
+	double right_first = (nr > sr + nl) ? nr : sr + nl;
+	tree->convert_right_first = right_first < left_first;
+	double need = tree->convert_right_first ? right_first : left_first;
+	if (need < 2*(sl + sr))
+		need = 2*(sl + sr);
+	*size = (tree->op == Intersection) ? ((sl < sr) ? sl : sr) : sl + sr;
+	return need;
+}
+
+void tree_schedule(Tree tree) {
+	assert(NULL != tree); 
+	assert(tree_is_valid(tree)); 
+	double size;
+	tree_plan(tree, &size);
+}
+
+void tree_statistics(TreeStatistics *statistics) {
+	assert(NULL != statistics); 
+	statistics->classifications = __sync_fetch_and_add(&(_tree_statistics_.classifications), 0UL);
+	statistics->primitive_tests = __sync_fetch_and_add(&(_tree_statistics_.primitive_tests), 0UL);
+	statistics->voxel_lookups = __sync_fetch_and_add(&(_tree_statistics_.voxel_lookups), 0UL);
+	statistics->voxel_hits = __sync_fetch_and_add(&(_tree_statistics_.voxel_hits), 0UL);
+	statistics->materialized = __sync_fetch_and_add(&(_tree_statistics_.materialized), 0UL);
+}
+
+void tree_reset_statistics(void) {
+	__sync_lock_test_and_set(&(_tree_statistics_.classifications), 0UL);
+	__sync_lock_test_and_set(&(_tree_statistics_.primitive_tests), 0UL);
+	__sync_lock_test_and_set(&(_tree_statistics_.voxel_lookups), 0UL);
+	__sync_lock_test_and_set(&(_tree_statistics_.voxel_hits), 0UL);
+	__sync_lock_test_and_set(&(_tree_statistics_.materialized), 0UL);
+}
+
+void tree_add_statistics(const TreeStatistics *statistics) {
+	assert(NULL != statistics); 
+	__sync_fetch_and_add(&(_tree_statistics_.classifications), statistics->classifications);
+	__sync_fetch_and_add(&(_tree_statistics_.primitive_tests), statistics->primitive_tests);
+	__sync_fetch_and_add(&(_tree_statistics_.voxel_lookups), statistics->voxel_lookups);
+	__sync_fetch_and_add(&(_tree_statistics_.voxel_hits), statistics->voxel_hits);
+	__sync_fetch_and_add(&(_tree_statistics_.materialized), statistics->materialized);
+	tree_flush_statistics(0, 0);
+}
+
+static void tree_bounds(Tree tree, const affine transformations, point3 min, point3 max, int *empty) {
+	assert(NULL != tree);
+	assert(NULL != empty);
+	affine world;
+	int i, k;
+	affine_product(world, transformations, tree->transformations);
+	if (NULL == tree->shape) {
+		tree_bounds(tree->left, world, min, max, empty);
+		tree_bounds(tree->right, world, min, max, empty);
+		return;
+	}
+	point3 corners[2], p, q;
+	shape_bounds(tree->shape, corners[0], corners[1]);
+	for (i = 0; i < 8; i++) {
+		point3_set(p, corners[i & 1][0], corners[(i >> 1) & 1][1], corners[(i >> 2) & 1][2]);
+		affine_product_point3(q, world, p);
+		for (k = 0; k < 3; k++) {
+			if (*empty || q[k] < min[k])
+				min[k] = q[k];
+			if (*empty || q[k] > max[k])
+				max[k] = q[k];
+		}
+		*empty = 0;
 	}
+}
+
+static int tree_classify_box(Tree tree, const affine inv_transformations, const point3 min, const point3 max) {
+	assert(NULL != tree);
+	affine local;
+	affine_product(local, tree->inv_transformations, inv_transformations);
+	if (NULL != tree->shape) {
+		point3 center, box_min, box_max;
+		int j, k;
+		for (k = 0; k < 3; k++) {
+			center[k] = (min[k] + max[k]) / 2;
+		}
+		affine_product_point3(box_min, local, center);
+		point3_copy(box_max, box_min);
+		for (k = 0; k < 3; k++) {
+			double half = VOXEL_EPSILON;
+			for (j = 0; j < 3; j++) {
+				double m = affine_get(local, j, k);
+				half += ((m < 0) ? -m : m) * (max[j] - min[j]) / 2;
+			}
+			box_min[k] -= half;
+			box_max[k] += half;
+		}
+		return shape_classify_box(tree->shape, box_min, box_max);
+	}
+	int left = tree_classify_box(tree->left, local, min, max);
 	switch (tree->op) {
-		case Union:
-			return op_union(tree->transformations, tree->norm_transformations, tree->left, tree->right, density);
 		case Intersection:
-			return op_intersection(tree->transformations, tree->norm_transformations, tree->left, tree->right, density);
+			if (left == SHAPE_OUTSIDE)
+				return SHAPE_OUTSIDE;
+			break;
 		case Difference:
-			return op_difference(tree->transformations, tree->norm_transformations, tree->left, tree->right, density);
-		case Identity:
-			return op_identity(tree->transformations, tree->norm_transformations, tree->left, tree->right, density);		
+			if (left == SHAPE_OUTSIDE)
+				return SHAPE_OUTSIDE;
+			break;
 		default:
-			fprintf(stderr, "Invalid Tree Operator descriptor '%u' (line %d file %s)", tree->op, __LINE__, __FILE__);
-			exit(EXIT_FAILURE);
+			if (left == SHAPE_INSIDE)
+				return SHAPE_INSIDE;
+	}
+	int right = tree_classify_box(tree->right, local, min, max);
+	switch (tree->op) {
+		case Intersection:
+			if (right == SHAPE_OUTSIDE)
+				return SHAPE_OUTSIDE;
+			return (left == SHAPE_INSIDE && right == SHAPE_INSIDE) ? SHAPE_INSIDE : SHAPE_BOUNDARY;
+		case Difference:
+			if (right == SHAPE_INSIDE)
+				return SHAPE_OUTSIDE;
+			return (left == SHAPE_INSIDE && right == SHAPE_OUTSIDE) ? SHAPE_INSIDE : SHAPE_BOUNDARY;
+		default:
+			if (right == SHAPE_INSIDE)
+				return SHAPE_INSIDE;
+			return (left == SHAPE_OUTSIDE && right == SHAPE_OUTSIDE) ? SHAPE_OUTSIDE : SHAPE_BOUNDARY;
+	}
+}
+
+static int tree_voxel_box(const struct TreeVoxels *voxels, const int *parents, int cell, double *box) {
+	int k;
+	if (cell == 0) {
+		for (k = 0; k < 3; k++) {
+			box[k] = voxels->min[k];
+			box[3 + k] = voxels->max[k];
+		}
+		return 0;
+	}
+	int parent = parents[cell];
+	int octant = cell - voxels->cells[parent];
+	int level = tree_voxel_box(voxels, parents, parent, box);
+	for (k = 0; k < 3; k++) {
+		double middle = (box[k] + box[3 + k]) / 2;
+		if (octant & (1 << k))
+			box[k] = middle;
+		else
+			box[3 + k] = middle;
+	}
+	return level + 1;
+}
+
+static size_t tree_voxelize_subtree(Tree tree, int depth, size_t capacity) {
+	assert(NULL != tree);
+	struct TreeVoxels *voxels = NULL;
+	int cells = (capacity > sizeof(struct TreeVoxels)) ? (int) ((capacity - sizeof(struct TreeVoxels)) / (2 * sizeof(int))) : 0;
+	if (cells < 1)
+		return 0;
+	if (cells > 0x7FFFFFF)
+		cells = 0x7FFFFFF;
+	int allocated = (cells < VOXEL_INITIAL_CELLS) ? cells : VOXEL_INITIAL_CELLS;
+	affine identity;
+	int empty = 1, i, k;
+	int *parents = NULL;
+	double box[6];
+	if (NULL == (voxels = (struct TreeVoxels *) malloc(sizeof(struct TreeVoxels)))
+	|| NULL == (voxels->cells = (int *) malloc(allocated * sizeof(int)))
+	|| NULL == (parents = (int *) malloc(allocated * sizeof(int)))) {
+		fprintf(stderr, "memory allocation error (line %d file %s)\n", __LINE__, __FILE__);
+		exit(EXIT_FAILURE);
+	}
+	affine_set_identity(identity);
+	tree_bounds(tree, identity, voxels->min, voxels->max, &empty);
+	for (k = 0; k < 3; k++) {
+		voxels->min[k] -= VOXEL_EPSILON;
+		voxels->max[k] += VOXEL_EPSILON;
+	}
+	parents[0] = -1;
+	voxels->size = 1;
+	for (i = 0; i < voxels->size; i++) {
+		int level = tree_voxel_box(voxels, parents, i, box);
+		int state = tree_classify_box(tree, identity, box, box + 3);
+		if (state != SHAPE_BOUNDARY || level == depth || voxels->size + 8 > cells) {
+			voxels->cells[i] = -state - 1;
+			continue;
+		}
+		if (voxels->size + 8 > allocated) {
+			allocated = (2 * allocated < cells) ? 2 * allocated : cells;
+			if (NULL == (voxels->cells = (int *) realloc(voxels->cells, allocated * sizeof(int)))
+			|| NULL == (parents = (int *) realloc(parents, allocated * sizeof(int)))) {
+				fprintf(stderr, "memory allocation error (line %d file %s)\n", __LINE__, __FILE__);
+				exit(EXIT_FAILURE);
+			}
+		}
+		int octant;
+		voxels->cells[i] = voxels->size;
+		for (octant = 0; octant < 8; octant++) {
+			parents[voxels->size + octant] = i;
+		}
+		voxels->size += 8;
+	}
+	free(parents);
+	if (NULL == (voxels->cells = (int *) realloc(voxels->cells, voxels->size * sizeof(int)))) {
+		fprintf(stderr, "memory allocation error (line %d file %s)\n", __LINE__, __FILE__);
+		exit(EXIT_FAILURE);
+	}
+	voxels->generation = _tree_generation_;
+	tree->voxels = voxels;
+	return sizeof(struct TreeVoxels) + voxels->size * sizeof(int);
+}
+
+static int tree_leaves(Tree tree) {
+	assert(NULL != tree);
+	if (NULL != tree->shape)
+		return 1;
+	return tree_leaves(tree->left) + tree_leaves(tree->right);
+}
+
+static size_t tree_voxelize_tested(Tree tree, int depth, double capacity_per_leaf) {
+	assert(NULL != tree);
+	size_t used = 0;
+	if (NULL != tree->shape)
+		return 0;
+	if (tree->op != Identity) {
+		if (NULL == tree->left->shape && NULL == tree->left->voxels)
+			used += tree_voxelize_subtree(tree->left, depth, (size_t) (capacity_per_leaf * tree_leaves(tree->left)));
+		if (NULL == tree->right->shape && NULL == tree->right->voxels)
+			used += tree_voxelize_subtree(tree->right, depth, (size_t) (capacity_per_leaf * tree_leaves(tree->right)));
+	}
+	return used + tree_voxelize_tested(tree->left, depth, capacity_per_leaf) + tree_voxelize_tested(tree->right, depth, capacity_per_leaf);
+}
+
+static int tree_tested_leaves(Tree tree) {
+	assert(NULL != tree);
+	int leaves = 0;
+	if (NULL != tree->shape)
+		return 0;
+	if (tree->op != Identity) {
+		if (NULL == tree->left->shape)
+			leaves += tree_leaves(tree->left);
+		if (NULL == tree->right->shape)
+			leaves += tree_leaves(tree->right);
+	}
+	return leaves + tree_tested_leaves(tree->left) + tree_tested_leaves(tree->right);
+}
+
+size_t tree_voxelize(Tree tree, int depth, size_t capacity) {
+	assert(NULL != tree);
+	assert(tree_is_valid(tree));
+	assert(depth >= 0);
+	tree_unvoxelize(tree);
+	int leaves = tree_tested_leaves(tree);
+	if (leaves == 0)
+		return 0;
+	return tree_voxelize_tested(tree, depth, (double) capacity / leaves);
+}
+
+int tree_is_accelerated(Tree tree) {
+	assert(NULL != tree);
+	return (NULL != tree->compiled && tree->compiled_generation == _tree_generation_)
+		|| (NULL != tree->voxels && tree->voxels->generation == _tree_generation_);
+}
+
+void tree_unvoxelize(Tree tree) {
+	assert(NULL != tree);
+	assert(tree_is_valid(tree));
+	tree_voxels_free(tree);
+	if (NULL == tree->shape) {
+		tree_unvoxelize(tree->left);
+		tree_unvoxelize(tree->right);
 	}
 }
 
@@ -342,6 +853,10 @@ void tree_free (Tree *tree) {
 	assert(NULL != tree);
 	assert(NULL != (*tree));
 	assert(tree_is_valid(*tree));
+	if (NULL != (*tree)->voxels) {
+		free((*tree)->voxels->cells);
+		free((*tree)->voxels);
+	}
 	if((*tree)->shape != NULL){
 		shape_free(&((*tree)->shape));
 	} else {
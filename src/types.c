@@ -53,22 +53,22 @@ void mat4_rotation_z(mat4 m, double alpha) {
 }
 
 void mat4_product_mat4(mat4 m_result, mat4 m1, mat4 m2) {
-	double x00 = mat4_get(m1, 0, 0)*mat4_get(m2, 0, 0) + mat4_get(m1, 1, 0)*mat4_get(m2, 0, 1) + mat4_get(m1, 2, 0)*mat4_get(m2, 0, 2) + mat4_get(m1, 3, 0)*mat4_get(m1, 0, 3);
-	double x01 = mat4_get(m1, 0, 0)*mat4_get(m2, 1, 0) + mat4_get(m1, 1, 0)*mat4_get(m2, 1, 1) + mat4_get(m1, 2, 0)*mat4_get(m2, 1, 2) + mat4_get(m1, 3, 0)*mat4_get(m1, 1, 3);
-	double x02 = mat4_get(m1, 0, 0)*mat4_get(m2, 2, 0) + mat4_get(m1, 1, 0)*mat4_get(m2, 2, 1) + mat4_get(m1, 2, 0)*mat4_get(m2, 2, 2) + mat4_get(m1, 3, 0)*mat4_get(m1, 2, 3);
-	double x03 = mat4_get(m1, 0, 0)*mat4_get(m2, 3, 0) + mat4_get(m1, 1, 0)*mat4_get(m2, 3, 1) + mat4_get(m1, 2, 0)*mat4_get(m2, 3, 2) + mat4_get(m1, 3, 0)*mat4_get(m1, 3, 3);
-	double x10 = mat4_get(m1, 0, 1)*mat4_get(m2, 0, 0) + mat4_get(m1, 1, 1)*mat4_get(m2, 0, 1) + mat4_get(m1, 2, 1)*mat4_get(m2, 0, 2) + mat4_get(m1, 3, 1)*mat4_get(m1, 0, 3);
-	double x11 = mat4_get(m1, 0, 1)*mat4_get(m2, 1, 0) + mat4_get(m1, 1, 1)*mat4_get(m2, 1, 1) + mat4_get(m1, 2, 1)*mat4_get(m2, 1, 2) + mat4_get(m1, 3, 1)*mat4_get(m1, 1, 3);
-	double x12 = mat4_get(m1, 0, 1)*mat4_get(m2, 2, 0) + mat4_get(m1, 1, 1)*mat4_get(m2, 2, 1) + mat4_get(m1, 2, 1)*mat4_get(m2, 2, 2) + mat4_get(m1, 3, 1)*mat4_get(m1, 2, 3);
-	double x13 = mat4_get(m1, 0, 1)*mat4_get(m2, 3, 0) + mat4_get(m1, 1, 1)*mat4_get(m2, 3, 1) + mat4_get(m1, 2, 1)*mat4_get(m2, 3, 2) + mat4_get(m1, 3, 1)*mat4_get(m1, 3, 3);
-	double x20 = mat4_get(m1, 0, 2)*mat4_get(m2, 0, 0) + mat4_get(m1, 1, 2)*mat4_get(m2, 0, 1) + mat4_get(m1, 2, 2)*mat4_get(m2, 0, 2) + mat4_get(m1, 3, 2)*mat4_get(m1, 0, 3);
-	double x21 = mat4_get(m1, 0, 2)*mat4_get(m2, 1, 0) + mat4_get(m1, 1, 2)*mat4_get(m2, 1, 1) + mat4_get(m1, 2, 2)*mat4_get(m2, 1, 2) + mat4_get(m1, 3, 2)*mat4_get(m1, 1, 3);
-	double x22 = mat4_get(m1, 0, 2)*mat4_get(m2, 2, 0) + mat4_get(m1, 1, 2)*mat4_get(m2, 2, 1) + mat4_get(m1, 2, 2)*mat4_get(m2, 2, 2) + mat4_get(m1, 3, 2)*mat4_get(m1, 2, 3);
-	double x23 = mat4_get(m1, 0, 2)*mat4_get(m2, 3, 0) + mat4_get(m1, 1, 2)*mat4_get(m2, 3, 1) + mat4_get(m1, 2, 2)*mat4_get(m2, 3, 2) + mat4_get(m1, 3, 2)*mat4_get(m1, 3, 3);
-	double x30 = mat4_get(m1, 0, 3)*mat4_get(m2, 0, 0) + mat4_get(m1, 1, 3)*mat4_get(m2, 0, 1) + mat4_get(m1, 2, 3)*mat4_get(m2, 0, 2) + mat4_get(m1, 3, 3)*mat4_get(m1, 0, 3);
-	double x31 = mat4_get(m1, 0, 3)*mat4_get(m2, 1, 0) + mat4_get(m1, 1, 3)*mat4_get(m2, 1, 1) + mat4_get(m1, 2, 3)*mat4_get(m2, 1, 2) + mat4_get(m1, 3, 3)*mat4_get(m1, 1, 3);
-	double x32 = mat4_get(m1, 0, 3)*mat4_get(m2, 2, 0) + mat4_get(m1, 1, 3)*mat4_get(m2, 2, 1) + mat4_get(m1, 2, 3)*mat4_get(m2, 2, 2) + mat4_get(m1, 3, 3)*mat4_get(m1, 2, 3);
-	double x33 = mat4_get(m1, 0, 3)*mat4_get(m2, 3, 0) + mat4_get(m1, 1, 3)*mat4_get(m2, 3, 1) + mat4_get(m1, 2, 3)*mat4_get(m2, 3, 2) + mat4_get(m1, 3, 3)*mat4_get(m1, 3, 3);
+	double x00 = mat4_get(m1, 0, 0)*mat4_get(m2, 0, 0) + mat4_get(m1, 1, 0)*mat4_get(m2, 0, 1) + mat4_get(m1, 2, 0)*mat4_get(m2, 0, 2) + mat4_get(m1, 3, 0)*mat4_get(m2, 0, 3);
+	double x01 = mat4_get(m1, 0, 0)*mat4_get(m2, 1, 0) + mat4_get(m1, 1, 0)*mat4_get(m2, 1, 1) + mat4_get(m1, 2, 0)*mat4_get(m2, 1, 2) + mat4_get(m1, 3, 0)*mat4_get(m2, 1, 3);
+	double x02 = mat4_get(m1, 0, 0)*mat4_get(m2, 2, 0) + mat4_get(m1, 1, 0)*mat4_get(m2, 2, 1) + mat4_get(m1, 2, 0)*mat4_get(m2, 2, 2) + mat4_get(m1, 3, 0)*mat4_get(m2, 2, 3);
+	double x03 = mat4_get(m1, 0, 0)*mat4_get(m2, 3, 0) + mat4_get(m1, 1, 0)*mat4_get(m2, 3, 1) + mat4_get(m1, 2, 0)*mat4_get(m2, 3, 2) + mat4_get(m1, 3, 0)*mat4_get(m2, 3, 3);
+	double x10 = mat4_get(m1, 0, 1)*mat4_get(m2, 0, 0) + mat4_get(m1, 1, 1)*mat4_get(m2, 0, 1) + mat4_get(m1, 2, 1)*mat4_get(m2, 0, 2) + mat4_get(m1, 3, 1)*mat4_get(m2, 0, 3);
+	double x11 = mat4_get(m1, 0, 1)*mat4_get(m2, 1, 0) + mat4_get(m1, 1, 1)*mat4_get(m2, 1, 1) + mat4_get(m1, 2, 1)*mat4_get(m2, 1, 2) + mat4_get(m1, 3, 1)*mat4_get(m2, 1, 3);
+	double x12 = mat4_get(m1, 0, 1)*mat4_get(m2, 2, 0) + mat4_get(m1, 1, 1)*mat4_get(m2, 2, 1) + mat4_get(m1, 2, 1)*mat4_get(m2, 2, 2) + mat4_get(m1, 3, 1)*mat4_get(m2, 2, 3);
+	double x13 = mat4_get(m1, 0, 1)*mat4_get(m2, 3, 0) + mat4_get(m1, 1, 1)*mat4_get(m2, 3, 1) + mat4_get(m1, 2, 1)*mat4_get(m2, 3, 2) + mat4_get(m1, 3, 1)*mat4_get(m2, 3, 3);
+	double x20 = mat4_get(m1, 0, 2)*mat4_get(m2, 0, 0) + mat4_get(m1, 1, 2)*mat4_get(m2, 0, 1) + mat4_get(m1, 2, 2)*mat4_get(m2, 0, 2) + mat4_get(m1, 3, 2)*mat4_get(m2, 0, 3);
+	double x21 = mat4_get(m1, 0, 2)*mat4_get(m2, 1, 0) + mat4_get(m1, 1, 2)*mat4_get(m2, 1, 1) + mat4_get(m1, 2, 2)*mat4_get(m2, 1, 2) + mat4_get(m1, 3, 2)*mat4_get(m2, 1, 3);
+	double x22 = mat4_get(m1, 0, 2)*mat4_get(m2, 2, 0) + mat4_get(m1, 1, 2)*mat4_get(m2, 2, 1) + mat4_get(m1, 2, 2)*mat4_get(m2, 2, 2) + mat4_get(m1, 3, 2)*mat4_get(m2, 2, 3);
+	double x23 = mat4_get(m1, 0, 2)*mat4_get(m2, 3, 0) + mat4_get(m1, 1, 2)*mat4_get(m2, 3, 1) + mat4_get(m1, 2, 2)*mat4_get(m2, 3, 2) + mat4_get(m1, 3, 2)*mat4_get(m2, 3, 3);
+	double x30 = mat4_get(m1, 0, 3)*mat4_get(m2, 0, 0) + mat4_get(m1, 1, 3)*mat4_get(m2, 0, 1) + mat4_get(m1, 2, 3)*mat4_get(m2, 0, 2) + mat4_get(m1, 3, 3)*mat4_get(m2, 0, 3);
+	double x31 = mat4_get(m1, 0, 3)*mat4_get(m2, 1, 0) + mat4_get(m1, 1, 3)*mat4_get(m2, 1, 1) + mat4_get(m1, 2, 3)*mat4_get(m2, 1, 2) + mat4_get(m1, 3, 3)*mat4_get(m2, 1, 3);
+	double x32 = mat4_get(m1, 0, 3)*mat4_get(m2, 2, 0) + mat4_get(m1, 1, 3)*mat4_get(m2, 2, 1) + mat4_get(m1, 2, 3)*mat4_get(m2, 2, 2) + mat4_get(m1, 3, 3)*mat4_get(m2, 2, 3);
+	double x33 = mat4_get(m1, 0, 3)*mat4_get(m2, 3, 0) + mat4_get(m1, 1, 3)*mat4_get(m2, 3, 1) + mat4_get(m1, 2, 3)*mat4_get(m2, 3, 2) + mat4_get(m1, 3, 3)*mat4_get(m2, 3, 3);
 	mat4_set(m_result, 0, 0, x00);
 	mat4_set(m_result, 1, 0, x01);
 	mat4_set(m_result, 2, 0, x02);
@@ -101,3 +101,108 @@ void mat4_product_point3(point3 p_result, mat4 m, point3 p) {
 	double z = mat4_get(m, 0, 2)*coord3_get_x(p) + mat4_get(m, 1, 2)*coord3_get_y(p) + mat4_get(m, 2, 2)*coord3_get_z(p) + mat4_get(m, 3, 2);
 	point3_set(p_result, x, y, z);
 }
+
+void affine_translation(affine m, double tx, double ty, double tz) {
+	affine_set_identity(m);
+	affine_set(m, 3, 0, tx);
+	affine_set(m, 3, 1, ty);
+	affine_set(m, 3, 2, tz);
+}
+
+void affine_homothety(affine m, double hx, double hy, double hz) {
+	affine_set_identity(m);
+	affine_set(m, 0, 0, hx);
+	affine_set(m, 1, 1, hy);
+	affine_set(m, 2, 2, hz);
+}
+
+void affine_rotation_x(affine m, double alpha) {
+	affine_set_identity(m);
+	affine_set(m, 1, 1, cos(alpha));
+	affine_set(m, 1, 2, sin(alpha));
+	affine_set(m, 2, 1, -sin(alpha));
+	affine_set(m, 2, 2, cos(alpha));
+}
+
+void affine_rotation_y(affine m, double alpha) {
+	affine_set_identity(m);
+	affine_set(m, 0, 0, cos(alpha));
+	affine_set(m, 0, 2, -sin(alpha));
+	affine_set(m, 2, 0, sin(alpha));
+	affine_set(m, 2, 2, cos(alpha));
+}
+
+void affine_rotation_z(affine m, double alpha) {
+	affine_set_identity(m);
+	affine_set(m, 0, 0, cos(alpha));
+	affine_set(m, 0, 1, sin(alpha));
+	affine_set(m, 1, 0, -sin(alpha));
+	affine_set(m, 1, 1, cos(alpha));
+}
+
+void affine_product(affine m_result, const affine m1, const affine m2) {
+	affine r;
+	int col, line;
+	for (col = 0; col < 3; col++) {
+		for (line = 0; line < 3; line++) {
+			affine_set(r, col, line,
+				affine_get(m1, 0, line)*affine_get(m2, col, 0)
+				+ affine_get(m1, 1, line)*affine_get(m2, col, 1)
+				+ affine_get(m1, 2, line)*affine_get(m2, col, 2));
+		}
+	}
+	for (line = 0; line < 3; line++) {
+		affine_set(r, 3, line,
+			affine_get(m1, 0, line)*affine_get(m2, 3, 0)
+			+ affine_get(m1, 1, line)*affine_get(m2, 3, 1)
+			+ affine_get(m1, 2, line)*affine_get(m2, 3, 2)
+			+ affine_get(m1, 3, line));
+	}
+	memcpy(m_result, r, sizeof(affine));
+}
+
+void affine_product_point3(point3 p_result, const affine m, const point3 p) {
+	double x = affine_get(m, 0, 0)*coord3_get_x(p) + affine_get(m, 1, 0)*coord3_get_y(p) + affine_get(m, 2, 0)*coord3_get_z(p) + affine_get(m, 3, 0);
+	double y = affine_get(m, 0, 1)*coord3_get_x(p) + affine_get(m, 1, 1)*coord3_get_y(p) + affine_get(m, 2, 1)*coord3_get_z(p) + affine_get(m, 3, 1);
+	double z = affine_get(m, 0, 2)*coord3_get_x(p) + affine_get(m, 1, 2)*coord3_get_y(p) + affine_get(m, 2, 2)*coord3_get_z(p) + affine_get(m, 3, 2);
+	point3_set(p_result, x, y, z);
+}
+
+void affine_product_vec3(vec3 v_result, const affine m, const vec3 v) {
+	double x = affine_get(m, 0, 0)*coord3_get_x(v) + affine_get(m, 1, 0)*coord3_get_y(v) + affine_get(m, 2, 0)*coord3_get_z(v);
+	double y = affine_get(m, 0, 1)*coord3_get_x(v) + affine_get(m, 1, 1)*coord3_get_y(v) + affine_get(m, 2, 1)*coord3_get_z(v);
+	double z = affine_get(m, 0, 2)*coord3_get_x(v) + affine_get(m, 1, 2)*coord3_get_y(v) + affine_get(m, 2, 2)*coord3_get_z(v);
+	vec3_set(v_result, x, y, z);
+	vec3_normalize(v_result);
+}
+
+void affine_apply_points(const affine m, point3 *dst, const point3 *src, int size) {
+	double m00 = affine_get(m, 0, 0), m10 = affine_get(m, 1, 0), m20 = affine_get(m, 2, 0), m30 = affine_get(m, 3, 0);
+	double m01 = affine_get(m, 0, 1), m11 = affine_get(m, 1, 1), m21 = affine_get(m, 2, 1), m31 = affine_get(m, 3, 1);
+	double m02 = affine_get(m, 0, 2), m12 = affine_get(m, 1, 2), m22 = affine_get(m, 2, 2), m32 = affine_get(m, 3, 2);
+	int i;
+	for (i = 0; i < size; i++) {
+		double x = coord3_get_x(src[i]), y = coord3_get_y(src[i]), z = coord3_get_z(src[i]);
+		point3_set(
+			dst[i],
+			m00*x + m10*y + m20*z + m30,
+			m01*x + m11*y + m21*z + m31,
+			m02*x + m12*y + m22*z + m32
+		);
+	}
+}
+
+void affine_apply_normals(const affine m, vec3 *dst, const vec3 *src, int size) {
+	double m00 = affine_get(m, 0, 0), m10 = affine_get(m, 1, 0), m20 = affine_get(m, 2, 0);
+	double m01 = affine_get(m, 0, 1), m11 = affine_get(m, 1, 1), m21 = affine_get(m, 2, 1);
+	double m02 = affine_get(m, 0, 2), m12 = affine_get(m, 1, 2), m22 = affine_get(m, 2, 2);
+	int i;
+	for (i = 0; i < size; i++) {
+		double x = coord3_get_x(src[i]), y = coord3_get_y(src[i]), z = coord3_get_z(src[i]);
+		double nx = m00*x + m10*y + m20*z;
+		double ny = m01*x + m11*y + m21*z;
+		double nz = m02*x + m12*y + m22*z;
+		double norm = sqrt(nx*nx + ny*ny + nz*nz);
+		vec3_set(dst[i], nx/norm, ny/norm, nz/norm);
+	}
+}
@@ -0,0 +1,215 @@
+#include "view.h"
+
+#include "types.h"
+#include "shape.h"
+#include "zone.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+#include "point_cloud.h"
+
+static void view_basis(const View *view, vec3 forward, vec3 right, vec3 up) {
+	assert(NULL != view);
+	vec3_set(forward, view->target[0] - view->eye[0], view->target[1] - view->eye[1], view->target[2] - view->eye[2]);
+	vec3_normalize(forward);
+	vec3_cross(right, forward, view->up);
+	vec3_normalize(right);
+	vec3_cross(up, right, forward);
+}
+
+double view_pixels(const View *view, const point3 min, const point3 max) {
+	assert(NULL != view);
+	vec3 forward, right, up, d;
+	point3 corner;
+	double left = 0, bottom = 0, top = 0, rightmost = 0;
+	double t = tan(view->fovy * PI / 360.);
+	double aspect = (double) view->width / view->height;
+	int i;
+	view_basis(view, forward, right, up);
+	for (i = 0; i < 8; i++) {
+		point3_set(corner, (i & 1) ? max[0] : min[0], (i & 2) ? max[1] : min[1], (i & 4) ? max[2] : min[2]);
+		vec3_set(d, corner[0] - view->eye[0], corner[1] - view->eye[1], corner[2] - view->eye[2]);
+		double z = vec3_dot(d, forward);
+		if (z < view->near)
+			return (double) view->width * view->height;
+		double x = vec3_dot(d, right) / (z * t * aspect);
+		double y = vec3_dot(d, up) / (z * t);
+		if (i == 0 || x < left)
+			left = x;
+		if (i == 0 || x > rightmost)
+			rightmost = x;
+		if (i == 0 || y < bottom)
+			bottom = y;
+		if (i == 0 || y > top)
+			top = y;
+	}
+	left = (left < -1) ? -1 : left;
+	rightmost = (rightmost > 1) ? 1 : rightmost;
+	bottom = (bottom < -1) ? -1 : bottom;
+	top = (top > 1) ? 1 : top;
+	if (left >= rightmost || bottom >= top)
+		return 0;
+	return (rightmost - left) * view->width / 2 * (top - bottom) * view->height / 2;
+}
+
+int view_leaf_density(const View *view, const Zones *zones, int leaf, int density, double points_per_pixel) {
+	assert(NULL != view);
+	assert(NULL != zones);
+	assert(0 <= leaf && leaf < zones->size);
+	assert(density > 0);
+	assert(points_per_pixel > 0);
+	const ZoneLeaf *l = zones->leaves + leaf;
+	double area = shape_area(l->shape);
+	if (area <= 0)
+		return density;
+	double d = 2 * points_per_pixel * view_pixels(view, l->min, l->max) / area;
+	if (d >= density)
+		return density;
+	return (d < 1) ? 1 : (int) ceil(d);
+}
+
+static PointCloud ** view_allocate_clouds(int size) {
+	PointCloud **clouds = NULL;
+	if (NULL == (clouds = (PointCloud **) malloc(size * sizeof(PointCloud *)))) {
+		fprintf(stderr, "memory allocation error (line %d file %s)\n", __LINE__, __FILE__);
+		exit(EXIT_FAILURE);
+	}
+	return clouds;
+}
+
+PointCloud * view_to_point_cloud(const View *view, const Zones *zones, int density, double points_per_pixel) {
+	assert(NULL != view);
+	assert(NULL != zones);
+	assert(density > 0);
+	assert(points_per_pixel > 0);
+	PointCloud **clouds = view_allocate_clouds(zones->size);
+	int i;
+	for (i = 0; i < zones->size; i++) {
+		clouds[i] = zone_leaf_to_point_cloud(zones, i, view_leaf_density(view, zones, i, density, points_per_pixel));
+	}
+	PointCloud *result = point_cloud_concatenate(clouds, zones->size);
+	free(clouds);
+	return result;
+}
+
+static void view_cull(const View *view, const ZoneLeaf *leaf, PointCloud *cloud) {
+	assert(NULL != view);
+	assert(NULL != leaf);
+	assert(NULL != cloud);
+	int i, size = 0;
+	for (i = 0; i < cloud->size; i++) {
+		vec3 d;
+		vec3_set(d, view->eye[0] - cloud->vrtx[i][0], view->eye[1] - cloud->vrtx[i][1], view->eye[2] - cloud->vrtx[i][2]);
+		double facing = vec3_dot(d, cloud->norm[i]);
+		if (leaf->flip ? facing >= 0 : facing <= 0)
+			continue;
+		point3_copy(cloud->vrtx[size], cloud->vrtx[i]);
+		vec3_copy(cloud->norm[size], cloud->norm[i]);
+		color4_copy(cloud->colors[size], cloud->colors[i]);
+		size++;
+	}
+	cloud->size = size;
+}
+
+static int view_cell(const View *view, const vec3 forward, const vec3 right, const vec3 up, const point3 point, double *depth) {
+	assert(NULL != view);
+	int columns = (view->width + VIEW_DEPTH_CELL - 1) / VIEW_DEPTH_CELL;
+	int lines = (view->height + VIEW_DEPTH_CELL - 1) / VIEW_DEPTH_CELL;
+	double t = tan(view->fovy * PI / 360.);
+	double aspect = (double) view->width / view->height;
+	vec3 d;
+	vec3_set(d, point[0] - view->eye[0], point[1] - view->eye[1], point[2] - view->eye[2]);
+	*depth = vec3_dot(d, forward);
+	if (*depth < view->near)
+		return -1;
+	double x = (vec3_dot(d, right) / (*depth * t * aspect) + 1) * view->width / 2;
+	double y = (vec3_dot(d, up) / (*depth * t) + 1) * view->height / 2;
+	if (x < 0 || y < 0 || x >= view->width || y >= view->height)
+		return -1;
+	int column = (int) x / VIEW_DEPTH_CELL;
+	int line = (int) y / VIEW_DEPTH_CELL;
+	return (column < columns && line < lines) ? line * columns + column : -1;
+}
+
+static void view_occlude(const View *view, PointCloud **clouds, int size) {
+	assert(NULL != view);
+	assert(NULL != clouds);
+	int columns = (view->width + VIEW_DEPTH_CELL - 1) / VIEW_DEPTH_CELL;
+	int lines = (view->height + VIEW_DEPTH_CELL - 1) / VIEW_DEPTH_CELL;
+	double footprint = 2 * tan(view->fovy * PI / 360.) * VIEW_DEPTH_CELL / view->height;
+	double *buffer = NULL;
+	vec3 forward, right, up;
+	int c, i, k;
+	if (NULL == (buffer = (double *) malloc(columns * lines * sizeof(double)))) {
+		fprintf(stderr, "memory allocation error (line %d file %s)\n", __LINE__, __FILE__);
+		exit(EXIT_FAILURE);
+	}
+	for (k = 0; k < columns * lines; k++) {
+		buffer[k] = HUGE_VAL;
+	}
+	view_basis(view, forward, right, up);
+	for (c = 0; c < size; c++) {
+		for (i = 0; i < clouds[c]->size; i++) {
+			double depth;
+			k = view_cell(view, forward, right, up, clouds[c]->vrtx[i], &depth);
+			if (k >= 0 && depth < buffer[k])
+				buffer[k] = depth;
+		}
+	}
+	for (c = 0; c < size; c++) {
+		PointCloud *cloud = clouds[c];
+		int kept = 0;
+		for (i = 0; i < cloud->size; i++) {
+			double depth;
+			k = view_cell(view, forward, right, up, cloud->vrtx[i], &depth);
+			if (k >= 0 && depth > buffer[k] * (1 + VIEW_DEPTH_SLOPE * footprint))
+				continue;
+			point3_copy(cloud->vrtx[kept], cloud->vrtx[i]);
+			vec3_copy(cloud->norm[kept], cloud->norm[i]);
+			color4_copy(cloud->colors[kept], cloud->colors[i]);
+			kept++;
+		}
+		cloud->size = kept;
+	}
+	free(buffer);
+}
+
+PointCloud * view_visible_point_cloud(const View *view, const Zones *zones, int density, double points_per_pixel, ViewStatistics *statistics) {
+	assert(NULL != view);
+	assert(NULL != zones);
+	assert(density > 0);
+	assert(points_per_pixel >= 0);
+	assert(NULL != statistics);
+	PointCloud **clouds = view_allocate_clouds(zones->size);
+	int i;
+	memset(statistics, 0, sizeof(ViewStatistics));
+	for (i = 0; i < zones->size; i++) {
+		const ZoneLeaf *leaf = zones->leaves + i;
+		int d = (points_per_pixel > 0) ? view_leaf_density(view, zones, i, density, points_per_pixel) : density;
+		if (leaf->empty) {
+			clouds[i] = zone_leaf_to_point_cloud(zones, i, d);
+			continue;
+		}
+		clouds[i] = shape_to_point_cloud(leaf->shape, d, leaf->transformations, leaf->norm_transformations);
+		int sampled = clouds[i]->size;
+		view_cull(view, leaf, clouds[i]);
+		int front = clouds[i]->size;
+		zone_leaf_select(zones, i, clouds[i]);
+		statistics->sampled += sampled;
+		statistics->back_facing += sampled - front;
+		statistics->classified_out += front - clouds[i]->size;
+	}
+	for (i = 0; i < zones->size; i++) {
+		statistics->occluded += clouds[i]->size;
+	}
+	view_occlude(view, clouds, zones->size);
+	for (i = 0; i < zones->size; i++) {
+		statistics->occluded -= clouds[i]->size;
+		statistics->kept += clouds[i]->size;
+	}
+	PointCloud *result = point_cloud_concatenate(clouds, zones->size);
+	free(clouds);
+	return result;
+}
@@ -0,0 +1,390 @@
+#include "zone.h"
+
+#include "types.h"
+#include "shape.h"
+#include "tree.h"
+#include "sample.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "point_cloud.h"
+
+#define ZONE_INITIAL_SIZE (64)
+#define ZONE_EPSILON (1e-9)
+
+typedef struct {
+	Tree tree;
+	point3 min;
+	point3 max;
+	int empty;
+	int leaf;
+	int right;
+} ZoneNode;
+
+typedef struct {
+	int sibling;
+	int keep_inside;
+} ZoneAncestor;
+
+typedef struct {
+	Zones *zones;
+	ZoneNode *nodes;
+	int nodes_size;
+	int nodes_capacity;
+	int leaves_capacity;
+	int constraints_capacity;
+	int terms_capacity;
+	ZoneAncestor *ancestors;
+	int depth;
+	int ancestors_capacity;
+} ZoneBuilder;
+
+static void * zone_grow(void *array, int *capacity, size_t size) {
+	assert(NULL != capacity);
+	*capacity = (*capacity > 0) ? 2*(*capacity) : ZONE_INITIAL_SIZE;
+	if (NULL == (array = realloc(array, (*capacity)*size))) {
+		fprintf(stderr, "memory allocation error (line %d file %s)\n", __LINE__, __FILE__);
+		exit(EXIT_FAILURE);
+	}
+	return array;
+}
+
+static void zone_box(const Shape *shape, const affine transformations, point3 min, point3 max) {
+	assert(NULL != shape);
+	point3 corners[2], p, q;
+	int i, k;
+	shape_bounds(shape, corners[0], corners[1]);
+	for (i = 0; i < 8; i++) {
+		point3_set(p, corners[i & 1][0], corners[(i >> 1) & 1][1], corners[(i >> 2) & 1][2]);
+		affine_product_point3(q, transformations, p);
+		for (k = 0; k < 3; k++) {
+			if (i == 0 || q[k] < min[k])
+				min[k] = q[k];
+			if (i == 0 || q[k] > max[k])
+				max[k] = q[k];
+		}
+	}
+}
+
+static int zone_overlap(const point3 min1, const point3 max1, const point3 min2, const point3 max2) {
+	int k;
+	for (k = 0; k < 3; k++) {
+		if (min1[k] > max2[k] + ZONE_EPSILON || min2[k] > max1[k] + ZONE_EPSILON)
+			return 0;
+	}
+	return 1;
+}
+
+static int zone_index(ZoneBuilder *builder, Tree tree, const affine world, const affine inv_world, const affine norm_world, int flip) {
+	assert(NULL != builder);
+	assert(NULL != tree);
+	assert(tree_is_valid(tree));
+	affine transformations, inv_transformations, norm_transformations;
+	affine_product(transformations, world, tree->transformations);
+	affine_product(inv_transformations, tree->inv_transformations, inv_world);
+	affine_product(norm_transformations, norm_world, tree->norm_transformations);
+	if (builder->nodes_size == builder->nodes_capacity) {
+		int capacity = builder->nodes_capacity;
+		builder->nodes = (ZoneNode *) zone_grow(builder->nodes, &(builder->nodes_capacity), sizeof(ZoneNode));
+		builder->zones->frames = (affine *) zone_grow(builder->zones->frames, &capacity, sizeof(affine));
+	}
+	int index = builder->nodes_size++;
+	memcpy(builder->zones->frames[index], inv_world, sizeof(affine));
+	ZoneNode *node = builder->nodes + index;
+	node->tree = tree;
+	node->empty = 0;
+	node->leaf = -1;
+	node->right = -1;
+	if (NULL != tree->shape) {
+		Zones *zones = builder->zones;
+		if (zones->size == builder->leaves_capacity)
+			zones->leaves = (ZoneLeaf *) zone_grow(zones->leaves, &(builder->leaves_capacity), sizeof(ZoneLeaf));
+		ZoneLeaf *leaf = zones->leaves + zones->size;
+		leaf->shape = tree->shape;
+		memcpy(leaf->transformations, transformations, sizeof(affine));
+		memcpy(leaf->inv_transformations, inv_transformations, sizeof(affine));
+		memcpy(leaf->norm_transformations, norm_transformations, sizeof(affine));
+		zone_box(tree->shape, transformations, leaf->min, leaf->max);
+		leaf->flip = flip;
+		leaf->empty = 0;
+		leaf->first = 0;
+		leaf->constraints = 0;
+		point3_copy(node->min, leaf->min);
+		point3_copy(node->max, leaf->max);
+		node->leaf = zones->size++;
+		return index;
+	}
+	int left = zone_index(builder, tree->left, transformations, inv_transformations, norm_transformations, flip);
+	int right = zone_index(builder, tree->right, transformations, inv_transformations, norm_transformations, flip ^ (tree->op == Difference));
+	const ZoneNode *l = builder->nodes + left;
+	const ZoneNode *r = builder->nodes + right;
+	int k;
+	node = builder->nodes + index;
+	node->right = right;
+	switch (tree->op) {
+		case Intersection:
+			node->empty = l->empty || r->empty || !zone_overlap(l->min, l->max, r->min, r->max);
+			for (k = 0; k < 3; k++) {
+				node->min[k] = (l->min[k] > r->min[k]) ? l->min[k] : r->min[k];
+				node->max[k] = (l->max[k] < r->max[k]) ? l->max[k] : r->max[k];
+			}
+			break;
+		case Difference:
+			node->empty = l->empty;
+			point3_copy(node->min, l->min);
+			point3_copy(node->max, l->max);
+			break;
+		default:
+			node->empty = l->empty && r->empty;
+			if (l->empty || r->empty) {
+				l = l->empty ? r : l;
+				point3_copy(node->min, l->min);
+				point3_copy(node->max, l->max);
+			} else {
+				for (k = 0; k < 3; k++) {
+					node->min[k] = (l->min[k] < r->min[k]) ? l->min[k] : r->min[k];
+					node->max[k] = (l->max[k] > r->max[k]) ? l->max[k] : r->max[k];
+				}
+			}
+	}
+	return index;
+}
+
+static int zone_term(ZoneBuilder *builder, int index, int leaf, int left, int right) {
+	assert(NULL != builder);
+	Zones *zones = builder->zones;
+	if (zones->terms_size == builder->terms_capacity)
+		zones->terms = (ZoneTerm *) zone_grow(zones->terms, &(builder->terms_capacity), sizeof(ZoneTerm));
+	ZoneTerm *term = zones->terms + zones->terms_size;
+	Tree tree = builder->nodes[index].tree;
+	term->op = tree->op;
+	term->leaf = leaf;
+	term->left = left;
+	term->right = right;
+	term->right_first = tree->right_first;
+	term->tree = tree;
+	term->frame = index;
+	return zones->terms_size++;
+}
+
+static int zone_reduce(ZoneBuilder *builder, int index, const point3 min, const point3 max) {
+	assert(NULL != builder);
+	const ZoneNode *node = builder->nodes + index;
+	if (node->empty || !zone_overlap(node->min, node->max, min, max))
+		return ZONE_EMPTY;
+	if (node->leaf >= 0)
+		return zone_term(builder, index, node->leaf, ZONE_EMPTY, ZONE_EMPTY);
+	Tree tree = node->tree;
+	int right_index = node->right;
+	int saved = builder->zones->terms_size;
+	int left = zone_reduce(builder, index + 1, min, max);
+	int right = zone_reduce(builder, right_index, min, max);
+	switch (tree->op) {
+		case Intersection:
+			if (left == ZONE_EMPTY || right == ZONE_EMPTY) {
+				builder->zones->terms_size = saved;
+				return ZONE_EMPTY;
+			}
+			break;
+		case Difference:
+			if (left == ZONE_EMPTY) {
+				builder->zones->terms_size = saved;
+				return ZONE_EMPTY;
+			}
+			if (right == ZONE_EMPTY)
+				return left;
+			break;
+		default:
+			if (left == ZONE_EMPTY)
+				return right;
+			if (right == ZONE_EMPTY)
+				return left;
+	}
+	return zone_term(builder, index, -1, left, right);
+}
+
+static void zone_constrain(ZoneBuilder *builder, int index) {
+	assert(NULL != builder);
+	Zones *zones = builder->zones;
+	ZoneLeaf *leaf = zones->leaves + builder->nodes[index].leaf;
+	int saved = zones->terms_size;
+	int k;
+	leaf->first = zones->constraints_size;
+	for (k = builder->depth - 1; k >= 0; k--) {
+		int term = zone_reduce(builder, builder->ancestors[k].sibling, leaf->min, leaf->max);
+		if (term == ZONE_EMPTY) {
+			if (builder->ancestors[k].keep_inside) {
+				leaf->empty = 1;
+				zones->constraints_size = leaf->first;
+				zones->terms_size = saved;
+				break;
+			}
+			continue;
+		}
+		if (zones->constraints_size == builder->constraints_capacity)
+			zones->constraints = (ZoneConstraint *) zone_grow(zones->constraints, &(builder->constraints_capacity), sizeof(ZoneConstraint));
+		zones->constraints[zones->constraints_size].term = term;
+		zones->constraints[zones->constraints_size].keep_inside = builder->ancestors[k].keep_inside;
+		zones->constraints_size++;
+	}
+	leaf->constraints = zones->constraints_size - leaf->first;
+}
+
+static void zone_push(ZoneBuilder *builder, int sibling, int keep_inside) {
+	assert(NULL != builder);
+	if (builder->depth == builder->ancestors_capacity)
+		builder->ancestors = (ZoneAncestor *) zone_grow(builder->ancestors, &(builder->ancestors_capacity), sizeof(ZoneAncestor));
+	builder->ancestors[builder->depth].sibling = sibling;
+	builder->ancestors[builder->depth].keep_inside = keep_inside;
+	builder->depth++;
+}
+
+static void zone_visit(ZoneBuilder *builder, int index) {
+	assert(NULL != builder);
+	const ZoneNode *node = builder->nodes + index;
+	if (node->leaf >= 0) {
+		zone_constrain(builder, index);
+		return;
+	}
+	Operator op = node->tree->op;
+	int right = node->right;
+	if (op == Identity) {
+		zone_visit(builder, index + 1);
+		zone_visit(builder, right);
+		return;
+	}
+	zone_push(builder, right, op == Intersection);
+	zone_visit(builder, index + 1);
+	builder->depth--;
+	zone_push(builder, index + 1, op == Intersection || op == Difference);
+	zone_visit(builder, right);
+	builder->depth--;
+}
+
+Zones * zone_build(Tree tree) {
+	assert(NULL != tree);
+	assert(tree_is_valid(tree));
+	Zones *zones = NULL;
+	if (NULL == (zones = (Zones *) malloc(sizeof(Zones)))) {
+		fprintf(stderr, "memory allocation error (line %d file %s)\n", __LINE__, __FILE__);
+		exit(EXIT_FAILURE);
+	}
+	memset(zones, 0, sizeof(Zones));
+	ZoneBuilder builder;
+	memset(&builder, 0, sizeof(ZoneBuilder));
+	builder.zones = zones;
+	affine identity;
+	affine_set_identity(identity);
+	zone_index(&builder, tree, identity, identity, identity, 0);
+	zone_visit(&builder, 0);
+	free(builder.nodes);
+	free(builder.ancestors);
+	return zones;
+}
+
+void zone_free(Zones **zones) {
+	assert(NULL != zones);
+	assert(NULL != *zones);
+	free((*zones)->leaves);
+	free((*zones)->constraints);
+	free((*zones)->terms);
+	free((*zones)->frames);
+	free(*zones);
+	*zones = NULL;
+}
+
+int zone_contains_point(const Zones *zones, int term, const point3 *point, unsigned long *tests) {
+	assert(NULL != zones);
+	assert(0 <= term && term < zones->terms_size);
+	assert(NULL != point);
+	assert(NULL != tests);
+	const ZoneTerm *t = zones->terms + term;
+	if (tree_is_accelerated(t->tree)) {
+		point3 p;
+		affine_product_point3(p, zones->frames[t->frame], *point);
+		return tree_contains_point(t->tree, &p, tests);
+	}
+	if (t->leaf >= 0) {
+		const ZoneLeaf *leaf = zones->leaves + t->leaf;
+		point3 p;
+		affine_product_point3(p, leaf->inv_transformations, *point);
+		(*tests)++;
+		return shape_contains_point(leaf->shape, (const point3 *) &p);
+	}
+	int first = t->right_first ? t->right : t->left;
+	int second = t->right_first ? t->left : t->right;
+	switch (t->op) {
+		case Intersection:
+			return zone_contains_point(zones, first, point, tests) && zone_contains_point(zones, second, point, tests);
+		case Difference:
+			if (t->right_first)
+				return !zone_contains_point(zones, t->right, point, tests) && zone_contains_point(zones, t->left, point, tests);
+			return zone_contains_point(zones, t->left, point, tests) && !zone_contains_point(zones, t->right, point, tests);
+		default:
+			return zone_contains_point(zones, first, point, tests) || zone_contains_point(zones, second, point, tests);
+	}
+}
+
+void zone_leaf_select(const Zones *zones, int leaf, PointCloud *cloud) {
+	assert(NULL != zones);
+	assert(0 <= leaf && leaf < zones->size);
+	assert(NULL != cloud);
+	const ZoneLeaf *l = zones->leaves + leaf;
+	if (l->empty) {
+		cloud->size = 0;
+		return;
+	}
+	const ZoneConstraint *constraints = zones->constraints + l->first;
+	TreeStatistics statistics = {0, 0, 0, 0, 0};
+	int i, c, size = 0;
+	for (i = 0; i < cloud->size; i++) {
+		for (c = 0; c < l->constraints; c++) {
+			statistics.classifications++;
+			if (zone_contains_point(zones, constraints[c].term, (const point3 *) (cloud->vrtx + i), &(statistics.primitive_tests)) != constraints[c].keep_inside)
+				break;
+		}
+		if (c < l->constraints)
+			continue;
+		point3_copy(cloud->vrtx[size], cloud->vrtx[i]);
+		if (l->flip) {
+			vec3_set(cloud->norm[size], -(vec3_get_x(cloud->norm[i])), -(vec3_get_y(cloud->norm[i])), -(vec3_get_z(cloud->norm[i])));
+		} else {
+			vec3_copy(cloud->norm[size], cloud->norm[i]);
+		}
+		color4_copy(cloud->colors[size], cloud->colors[i]);
+		size++;
+	}
+	cloud->size = size;
+	tree_add_statistics(&statistics);
+}
+
+PointCloud * zone_leaf_to_point_cloud(const Zones *zones, int leaf, int density) {
+	assert(NULL != zones);
+	assert(0 <= leaf && leaf < zones->size);
+	assert(density > 0);
+	const ZoneLeaf *l = zones->leaves + leaf;
+	/* an empty leaf is still sampled, so the following leaves draw the same random numbers as tree_to_point_cloud */
+	PointCloud *cloud = (NULL != zones->samples)
+		? sample_to_point_cloud(zones->samples, l->shape, density, l->transformations, l->norm_transformations)
+		: shape_to_point_cloud(l->shape, density, l->transformations, l->norm_transformations);
+	zone_leaf_select(zones, leaf, cloud);
+	return cloud;
+}
+
+PointCloud * zone_to_point_cloud(const Zones *zones, int density) {
+	assert(NULL != zones);
+	assert(density > 0);
+	PointCloud **clouds = NULL;
+	int i;
+	if (NULL == (clouds = (PointCloud **) malloc(zones->size * sizeof(PointCloud *)))) {
+		fprintf(stderr, "memory allocation error (line %d file %s)\n", __LINE__, __FILE__);
+		exit(EXIT_FAILURE);
+	}
+	for (i = 0; i < zones->size; i++) {
+		clouds[i] = zone_leaf_to_point_cloud(zones, i, density);
+	}
+	PointCloud *result = point_cloud_concatenate(clouds, zones->size);
+	free(clouds);
+	return result;
+}